@@ -1212,6 +1212,604 @@ def ins_missing_e_test():
     else:
         raise Exception("should have failed")
 
+def ram_run_dir_test():
+    if "linux" not in platform.platform().lower():
+        return
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_ram_run_dir")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    ram_d = os.path.abspath(os.path.join(model_d, "ram_stage"))
+    if os.path.exists(ram_d):
+        shutil.rmtree(ram_d)
+    os.makedirs(ram_d)
+
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    pst.control_data.noptmax = -1
+    pst.pestpp_options = {"ies_num_reals": 5}
+    pst.write(os.path.join(new_d, "pest.pst"))
+    pyemu.os_utils.run("{0} pest.pst".format(exe_path), cwd=new_d)
+    base_oe = pd.read_csv(os.path.join(new_d, "pest.0.obs.csv"), index_col=0)
+
+    # only the model files and the listed files are staged
+    model_files = [f for f in os.listdir(t_d) if f.startswith("10par_xsec.") or f.endswith(".ref")]
+    pst.pestpp_options["ram_run_dir"] = ram_d
+    pst.pestpp_options["ram_run_files"] = model_files
+    pst.write(os.path.join(new_d, "pest_ram.pst"))
+    pyemu.os_utils.run("{0} pest_ram.pst".format(exe_path), cwd=new_d)
+    ram_oe = pd.read_csv(os.path.join(new_d, "pest_ram.0.obs.csv"), index_col=0)
+    d = np.abs(base_oe.values - ram_oe.values).max()
+    print(d)
+    assert d < 1.0e-6, d
+    # the staged dir is removed at the end of the run
+    assert len(os.listdir(ram_d)) == 0, os.listdir(ram_d)
+
+    # files outside of the working dir cant be staged
+    pst.pestpp_options["ram_run_files"] = model_files + [os.path.join("..", "template", "pest.pst")]
+    pst.write(os.path.join(new_d, "pest_ram_fail.pst"))
+    try:
+        pyemu.os_utils.run("{0} pest_ram_fail.pst".format(exe_path), cwd=new_d)
+    except:
+        pass
+    else:
+        raise Exception("should have failed")
+
+
+def ies_out_of_core_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_out_of_core")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    # a full localizer so that the local analysis (out-of-core capable) solve is used
+    mat = pyemu.Matrix(x=np.ones((pst.nnz_obs, pst.npar_adj)), row_names=pst.nnz_obs_names,
+                       col_names=pst.adj_par_names)
+    mat.to_ascii(os.path.join(new_d, "loc.mat"))
+    pst.control_data.noptmax = 2
+    pst.pestpp_options = {"ies_num_reals": 10, "ies_localizer": "loc.mat", "ies_lambda_mults": [0.5, 1.0],
+                          "ies_num_threads": 2}
+    pst.write(os.path.join(new_d, "pest.pst"))
+    pyemu.os_utils.run("{0} pest.pst".format(exe_path), cwd=new_d)
+    base_phi = pd.read_csv(os.path.join(new_d, "pest.phi.actual.csv"), index_col=0)
+
+    # a tiny cache forces the anomalies and residuals to be paged back in from disk
+    pst.pestpp_options["ies_out_of_core"] = True
+    pst.pestpp_options["ies_out_of_core_cache_mb"] = 0.00001
+    pst.write(os.path.join(new_d, "pest_ooc.pst"))
+    pyemu.os_utils.run("{0} pest_ooc.pst".format(exe_path), cwd=new_d)
+    ooc_phi = pd.read_csv(os.path.join(new_d, "pest_ooc.phi.actual.csv"), index_col=0)
+    d = np.abs(base_phi.iloc[:, 1:].values - ooc_phi.iloc[:, 1:].values).max()
+    print(d)
+    assert d < 1.0e-6, d
+    # the out-of-core scratch files are removed
+    left = [f for f in os.listdir(new_d) if ".ooc." in f]
+    assert len(left) == 0, left
+
+    # localizing by obs, every case spans all the pars - the cases share their columns
+    pst.pestpp_options["ies_localize_how"] = "obs"
+    pst.pestpp_options["ies_out_of_core"] = False
+    pst.write(os.path.join(new_d, "pest_obs.pst"))
+    pyemu.os_utils.run("{0} pest_obs.pst".format(exe_path), cwd=new_d)
+    base_phi = pd.read_csv(os.path.join(new_d, "pest_obs.phi.actual.csv"), index_col=0)
+    pst.pestpp_options["ies_out_of_core"] = True
+    pst.write(os.path.join(new_d, "pest_obs_ooc.pst"))
+    pyemu.os_utils.run("{0} pest_obs_ooc.pst".format(exe_path), cwd=new_d)
+    ooc_phi = pd.read_csv(os.path.join(new_d, "pest_obs_ooc.phi.actual.csv"), index_col=0)
+    d = np.abs(base_phi.iloc[:, 1:].values - ooc_phi.iloc[:, 1:].values).max()
+    print(d)
+    assert d < 1.0e-6, d
+    with open(os.path.join(new_d, "pest_obs_ooc.rec"), 'r') as f:
+        lines = [line for line in f if "out-of-core upgrade solved in" in line]
+    assert len(lines) > 0
+    for line in lines:
+        assert "solved in 1 batches" in line, line
+
+
+def ies_ensemble_precision_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_ensemble_precision")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    pst.control_data.noptmax = 2
+    pst.pestpp_options = {"ies_num_reals": 10, "ies_lambda_mults": [0.5, 1.0], "ies_save_binary": True,
+                          "ensemble_binary_format": "ens"}
+    pst.write(os.path.join(new_d, "pest.pst"))
+    pyemu.os_utils.run("{0} pest.pst".format(exe_path), cwd=new_d)
+    base_phi = pd.read_csv(os.path.join(new_d, "pest.phi.actual.csv"), index_col=0)
+
+    pst.pestpp_options["ies_ensemble_precision"] = "float"
+    pst.write(os.path.join(new_d, "pest_float.pst"))
+    pyemu.os_utils.run("{0} pest_float.pst".format(exe_path), cwd=new_d)
+    float_phi = pd.read_csv(os.path.join(new_d, "pest_float.phi.actual.csv"), index_col=0)
+    d = np.abs(base_phi.loc[:, "mean"].values - float_phi.loc[:, "mean"].values) / base_phi.loc[:, "mean"].values
+    print(d)
+    assert d.max() < 1.0e-3, d
+
+    # the saved ensemble files follow ensemble_binary_format, not ies_ensemble_precision
+    for tag in ["0.par", "0.obs", "2.par", "2.obs"]:
+        s1 = os.path.getsize(os.path.join(new_d, "pest.{0}.ens".format(tag)))
+        s2 = os.path.getsize(os.path.join(new_d, "pest_float.{0}.ens".format(tag)))
+        assert s1 == s2, (tag, s1, s2)
+
+
+def ies_mda_no_approx_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_mda_no_approx")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    mat = pyemu.Matrix(x=np.ones((pst.nnz_obs, pst.npar_adj)), row_names=pst.nnz_obs_names,
+                       col_names=pst.adj_par_names)
+    mat.to_ascii(os.path.join(new_d, "loc.mat"))
+    pst.control_data.noptmax = 3
+    # the mda solver has no Am term, so turning off the approx form should not change the upgrades
+    cases = {"glob": {},
+             "loc": {"ies_localizer": "loc.mat", "ies_num_threads": 2},
+             "ooc": {"ies_localizer": "loc.mat", "ies_num_threads": 2, "ies_out_of_core": True,
+                     "ies_out_of_core_cache_mb": 0.00001},
+             "mm": {"ies_multimodal_alpha": 0.25}}
+    for case, opts in cases.items():
+        phis = []
+        for use_approx in [True, False]:
+            pst.pestpp_options = {"ies_num_reals": 10, "ies_lambda_mults": [0.5, 1.0], "ies_use_mda": True,
+                                  "ies_use_approx": use_approx}
+            pst.pestpp_options.update(opts)
+            pst_name = "pest_{0}_{1}.pst".format(case, str(use_approx).lower())
+            pst.write(os.path.join(new_d, pst_name))
+            pyemu.os_utils.run("{0} {1}".format(exe_path, pst_name), cwd=new_d)
+            phis.append(pd.read_csv(os.path.join(new_d, pst_name.replace(".pst", ".phi.actual.csv")), index_col=0))
+        assert phis[0].shape == phis[1].shape, case
+        d = np.abs(phis[0].iloc[:, 1:].values - phis[1].iloc[:, 1:].values).max()
+        print(case, d)
+        assert d < 1.0e-6, (case, d)
+
+
+def ies_loc_distance_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_loc_distance")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    # pars and obs are located by model column along the cross section
+    par = pst.parameter_data
+    pcoords = pd.DataFrame({"x": par.parnme.apply(lambda x: float(x.split("_")[-1]) if x.startswith("k_") else 0.0),
+                            "y": 0.0}, index=par.parnme)
+    obs = pst.observation_data
+    ocoords = pd.DataFrame({"y": 0.0, "x": obs.obsnme.apply(lambda x: float(x.split("_")[-1]))}, index=obs.obsnme)
+    pcoords.to_csv(os.path.join(new_d, "pcoords.csv"), index_label="name")
+    ocoords.to_csv(os.path.join(new_d, "ocoords.csv"), index_label="name")
+    loc_dist = 3.0
+
+    # the equivalent precomputed Gaspari-Cohn localizer for the adjustable pars and non-zero weighted obs
+    c = loc_dist / 2.0
+    pc = pcoords.loc[pst.adj_par_names, ["x", "y"]].values
+    oc = ocoords.loc[pst.nnz_obs_names, ["x", "y"]].values
+    d = np.sqrt(((oc[:, None, :] - pc[None, :, :]) ** 2).sum(axis=2))
+    r = d / c
+    with np.errstate(divide="ignore"):
+        inner = (((-0.25 * r + 0.5) * r + 0.625) * r - (5.0 / 3.0)) * r * r + 1.0
+        outer = ((((r / 12.0 - 0.5) * r + 0.625) * r + (5.0 / 3.0)) * r - 5.0) * r + 4.0 - 2.0 / (3.0 * r)
+    x = np.where(r <= 1.0, inner, outer)
+    x[d >= loc_dist] = 0.0
+    x[x < 0.0] = 0.0
+    assert (x == 0.0).any()
+    # csv keeps full precision so both runs see the same localizer values
+    loc = pd.DataFrame(x, index=pst.nnz_obs_names, columns=pst.adj_par_names)
+    loc.to_csv(os.path.join(new_d, "loc.csv"))
+
+    pst.control_data.noptmax = 2
+    pst.pestpp_options = {"ies_num_reals": 10, "ies_lambda_mults": [0.5, 1.0], "ies_localizer": "loc.csv"}
+    pst.write(os.path.join(new_d, "pest_mat.pst"))
+    pyemu.os_utils.run("{0} pest_mat.pst".format(exe_path), cwd=new_d)
+    mat_phi = pd.read_csv(os.path.join(new_d, "pest_mat.phi.actual.csv"), index_col=0)
+
+    pst.pestpp_options.pop("ies_localizer")
+    pst.pestpp_options["ies_loc_par_coords"] = "pcoords.csv"
+    pst.pestpp_options["ies_loc_obs_coords"] = "ocoords.csv"
+    pst.pestpp_options["ies_loc_distance"] = loc_dist
+    pst.write(os.path.join(new_d, "pest_dist.pst"))
+    pyemu.os_utils.run("{0} pest_dist.pst".format(exe_path), cwd=new_d)
+    dist_phi = pd.read_csv(os.path.join(new_d, "pest_dist.phi.actual.csv"), index_col=0)
+    d = np.abs(mat_phi.iloc[:, 1:].values - dist_phi.iloc[:, 1:].values).max()
+    print(d)
+    assert d < 1.0e-6, d
+    mat_pe = pd.read_csv(os.path.join(new_d, "pest_mat.2.par.csv"), index_col=0)
+    dist_pe = pd.read_csv(os.path.join(new_d, "pest_dist.2.par.csv"), index_col=0)
+    d = np.abs(mat_pe.values - dist_pe.loc[mat_pe.index, mat_pe.columns].values).max()
+    print(d)
+    assert d < 1.0e-6, d
+
+
+def ensemble_binary_format_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_binary_format")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    pst.control_data.noptmax = 2
+    phis = {}
+    for fmt in ["jcb", "ens", "ens32"]:
+        pst.pestpp_options = {"ies_num_reals": 10, "ies_lambda_mults": [0.5, 1.0], "ies_save_binary": True,
+                              "ensemble_binary_format": fmt}
+        pst.write(os.path.join(new_d, "pest_{0}.pst".format(fmt)))
+        pyemu.os_utils.run("{0} pest_{1}.pst".format(exe_path, fmt), cwd=new_d)
+        phis[fmt] = pd.read_csv(os.path.join(new_d, "pest_{0}.phi.actual.csv".format(fmt)), index_col=0)
+        ext = "jcb" if fmt == "jcb" else "ens"
+        for tag in ["0.par", "0.obs", "2.par", "2.obs", "obs+noise"]:
+            assert os.path.exists(os.path.join(new_d, "pest_{0}.{1}.{2}".format(fmt, tag, ext))), (fmt, tag)
+    for fmt in ["ens", "ens32"]:
+        d = np.abs(phis["jcb"].iloc[:, 1:].values - phis[fmt].iloc[:, 1:].values).max()
+        print(fmt, d)
+        assert d < 1.0e-6, (fmt, d)
+    s1 = os.path.getsize(os.path.join(new_d, "pest_ens.2.par.ens"))
+    s2 = os.path.getsize(os.path.join(new_d, "pest_ens32.2.par.ens"))
+    assert s2 < s1, (s1, s2)
+
+    # .ens files can be used to restart
+    pst.pestpp_options = {"ies_num_reals": 10, "ies_lambda_mults": [0.5, 1.0],
+                          "ies_parameter_ensemble": "pest_ens.0.par.ens",
+                          "ies_observation_ensemble": "pest_ens.obs+noise.ens",
+                          "ies_restart_observation_ensemble": "pest_ens.0.obs.ens"}
+    pst.write(os.path.join(new_d, "pest_restart.pst"))
+    pyemu.os_utils.run("{0} pest_restart.pst".format(exe_path), cwd=new_d)
+    phi = pd.read_csv(os.path.join(new_d, "pest_restart.phi.actual.csv"), index_col=0)
+    d = np.abs(phis["ens"].iloc[:, 1:].values - phi.iloc[:, 1:].values).max()
+    print(d)
+    assert d < 1.0e-6, d
+
+    # lambda-testing ensembles spilled to disk go through the .ens container, and must not
+    # collide with the lambda ensembles saved in the ens format
+    pst.pestpp_options = {"ies_num_reals": 10, "ies_lambda_mults": [0.5, 1.0], "ies_upgrades_in_memory": False,
+                          "ies_save_binary": True, "ensemble_binary_format": "ens", "ies_save_lambda_en": True}
+    pst.write(os.path.join(new_d, "pest_disk.pst"))
+    pyemu.os_utils.run("{0} pest_disk.pst".format(exe_path), cwd=new_d)
+    phi = pd.read_csv(os.path.join(new_d, "pest_disk.phi.actual.csv"), index_col=0)
+    d = np.abs(phis["jcb"].iloc[:, 1:].values - phi.iloc[:, 1:].values).max()
+    print(d)
+    assert d < 1.0e-6, d
+    files = os.listdir(new_d)
+    lam_files = [f for f in files if f.startswith("pest_disk.1.") and f.endswith(".scale.par.ens")]
+    assert len(lam_files) > 0
+    spill_files = [f for f in files if f.startswith("pest_disk.") and f.endswith(".spill.ens")]
+    assert len(spill_files) == 0, spill_files
+
+
+def ies_upgrade_factor_cache_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_factor_cache")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    # the factors are only cached for the local analysis solve
+    mat = pyemu.Matrix(x=np.ones((pst.nnz_obs, pst.npar_adj)), row_names=pst.nnz_obs_names,
+                       col_names=pst.adj_par_names)
+    mat.to_ascii(os.path.join(new_d, "loc.mat"))
+    pst.control_data.noptmax = 3
+    cases = {"glm": {}, "glm_full": {"ies_use_approx": False}, "mda": {"ies_use_mda": True}}
+    for case, opts in cases.items():
+        phis = []
+        # disabled, too small to hold every case, and the default budget
+        for cache_mb in [0, 0.0001, 1000]:
+            pst.pestpp_options = {"ies_num_reals": 10, "ies_localizer": "loc.mat", "ies_lambda_mults": [0.5, 1.0, 2.0],
+                                  "ies_upgrade_factor_cache_mb": cache_mb}
+            pst.pestpp_options.update(opts)
+            pst_name = "pest_{0}_{1}.pst".format(case, cache_mb)
+            pst.write(os.path.join(new_d, pst_name))
+            pyemu.os_utils.run("{0} {1}".format(exe_path, pst_name), cwd=new_d)
+            phis.append(pd.read_csv(os.path.join(new_d, pst_name.replace(".pst", ".phi.actual.csv")), index_col=0))
+        for phi in phis[1:]:
+            d = np.abs(phis[0].iloc[:, 1:].values - phi.iloc[:, 1:].values).max()
+            print(case, d)
+            assert d < 1.0e-6, (case, d)
+
+
+def ies_overlap_lambda_runs_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_overlap_lambda_runs")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    pst.control_data.noptmax = 3
+    cases = {"glm": {}, "mda": {"ies_use_mda": True}, "disk": {"ies_upgrades_in_memory": False}}
+    for case, opts in cases.items():
+        phis = []
+        for overlap in [True, False]:
+            pst.pestpp_options = {"ies_num_reals": 10, "ies_lambda_mults": [0.5, 1.0, 2.0],
+                                  "lambda_scale_fac": [0.75, 1.0], "ies_overlap_lambda_runs": overlap}
+            pst.pestpp_options.update(opts)
+            pst_name = "pest_{0}_{1}.pst".format(case, str(overlap).lower())
+            pst.write(os.path.join(new_d, pst_name))
+            pyemu.os_utils.run("{0} {1}".format(exe_path, pst_name), cwd=new_d)
+            phis.append(pd.read_csv(os.path.join(new_d, pst_name.replace(".pst", ".phi.actual.csv")), index_col=0))
+        # the same runs are made and the same upgrades are selected either way
+        assert np.array_equal(phis[0].total_runs.values, phis[1].total_runs.values), case
+        d = np.abs(phis[0].iloc[:, 1:].values - phis[1].iloc[:, 1:].values).max()
+        print(case, d)
+        assert d < 1.0e-6, (case, d)
+
+
+def ies_multimodal_reuse_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_multimodal_reuse")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    pst.control_data.noptmax = 3
+    pst.pestpp_options = {"ies_num_reals": 10, "ies_lambda_mults": [0.5, 1.0]}
+    pst.write(os.path.join(new_d, "pest.pst"))
+    pyemu.os_utils.run("{0} pest.pst".format(exe_path), cwd=new_d)
+    base_phi = pd.read_csv(os.path.join(new_d, "pest.phi.actual.csv"), index_col=0)
+
+    # with every other realization in each neighborhood (and shared weights), all realizations
+    # share one local solve, which is the standard solve
+    pst.pestpp_options["ies_multimodal_alpha"] = 0.99
+    pst.write(os.path.join(new_d, "pest_all.pst"))
+    pyemu.os_utils.run("{0} pest_all.pst".format(exe_path), cwd=new_d)
+    mm_phi = pd.read_csv(os.path.join(new_d, "pest_all.phi.actual.csv"), index_col=0)
+    d = (np.abs(base_phi.iloc[:, 1:].values - mm_phi.iloc[:, 1:].values) / base_phi.iloc[:, 1:].values).max()
+    print(d)
+    assert d < 1.0e-5, d
+    with open(os.path.join(new_d, "pest_all.rec"), 'r') as f:
+        assert "reused 9 local solves" in f.read()
+
+    pst.pestpp_options["ies_multimodal_alpha"] = 0.25
+    pst.pestpp_options["ies_verbose_level"] = 2
+    pst.write(os.path.join(new_d, "pest_mm.pst"))
+    pyemu.os_utils.run("{0} pest_mm.pst".format(exe_path), cwd=new_d)
+    mm_phi = pd.read_csv(os.path.join(new_d, "pest_mm.phi.actual.csv"), index_col=0)
+    assert mm_phi.loc[:, "mean"].iloc[-1] < mm_phi.loc[:, "mean"].iloc[0]
+    info_files = [f for f in os.listdir(new_d) if f.startswith("pest_mm.") and f.endswith(".mm.info.csv")]
+    assert len(info_files) > 0
+    for info_file in info_files:
+        info = pd.read_csv(os.path.join(new_d, info_file), index_col=0)
+        assert info.shape[0] == 10, info.shape
+        assert len([c for c in info.columns if c.startswith("neighbor_")]) == 2, info.columns
+        # no realization is its own neighbor
+        for rname, row in info.iterrows():
+            assert str(rname) not in [str(row[c]) for c in info.columns if c.startswith("neighbor_")]
+
+
+def binary_ins_test():
+    t_d = os.path.join("tplins_test_1", "test_binary_ins")
+    if os.path.exists(t_d):
+        shutil.rmtree(t_d)
+    os.makedirs(t_d)
+    # a MODFLOW-style single precision heads file: two stress periods, each with one record per layer
+    nlay, nrow, ncol = 2, 3, 4
+    arrs = {}
+    with open(os.path.join(t_d, "heads.bin.bak"), "wb") as f:
+        for kper in [1, 2]:
+            for k in range(1, nlay + 1):
+                arr = np.arange(nrow * ncol, dtype=np.float32).reshape(nrow, ncol) + 100.0 * kper + 10.0 * k
+                arrs[(kper, k)] = arr
+                f.write(np.array([1, kper], dtype=np.int32).tobytes())
+                f.write(np.array([1.0, kper], dtype=np.float32).tobytes())
+                f.write("{0:>16s}".format("HEAD").encode())
+                f.write(np.array([ncol, nrow, k], dtype=np.int32).tobytes())
+                f.write(arr.astype(np.float32).tobytes())
+    # a raw file with one value of each dtype
+    with open(os.path.join(t_d, "raw.bin.bak"), "wb") as f:
+        f.write(np.array([1500.5], dtype=np.float64).tobytes())
+        f.write(np.array([-7], dtype=np.int32).tobytes())
+        f.write(np.array([123456789012], dtype=np.int64).tobytes())
+        f.write(np.array([2.25], dtype=np.float32).tobytes())
+
+    # header is 44 bytes and each record 44 + 12 * 4 = 92 bytes, so (kper 2, layer 1, row 1, col 2) is at 232
+    expected = {"h_1_1_1_1": arrs[(1, 1)][0, 0], "h_2_2_3_4": arrs[(2, 2)][2, 3], "h_1_2_2_3": arrs[(1, 2)][1, 2],
+                "h_off": arrs[(2, 1)][0, 1], "r_f64": 1500.5, "r_i32": -7.0, "r_i64": 123456789012.0, "r_f32": 2.25}
+    with open(os.path.join(t_d, "heads.bin.ins"), "w") as f:
+        f.write("bif\nprecision single\n")
+        f.write("h_1_1_1_1 array 1 1 1 1\nh_2_2_3_4 array 2 2 3 4\nh_1_2_2_3 array 1 2 2 3\n")
+        f.write("# the same file read by byte offset\nh_off offset 232 float32\n")
+    with open(os.path.join(t_d, "raw.bin.ins"), "w") as f:
+        f.write("bif\nr_f64 offset 0 float64\nr_i32 offset 8 int32\nr_i64 offset 12 int64\nr_f32 offset 20 float32\n")
+    # a float32 at offset 22 runs past the end of the 24 byte raw file
+    with open(os.path.join(t_d, "bad_offset.bin.ins"), "w") as f:
+        f.write("bif\nr_f64 offset 0 float64\nr_i32 offset 8 int32\nr_i64 offset 12 int64\nr_f32 offset 22 float32\n")
+    # there are only two records
+    with open(os.path.join(t_d, "bad_record.bin.ins"), "w") as f:
+        f.write("bif\nprecision single\n")
+        f.write("h_1_1_1_1 array 1 1 1 1\nh_2_2_3_4 array 3 2 3 4\nh_1_2_2_3 array 1 2 2 3\nh_off offset 232 float32\n")
+    with open(os.path.join(t_d, "p1.dat.tpl"), "w") as f:
+        f.write("ptf ~\n~ p1          ~\n")
+    with open(os.path.join(t_d, "forward_run.py"), "w") as f:
+        f.write("import shutil\n")
+        f.write("shutil.copy2('heads.bin.bak','heads.bin')\n")
+        f.write("shutil.copy2('raw.bin.bak','raw.bin')\n")
+
+    pst = pyemu.helpers.pst_from_parnames_obsnames(["p1"], list(expected.keys()))
+    pst.control_data.noptmax = 0
+    pst.model_command = "python forward_run.py"
+    pst.model_input_data = pd.DataFrame({"pest_file": ["p1.dat.tpl"], "model_file": ["p1.dat"]}, index=["p1.dat.tpl"])
+    pst.model_output_data = pd.DataFrame({"pest_file": ["heads.bin.ins", "raw.bin.ins"],
+                                          "model_file": ["heads.bin", "raw.bin"]},
+                                         index=["heads.bin.ins", "raw.bin.ins"])
+    pst.write(os.path.join(t_d, "pest.pst"))
+    pyemu.os_utils.run("{0} pest.pst".format(exe_path.replace("-ies", "-glm")), cwd=t_d)
+    pst = pyemu.Pst(os.path.join(t_d, "pest.pst"))
+    res = pst.res
+    for oname, val in expected.items():
+        assert np.abs(res.loc[oname, "modelled"] - val) < 1.0e-6, (oname, res.loc[oname, "modelled"], val)
+
+    for ins_file, out_file in [("bad_offset.bin.ins", "raw.bin"), ("bad_record.bin.ins", "heads.bin")]:
+        pst.model_output_data.loc[pst.model_output_data.model_file == out_file, "pest_file"] = ins_file
+        pst.write(os.path.join(t_d, "pest_bad.pst"))
+        pst.model_output_data.loc[pst.model_output_data.model_file == out_file, "pest_file"] = out_file + ".ins"
+        try:
+            pyemu.os_utils.run("{0} pest_bad.pst".format(exe_path.replace("-ies", "-glm")), cwd=t_d)
+        except:
+            pass
+        else:
+            raise Exception("should have failed with " + ins_file)
+
+
+def ies_add_runs_transform_test():
+    t_d = os.path.join("tplins_test_1", "test_add_runs_transform")
+    if os.path.exists(t_d):
+        shutil.rmtree(t_d)
+    os.makedirs(t_d)
+    # the model echoes its (model space) input values so the applied transforms can be checked
+    par_names = ["p1", "p2", "p3", "p4", "p5", "p6"]
+    tpl_file = os.path.join(t_d, "in.dat.tpl")
+    with open(tpl_file, "w") as f:
+        f.write("ptf ~\n")
+        for par_name in par_names:
+            f.write("{0} ~     {0}              ~\n".format(par_name))
+    ins_file = os.path.join(t_d, "out.dat.ins")
+    with open(ins_file, "w") as f:
+        f.write("pif ~\n")
+        for par_name in par_names:
+            f.write("l1 w !{0}!\n".format(par_name.replace("p", "o")))
+    with open(os.path.join(t_d, "in.dat"), "w") as f:
+        for par_name in par_names:
+            f.write("{0} 1.0\n".format(par_name))
+    with open(os.path.join(t_d, "forward_run.py"), "w") as f:
+        f.write("import shutil\n")
+        f.write("shutil.copy2('in.dat','out.dat')\n")
+    pyemu.os_utils.run("python forward_run.py", cwd=t_d)
+
+    pst = pyemu.Pst.from_io_files(tpl_files=tpl_file, in_files=tpl_file.replace(".tpl", ""),
+                                  ins_files=ins_file, out_files=ins_file.replace(".ins", ""), pst_path=".")
+    pst.model_command = "python forward_run.py"
+    par = pst.parameter_data
+    # log, none, tied (with its own scale/offset), fixed, and log with scale/offset
+    par_info = {"p1": ["log", 2.0, 0.1, 10.0, 1.0, 0.0], "p2": ["none", 3.0, 0.0, 10.0, 2.0, 1.0],
+                "p3": ["tied", 4.0, 0.1, 20.0, 2.0, -1.0], "p4": ["fixed", 5.0, 1.0, 10.0, 1.0, 0.0],
+                "p5": ["log", 1.0, 0.1, 10.0, 0.5, 3.0], "p6": ["tied", 1.5, 0.0, 10.0, -1.0, 10.0]}
+    for par_name, info in par_info.items():
+        par.loc[par_name, ["partrans", "parval1", "parlbnd", "parubnd", "scale", "offset"]] = info
+    par.loc["p3", "partied"] = "p1"
+    par.loc["p6", "partied"] = "p2"
+
+    # more realizations than one block of the column-wise transform, and a per-realization fixed par
+    num_reals = 150
+    np.random.seed(2)
+    pe = pd.DataFrame({"p1": np.random.uniform(0.2, 9.0, num_reals), "p2": np.random.uniform(0.5, 9.0, num_reals),
+                       "p4": np.random.uniform(1.0, 9.0, num_reals), "p5": np.random.uniform(0.2, 9.0, num_reals)})
+    pe.to_csv(os.path.join(t_d, "pe.csv"))
+    pst.control_data.noptmax = -1
+    pst.pestpp_options = {"ies_parameter_ensemble": "pe.csv", "ies_num_reals": num_reals,
+                          "ensemble_output_precision": 15}
+    pst.write(os.path.join(t_d, "pest.pst"))
+    pyemu.os_utils.run("{0} pest.pst".format(exe_path), cwd=t_d)
+
+    oe = pd.read_csv(os.path.join(t_d, "pest.0.obs.csv"), index_col=0)
+    oe.index = oe.index.map(str)
+    pe.index = pe.index.map(str)
+    # model value = (ctl value * scale) + offset, tied pars follow their parent by the parval1 ratio
+    expected = pd.DataFrame({"o1": pe.p1, "o2": pe.p2 * 2.0 + 1.0, "o3": pe.p1 * 2.0 * 2.0 - 1.0, "o4": pe.p4,
+                             "o5": pe.p5 * 0.5 + 3.0, "o6": pe.p2 * 0.5 * -1.0 + 10.0})
+    expected.loc["base", :] = [2.0, 7.0, 7.0, 5.0, 3.5, 8.5]
+    common = [r for r in expected.index if r in oe.index]
+    assert len(common) == num_reals, len(common)
+    d = ((oe.loc[common, expected.columns] - expected.loc[common, :]).abs() / expected.loc[common, :].abs()).values.max()
+    print(d)
+    assert d < 1.0e-10, d
+
+
+def ies_csv_reader_test():
+    model_d = "ies_10par_xsec"
+    t_d = os.path.join(model_d, "template")
+    new_d = os.path.join(model_d, "test_csv_reader")
+    if os.path.exists(new_d):
+        shutil.rmtree(new_d)
+    shutil.copytree(t_d, new_d)
+    pst = pyemu.Pst(os.path.join(new_d, "pest.pst"))
+    np.random.seed(3)
+
+    def write_csv(file_name, names, vals, by_reals=True, eol="\n", final_eol=True, blank_line=False,
+                  quote_index=False, quote_header=False):
+        # written by hand so the line endings and quoting are exactly as given
+        q = lambda s, quote: '"{0}"'.format(s) if quote else s
+        real_names = [str(i) for i in range(vals.shape[0])]
+        lines = []
+        if by_reals:
+            lines.append(",".join([q("real_name", quote_index or quote_header)] + [q(n, quote_header) for n in names]))
+            for rname, row in zip(real_names, vals):
+                lines.append(",".join([q(rname, quote_index)] + [repr(float(v)) for v in row]))
+        else:
+            lines.append(",".join([q("name", quote_index or quote_header)] + [q(r, quote_header) for r in real_names]))
+            for j, n in enumerate(names):
+                lines.append(",".join([q(n, quote_index)] + [repr(float(v)) for v in vals[:, j]]))
+        text = eol.join(lines)
+        if final_eol:
+            text += eol
+        if blank_line:
+            text += eol
+        with open(os.path.join(new_d, file_name), "w", newline="") as f:
+            f.write(text)
+
+    def check(case, by_reals, pe_vals, oe_vals):
+        # fixed pars are not part of the adjustable ensemble, so only the adjustable ones are compared
+        for tag, names, vals in [("par", pst.par_names, pe_vals), ("obs", pst.obs_names, oe_vals)]:
+            org = pd.DataFrame(vals, columns=names, index=[str(i) for i in range(vals.shape[0])])
+            if tag == "par":
+                org = org.loc[:, pst.adj_par_names]
+            df = pd.read_csv(os.path.join(new_d, "{0}.0.{1}.csv".format(case, tag)), index_col=0)
+            if not by_reals:
+                df = df.T
+            df.index = df.index.map(lambda x: str(x).strip('"'))
+            df.columns = df.columns.str.lower()
+            df = df.loc[org.index, org.columns]
+            d = np.abs(df.values - org.values).max()
+            print(case, tag, d)
+            assert d == 0.0, (case, tag, d)
+
+    # each case is read back in through the par, obs+noise and restart obs csv readers, and the
+    # values saved to the .0. ensembles must be exactly the values in the csv (what the stream
+    # reader returned).  the large case is split over several threads
+    cases = {"plain": {}, "crlf": {"eol": "\r\n"}, "no_final_eol": {"final_eol": False},
+             "quoted_index": {"quote_index": True}, "by_vars": {"by_reals": False, "eol": "\r\n"},
+             "large": {"num_reals": 20000}, "blank_line": {"blank_line": True, "fail": True},
+             "quoted_header": {"quote_header": True, "fail": True}}
+    pst.control_data.noptmax = -1
+    for case, kwargs in cases.items():
+        kwargs = kwargs.copy()
+        num_reals = kwargs.pop("num_reals", 10)
+        fail = kwargs.pop("fail", False)
+        by_reals = kwargs.get("by_reals", True)
+        pe_vals = np.random.uniform(0.5, 1.5, (num_reals, pst.npar)) * pst.parameter_data.parval1.values
+        oe_vals = np.random.uniform(0.5, 1.5, (num_reals, pst.nobs)) * pst.observation_data.obsval.values
+        write_csv("{0}_pe.csv".format(case), pst.par_names, pe_vals, **kwargs)
+        write_csv("{0}_oe.csv".format(case), pst.obs_names, oe_vals, **kwargs)
+        pst.pestpp_options = {"ies_parameter_ensemble": "{0}_pe.csv".format(case),
+                              "ies_observation_ensemble": "{0}_oe.csv".format(case),
+                              "ies_restart_observation_ensemble": "{0}_oe.csv".format(case),
+                              "ies_add_base": False, "ies_csv_by_reals": by_reals, "ies_num_threads": 4,
+                              "ensemble_output_precision": 17}
+        pst.write(os.path.join(new_d, "{0}.pst".format(case)))
+        if fail:
+            # rejected by the header/line checks shared by both readers
+            try:
+                pyemu.os_utils.run("{0} {1}.pst".format(exe_path, case), cwd=new_d)
+            except:
+                pass
+            else:
+                raise Exception("should have failed: " + case)
+            continue
+        pyemu.os_utils.run("{0} {1}.pst".format(exe_path, case), cwd=new_d)
+        check(case, by_reals, pe_vals, oe_vals)
+
+
 if __name__ == "__main__":
     #shutil.copy2(os.path.join("..","exe","windows","x64","Debug","pestpp-glm.exe"),os.path.join("..","bin","win","pestpp-glm.exe"))
     #shutil.copy2(os.path.join("..", "exe", "windows", "x64", "Debug", "pestpp-ies.exe"),
@@ -123,14 +123,15 @@ bool OperSys::double_is_invalid(double x)
 
 
 #ifdef OS_WIN
-PROCESS_INFORMATION start(string &cmd_string)
+PROCESS_INFORMATION start(string &cmd_string, const string &work_dir)
 {
 	char* cmd_line = _strdup(cmd_string.c_str());
 	STARTUPINFO si;
 	PROCESS_INFORMATION pi;
 	ZeroMemory(&si, sizeof(si));
 	ZeroMemory(&pi, sizeof(pi));
-	if (!CreateProcess(NULL, cmd_line, NULL, NULL, false, 0, NULL, NULL, &si, &pi))
+	const char* cwd = work_dir.empty() ? NULL : work_dir.c_str();
+	if (!CreateProcess(NULL, cmd_line, NULL, NULL, false, 0, NULL, cwd, &si, &pi))
 	{
 		std::string cmd_string(cmd_line);
 		throw std::runtime_error("CreateProcess() failed for command: " + cmd_string);
@@ -142,7 +143,7 @@ PROCESS_INFORMATION start(string &cmd_string)
 
 
 #ifdef OS_LINUX
-int start(string &cmd_string)
+int start(string &cmd_string, const string &work_dir)
 {
 	//split cmd_string on whitespaces
 	stringstream cmd_ss(cmd_string);
@@ -171,6 +172,13 @@ int start(string &cmd_string)
 	if (pid == 0)
 	{
 		setpgid(0, 0);
+		//only the child changes directory so the parent process cwd is untouched
+		//dont throw here - the child would unwind through its copy of the parent's stack
+		if ((!work_dir.empty()) && (::chdir(work_dir.c_str()) != 0))
+		{
+			fprintf(stderr, "chdir() to '%s' failed for command: %s\n", work_dir.c_str(), cmd_string.c_str());
+			_exit(127);
+		}
 		int success = execvp(arg_v[0], const_cast<char* const*>(&(arg_v[0])));
 		if (success == -1)
 		{
@@ -38,10 +38,10 @@ public:
 
 #ifdef OS_WIN
 #include <Windows.h>
-PROCESS_INFORMATION start(std::string &cmd_string);
+PROCESS_INFORMATION start(std::string &cmd_string, const std::string &work_dir="");
 #endif
 #ifdef OS_LINUX
-int start(std::string &cmd_string);
+int start(std::string &cmd_string, const std::string &work_dir="");
 #endif
 
 
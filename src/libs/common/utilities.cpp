@@ -24,6 +24,13 @@
 
 #include "utilities.h"
 #include "system_variables.h"
+#include <cstdint>
+#ifdef OS_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 using namespace std;
@@ -567,6 +574,59 @@ void try_clean_up_run_storage_files(const string& case_name)
 	}
 }
 
+NameIndex::NameIndex() : data(make_shared<Data>())
+{
+}
+
+NameIndex::NameIndex(const vector<string>& _names)
+{
+	shared_ptr<Data> d = make_shared<Data>();
+	d->names = _names;
+	d->index.reserve(_names.size());
+	for (int i = 0; i < _names.size(); i++)
+		d->index.insert(make_pair(_names[i], i));
+	data = d;
+}
+
+int NameIndex::find_index(const string& name) const
+{
+	const_iterator it = data->index.find(name);
+	if (it == data->index.end())
+		return -1;
+	return it->second;
+}
+
+int NameIndex::at(const string& name) const
+{
+	const_iterator it = data->index.find(name);
+	if (it == data->index.end())
+		throw runtime_error("NameIndex::at(): name not found: " + name);
+	return it->second;
+}
+
+bool NameIndex::same_names(const vector<string>& other) const
+{
+	return (&other == &data->names) || (other == data->names);
+}
+
+vector<int> NameIndex::get_indices(const vector<string>& other_names) const
+{
+	vector<int> idxs;
+	idxs.reserve(other_names.size());
+	for (auto& name : other_names)
+		idxs.push_back(find_index(name));
+	return idxs;
+}
+
+vector<int> NameIndex::get_indices(const vector<string>& other_names, vector<string>& missing) const
+{
+	vector<int> idxs = get_indices(other_names);
+	for (int i = 0; i < idxs.size(); i++)
+		if (idxs[i] < 0)
+			missing.push_back(other_names[i]);
+	return idxs;
+}
+
 thread_flag::thread_flag(bool _flag)
 {
 	flag = _flag;
@@ -585,6 +645,175 @@ bool thread_flag::get()
 	else return false;
 }
 
+TaskPool& TaskPool::get_instance()
+{
+	static TaskPool pool;
+	return pool;
+}
+
+TaskPool::TaskPool() : job(nullptr), job_workers(0), active_workers(0), generation(0), stop(false), failed(false),
+	job_owner(thread::id())
+{
+	queues.push_back(unique_ptr<TaskQueue>(new TaskQueue()));
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		lock_guard<mutex> guard(pool_lock);
+		stop = true;
+	}
+	start_cv.notify_all();
+	for (auto& t : threads)
+		if (t.joinable())
+			t.join();
+}
+
+int TaskPool::get_num_threads()
+{
+	lock_guard<mutex> guard(pool_lock);
+	return threads.size() + 1;
+}
+
+void TaskPool::parallel_for(int num_tasks, int num_workers, const std::function<void(int, int)>& task)
+{
+	if (num_tasks <= 0)
+		return;
+	num_workers = max(1, min(num_workers, num_tasks));
+	//a job issued from inside a running job (or a single worker job) runs in the caller
+	unique_lock<mutex> job_guard(job_lock, defer_lock);
+	if ((num_workers == 1) || (job_owner == this_thread::get_id()) || (!job_guard.try_lock()))
+	{
+		for (int i = 0; i < num_tasks; i++)
+			task(0, i);
+		return;
+	}
+	job_owner = this_thread::get_id();
+	{
+		lock_guard<mutex> guard(pool_lock);
+		//grow the pool as needed - threads are kept for later jobs
+		while (threads.size() < num_workers - 1)
+		{
+			queues.push_back(unique_ptr<TaskQueue>(new TaskQueue()));
+			int worker_id = threads.size() + 1;
+			threads.push_back(thread(&TaskPool::worker_loop, this, worker_id));
+		}
+		for (int w = 0; w < num_workers; w++)
+		{
+			lock_guard<mutex> qguard(queues[w]->lock);
+			queues[w]->tasks.clear();
+			int start = (int)(((long long)num_tasks * w) / num_workers);
+			int end = (int)(((long long)num_tasks * (w + 1)) / num_workers);
+			for (int i = start; i < end; i++)
+				queues[w]->tasks.push_back(i);
+		}
+		errors.clear();
+		failed = false;
+		job = &task;
+		job_workers = num_workers;
+		active_workers = num_workers - 1;
+		generation++;
+	}
+	start_cv.notify_all();
+	run_tasks(0);
+	{
+		unique_lock<mutex> guard(pool_lock);
+		done_cv.wait(guard, [this]() { return active_workers == 0; });
+		job = nullptr;
+		job_workers = 0;
+	}
+	job_owner = thread::id();
+	vector<string> job_errors;
+	{
+		lock_guard<mutex> guard(error_lock);
+		job_errors.swap(errors);
+	}
+	job_guard.unlock();
+	if (job_errors.size() > 0)
+	{
+		stringstream ss;
+		for (auto& e : job_errors)
+			ss << e;
+		throw runtime_error(ss.str());
+	}
+}
+
+void TaskPool::worker_loop(int worker_id)
+{
+	long long seen = 0;
+	while (true)
+	{
+		{
+			unique_lock<mutex> guard(pool_lock);
+			start_cv.wait(guard, [this, &seen, worker_id]() { return (stop) || ((generation != seen) && (worker_id < job_workers)); });
+			if (stop)
+				return;
+			seen = generation;
+		}
+		run_tasks(worker_id);
+		{
+			lock_guard<mutex> guard(pool_lock);
+			active_workers--;
+		}
+		done_cv.notify_all();
+	}
+}
+
+bool TaskPool::next_task(int worker_id, int& task_idx)
+{
+	{
+		TaskQueue& own = *queues[worker_id];
+		lock_guard<mutex> guard(own.lock);
+		if (own.tasks.size() > 0)
+		{
+			task_idx = own.tasks.front();
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+	//steal from the back of the other workers' runs
+	for (int i = 1; i < job_workers; i++)
+	{
+		TaskQueue& other = *queues[(worker_id + i) % job_workers];
+		lock_guard<mutex> guard(other.lock);
+		if (other.tasks.size() > 0)
+		{
+			task_idx = other.tasks.back();
+			other.tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskPool::run_tasks(int worker_id)
+{
+	int task_idx;
+	while ((!failed) && (next_task(worker_id, task_idx)))
+	{
+		try
+		{
+			(*job)(worker_id, task_idx);
+		}
+		catch (const std::exception& e)
+		{
+			failed = true;
+			lock_guard<mutex> guard(error_lock);
+			stringstream ss;
+			ss << " thread " << worker_id << " raised an exception: " << e.what();
+			errors.push_back(ss.str());
+		}
+		catch (...)
+		{
+			failed = true;
+			lock_guard<mutex> guard(error_lock);
+			stringstream ss;
+			ss << " thread " << worker_id << " raised an exception";
+			errors.push_back(ss.str());
+		}
+	}
+}
+
 //void thread_exceptions::add(std::exception_ptr ex_ptr)
 //{
 //	std::lock_guard<std::mutex> lock(m);
@@ -894,6 +1123,11 @@ void read_binary_matrix_header(const string& filename, int& tmp1, int& tmp2, int
 
 bool read_binary(const string& filename, vector<string>& row_names, vector<string>& col_names, Eigen::MatrixXd& matrix)
 {
+	if (is_chunked_binary(filename))
+	{
+		read_chunked_binary(filename, row_names, col_names, matrix);
+		return true;
+	}
 	int tmp1 = 0, tmp2 = 0, tmp3 = 0;
 
 	try
@@ -924,6 +1158,270 @@ bool read_binary(const string& filename, vector<string>& row_names, vector<strin
 }
 
 
+static const char chunked_binary_magic[8] = { 'P','E','S','T','E','N','S','2' };
+
+bool is_chunked_binary(const string& filename)
+{
+	ifstream in(filename.c_str(), ifstream::binary);
+	if (!in.good())
+		return false;
+	char magic[8];
+	in.read(magic, 8);
+	if (in.gcount() != 8)
+		return false;
+	return memcmp(magic, chunked_binary_magic, 8) == 0;
+}
+
+void save_chunked_binary(const string& filename, const vector<string>& row_names, const vector<string>& col_names,
+	const std::function<void(int, Eigen::VectorXd&)>& get_col, bool single_precision, int chunk_cols)
+{
+	ofstream out(filename.c_str(), ofstream::binary);
+	if (!out.good())
+		throw runtime_error("save_chunked_binary() error opening binary file " + filename + " for writing");
+	int32_t version = 2;
+	int32_t value_size = single_precision ? sizeof(float) : sizeof(double);
+	int64_t nrow = row_names.size(), ncol = col_names.size(), nchunk_cols = max(1, chunk_cols);
+	out.write(chunked_binary_magic, 8);
+	out.write((char*)&version, sizeof(version));
+	out.write((char*)&value_size, sizeof(value_size));
+	out.write((char*)&nrow, sizeof(nrow));
+	out.write((char*)&ncol, sizeof(ncol));
+	out.write((char*)&nchunk_cols, sizeof(nchunk_cols));
+	int32_t len;
+	for (auto names : { &row_names, &col_names })
+	{
+		for (auto& name : *names)
+		{
+			string l = lower_cp(name);
+			len = l.size();
+			out.write((char*)&len, sizeof(len));
+			out.write(l.data(), len);
+		}
+	}
+
+	Eigen::MatrixXd block;
+	Eigen::MatrixXf fblock;
+	Eigen::VectorXd col;
+	for (int64_t c0 = 0; c0 < ncol; c0 += nchunk_cols)
+	{
+		int ncc = min(nchunk_cols, ncol - c0);
+		//the transpose of a col-major block is the row-major layout of the chunk
+		block.resize(ncc, nrow);
+		for (int j = 0; j < ncc; j++)
+		{
+			get_col(c0 + j, col);
+			if (col.size() != nrow)
+				throw runtime_error("save_chunked_binary() error: column " + col_names[c0 + j] + " has the wrong number of values");
+			block.row(j) = col.transpose();
+		}
+		if (single_precision)
+		{
+			fblock = block.cast<float>();
+			out.write((char*)fblock.data(), sizeof(float) * fblock.size());
+		}
+		else
+			out.write((char*)block.data(), sizeof(double) * block.size());
+		if (!out.good())
+			throw runtime_error("save_chunked_binary() error writing to binary file " + filename);
+	}
+	out.close();
+}
+
+void save_chunked_binary(const string& filename, const vector<string>& row_names, const vector<string>& col_names,
+	const Eigen::MatrixXd& matrix, bool single_precision, int chunk_cols)
+{
+	save_chunked_binary(filename, row_names, col_names,
+		[&matrix](int j, Eigen::VectorXd& col) { col = matrix.col(j); }, single_precision, chunk_cols);
+}
+
+ChunkedBinaryHeader read_chunked_binary_header(ifstream& in, const string& filename)
+{
+	ChunkedBinaryHeader header;
+	char magic[8];
+	int32_t version;
+	in.read(magic, 8);
+	in.read((char*)&version, sizeof(version));
+	in.read((char*)&header.value_size, sizeof(header.value_size));
+	in.read((char*)&header.nrow, sizeof(header.nrow));
+	in.read((char*)&header.ncol, sizeof(header.ncol));
+	in.read((char*)&header.chunk_cols, sizeof(header.chunk_cols));
+	if ((!in.good()) || (memcmp(magic, chunked_binary_magic, 8) != 0))
+		throw runtime_error("read_chunked_binary() error reading header from " + filename);
+	if ((version != 2) || ((header.value_size != sizeof(float)) && (header.value_size != sizeof(double))) ||
+		(header.nrow < 0) || (header.ncol < 0) || (header.chunk_cols < 1))
+		throw runtime_error("read_chunked_binary() unsupported or corrupt header in " + filename);
+
+	header.row_names.resize(header.nrow);
+	header.col_names.resize(header.ncol);
+	int32_t len;
+	string name;
+	for (auto names : { &header.row_names, &header.col_names })
+	{
+		for (auto& n : *names)
+		{
+			in.read((char*)&len, sizeof(len));
+			if ((!in.good()) || (len < 0))
+				throw runtime_error("read_chunked_binary() error reading names from " + filename);
+			name.resize(len);
+			in.read(&name[0], len);
+			upper_ip(name);
+			n = name;
+		}
+	}
+	if (!in.good())
+		throw runtime_error("read_chunked_binary() error reading names from " + filename);
+	header.data_start = in.tellg();
+	return header;
+}
+
+void read_chunked_binary_block(ifstream& in, const ChunkedBinaryHeader& header, int64_t block, Eigen::MatrixXd& values)
+{
+	int64_t c0 = block * header.chunk_cols;
+	if ((block < 0) || (c0 >= header.ncol))
+		throw runtime_error("read_chunked_binary_block() error: block index out of range");
+	int64_t ncc = min(header.chunk_cols, header.ncol - c0);
+	//the chunk is row-major, which is the col-major layout of its transpose
+	in.seekg(header.data_start + c0 * header.nrow * header.value_size, ios_base::beg);
+	if (header.value_size == sizeof(double))
+	{
+		Eigen::MatrixXd block_t(ncc, header.nrow);
+		in.read((char*)block_t.data(), sizeof(double) * block_t.size());
+		values = block_t.transpose();
+	}
+	else
+	{
+		Eigen::MatrixXf block_t(ncc, header.nrow);
+		in.read((char*)block_t.data(), sizeof(float) * block_t.size());
+		values = block_t.transpose().cast<double>();
+	}
+	if (!in.good())
+		throw runtime_error("read_chunked_binary_block() error reading values");
+}
+
+void read_chunked_binary(const string& filename, vector<string>& row_names, vector<string>& col_names, Eigen::MatrixXd& matrix,
+	const vector<string>& keep_rows, const vector<string>& keep_cols)
+{
+	ifstream in(filename.c_str(), ifstream::binary);
+	if (!in.good())
+		throw runtime_error("read_chunked_binary() error opening binary file " + filename + " for reading");
+	ChunkedBinaryHeader header = read_chunked_binary_header(in, filename);
+	int32_t value_size = header.value_size;
+	int64_t nrow = header.nrow, ncol = header.ncol, chunk_cols = header.chunk_cols;
+	int64_t data_start = header.data_start;
+	const vector<string>& file_rows = header.row_names;
+	const vector<string>& file_cols = header.col_names;
+
+	//the rows and columns to load, in file order
+	vector<int64_t> row_idx, col_idx;
+	set<string> skeep;
+	if (keep_rows.size() > 0)
+		skeep = set<string>(keep_rows.begin(), keep_rows.end());
+	for (int64_t i = 0; i < nrow; i++)
+		if ((keep_rows.size() == 0) || (skeep.find(file_rows[i]) != skeep.end()))
+			row_idx.push_back(i);
+	skeep.clear();
+	if (keep_cols.size() > 0)
+		skeep = set<string>(keep_cols.begin(), keep_cols.end());
+	for (int64_t j = 0; j < ncol; j++)
+		if ((keep_cols.size() == 0) || (skeep.find(file_cols[j]) != skeep.end()))
+			col_idx.push_back(j);
+
+	row_names.clear();
+	col_names.clear();
+	for (auto i : row_idx)
+		row_names.push_back(file_rows[i]);
+	for (auto j : col_idx)
+		col_names.push_back(file_cols[j]);
+	matrix.resize(row_idx.size(), col_idx.size());
+
+	int64_t data_size = nrow * ncol * value_size;
+	const char* mapped = NULL;
+	void* addr = NULL;
+	size_t map_size = 0;
+#ifdef OS_LINUX
+	//map the file so only the pages that hold the requested values are read
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd >= 0)
+	{
+		map_size = data_start + data_size;
+		struct stat sb;
+		if ((fstat(fd, &sb) != 0) || (sb.st_size < map_size))
+		{
+			close(fd);
+			throw runtime_error("read_chunked_binary() error: file " + filename + " is truncated");
+		}
+		addr = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED)
+			addr = NULL;
+		else
+			mapped = static_cast<const char*>(addr);
+	}
+#endif
+	vector<char> seg;
+	int64_t k = 0;
+	try
+	{
+		while (k < col_idx.size())
+		{
+			//all requested columns in this chunk
+			int64_t c0 = (col_idx[k] / chunk_cols) * chunk_cols;
+			int64_t ncc = min(chunk_cols, ncol - c0);
+			int64_t kend = k;
+			while ((kend < col_idx.size()) && (col_idx[kend] < c0 + ncc))
+				kend++;
+			int64_t seg_size = ncc * value_size;
+			int64_t chunk_start = data_start + c0 * nrow * value_size;
+			for (int64_t ii = 0; ii < row_idx.size(); ii++)
+			{
+				int64_t offset = chunk_start + row_idx[ii] * seg_size;
+				const char* src;
+				if (mapped != NULL)
+					src = mapped + offset;
+				else
+				{
+					seg.resize(seg_size);
+					in.seekg(offset, ios_base::beg);
+					in.read(seg.data(), seg_size);
+					if (!in.good())
+						throw runtime_error("read_chunked_binary() error reading values from " + filename);
+					src = seg.data();
+				}
+				for (int64_t kk = k; kk < kend; kk++)
+				{
+					const char* vptr = src + (col_idx[kk] - c0) * value_size;
+					if (value_size == sizeof(double))
+					{
+						double v;
+						memcpy(&v, vptr, sizeof(double));
+						matrix(ii, kk) = v;
+					}
+					else
+					{
+						float v;
+						memcpy(&v, vptr, sizeof(float));
+						matrix(ii, kk) = v;
+					}
+				}
+			}
+			k = kend;
+		}
+	}
+	catch (...)
+	{
+#ifdef OS_LINUX
+		if (addr != NULL)
+			munmap(addr, map_size);
+#endif
+		throw;
+	}
+#ifdef OS_LINUX
+	if (addr != NULL)
+		munmap(addr, map_size);
+#endif
+	in.close();
+}
+
 bool read_binary(const string &filename, vector<string> &row_names, vector<string> &col_names, Eigen::SparseMatrix<double> &matrix)
 {
 	stringstream ss;
@@ -22,6 +22,12 @@
 #include <chrono>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <deque>
+#include <atomic>
+#include <condition_variable>
 
 
 const string QUIT_FILENAME = "pest.stp";
@@ -256,6 +262,48 @@ private:
 
 };
 
+//a persistent pool of worker threads shared by the threaded ensemble calculations (upgrade
+//solves, automatic adaptive localization and grouped prior draws).  each job's tasks are
+//split into contiguous runs, one per worker; a worker takes tasks from the front of its own
+//run and, once that is empty, steals from the back of the others.  the calling thread works
+//as worker 0, so a job with one worker runs serially in the caller.  jobs do not nest: a
+//parallel_for issued from inside a task also runs serially in the calling task
+class TaskPool
+{
+public:
+	static TaskPool& get_instance();
+	~TaskPool();
+	//run task(worker_id, task_idx) for every task_idx in [0, num_tasks) on up to num_workers
+	//threads and wait for them all.  exceptions raised by tasks stop the remaining tasks and
+	//are rethrown as a single runtime_error once the job has drained
+	void parallel_for(int num_tasks, int num_workers, const std::function<void(int, int)>& task);
+	int get_num_threads();
+
+private:
+	struct TaskQueue
+	{
+		std::mutex lock;
+		std::deque<int> tasks;
+	};
+	TaskPool();
+	TaskPool(const TaskPool&);
+	TaskPool& operator=(const TaskPool&);
+	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::mutex job_lock, pool_lock, error_lock;
+	std::condition_variable start_cv, done_cv;
+	const std::function<void(int, int)>* job;
+	int job_workers, active_workers;
+	long long generation;
+	bool stop;
+	std::atomic<bool> failed;
+	std::atomic<std::thread::id> job_owner;
+	vector<string> errors;
+	void worker_loop(int worker_id);
+	void run_tasks(int worker_id);
+	bool next_task(int worker_id, int& task_idx);
+};
+
 //class thread_exceptions
 //{
 //public:
@@ -296,12 +344,68 @@ private:
 //};
 //
 
+//an immutable list of names plus a hash index into it.  copies share the same storage, so an
+//index can be handed between ensembles, matrices and run storage without copying or rebuilding
+//it.  duplicate names resolve to their first position
+class NameIndex
+{
+public:
+	typedef unordered_map<string, int>::const_iterator const_iterator;
+	NameIndex();
+	NameIndex(const vector<string>& _names);
+	const vector<string>& names() const { return data->names; }
+	int size() const { return data->names.size(); }
+	bool empty() const { return data->names.empty(); }
+	const_iterator begin() const { return data->index.begin(); }
+	const_iterator end() const { return data->index.end(); }
+	const_iterator find(const string& name) const { return data->index.find(name); }
+	size_t count(const string& name) const { return data->index.count(name); }
+	//-1 if name is not in the index
+	int find_index(const string& name) const;
+	int at(const string& name) const;
+	int operator[](const string& name) const { return at(name); }
+	bool shares(const NameIndex& other) const { return data == other.data; }
+	bool same_names(const vector<string>& other) const;
+	//position of each of other_names in this index (-1 if missing)
+	vector<int> get_indices(const vector<string>& other_names) const;
+	vector<int> get_indices(const vector<string>& other_names, vector<string>& missing) const;
+
+private:
+	struct Data
+	{
+		vector<string> names;
+		unordered_map<string, int> index;
+	};
+	shared_ptr<const Data> data;
+};
+
 void read_binary_matrix_header(const string& filename, int& tmp1, int& tmp2, int& tmp3);
 void read_dense_binary(const string& filename, vector<string>& row_names, vector<string>& col_names, Eigen::MatrixXd& matrix);
 bool read_binary(const string &filename, vector<string> &row_names, vector<string> &col_names, Eigen::SparseMatrix<double> &matrix);
 
 bool read_binary(const string &filename, vector<string> &row_names, vector<string> &col_names, Eigen::MatrixXd &matrix);
 
+//column-chunked dense container ("PESTENS2", extension .ens): a header with the row and column
+//names followed by blocks of chunk_cols columns, each block stored row-major, in float64 or float32.
+//any subset of rows and/or columns can be loaded without reading the whole file
+bool is_chunked_binary(const string& filename);
+void save_chunked_binary(const string& filename, const vector<string>& row_names, const vector<string>& col_names,
+	const std::function<void(int, Eigen::VectorXd&)>& get_col, bool single_precision = false, int chunk_cols = 256);
+void save_chunked_binary(const string& filename, const vector<string>& row_names, const vector<string>& col_names,
+	const Eigen::MatrixXd& matrix, bool single_precision = false, int chunk_cols = 256);
+void read_chunked_binary(const string& filename, vector<string>& row_names, vector<string>& col_names, Eigen::MatrixXd& matrix,
+	const vector<string>& keep_rows = vector<string>(), const vector<string>& keep_cols = vector<string>());
+//header of a chunked container - data_start is the byte offset of the first block
+struct ChunkedBinaryHeader
+{
+	int32_t value_size;
+	int64_t nrow, ncol, chunk_cols, data_start;
+	vector<string> row_names, col_names;
+};
+ChunkedBinaryHeader read_chunked_binary_header(ifstream& in, const string& filename);
+//read all rows of one block of columns into values (nrow x block columns)
+void read_chunked_binary_block(ifstream& in, const ChunkedBinaryHeader& header, int64_t block, Eigen::MatrixXd& values);
+
 
 void save_binary(const string &filename, const vector<string> &row_names, const vector<string> &col_names, const Eigen::SparseMatrix<double> &matrix);
 void save_binary_extfmt(const string &filename,const  vector<string> &row_names, const vector<string> &col_names, const Eigen::SparseMatrix<double> &matrix);
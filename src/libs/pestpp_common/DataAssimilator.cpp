@@ -189,6 +189,8 @@ void DataAssimilator::da_update(int cycle)
             }
         }
 	}
+	//the next cycle updates the control file info the writer reads from
+	flush_saves();
 }
 
 
@@ -216,7 +218,7 @@ void DataAssimilator::eig2csv(string name, Eigen::MatrixXd matrix)
 
 void DataAssimilator::finalize()
 {
-
+	flush_saves();
 }
 
 map<int, map<string, double>> process_da_obs_cycle_table(Pest& pest_scenario, vector <int>& ncycles_in_tables, ofstream& fout_rec, set<string>& obs_in_tbl)
@@ -702,8 +704,8 @@ void generate_global_ensembles(DataAssimilator& da, ofstream& fout_rec, Paramete
 	fout_rec << "...global parameter ensemble has " << curr_pe.shape().first << " rows and " << curr_pe.shape().second << " columns" << endl;
 	if (pest_scenario_ptr->get_pestpp_options().get_save_binary())
     {
-        curr_pe.to_binary(da.get_file_manager().get_base_filename() + ".global.prior.pe.jcb");
-        curr_noise.to_binary(da.get_file_manager().get_base_filename() + ".global.obs+noise.jcb");
+        curr_pe.to_binary(da.get_file_manager().get_base_filename() + ".global.prior.pe" + pest_scenario_ptr->get_pestpp_options().get_ensemble_binary_ext());
+        curr_noise.to_binary(da.get_file_manager().get_base_filename() + ".global.obs+noise" + pest_scenario_ptr->get_pestpp_options().get_ensemble_binary_ext());
     }
 	else {
         curr_pe.to_csv(da.get_file_manager().get_base_filename() + ".global.prior.pe.csv");
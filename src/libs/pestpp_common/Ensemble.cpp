@@ -3,6 +3,7 @@
 #include <unordered_set>
 #include <iterator>
 #include <limits>
+#include <numeric>
 #include "Ensemble.h"
 #include "RestartController.h"
 #include "utilities.h"
@@ -15,6 +16,15 @@
 #include "pest_data_structs.h"
 #include "eigen_tools.h"
 #include "Transformable.h"
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#ifdef OS_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 Ensemble::Ensemble(Pest *_pest_scenario_ptr, std::mt19937* _rand_gen_ptr): pest_scenario_ptr(_pest_scenario_ptr),
 rand_gen_ptr(_rand_gen_ptr)
@@ -182,21 +192,6 @@ void Ensemble::add_2_cols_ip(Ensemble &other)
 }
 
 
-void draw_thread_function(int id, DrawThread &worker, int num_reals, int ies_verbose, map<string, int> idx_map, map<string, double> std_map, exception_ptr &eptr)
-{
-	try
-	{
-		worker.work(id, num_reals, ies_verbose, idx_map, std_map);
-	}
-	catch (...)
-	{
-		eptr = current_exception();
-	}
-
-	return;
-}
-
-
 void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const vector<string> &draw_names,
 	const map<string, vector<string>> &grouper, PerformanceLog *plog, int level)
 {
@@ -235,11 +230,6 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 	//Eigen::MatrixXd draws_temp = draws;
 
 	Eigen::VectorXd std = cov.e_ptr()->diagonal().cwiseSqrt();
-	map<string, double> std_map;
-	for (int i = 0; i < std.size(); i++)
-	{
-		std_map[var_names[i]] = std(i);
-	}
 	//if diagonal cov, then scale by std
 	if (cov.isdiagonal())
 	{
@@ -262,19 +252,56 @@ void Ensemble::draw(int num_reals, Covariance cov, Transformable &tran, const ve
 			ss << "...drawing by group" << endl;
 			plog->log_event(ss.str());
 			cout << ss.str();
-			map<string, int> idx_map;
-			
-			for (int i = 0; i < var_names.size(); i++)
-				idx_map[var_names[i]] = i;
+			//locate each group's contiguous column range in the draws (and the aligned cov).
+			//the standard normal draws above are made serially, so projecting the groups in
+			//any order (or on any number of threads) gives the same result for a given seed
+			pest_utils::NameIndex draw_index(draw_names);
 			vector<string> group_keys;
-			for (auto gi : grouper)
+			vector<int> group_starts, group_sizes;
+			for (auto& gi : grouper)
+			{
+				if (gi.second.size() == 0)
+				{
+					plog->log_event("no entries for grouper key:" + gi.first);
+					continue;
+				}
+				int start = draw_index.find_index(gi.second[0]);
+				for (int i = 0; i < gi.second.size(); i++)
+				{
+					if ((start < 0) || (draw_index.find_index(gi.second[i]) != start + i))
+					{
+						ss.str("");
+						ss << "Ensemble::draw() error: idx out of order for group: " << gi.first;
+						plog->log_event(ss.str());
+						throw_ensemble_error(ss.str());
+					}
+				}
+				//single element groups just get scaled by std
+				if (gi.second.size() == 1)
+				{
+					draws.col(start) *= std(start);
+					continue;
+				}
 				group_keys.push_back(gi.first);
-			DrawThread worker(plog, cov, &draws, group_keys, grouper);
+				group_starts.push_back(start);
+				group_sizes.push_back(gi.second.size());
+			}
+			DrawThread worker(plog, cov, &draws, group_keys, group_starts, group_sizes);
 			int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
-			//if ((num_threads <= 0) || (group_keys.size() == 1))
-			//jwhite 23 dec 2020 - something is up with the multithreaded draw (and its a really mem pig)
-			//so turning it off
-			worker.work(0, num_reals, level, idx_map, std_map);
+			num_threads = max(min(num_threads, (int)group_keys.size()), 1);
+			if (num_threads > 1)
+				Eigen::setNbThreads(1);
+			try
+			{
+				pest_utils::TaskPool::get_instance().parallel_for(group_keys.size(), num_threads, [&](int thread_id, int igroup)
+					{
+						worker.draw_group(thread_id, igroup, level);
+					});
+			}
+			catch (exception& e)
+			{
+				throw_ensemble_error("error in grouped draw: " + string(e.what()));
+			}
 		}
 		else
 		{
@@ -474,90 +501,24 @@ Eigen::MatrixXd Ensemble::get_eigen_anomalies(string on_real)
 Eigen::MatrixXd Ensemble::get_eigen_anomalies(const vector<string> &_real_names, const vector<string> &_var_names, string on_real)
 {
 	//get a matrix this is the differences of var_names  realized values from the mean realized value
+	//the subset is read through a view so only the returned matrix is allocated
+	EnsembleView view = get_view(_real_names, _var_names);
+	return view.get_anomalies(get_center(view, _real_names, on_real));
+}
 
-	//the new Eigen matrix
-	Eigen::MatrixXd _reals;
-	if ((_real_names.size() == 0) && (_var_names.size() == 0))
-		_reals = reals;
-	else {
-        _reals = get_eigen(_real_names, _var_names);
-    }
-
-
-	map<int, double> center_on_map;
-	if (on_real.size() > 0)
-	{
-		//cheap median approx - doesnt deal with mean of the two middle elements if even 
-		if (pest_utils::upper_cp(on_real) == MEDIAN_CENTER_ON_NAME)
-		{
-			int half_size = _reals.rows() / 2;
-			vector<double> d(_reals.rows());
-			vector<double>::iterator begin;
-			vector<double>::iterator end;
-			vector<double>::iterator half;
-			vector<double>::iterator half_minus_one;
-			double half_val;
-			bool even = _reals.rows() % 2 == 0;
-
-			for (int i = 0; i < _reals.cols(); i++)
-			{
-				d = eigenvec_2_stlvec(_reals.col(i));
-				begin = d.begin();
-				end = d.end();
-				half = d.begin() + half_size;
-				half_minus_one = half - 1;
-				nth_element(begin,half,end);
-				half_val = *half;
-				if (even)
-				{
-					nth_element(begin, half_minus_one, end);
-					center_on_map[i] = (half_val + *half_minus_one) / 2.0;
-				}
-				else
-					center_on_map[i] = half_val;
-			}
-				
-
-		}
-		else
-		{
-			int idx;
-			if (_real_names.size() > 0) {
-
-                vector<string>::const_iterator it = find(_real_names.begin(), _real_names.end(), on_real);
-                if (it == _real_names.end())
-                    throw runtime_error("Ensemble::get_eigen_mean_diff() error: 'on_real' not found: " + on_real);
-                idx = distance(_real_names.begin(), it);
-            }
-			else
-            {
-                vector<string>::iterator it = find(real_names.begin(), real_names.end(), on_real);
-                if (it == real_names.end())
-                    throw runtime_error("Ensemble::get_eigen_mean_diff() error: 'on_real' not found: " + on_real);
-                idx = distance(real_names.begin(), it);
-            }
-			for (int i = 0; i < _reals.cols(); i++)
-				center_on_map[i] = _reals(idx, i);
-		}
-	}
-	else
-	{
-		for (int j = 0; j < _reals.cols(); j++)
-			center_on_map[j] = _reals.col(j).mean();
-	}
-
-	//process each var name
-	//double mean;
-	int s = _reals.rows();
-	for (int j = 0; j < _reals.cols(); j++)
-	{
-		//mean = _reals.col(j).mean();
-		//Eigen::MatrixXd temp = _reals.col(j);
-		_reals.col(j) = _reals.col(j) - (Eigen::VectorXd::Ones(s) * center_on_map[j]);
-		//temp = _reals.col(j);
-		//cout << temp << endl;
-	}
-	return _reals;
+Eigen::RowVectorXd Ensemble::get_center(const EnsembleView& view, const vector<string>& _real_names, string on_real)
+{
+	//the center of the rows of a view - the mean, the (approximate) median or a named realization
+	if (on_real.size() == 0)
+		return view.get_center();
+	if (pest_utils::upper_cp(on_real) == MEDIAN_CENTER_ON_NAME)
+		return view.get_center(-1, true);
+
+	const vector<string>& rnames = (_real_names.size() > 0) ? _real_names : real_names;
+	vector<string>::const_iterator it = find(rnames.begin(), rnames.end(), on_real);
+	if (it == rnames.end())
+		throw runtime_error("Ensemble::get_eigen_mean_diff() error: 'on_real' not found: " + on_real);
+	return view.get_center(distance(rnames.begin(), it));
 }
 
 vector<double> Ensemble::get_mean_stl_var_vector()
@@ -664,7 +625,14 @@ void Ensemble::set_eigen(Eigen::MatrixXd _reals)
 
 void Ensemble::reorder(const vector<string> &_real_names, const vector<string> &_var_names, bool update_org_real_names)
 {
-	//reorder inplace
+	//reorder inplace - nothing to do if the names are already in the requested order
+	if (((_real_names.size() == 0) || (_real_names == real_names)) &&
+		((_var_names.size() == 0) || (_var_names == var_names)))
+	{
+		if ((_real_names.size() != 0) && (update_org_real_names))
+			org_real_names = _real_names;
+		return;
+	}
 	reals = get_eigen(_real_names, _var_names);
 	if (_var_names.size() != 0)
 		var_names = _var_names;
@@ -748,11 +716,8 @@ void Ensemble::keep_rows(const vector<int> &row_idxs)
 void Ensemble::keep_rows(const vector<string> &keep_names)
 {
 	//make sure all names are in real_names
-	vector<string>::const_iterator start = real_names.begin(), end = real_names.end();
 	vector<string> missing;
-	for (auto &n : keep_names)
-		if (find(start, end, n) == end)
-			missing.push_back(n);
+	pest_utils::NameIndex(real_names).get_indices(keep_names, missing);
 	if (missing.size() > 0)
 		throw_ensemble_error("Ensemble::keep_rows() error: the following real names not found: ", missing);
 	reals = get_eigen(keep_names, vector<string>());
@@ -760,106 +725,54 @@ void Ensemble::keep_rows(const vector<string> &keep_names)
 }
 
 
-Eigen::MatrixXd Ensemble::get_eigen(vector<string> row_names, vector<string> col_names, bool update_vmap)
+Eigen::MatrixXd Ensemble::get_eigen(const vector<string>& row_names, const vector<string>& col_names, bool update_vmap)
 {
 	//get a dense eigen matrix from reals by row and col names
-	vector<string> missing_rows,missing_cols;
-	vector<string>::iterator iter, start = real_names.begin(), end = real_names.end();
-	vector<int> row_idxs, col_idxs;
+	return get_view(row_names, col_names, update_vmap).eval();
+}
 
-	//check for missing
+EnsembleView Ensemble::get_view(const vector<string>& row_names, const vector<string>& col_names, bool update_vmap)
+{
+	//resolve names to index arrays - an empty name vector means all rows/cols
+	vector<int> row_idxs, col_idxs;
 	vector<string> missing;
-
 	if (row_names.size() > 0)
 	{
-		map<string, int> real_map;
-		for (int i = 0; i < real_names.size(); i++)
-			real_map[real_names[i]] = i;
-		set<string> real_set(real_names.begin(), end = real_names.end());
-		set<string>::iterator end = real_set.end();
-		for (auto &name : row_names)
-		{
-			if (real_set.find(name) == end)
-				missing.push_back(name);
-			row_idxs.push_back(real_map[name]);
-		}
+		pest_utils::NameIndex real_index(real_names);
+		row_idxs = real_index.get_indices(row_names, missing);
 		if (missing.size() > 0)
-			throw_ensemble_error("Ensemble.get_eigen() error: the following realization names were not found:", missing);
+			throw_ensemble_error("Ensemble.get_view() error: the following realization names were not found:", missing);
+	}
+	else
+	{
+		row_idxs.resize(reals.rows());
+		iota(row_idxs.begin(), row_idxs.end(), 0);
 	}
 	if (col_names.size() > 0)
 	{
-		//map<string, int> var_map;
-		//for (int i = 0; i < var_names.size(); i++)
-		//	var_map[var_names[i]] = i;
 		if (update_vmap)
 			update_var_map();
-
-		//set<string> var_set(var_names.begin(), var_names.end());
-		map<string,int>::iterator end = var_map.end();
-		for (auto &name : col_names)
-		{
-			if (var_map.find(name) == end)
-				missing.push_back(name);
-			col_idxs.push_back(var_map[name]);
-		}
+		col_idxs = var_map.get_indices(col_names, missing);
 		if (missing.size() > 0)
-			throw_ensemble_error("Ensemble.get_eigen() error: the following variable names were not found:", missing);
-	}
-
-
-	Eigen::MatrixXd mat;
-
-	// only mess with columns, keep rows the same
-	if (row_names.size() == 0)
-	{
-		if (missing_cols.size() > 0)
-			throw_ensemble_error("Ensemble.get_eigen() the following col_names not found:", missing_cols);
-		mat.resize(real_names.size(), col_names.size());
-		int j = 0;
-		for (auto &jj : col_idxs)
-		{
-			mat.col(j) = reals.col(jj);
-			j++;
-		}
-		return mat;
-	}
-
-	// only mess with rows, keep cols the same
-	if (col_names.size() == 0)
-	{
-		if (missing_rows.size() > 0)
-			throw_ensemble_error("Ensemble.get_eigen() the following row_names not found:", missing_rows);
-		mat.resize(row_names.size(), var_names.size());
-		int i = 0;
-		for (auto &ii : row_idxs)
-		{
-			mat.row(i) = reals.row(ii);
-			i++;
-		}
-		return mat;
+			throw_ensemble_error("Ensemble.get_view() error: the following variable names were not found:", missing);
 	}
-
-	//the slow one where we are rearranging rows and cols
-	if (missing_rows.size() > 0)
-		throw_ensemble_error("Ensemble.get_eigen() the following row_names not found:", missing_rows);
-
-	if (missing_cols.size() > 0)
-		throw_ensemble_error("Ensemble.get_eigen() the following col_names not found:", missing_cols);
-	mat.resize(row_names.size(), col_names.size());
-	int i=0, j=0;
-	for (auto &ii : row_idxs)
+	else
 	{
-		j = 0;
-		for (auto &jj : col_idxs)
-		{
-			//cout << i << ',' << j << ';' << ii << ',' << jj << endl;
-			mat(i, j) = reals(ii, jj);
-			j++;
-		}
-		i++;
+		col_idxs.resize(reals.cols());
+		iota(col_idxs.begin(), col_idxs.end(), 0);
 	}
-	return mat;
+	return EnsembleView(&reals, row_idxs, col_idxs);
+}
 
+EnsembleView Ensemble::get_view(const vector<int>& row_idxs, const vector<int>& col_idxs) const
+{
+	for (auto& i : row_idxs)
+		if ((i < 0) || (i >= reals.rows()))
+			throw runtime_error("Ensemble::get_view() error: row index out of range: " + to_string(i));
+	for (auto& j : col_idxs)
+		if ((j < 0) || (j >= reals.cols()))
+			throw runtime_error("Ensemble::get_view() error: col index out of range: " + to_string(j));
+	return EnsembleView(&reals, row_idxs, col_idxs);
 }
 
 
@@ -1019,16 +932,9 @@ void Ensemble::update_real_ip(const string & rname, Eigen::VectorXd & real)
 
 void Ensemble::update_var_map()
 {
-	var_map.clear();
-	
-	//for (int i = 0; i < var_names.size(); i++)
-	int i = 0;
-	for (auto& name : var_names)
-	{
-		//var_map[var_names[i]] = i;
-		var_map.insert(make_pair(name, i));
-		i++;
-	}
+	//the index is shared with copies of this ensemble, so only rebuild it if the names changed
+	if (!var_map.same_names(var_names))
+		var_map = pest_utils::NameIndex(var_names);
 }
 
 void Ensemble::throw_ensemble_error(string message, vector<string> vec)
@@ -1113,18 +1019,18 @@ pair<map<string,int>, map<string, int>> Ensemble::prepare_csv(const vector<strin
 	int lcount = 1, nerr = 0;
 	stringstream ss;
 	
+	//only the item count and the index label are needed here, so skip the full tokenize
+	size_t ntok;
 	while (getline(csv, line))
 	{
 		pest_utils::strip_ip(line);
-		pest_utils::upper_ip(line);
-		tokens.clear();
-		pest_utils::tokenize(line, tokens, ",", false);
-		if (header_tokens.size() != tokens.size())
+		ntok = count(line.begin(), line.end(), ',') + 1;
+		if (header_tokens.size() != ntok)
 		{
-			ss << "wrong number of items on line " << lcount << ", expecting " << header_tokens.size() << " but found " << tokens.size() << endl;
+			ss << "wrong number of items on line " << lcount << ", expecting " << header_tokens.size() << " but found " << ntok << endl;
 			nerr++;
 		}
-		index_tokens.push_back(tokens[0]);
+		index_tokens.push_back(pest_utils::upper_cp(line.substr(0, line.find(','))));
 		lcount++;
 	}
 
@@ -1539,7 +1445,6 @@ void Ensemble::check_for_normal(string context)
 		for (int j = 0; j < reals.cols(); j++)
 			if (!isnormal(reals(i, j)) && (reals(i, j) != 0.0))
 			{
-				double v = reals(i, j);
 				ss << real_names[i] << "," << var_names[j] << "," << reals(i,j) << endl;
 				nn_found = true;
 			}
@@ -1556,6 +1461,11 @@ void Ensemble::check_for_normal(string context)
 
 void Ensemble::to_binary(string file_name, bool transposed)
 {
+	if ((file_name.size() > 3) && (pest_utils::lower_cp(file_name).substr(file_name.size() - 4) == ".ens"))
+	{
+		to_binary_chunked(file_name, pest_scenario_ptr->get_pestpp_options().get_ensemble_binary_single());
+		return;
+	}
 	ofstream fout(file_name, ios::binary);
 	if (!fout.good())
 	{
@@ -1627,12 +1537,34 @@ void Ensemble::to_binary(string file_name, bool transposed)
 	fout.close();
 }
 
-map<string, int> Ensemble::from_binary(string file_name, vector<string> &names, bool transposed)
+void Ensemble::to_binary_chunked(string file_name, bool single_precision)
+{
+	pest_utils::save_chunked_binary(file_name, real_names, var_names, reals, single_precision);
+}
+
+map<string, int> Ensemble::from_binary(string file_name, vector<string> &names, bool transposed, const vector<string>& real_subset)
 {
 	var_names.clear();
 	real_names.clear();
 	reals.resize(0, 0);
-	bool is_new_format = pest_utils::read_binary(file_name, real_names, var_names, reals);
+	bool is_new_format = true;
+	//chunked files only read the requested realizations
+	if (pest_utils::is_chunked_binary(file_name))
+		pest_utils::read_chunked_binary(file_name, real_names, var_names, reals, real_subset);
+	else
+	{
+		is_new_format = pest_utils::read_binary(file_name, real_names, var_names, reals);
+		if (real_subset.size() > 0)
+		{
+			set<string> skeep(real_subset.begin(), real_subset.end());
+			vector<string> drop;
+			for (auto& rname : real_names)
+				if (skeep.find(rname) == skeep.end())
+					drop.push_back(rname);
+			if (drop.size() > 0)
+				drop_rows(drop);
+		}
+	}
 	if ((!is_new_format) && (transposed))
 	{
 		vector<string> temp = real_names;
@@ -1843,9 +1775,7 @@ void Ensemble::read_csv_by_reals(int num_reals,ifstream &csv, map<string,int> &h
 	reals.setZero();
 	int irow = 0;
 
-	map<string, int> var_map;
-	for (int i = 0; i < var_names.size(); i++)
-		var_map[var_names[i]] = i;
+	update_var_map();
 
 	while (getline(csv, line))
 	{
@@ -1908,9 +1838,7 @@ void Ensemble::read_csv_by_vars(int num_reals, ifstream &csv, map<string, int> &
 	reals.setZero();
 	int var_idx;
 
-	map<string, int> var_map;
-	for (int i = 0; i < var_names.size(); i++)
-		var_map[var_names[i]] = i;
+	update_var_map();
 
 	while (getline(csv, line))
 	{
@@ -1959,6 +1887,183 @@ void Ensemble::read_csv_by_vars(int num_reals, ifstream &csv, map<string, int> &
 
 
 
+bool Ensemble::read_csv_mapped(const string& file_name, int num_reals, map<string, int>& header_info, bool by_reals)
+{
+	//memory-map the csv and parse blocks of lines in parallel straight into reals.
+	//returns false if the file can't be mapped so the caller can fall back to the
+	//stream-based readers
+#ifdef OS_LINUX
+	if (header_info.size() == 0)
+	{
+		throw_ensemble_error("Ensemble::read_csv_mapped() error: header_info is empty");
+	}
+	int fd = open(file_name.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat sb;
+	if ((fstat(fd, &sb) != 0) || (sb.st_size == 0))
+	{
+		::close(fd);
+		return false;
+	}
+	size_t fsize = sb.st_size;
+	void* addr = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+	madvise(addr, fsize, MADV_SEQUENTIAL);
+	const char* data = static_cast<const char*>(addr);
+	const char* data_end = data + fsize;
+
+	//line boundaries, skipping the header line - same lines getline() would return
+	vector<pair<const char*, const char*>> lines;
+	const char* p = static_cast<const char*>(memchr(data, '\n', fsize));
+	p = (p == NULL) ? data_end : p + 1;
+	while (p < data_end)
+	{
+		const char* nl = static_cast<const char*>(memchr(p, '\n', data_end - p));
+		if (nl == NULL)
+			nl = data_end;
+		lines.push_back(pair<const char*, const char*>(p, nl));
+		p = nl + 1;
+	}
+
+	reals.resize(num_reals, var_names.size());
+	reals.setZero();
+	unordered_map<string, int> vmap;
+	for (int i = 0; i < var_names.size(); i++)
+		vmap[var_names[i]] = i;
+
+	//csv column -> reals column (by reals) or reals row (by vars), -1 to skip
+	int max_col = 0;
+	for (auto& hi : header_info)
+		max_col = max(max_col, hi.second);
+	vector<int> col_dest(max_col + 1, -1);
+	vector<string> col_name(max_col + 1);
+	for (auto& hi : header_info)
+	{
+		if (by_reals)
+		{
+			unordered_map<string, int>::iterator it = vmap.find(hi.first);
+			col_dest[hi.second] = (it == vmap.end()) ? -1 : it->second;
+		}
+		else
+			col_dest[hi.second] = hi.second - 1;
+		col_name[hi.second] = hi.first;
+	}
+	if (by_reals && (lines.size() != num_reals))
+	{
+		munmap(addr, fsize);
+		throw runtime_error("different number of reals found");
+	}
+
+	int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
+	if (num_threads < 1)
+		num_threads = 1;
+	num_threads = min(num_threads, max(1, (int)lines.size()));
+	int block_size = (lines.size() + num_threads - 1) / num_threads;
+	vector<exception_ptr> exception_ptrs(num_threads, exception_ptr());
+	const string ws = " \t\n\r";
+
+	auto parse_block = [&](int tid)
+	{
+		try
+		{
+			int lstart = tid * block_size;
+			int lend = min((int)lines.size(), lstart + block_size);
+			//fields are copied into a small reusable buffer so strtod can't run off the mapped region
+			vector<char> buf(64);
+			string name;
+			for (int iline = lstart; iline < lend; iline++)
+			{
+				const char* s = lines[iline].first;
+				const char* e = lines[iline].second;
+				while ((s < e) && (ws.find(*s) != string::npos)) s++;
+				while ((e > s) && (ws.find(*(e - 1)) != string::npos)) e--;
+				int lcount = iline + 1;
+				const char* fend = static_cast<const char*>(memchr(s, ',', e - s));
+				if (fend == NULL) fend = e;
+				name.assign(s, fend);
+				int row = iline, col = -1;
+				if (!by_reals)
+				{
+					pest_utils::upper_ip(name);
+					unordered_map<string, int>::iterator it = vmap.find(name);
+					//names not in var_names are not part of this ensemble
+					if (it == vmap.end())
+						continue;
+					col = it->second;
+				}
+				const char* fs = (fend < e) ? fend + 1 : e;
+				int icol = 1;
+				while ((icol <= max_col) && (fs <= e))
+				{
+					fend = static_cast<const char*>(memchr(fs, ',', e - fs));
+					if (fend == NULL) fend = e;
+					if (col_dest[icol] != -1)
+					{
+						size_t len = fend - fs;
+						if (len + 1 > buf.size())
+							buf.resize(len + 1);
+						memcpy(buf.data(), fs, len);
+						buf[len] = '\0';
+						char* pend;
+						errno = 0;
+						double val = strtod(buf.data(), &pend);
+						if ((pend == buf.data()) || (errno == ERANGE))
+						{
+							stringstream ss;
+							ss << "error converting token '" << buf.data() << "' to double for " << col_name[icol] << " on line " << lcount << " : stod";
+							throw runtime_error(ss.str());
+						}
+						if (by_reals)
+							reals(row, col_dest[icol]) = val;
+						else
+							reals(col_dest[icol], col) = val;
+					}
+					icol++;
+					if (fend == e)
+						break;
+					fs = fend + 1;
+				}
+				if (icol <= max_col)
+				{
+					stringstream ss;
+					ss << "wrong number of items on line " << lcount << ", expecting at least " << max_col + 1 << " but found " << icol;
+					throw runtime_error(ss.str());
+				}
+			}
+		}
+		catch (...)
+		{
+			exception_ptrs[tid] = current_exception();
+		}
+	};
+
+	if (num_threads == 1)
+		parse_block(0);
+	else
+	{
+		vector<thread> threads;
+		for (int i = 0; i < num_threads; i++)
+			threads.push_back(thread(parse_block, i));
+		for (auto& t : threads)
+			t.join();
+	}
+	munmap(addr, fsize);
+	//report the error from the earliest block of lines
+	for (auto& eptr : exception_ptrs)
+	{
+		if (eptr)
+			rethrow_exception(eptr);
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+
 ParameterEnsemble::ParameterEnsemble(Pest *_pest_scenario_ptr, std::mt19937* rand_gen_ptr):Ensemble(_pest_scenario_ptr, rand_gen_ptr)
 {
 	par_transform = pest_scenario_ptr->get_base_par_tran_seq();
@@ -2196,6 +2301,11 @@ map<int,int> ParameterEnsemble::add_runs(RunManagerAbstract *run_mgr_ptr,const v
 		ss << " da_cycle=" << da_cycle << " ";
 		info_txt = ss.str();
 	}
+	if (batch_model_transform_supported())
+	{
+		add_runs_batch(run_mgr_ptr, pars, run_real_names, rmap, info_txt, real_run_ids);
+		return real_run_ids;
+	}
 	for (auto &rname : run_real_names)
 	{
 		//idx = find(real_names.begin(), real_names.end(), rname) - real_names.begin();
@@ -2224,6 +2334,186 @@ map<int,int> ParameterEnsemble::add_runs(RunManagerAbstract *run_mgr_ptr,const v
 	return real_run_ids;
 }
 
+bool ParameterEnsemble::batch_model_transform_supported() const
+{
+	//the batch path hard-codes the control file transformation sequence
+	//(scale,offset / tied,fixed / log10) - anything else goes thru the map-based transforms
+	vector<Transformation*> ctl2model = par_transform.get_ctl2model_tranformations();
+	vector<Transformation*> ctl2active_ctl = par_transform.get_ctl2active_ctl_tranformations();
+	vector<Transformation*> active_ctl2numeric = par_transform.get_active_ctl2numeric_tranformations();
+	if ((ctl2model.size() != 2) || (ctl2active_ctl.size() != 2) || (active_ctl2numeric.size() != 1))
+		return false;
+	if ((dynamic_cast<TranScale*>(ctl2model[0]) == nullptr) || (dynamic_cast<TranOffset*>(ctl2model[1]) == nullptr))
+		return false;
+	if ((dynamic_cast<TranTied*>(ctl2active_ctl[0]) == nullptr) || (dynamic_cast<TranFixed*>(ctl2active_ctl[1]) == nullptr))
+		return false;
+	if (dynamic_cast<TranLog10*>(active_ctl2numeric[0]) == nullptr)
+		return false;
+	if ((par_transform.get_scale_ptr() != ctl2model[0]) || (par_transform.get_offset_ptr() != ctl2model[1]) ||
+		(par_transform.get_tied_ptr() != ctl2active_ctl[0]) || (par_transform.get_fixed_ptr() != ctl2active_ctl[1]) ||
+		(par_transform.get_log10_ptr() != active_ctl2numeric[0]))
+		return false;
+	return true;
+}
+
+void ParameterEnsemble::add_runs_batch(RunManagerAbstract* run_mgr_ptr, Parameters& pars, const vector<string>& run_real_names,
+	map<string, int>& rmap, const string& info_txt, map<int, int>& real_run_ids)
+{
+	//same result as transforming a Parameters instance per realization, but the
+	//log10/scale/offset/tied transforms are applied column-wise on blocks of realizations
+	//and the results are scattered into run storage order with precomputed indices
+	const vector<string>& run_par_names = run_mgr_ptr->get_par_name_vec();
+	const pest_utils::NameIndex& run_par_map = run_mgr_ptr->get_par_name_index();
+	unordered_map<string, int> col_map;
+	for (int j = 0; j < var_names.size(); j++)
+		col_map[var_names[j]] = j;
+
+	//model-space values of everything not carried by the ensemble
+	Parameters base_pars = pars;
+	if (tstat == transStatus::CTL)
+		par_transform.active_ctl2model_ip(base_pars);
+	else if (tstat == transStatus::NUM)
+		par_transform.numeric2model_ip(base_pars);
+	Eigen::VectorXd base_vec = base_pars.get_data_eigen_vec(run_par_names);
+
+	vector<int> col_dest, scatter_cols, log_cols, scale_cols, offset_cols;
+	vector<double> col_scale, col_offset;
+	vector<int> tied_dest, tied_src;
+	vector<double> tied_factor, tied_scale, tied_offset;
+	if (tstat == transStatus::MODEL)
+	{
+		for (int j = 0; j < var_names.size(); j++)
+		{
+			col_dest.push_back(run_par_map.at(var_names[j]));
+			scatter_cols.push_back(j);
+		}
+	}
+	else
+	{
+		set<string> log_pars;
+		if (tstat == transStatus::NUM)
+			log_pars = par_transform.get_log10_ptr()->get_items();
+		const TranScale* t_scale = par_transform.get_scale_ptr();
+		const TranOffset* t_offset = par_transform.get_offset_ptr();
+		const TranFixed* t_fixed = par_transform.get_fixed_ptr();
+		map<string, TranTied::pair_string_double> tied_items = par_transform.get_tied_ptr()->get_items();
+		pair<bool, double> tval;
+		for (int j = 0; j < var_names.size(); j++)
+		{
+			const string& vname = var_names[j];
+			pest_utils::NameIndex::const_iterator it = run_par_map.find(vname);
+			if (it == run_par_map.end())
+				throw_ensemble_error("ParameterEnsemble::add_runs() error: par not found in run storage: " + vname);
+			col_dest.push_back(it->second);
+			if (log_pars.find(vname) != log_pars.end())
+				log_cols.push_back(j);
+			tval = t_scale->get_value(vname);
+			if (tval.first)
+				scale_cols.push_back(j);
+			col_scale.push_back(tval.first ? tval.second : 1.0);
+			tval = t_offset->get_value(vname);
+			if (tval.first)
+				offset_cols.push_back(j);
+			col_offset.push_back(tval.first ? tval.second : 0.0);
+			//tied pars get overwritten by their base par whenever the base par is available
+			map<string, TranTied::pair_string_double>::iterator tit = tied_items.find(vname);
+			if (tit != tied_items.end())
+			{
+				const string& base_name = tit->second.first;
+				if ((col_map.find(base_name) != col_map.end()) || (pars.find(base_name) != pars.end()) ||
+					(t_fixed->get_value(base_name).first))
+					continue;
+			}
+			scatter_cols.push_back(j);
+		}
+		//tied pars whose base par is in the ensemble vary by realization
+		for (auto& ti : tied_items)
+		{
+			unordered_map<string, int>::iterator cit = col_map.find(ti.second.first);
+			if (cit == col_map.end())
+				continue;
+			tied_dest.push_back(run_par_map.at(ti.first));
+			tied_src.push_back(cit->second);
+			tied_factor.push_back(ti.second.second);
+			tval = t_scale->get_value(ti.first);
+			tied_scale.push_back(tval.first ? tval.second : 1.0);
+			tval = t_offset->get_value(ti.first);
+			tied_offset.push_back(tval.first ? tval.second : 0.0);
+		}
+	}
+
+	const int chunk_size = 100;
+	int nvar = var_names.size();
+	int nrun = run_real_names.size();
+	Eigen::MatrixXd block, tied_block;
+	Eigen::VectorXd rvec;
+	vector<string> nn;
+	//run storage position of each fixed par, resolved once for all realizations
+	const vector<string>& fixed_names = pfinfo.get_fixed_names();
+	vector<int> fixed_dest;
+	for (auto& fname : fixed_names)
+	{
+		pest_utils::NameIndex::const_iterator it = run_par_map.find(fname);
+		if (it == run_par_map.end())
+			throw_ensemble_error("ParameterEnsemble::add_runs() error: fixed par not found in run storage: " + fname);
+		fixed_dest.push_back(it->second);
+	}
+	Eigen::VectorXd fixed_vals;
+	int idx, run_id;
+	for (int istart = 0; istart < nrun; istart += chunk_size)
+	{
+		int nrows = min(chunk_size, nrun - istart);
+		block.resize(nrows, nvar);
+		for (int r = 0; r < nrows; r++)
+			block.row(r) = reals.row(rmap[run_real_names[istart + r]]);
+		//numeric -> ctl
+		for (auto j : log_cols)
+			block.col(j) = block.col(j).unaryExpr([](double v) { return pow(10.0, v); });
+		tied_block.resize(nrows, tied_dest.size());
+		for (int k = 0; k < tied_dest.size(); k++)
+			tied_block.col(k) = ((block.col(tied_src[k]) * tied_factor[k]) * tied_scale[k]).array() + tied_offset[k];
+		//ctl -> model
+		for (auto j : scale_cols)
+			block.col(j) *= col_scale[j];
+		for (auto j : offset_cols)
+			block.col(j).array() += col_offset[j];
+
+		for (int r = 0; r < nrows; r++)
+		{
+			const string& rname = run_real_names[istart + r];
+			idx = rmap[rname];
+			rvec = base_vec;
+			for (auto j : scatter_cols)
+				rvec(col_dest[j]) = block(r, j);
+			for (int k = 0; k < tied_dest.size(); k++)
+				rvec(tied_dest[k]) = tied_block(r, k);
+			if (fixed_dest.size() > 0)
+			{
+				fixed_vals = pfinfo.get_real_fixed_vector(rname);
+				for (int k = 0; k < fixed_dest.size(); k++)
+					rvec(fixed_dest[k]) = fixed_vals[k];
+			}
+			nn.clear();
+			for (int i = 0; i < rvec.size(); i++)
+			{
+				if ((isnormal(rvec(i))) || (rvec(i) == 0.0))
+					continue;
+				nn.push_back(run_par_names[i]);
+			}
+			if (nn.size() > 0)
+			{
+				stringstream ss;
+				ss << "ParameterEnsemble:: add_runs() error: denormal values for realization " << rname << " : ";
+				for (auto n : nn)
+					ss << n << ",";
+				throw_ensemble_error(ss.str());
+			}
+			run_id = run_mgr_ptr->add_run(rvec, info_txt + " realization=" + rname);
+			real_run_ids[idx] = run_id;
+		}
+	}
+}
+
 void ParameterEnsemble::from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names, ParameterEnsemble::transStatus _tstat)
 {
 	//create a par ensemble from components
@@ -2250,12 +2540,12 @@ void ParameterEnsemble::from_eigen_mat(Eigen::MatrixXd mat, const vector<string>
 	tstat = _tstat;
 }
 
-void ParameterEnsemble::from_binary(string file_name, bool forgive)
+void ParameterEnsemble::from_binary(string file_name, bool forgive, const vector<string>& real_subset)
 {
 	//fixed_names.clear();
 	//fixed_map.clear();
 	vector<string> names = pest_scenario_ptr->get_ctl_ordered_adj_par_names();
-	map<string,int> header_info = Ensemble::from_binary(file_name, names, false);
+	map<string,int> header_info = Ensemble::from_binary(file_name, names, false, real_subset);
 	unordered_set<string>svar_names(var_names.begin(), var_names.end());
 	vector<string> missing;
 	for (auto& name : pest_scenario_ptr->get_ctl_ordered_adj_par_names())
@@ -2359,12 +2649,14 @@ void ParameterEnsemble::from_csv(string file_name, bool forgive)
 	string line;
 	getline(csv, line);
 	if (csv_by_reals) {
-        Ensemble::read_csv_by_reals(num_reals, csv, header_info, index_info);
+		if (!read_csv_mapped(file_name, num_reals, header_info, true))
+			Ensemble::read_csv_by_reals(num_reals, csv, header_info, index_info);
         prep_par_ensemble_after_read(header_info);
     }
 	else
     {
-		Ensemble::read_csv_by_vars(num_reals, csv, header_info, index_info);
+		if (!read_csv_mapped(file_name, num_reals, header_info, false))
+			Ensemble::read_csv_by_vars(num_reals, csv, header_info, index_info);
         prep_par_ensemble_after_read(index_info);}
 
 }
@@ -2413,9 +2705,7 @@ void ParameterEnsemble::fill_fixed(const map<string, int> &header_info, vector<s
 	
 	if (fixed_names.size() == 0)
 		return;
-	map<string, int> var_map;
-	for (int i = 0; i < var_names.size(); i++)
-		var_map[var_names[i]] = i;
+	update_var_map();
 
 	Parameters pars = pest_scenario_ptr->get_ctl_parameters();
 	int c = 0;
@@ -2442,18 +2732,8 @@ void ParameterEnsemble::save_fixed(vector<string>& fixed_names)
 		return;
 	
 	Eigen::MatrixXd fixed_reals = get_eigen(vector<string>(), fixed_names);
+	pfinfo.add_realizations(real_names, fixed_reals, fixed_names);
 	Eigen::VectorXd v;
-	for (int i = 0; i < real_names.size(); i++)
-	{
-		v = fixed_reals.row(i);
-		pfinfo.add_realization(real_names[i], v, fixed_names);
-		/*for (int j = 0; j < fixed_names.size(); j++)
-		{
-			pair<string, string> key(real_names[i], fixed_names[j]);
-			fixed_map[key] = fixed_reals(i, j);
-
-		}*/
-	}
 	// add the "base" if its not in the real names already
 	if (find(real_names.begin(), real_names.end(), BASE_REAL_NAME) == real_names.end())
 	{
@@ -2756,42 +3036,113 @@ void ParameterEnsemble::replace_col_vals_and_fixed(const vector<string>& other_v
 
 void ParameterEnsemble::to_binary(string file_name)
 {
+	if ((file_name.size() > 3) && (pest_utils::lower_cp(file_name).substr(file_name.size() - 4) == ".ens"))
+	{
+		to_binary_chunked(file_name, pest_scenario_ptr->get_pestpp_options().get_ensemble_binary_single());
+		return;
+	}
 	if (pest_scenario_ptr->get_pestpp_options().get_ies_ordered_binary())
 		return to_binary_ordered(file_name);
 	else
 		return to_binary_unordered(file_name);
 }
 
-void ParameterEnsemble::to_binary_unordered(string file_name)
+void ParameterEnsemble::to_binary_chunked(string file_name, bool single_precision)
 {
-	ofstream fout(file_name, ios::binary);
-	if (!fout.good())
-	{
-		throw runtime_error("error opening file for binary parameter ensemble:" + file_name);
-	}
-
-	vector<string> vnames = var_names;
-	//vector<string> vnames = pest_scenario_ptr->get_ctl_ordered_par_names();
-	//vnames.insert(vnames.end(), fixed_names.begin(), fixed_names.end());
+	//same content as to_binary_unordered(): control-space values for the ensemble vars followed
+	//by any fixed and tied pars not in the ensemble, streamed one column chunk at a time
 	ParameterInfo pi = pest_scenario_ptr->get_ctl_parameter_info();
 	ParameterRec::TRAN_TYPE ft = ParameterRec::TRAN_TYPE::FIXED;
 	ParameterRec::TRAN_TYPE tt = ParameterRec::TRAN_TYPE::TIED;
-
-	vector<string> f_names,t_names;
+	vector<string> f_names, t_names;
 	set<string> snames(var_names.begin(), var_names.end());
-	set<string>::iterator end = snames.end();
 	for (auto& name : pest_scenario_ptr->get_ctl_ordered_par_names())
 	{
-		if (snames.find(name) != end)
+		if (snames.find(name) != snames.end())
 			continue;
 		if (pi.get_parameter_rec_ptr(name)->tranform_type == ft)
 			f_names.push_back(name);
 		else if (pi.get_parameter_rec_ptr(name)->tranform_type == tt)
 			t_names.push_back(name);
-		else
-		{
-			//throw_ensemble_error("ParameterEnsemble::to_binary_unordered()::unsupported transform for parameter '" + name + "'");
-		}
+	}
+	vector<string> vnames = var_names;
+	vnames.insert(vnames.end(), f_names.begin(), f_names.end());
+	vnames.insert(vnames.end(), t_names.begin(), t_names.end());
+
+	Parameters ctl_pars = pest_scenario_ptr->get_ctl_parameters();
+	map<string, TranTied::pair_string_double> tied_items = par_transform.get_tied_ptr()->get_items();
+	update_var_map();
+	transStatus org_tstat = tstat;
+	transform_ip(transStatus::CTL);
+	int nvar = var_names.size(), nfixed = f_names.size();
+	int n_real = real_names.size();
+	double fvalue;
+	auto get_col = [&](int j, Eigen::VectorXd& col)
+	{
+		if (j < nvar)
+		{
+			col = reals.col(j);
+			return;
+		}
+		col.resize(n_real);
+		if (j < nvar + nfixed)
+		{
+			const string& fname = f_names[j - nvar];
+			for (int irow = 0; irow < n_real; irow++)
+				col[irow] = (pfinfo.get_fixed_value(fname, real_names[irow], fvalue)) ? fvalue : ctl_pars[fname];
+		}
+		else
+		{
+			const TranTied::pair_string_double& ti = tied_items.at(t_names[j - nvar - nfixed]);
+			pest_utils::NameIndex::const_iterator it = var_map.find(ti.first);
+			if (it != var_map.end())
+				col = reals.col(it->second) * ti.second;
+			else
+				col.setConstant(ctl_pars[ti.first] * ti.second);
+		}
+	};
+	try
+	{
+		pest_utils::save_chunked_binary(file_name, real_names, vnames, get_col, single_precision);
+	}
+	catch (...)
+	{
+		transform_ip(org_tstat);
+		throw;
+	}
+	transform_ip(org_tstat);
+}
+
+void ParameterEnsemble::to_binary_unordered(string file_name)
+{
+	ofstream fout(file_name, ios::binary);
+	if (!fout.good())
+	{
+		throw runtime_error("error opening file for binary parameter ensemble:" + file_name);
+	}
+
+	vector<string> vnames = var_names;
+	//vector<string> vnames = pest_scenario_ptr->get_ctl_ordered_par_names();
+	//vnames.insert(vnames.end(), fixed_names.begin(), fixed_names.end());
+	ParameterInfo pi = pest_scenario_ptr->get_ctl_parameter_info();
+	ParameterRec::TRAN_TYPE ft = ParameterRec::TRAN_TYPE::FIXED;
+	ParameterRec::TRAN_TYPE tt = ParameterRec::TRAN_TYPE::TIED;
+
+	vector<string> f_names,t_names;
+	set<string> snames(var_names.begin(), var_names.end());
+	set<string>::iterator end = snames.end();
+	for (auto& name : pest_scenario_ptr->get_ctl_ordered_par_names())
+	{
+		if (snames.find(name) != end)
+			continue;
+		if (pi.get_parameter_rec_ptr(name)->tranform_type == ft)
+			f_names.push_back(name);
+		else if (pi.get_parameter_rec_ptr(name)->tranform_type == tt)
+			t_names.push_back(name);
+		else
+		{
+			//throw_ensemble_error("ParameterEnsemble::to_binary_unordered()::unsupported transform for parameter '" + name + "'");
+		}
 	}
 	//this order matters!
 	vnames.insert(vnames.end(),f_names.begin(),f_names.end());
@@ -2875,7 +3226,9 @@ void ParameterEnsemble::to_binary_unordered(string file_name)
 		for (auto& tname : t_names)
 		{
 			n = irow + 1 + (jcol * n_real);
-			data = t[var_map[tied_items.at(tname).first]] * tied_items.at(tname).second;
+			const TranTied::pair_string_double& ti = tied_items.at(tname);
+			int base_idx = var_map.find_index(ti.first);
+			data = ((base_idx < 0) ? ctl_pars[ti.first] : t[base_idx]) * ti.second;
 			n = irow;
 			fout.write((char*)&(n), sizeof(n));
 			n = jcol;
@@ -3261,7 +3614,9 @@ void ParameterEnsemble::to_dense_unordered(string file_name)
 
 		for (auto& tname : t_names)
 		{
-			data = t[var_map[tied_items.at(tname).first]] * tied_items.at(tname).second;
+			const TranTied::pair_string_double& ti = tied_items.at(tname);
+			int base_idx = var_map.find_index(ti.first);
+			data = ((base_idx < 0) ? ctl_pars[ti.first] : t[base_idx]) * ti.second;
 			fout.write((char*)&(data), sizeof(data));
 			jcol++;
 		}
@@ -3425,13 +3780,12 @@ void ParameterEnsemble::to_csv_by_reals(ofstream &csv, bool write_header)
 void ParameterEnsemble::replace_fixed(string real_name,Parameters &pars)
 {
 	
-	map<string, double> rmap = pfinfo.get_real_fixed_values(real_name);
-	for (auto& r : rmap)
-	{
-		//pair<string, string> key(real_name, fname);
-		//double val = fixed_map.at(key);
-		pars.update_rec(r.first, r.second);
-	}
+	const vector<string>& fixed_names = pfinfo.get_fixed_names();
+	if (fixed_names.size() == 0)
+		return;
+	Eigen::VectorXd fixed_vals = pfinfo.get_real_fixed_vector(real_name);
+	for (int j = 0; j < fixed_names.size(); j++)
+		pars.update_rec(fixed_names[j], fixed_vals[j]);
 
 	
 
@@ -3676,43 +4030,153 @@ void ObservationEnsemble::update_from_obs(string real_name, Observations &obs)
 
 vector<int> ObservationEnsemble::update_from_runs(map<int, int>& real_run_ids, RunManagerAbstract* run_mgr_ptr)
 {
-	ParameterEnsemble run_mgr_pe(pest_scenario_ptr, rand_gen_ptr);
-	return update_from_runs(real_run_ids, run_mgr_ptr, run_mgr_pe);
+	return update_from_runs_bulk(real_run_ids, run_mgr_ptr, nullptr);
 }
 
 vector<int> ObservationEnsemble::update_from_runs(map<int, int>& real_run_ids, RunManagerAbstract* run_mgr_ptr, ParameterEnsemble& run_mgr_pe)
 {
 	//run_mgr_pe is reset here and filled with the parameter value from the run mgr - these can be used to check that the 
 	//par values from the run mgr are consistent with what par values were desired
+	return update_from_runs_bulk(real_run_ids, run_mgr_ptr, &run_mgr_pe);
+}
 
-	//update the obs ensemble in place from the run manager
-	
+vector<int> ObservationEnsemble::update_from_runs_bulk(map<int, int>& real_run_ids, RunManagerAbstract* run_mgr_ptr, ParameterEnsemble* run_mgr_pe)
+{
+	//update the obs ensemble in place from the run manager.  run storage rows are read in blocks
+	//(serially, since there is one storage stream) while the previous block is scattered into
+	//the ensemble rows by several threads using precomputed column indices
 	set<int> failed_runs = run_mgr_ptr->get_failed_run_ids();
 	vector<int> failed_real_idxs;
-	Parameters pars = pest_scenario_ptr->get_ctl_parameters();
-	Observations obs = pest_scenario_ptr->get_ctl_observations();
-	string real_name;
-	int ireal = 0;
-	run_mgr_pe = ParameterEnsemble(pest_scenario_ptr, rand_gen_ptr);
-	vector<string> var_names = pars.get_keys();
-	run_mgr_pe.reserve(real_names,var_names);
-	run_mgr_pe.set_zeros();
-	for (auto &real_run_id : real_run_ids)
+	vector<pair<int, int>> good_runs;
+	for (auto& real_run_id : real_run_ids)
 	{
+		if (real_run_id.first >= real_names.size())
+			throw_ensemble_error("ObservtionEnsemble.update_from_runs() real index out of range");
 		if (failed_runs.find(real_run_id.second) != failed_runs.end())
-		{
 			failed_real_idxs.push_back(real_run_id.first);
-			//failed_real_idxs.push_back(ireal);
+		else
+			good_runs.push_back(real_run_id);
+	}
+
+	const vector<string>& run_obs_names = run_mgr_ptr->get_obs_name_vec();
+	const vector<string>& run_par_names = run_mgr_ptr->get_par_name_vec();
+	size_t nobs_run = run_obs_names.size(), npar_run = run_par_names.size();
+	vector<int> obs_idx, par_idx;
+	vector<string> missing;
+	obs_idx = run_mgr_ptr->get_obs_name_index().get_indices(var_names, missing);
+	if (missing.size() > 0)
+		throw_ensemble_error("ObservationEnsemble.update_from_runs() the following obs names are not in the run storage: ", missing);
+
+	if (run_mgr_pe != nullptr)
+	{
+		//keep the var order of the ensemble passed in (if any) so the realizations line up
+		vector<string> pe_var_names = run_mgr_pe->get_var_names();
+		if (pe_var_names.size() == 0)
+			pe_var_names = run_par_names;
+		par_idx = run_mgr_ptr->get_par_name_index().get_indices(pe_var_names, missing);
+		if (missing.size() > 0)
+			throw_ensemble_error("ObservationEnsemble.update_from_runs() the following par names are not in the run storage: ", missing);
+		*run_mgr_pe = ParameterEnsemble(pest_scenario_ptr, rand_gen_ptr);
+		run_mgr_pe->reserve(real_names, pe_var_names);
+		run_mgr_pe->set_zeros();
+	}
+	if (good_runs.size() == 0)
+		return failed_real_idxs;
+
+	int num_threads = pest_scenario_ptr->get_pestpp_options().get_ies_num_threads();
+	if (num_threads < 1)
+		num_threads = 1;
+	//size the blocks so each of the two buffers holds about 64MB of run results
+	size_t row_size = nobs_run + ((run_mgr_pe != nullptr) ? npar_run : 0);
+	int block_size = max((size_t)num_threads, (size_t)(8 * 1024 * 1024) / max(row_size, (size_t)1));
+	block_size = min(block_size, (int)good_runs.size());
+	num_threads = min(num_threads, block_size);
+	vector<vector<double>> obs_buf(2, vector<double>(block_size * nobs_run));
+	vector<vector<double>> par_buf(2, vector<double>(block_size * npar_run));
+	vector<double> dummy_par(npar_run);
+
+	auto read_block = [&](int ibuf, int start, int count)
+	{
+		for (int k = 0; k < count; k++)
+		{
+			double* par_ptr = (run_mgr_pe != nullptr) ? &par_buf[ibuf][k * npar_run] : dummy_par.data();
+			run_mgr_ptr->get_run(good_runs[start + k].second, par_ptr, npar_run, &obs_buf[ibuf][k * nobs_run], nobs_run);
+		}
+	};
+	Eigen::MatrixXd* pe_reals = (run_mgr_pe != nullptr) ? run_mgr_pe->get_eigen_ptr_4_mod() : nullptr;
+	vector<exception_ptr> exception_ptrs(num_threads, exception_ptr());
+	auto scatter_block = [&](int tid, int ibuf, int start, int count)
+	{
+		try
+		{
+			for (int k = tid; k < count; k += num_threads)
+			{
+				int irow = good_runs[start + k].first;
+				const double* orow = &obs_buf[ibuf][k * nobs_run];
+				for (int j = 0; j < obs_idx.size(); j++)
+					reals(irow, j) = orow[obs_idx[j]];
+				if (pe_reals != nullptr)
+				{
+					const double* prow = &par_buf[ibuf][k * npar_run];
+					for (int j = 0; j < par_idx.size(); j++)
+						(*pe_reals)(irow, j) = prow[par_idx[j]];
+				}
+			}
+		}
+		catch (...)
+		{
+			exception_ptrs[tid] = current_exception();
 		}
+	};
 
-		else
+	int nruns = good_runs.size();
+	read_block(0, 0, min(block_size, nruns));
+	for (int start = 0, ibuf = 0; start < nruns; start += block_size, ibuf = 1 - ibuf)
+	{
+		int count = min(block_size, nruns - start);
+		int next_start = start + block_size;
+		exception_ptr read_eptr;
+		thread reader;
+		if (next_start < nruns)
+		{
+			reader = thread([&, ibuf, next_start]()
+			{
+				try
+				{
+					read_block(1 - ibuf, next_start, min(block_size, nruns - next_start));
+				}
+				catch (...)
+				{
+					read_eptr = current_exception();
+				}
+			});
+		}
+		vector<thread> threads;
+		for (int i = 1; i < num_threads; i++)
+			threads.push_back(thread(scatter_block, i, ibuf, start, count));
+		scatter_block(0, ibuf, start, count);
+		for (auto& t : threads)
+			t.join();
+		if (reader.joinable())
+			reader.join();
+		for (auto& eptr : exception_ptrs)
+		{
+			if (eptr)
+				rethrow_exception(eptr);
+		}
+		if (read_eptr)
+			rethrow_exception(read_eptr);
+	}
+	if (run_mgr_pe != nullptr)
+	{
+		//run storage holds model-space values - undo scale and offset so run_mgr_pe is in ctl space
+		const ParameterInfo& pi = pest_scenario_ptr->get_ctl_parameter_info();
+		vector<string> pe_var_names = run_mgr_pe->get_var_names();
+		for (int j = 0; j < pe_var_names.size(); j++)
 		{
-			run_mgr_ptr->get_run(real_run_id.second, pars, obs);
-			//real_name = real_names[real_run_id.first];
-			update_from_obs(real_run_id.first, obs);
-			Eigen::VectorXd real = pars.get_data_eigen_vec(var_names);
-			run_mgr_pe.update_real_ip(real_names[real_run_id.first], real);
-			//update_from_obs(ireal, obs);
+			const ParameterRec* prec = pi.get_parameter_rec_ptr(pe_var_names[j]);
+			if ((prec->scale != 1.0) || (prec->offset != 0.0))
+				pe_reals->col(j) = (pe_reals->col(j).array() - prec->offset) / prec->scale;
 		}
 	}
 	return failed_real_idxs;
@@ -3738,7 +4202,7 @@ void ObservationEnsemble::from_binary(string file_name)
 	if (var_names.size() < names.size())
 	{
 		update_var_map();
-		map<string, int>::iterator end = var_map.end();
+		pest_utils::NameIndex::const_iterator end = var_map.end();
 		Eigen::MatrixXd full(reals.rows(), names.size());
 		full.setZero();
 		string name;
@@ -3788,9 +4252,15 @@ void ObservationEnsemble::from_csv(string file_name)
 	getline(csv, line);
 	//Ensemble::read_csv(num_reals, csv,header_info,index_info);
 	if (csv_by_reals)
-		Ensemble::read_csv_by_reals(num_reals, csv, header_info, index_info);
+	{
+		if (!read_csv_mapped(file_name, num_reals, header_info, true))
+			Ensemble::read_csv_by_reals(num_reals, csv, header_info, index_info);
+	}
 	else
-		Ensemble::read_csv_by_vars(num_reals, csv, header_info, index_info);
+	{
+		if (!read_csv_mapped(file_name, num_reals, header_info, false))
+			Ensemble::read_csv_by_vars(num_reals, csv, header_info, index_info);
+	}
 }
 
 void ObservationEnsemble::from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names)
@@ -3808,240 +4278,365 @@ void ObservationEnsemble::from_eigen_mat(Eigen::MatrixXd mat, const vector<strin
 	Ensemble::from_eigen_mat(mat, _real_names, _var_names);
 }
 
-DrawThread::DrawThread(PerformanceLog * _performance_log, Covariance & _cov,
-	Eigen::MatrixXd *_draws_ptr, vector<string> &_group_keys, const map<string, vector<string>> &_grouper) : cov(_cov),
-	group_keys(_group_keys), grouper(_grouper)
+EnsembleView::EnsembleView(const Eigen::MatrixXd* _parent, vector<int> _row_idxs, vector<int> _col_idxs) :
+	parent(_parent), row_idxs(std::move(_row_idxs)), col_idxs(std::move(_col_idxs))
 {
-	//idx_map = _idx_map;
-	//std_map = _std_map;
-	//std_map = _std_map;
-	performance_log = _performance_log;
-	draws_ptr = _draws_ptr;
+	//flag the common "all rows in order" case so columns can be block copied
+	all_rows = (row_idxs.size() == parent->rows());
+	for (int i = 0; all_rows && (i < row_idxs.size()); i++)
+		all_rows = (row_idxs[i] == i);
 }
 
+Eigen::MatrixXd EnsembleView::eval() const
+{
+	Eigen::MatrixXd mat(rows(), cols());
+	for (int j = 0; j < col_idxs.size(); j++)
+	{
+		if (all_rows)
+			mat.col(j) = parent->col(col_idxs[j]);
+		else
+			for (int i = 0; i < row_idxs.size(); i++)
+				mat(i, j) = (*parent)(row_idxs[i], col_idxs[j]);
+	}
+	return mat;
+}
 
-void DrawThread::work(int thread_id, int num_reals, int ies_verbose, map<string, int> idx_map, map<string,double> std_map)
+Eigen::VectorXd EnsembleView::get_col_vector(int j) const
 {
-	stringstream ss;
+	if (all_rows)
+		return parent->col(col_idxs[j]);
+	Eigen::VectorXd vec(rows());
+	for (int i = 0; i < row_idxs.size(); i++)
+		vec[i] = (*parent)(row_idxs[i], col_idxs[j]);
+	return vec;
+}
 
-	unique_lock<mutex> cov_guard(cov_lock,defer_lock);
-	unique_lock<mutex> draw_guard(draw_lock,defer_lock);
-	//unique_lock<mutex> grouper_guard(grouper_lock,defer_lock);
-	unique_lock<mutex> pfm_guard(pfm_lock,defer_lock);
-	unique_lock<mutex> key_guard(key_lock, defer_lock);
-	int count = 0;
-	string group;
-	vector<string> names;
-	Covariance gcov;
-	vector<int> idx;
-	Eigen::MatrixXd block, proj;
-	RedSVD::RedSymEigen<Eigen::SparseMatrix<double>> eig;
-	while (true)
+Eigen::RowVectorXd EnsembleView::get_center(int center_row, bool median) const
+{
+	Eigen::RowVectorXd center(cols());
+	if (center_row >= 0)
 	{
-		//get the key for more work, or return if all work done
-		while (true)
+		for (int j = 0; j < col_idxs.size(); j++)
+			center[j] = (*this)(center_row, j);
+	}
+	else if (median)
+	{
+		//cheap median approx - doesnt deal with mean of the two middle elements if even
+		int half_size = rows() / 2;
+		bool even = rows() % 2 == 0;
+		vector<double> d(rows());
+		vector<double>::iterator half, half_minus_one;
+		double half_val;
+		for (int j = 0; j < col_idxs.size(); j++)
 		{
-			if (key_guard.try_lock())
-			{
-				if (group_keys.size() == 0)
-				{
-					ss.str("");
-					ss << "draw thread: " << thread_id << " processed " << count << " groups";
-					if (ies_verbose > 1)
-					{
-						cout << ss.str() << endl;
-
-					}
-					while (true)
-					{
-						if (pfm_guard.try_lock())
-						{
-							performance_log->log_event(ss.str());
-							pfm_guard.unlock();
-							break;
-						}
-					}
-					key_guard.unlock();
-					return;
-				}
-			}
-			group = group_keys[group_keys.size() - 1];
-			group_keys.pop_back();
-			names = grouper[group];
-			if (names.size() == 0)
+			for (int i = 0; i < row_idxs.size(); i++)
+				d[i] = (*parent)(row_idxs[i], col_idxs[j]);
+			half = d.begin() + half_size;
+			half_minus_one = half - 1;
+			nth_element(d.begin(), half, d.end());
+			half_val = *half;
+			if (even)
 			{
-				ss.str("");
-				ss << "no entries for grouper key:" << group;
-				while (true)
-				{
-					if (pfm_guard.try_lock())
-					{
-						performance_log->log_event(ss.str());
-						pfm_guard.unlock();
-						break;
-					}
-				}
-				key_guard.unlock();
-				continue;
+				nth_element(d.begin(), half_minus_one, d.end());
+				center[j] = (half_val + *half_minus_one) / 2.0;
 			}
-			key_guard.unlock();
-			break;
+			else
+				center[j] = half_val;
 		}
-		
-		if (ies_verbose > 1)
+	}
+	else
+	{
+		for (int j = 0; j < col_idxs.size(); j++)
 		{
-			ss.str("");
-			ss << "...processing " << group << " with " <<names.size() << " elements" << endl;
-			cout << ss.str();
-			while (true)
+			if (all_rows)
+				center[j] = parent->col(col_idxs[j]).mean();
+			else
 			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
+				double sum = 0.0;
+				for (int i = 0; i < row_idxs.size(); i++)
+					sum += (*parent)(row_idxs[i], col_idxs[j]);
+				center[j] = sum / rows();
 			}
 		}
+	}
+	return center;
+}
 
-		//if there is only one par in the group
-		if (names.size() == 1)
-		{
-			ss.str("");
-			ss << "thread: " << thread_id << " - only one element in group " <<group << ", scaling by std";
-			while (true)
-			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
-			}
-			int j = idx_map[names[0]];
-			while (true)
-			{
-				if (draw_guard.try_lock())
-				{
-					draws_ptr->col(j) *= std_map[names[0]];
-					draw_guard.unlock();
-					break;
-				}
-			}
-			
-			continue;
-		}
+Eigen::MatrixXd EnsembleView::get_anomalies(const Eigen::RowVectorXd& center) const
+{
+	//one pass over the parent - the subset itself is never materialized
+	Eigen::MatrixXd mat(rows(), cols());
+	for (int j = 0; j < col_idxs.size(); j++)
+	{
+		if (all_rows)
+			mat.col(j) = parent->col(col_idxs[j]).array() - center[j];
+		else
+			for (int i = 0; i < row_idxs.size(); i++)
+				mat(i, j) = (*parent)(row_idxs[i], col_idxs[j]) - center[j];
+	}
+	return mat;
+}
 
-		//get a sub cov
-		while (true)
-		{
-			if (cov_guard.try_lock())
-			{
-				gcov = cov.get(names);
-				cov_guard.unlock();
-				break;
-			}
-		}
-		
-		if (ies_verbose > 2)
-		{
-			gcov.to_ascii(group + "_cov.dat");
-		}
+AsyncEnsembleWriter::~AsyncEnsembleWriter()
+{
+	if (write_thread.joinable())
+		write_thread.join();
+}
 
-		idx.clear();
-		for (auto n : names)
-			idx.push_back(idx_map[n]);
+bool AsyncEnsembleWriter::is_csv(const string& file_name)
+{
+	return (file_name.size() > 3) && (pest_utils::lower_cp(file_name).substr(file_name.size() - 4) == ".csv");
+}
 
-		if (idx.size() != idx[idx.size() - 1] - idx[0] + 1)
+void AsyncEnsembleWriter::save(const ParameterEnsemble& _pe, const vector<string>& file_names)
+{
+	//one copy per save() call, written to each of file_names.  the scenario (ctl ordering, par info and
+	//options the writers read) is copied too since the caller keeps changing it while the write runs
+	shared_ptr<Pest> scenario = make_shared<Pest>(*_pe.get_pest_scenario_ptr());
+	shared_ptr<ParameterEnsemble> snap = make_shared<ParameterEnsemble>(_pe);
+	snap->Ensemble::set_pest_scenario_ptr(scenario.get());
+	jobs.push_back([scenario, snap, file_names]()
+	{
+		for (auto& file_name : file_names)
 		{
-			ss.str("");
-			ss << "thread: " << thread_id << " - DrawThread error: idx out of order for group: " << group;
-			while (true)
-			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
-			}
-			throw runtime_error(ss.str());
+			if (is_csv(file_name))
+				snap->to_csv(file_name);
+			else
+				snap->to_binary(file_name);
 		}
+	});
+}
 
-
-		double fac = gcov.e_ptr()->diagonal().minCoeff();
-		ss.str("");
-		ss << "thread: " << thread_id <<  " - min variance for group " << group << ": " << fac;
-		while (true)
+void AsyncEnsembleWriter::save(const ObservationEnsemble& _oe, const vector<string>& file_names)
+{
+	shared_ptr<Pest> scenario = make_shared<Pest>(*_oe.get_pest_scenario_ptr());
+	shared_ptr<ObservationEnsemble> snap = make_shared<ObservationEnsemble>(_oe);
+	snap->set_pest_scenario_ptr(scenario.get());
+	jobs.push_back([scenario, snap, file_names]()
+	{
+		for (auto& file_name : file_names)
 		{
-			if (pfm_guard.try_lock())
-			{
-				performance_log->log_event(ss.str());
-				pfm_guard.unlock();
-				break;
-			}
+			if (is_csv(file_name))
+				snap->to_csv(file_name);
+			else
+				snap->to_binary(file_name);
 		}
-		/*while (true)
+	});
+}
+
+void AsyncEnsembleWriter::dispatch()
+{
+	flush();
+	if (jobs.size() == 0)
+		return;
+	vector<function<void()>> batch;
+	batch.swap(jobs);
+	write_exception = nullptr;
+	write_thread = thread([this, batch]()
+	{
+		try
 		{
-			if (draw_guard.try_lock())
-			{
-				block = draws_ptr->block(0, idx[0], num_reals, idx.size());
-				draw_guard.unlock();
-				break;
-			}
-		}*/
-		
-		ss.str("");
-		ss << "thread: " << thread_id <<  " - Randomized Eigen decomposition of full cov for " << names.size() << " element matrix" << endl;
-		while (true)
+			for (auto& job : batch)
+				job();
+		}
+		catch (...)
 		{
-			if (pfm_guard.try_lock())
-			{
-				performance_log->log_event(ss.str());
-				pfm_guard.unlock();
-				break;
-			}
+			write_exception = current_exception();
 		}
-		eig.compute(*gcov.e_ptr() * (1.0 / fac), names.size());
-		//RedSVD::RedSVD<Eigen::SparseMatrix<double>> svd;
-		//svd.compute(*gcov.e_ptr(),gcov.get_col_names().size());// , gi.second.size());
-		//cout << svd.singularValues() << endl;
-		//Eigen::JacobiSVD<Eigen::MatrixXd> svd(gcov.e_ptr()->toDense(), Eigen::ComputeFullU);
-		//svd.computeU();
+	});
+}
+
+void AsyncEnsembleWriter::flush()
+{
+	if (write_thread.joinable())
+		write_thread.join();
+	if (write_exception)
+	{
+		exception_ptr eptr = write_exception;
+		write_exception = nullptr;
+		rethrow_exception(eptr);
+	}
+}
 
-		proj = (eig.eigenvectors() * (fac *eig.eigenvalues()).cwiseSqrt().asDiagonal());
-		//proj = (svd.matrixU() * svd.singularValues().asDiagonal());
+EnsembleBlockCache::EnsembleBlockCache(const string& _filename, double cache_mb, bool _remove_file) :
+	filename(_filename), remove_file(_remove_file), hits(0), misses(0)
+{
+	ifstream in(filename.c_str(), ifstream::binary);
+	if (!in.good())
+		throw runtime_error("EnsembleBlockCache error opening file " + filename + " for reading");
+	header = pest_utils::read_chunked_binary_header(in, filename);
+	in.close();
+	col_index = pest_utils::NameIndex(header.col_names);
+	double block_mb = (double)header.nrow * header.chunk_cols * sizeof(double) / 1.0e+6;
+	max_blocks = max(1, (int)(cache_mb / max(block_mb, 1.0e-6)));
+}
 
-		if (ies_verbose > 2)
+EnsembleBlockCache::~EnsembleBlockCache()
+{
+	if (remove_file)
+		remove(filename.c_str());
+}
+
+EnsembleBlockCache::BlockPtr EnsembleBlockCache::get_block(int64_t block)
+{
+	unique_lock<mutex> guard(cache_lock);
+	while (true)
+	{
+		auto it = blocks.find(block);
+		if (it != blocks.end())
 		{
-			ofstream f(group + "_evec.dat");
-			f << eig.eigenvectors() << endl;
-			//f << svd.matrixU() << endl;
-			f.close();
-			ofstream ff(group + "_sqrt_evals.dat");
-			ff << (fac * eig.eigenvalues()).cwiseSqrt() << endl;
-			//ff << svd.singularValues() << endl;
-			ff.close();
-			ofstream fff(group + "_proj.dat");
-			fff << proj << endl;
-			fff.close();
+			hits++;
+			lru.splice(lru.begin(), lru, it->second.first);
+			return it->second.second;
 		}
-		//cout << "block " << block.rows() << " , " << block.cols() << endl;
-		//cout << " proj " << proj.rows() << " , " << proj.cols() << endl;
-		while (true)
+		if (loading.find(block) == loading.end())
+			break;
+		//another thread is already reading this block
+		block_loaded.wait(guard);
+	}
+	misses++;
+	loading.insert(block);
+	guard.unlock();
+
+	//each read uses its own stream so that reads by different threads can overlap
+	shared_ptr<Eigen::MatrixXd> values = make_shared<Eigen::MatrixXd>();
+	try
+	{
+		ifstream in(filename.c_str(), ifstream::binary);
+		if (!in.good())
+			throw runtime_error("EnsembleBlockCache error opening file " + filename + " for reading");
+		pest_utils::read_chunked_binary_block(in, header, block, *values);
+	}
+	catch (...)
+	{
+		guard.lock();
+		loading.erase(block);
+		guard.unlock();
+		block_loaded.notify_all();
+		throw;
+	}
+
+	guard.lock();
+	loading.erase(block);
+	//evict least recently used blocks - shared pointers keep any block still in use alive
+	while (blocks.size() >= max_blocks)
+	{
+		blocks.erase(lru.back());
+		lru.pop_back();
+	}
+	lru.push_front(block);
+	blocks[block] = make_pair(lru.begin(), BlockPtr(values));
+	guard.unlock();
+	block_loaded.notify_all();
+	return values;
+}
+
+Eigen::MatrixXd EnsembleBlockCache::get_cols(const vector<string>& names)
+{
+	vector<string> missing;
+	vector<int> idxs = col_index.get_indices(names, missing);
+	if (missing.size() > 0)
+		throw runtime_error("EnsembleBlockCache::get_cols() error: " + to_string(missing.size()) + " names not found in " + filename + ", first: " + missing[0]);
+	return get_cols(idxs);
+}
+
+Eigen::MatrixXd EnsembleBlockCache::get_cols(const vector<int>& idxs)
+{
+	Eigen::MatrixXd mat(header.nrow, idxs.size());
+	int64_t cur_block = -1;
+	BlockPtr block;
+	for (int j = 0; j < idxs.size(); j++)
+	{
+		if ((idxs[j] < 0) || (idxs[j] >= header.ncol))
+			throw runtime_error("EnsembleBlockCache::get_cols() error: col index out of range: " + to_string(idxs[j]));
+		int64_t b = idxs[j] / header.chunk_cols;
+		if (b != cur_block)
 		{
-			if (draw_guard.try_lock())
-			{
-				block = draws_ptr->block(0, idx[0], num_reals, idx.size());
-				draws_ptr->block(0, idx[0], num_reals, idx.size()) = (proj * block.transpose()).transpose();
-				draw_guard.unlock();
-				break;
-			}
+			block = get_block(b);
+			cur_block = b;
 		}
-		
+		mat.col(j) = block->col(idxs[j] - b * header.chunk_cols);
+	}
+	return mat;
+}
 
+DrawThread::DrawThread(PerformanceLog * _performance_log, Covariance & _cov,
+	Eigen::MatrixXd *_draws_ptr, const vector<string> &_group_keys, const vector<int> &_group_starts,
+	const vector<int> &_group_sizes) : cov(_cov), group_keys(_group_keys), group_starts(_group_starts),
+	group_sizes(_group_sizes)
+{
+	performance_log = _performance_log;
+	draws_ptr = _draws_ptr;
+}
+
+void DrawThread::log_event(const string& message)
+{
+	lock_guard<mutex> pfm_guard(pfm_lock);
+	performance_log->log_event(message);
+}
+
+void DrawThread::draw_group(int thread_id, int igroup, int ies_verbose)
+{
+	stringstream ss;
+	int num_reals = draws_ptr->rows();
+	//project the draws in row chunks so the temporary is never a full group-sized copy
+	int chunk_rows = min(num_reals, 256);
+	Eigen::MatrixXd proj, chunk;
+	Eigen::SparseMatrix<double> gcov;
+	RedSVD::RedSymEigen<Eigen::SparseMatrix<double>> eig;
+	const string& group = group_keys[igroup];
+	int start = group_starts[igroup];
+	int size = group_sizes[igroup];
+
+	if (ies_verbose > 1)
+	{
+		ss.str("");
+		ss << "...processing " << group << " with " << size << " elements" << endl;
+		cout << ss.str();
+		log_event(ss.str());
+	}
+
+	//the group's diagonal block of the aligned cov - no name lookups or full-matrix copies
+	gcov = cov.e_ptr()->block(start, start, size, size);
+	if (ies_verbose > 2)
+	{
+		vector<string> cov_names = cov.get_col_names();
+		vector<string> names(cov_names.begin() + start, cov_names.begin() + start + size);
+		Covariance(names, gcov).to_ascii(group + "_cov.dat");
 	}
 
+	double fac = gcov.diagonal().minCoeff();
+	ss.str("");
+	ss << "thread: " << thread_id <<  " - min variance for group " << group << ": " << fac;
+	log_event(ss.str());
+
+	ss.str("");
+	ss << "thread: " << thread_id <<  " - Randomized Eigen decomposition of full cov for " << size << " element matrix" << endl;
+	log_event(ss.str());
+	gcov *= (1.0 / fac);
+	eig.compute(gcov, size);
+	gcov.resize(0, 0);
+	proj = (eig.eigenvectors() * (fac *eig.eigenvalues()).cwiseSqrt().asDiagonal());
+
+	if (ies_verbose > 2)
+	{
+		ofstream f(group + "_evec.dat");
+		f << eig.eigenvectors() << endl;
+		f.close();
+		ofstream ff(group + "_sqrt_evals.dat");
+		ff << (fac * eig.eigenvalues()).cwiseSqrt() << endl;
+		ff.close();
+		ofstream fff(group + "_proj.dat");
+		fff << proj << endl;
+		fff.close();
+	}
+	//groups own disjoint column ranges, so the in-place projection needs no lock
+	for (int istart = 0; istart < num_reals; istart += chunk_rows)
+	{
+		int nrows = min(chunk_rows, num_reals - istart);
+		chunk.noalias() = draws_ptr->block(istart, start, nrows, size) * proj.transpose();
+		draws_ptr->block(istart, start, nrows, size) = chunk;
+	}
 }
 
 FixedParInfo::FixedParInfo(vector<string> _fixed_names)
@@ -4051,25 +4646,57 @@ FixedParInfo::FixedParInfo(vector<string> _fixed_names)
 	initialize();
 }
 
+int FixedParInfo::find_real_row(const string& rname)
+{
+	unordered_map<string, int>::const_iterator it = real_index.find(rname);
+	if (it == real_index.end())
+		return -1;
+	return it->second;
+}
+
+vector<int> FixedParInfo::get_real_rows(const vector<string>& rnames)
+{
+	//row indices for rnames - any new realizations are appended (unset) with a single resize
+	vector<int> rows;
+	rows.reserve(rnames.size());
+	int nrows = real_names.size();
+	for (auto& rname : rnames)
+	{
+		int row = find_real_row(rname);
+		if (row == -1)
+		{
+			row = real_names.size();
+			real_index[rname] = row;
+			real_names.push_back(rname);
+		}
+		rows.push_back(row);
+	}
+	if (real_names.size() > nrows)
+	{
+		values.conservativeResize(real_names.size(), fixed_names.size());
+		values.bottomRows(real_names.size() - nrows).setConstant(numeric_limits<double>::quiet_NaN());
+	}
+	return rows;
+}
+
 bool FixedParInfo::get_fixed_value(const string& pname, const string& rname, double& value)
 {
 	if (fixed_names.size() == 0)
 	{
-		//throw runtime_error("FixedParInfo::get_fixed_value(): fixed_names is empty");
 		return false;
 	}
-	if (fixed_info.find(pname) == fixed_info.end())
+	int col = par_index.find_index(pname);
+	if (col == -1)
 	{
-		//throw runtime_error("FixedParInfo::get_real_fixed_value(): pname '" + pname + "' not in fixed_info");
 		return false;
 	}
-	if (fixed_info.at(pname).find(rname) == fixed_info.at(pname).end())
+	int row = find_real_row(rname);
+	if ((row == -1) || (isnan(values(row, col))))
 	{
-		//throw runtime_error("FixedParInfo::get_real_fixed_value(): rname '" + rname + "' not in fixed_info");
 		return false;
 	}
 
-	value = fixed_info.at(pname).at(rname);
+	value = values(row, col);
 	return true;
 }
 
@@ -4083,12 +4710,16 @@ map<string, double> FixedParInfo::get_par_fixed_values(const string& pname)
 	{
 		return map<string, double>();
 	}
-	if (fixed_info.find(pname) == fixed_info.end())
+	int col = par_index.find_index(pname);
+	if (col == -1)
 	{
 		throw runtime_error("FixedParInfo::get_par_fixed_values(): pname '"+pname+"' not in fixed_info");
 	}
-
-	return fixed_info.at(pname);
+	map<string, double> pmap;
+	for (int i = 0; i < real_names.size(); i++)
+		if (!isnan(values(i, col)))
+			pmap[real_names[i]] = values(i, col);
+	return pmap;
 }
 
 vector<double> FixedParInfo::get_real_fixed_values(const string& rname, vector<string>& pnames)
@@ -4101,15 +4732,17 @@ vector<double> FixedParInfo::get_real_fixed_values(const string& rname, vector<s
 	{
 		return vector<double>();
 	}
+	int row = find_real_row(rname);
 	vector<double> real_vals(pnames.size());
 	int c = 0;
 	for (auto& name : pnames)
 	{
-		if (fixed_info.find(name) == fixed_info.end())
+		int col = par_index.find_index(name);
+		if (col == -1)
 			throw runtime_error("FixedParInfo::get_real_fixed_values(): pname '" + name +"' not in fixed_info");
-		if (fixed_info.at(name).find(rname) == fixed_info.at(name).end())
+		if ((row == -1) || (isnan(values(row, col))))
 			throw runtime_error("FixedParInfo::get_real_fixed_values(): rname '" + rname + "' not in fixed_info");
-		real_vals[c] = fixed_info.at(name).at(rname);
+		real_vals[c] = values(row, col);
 		c++;
 	}
 	return real_vals;
@@ -4117,27 +4750,48 @@ vector<double> FixedParInfo::get_real_fixed_values(const string& rname, vector<s
 
 map<string, double> FixedParInfo::get_real_fixed_values(const string& rname)
 {
+	if (fixed_names.size() == 0)
+	{
+		if (!initialized)
+			throw runtime_error("FixedParInfo::get_real_fixed_values(): not initialized");
+		return map<string, double>();
+	}
+	Eigen::VectorXd vals = get_real_fixed_vector(rname);
+	map<string, double> rmap;
+	for (int j = 0; j < fixed_names.size(); j++)
+		rmap[fixed_names[j]] = vals[j];
+	return rmap;
+}
+
+Eigen::VectorXd FixedParInfo::get_real_fixed_vector(const string& rname)
+{
+	//all fixed values for a realization, in fixed_names order
 	if (!initialized)
 	{
 		throw runtime_error("FixedParInfo::get_real_fixed_values(): not initialized");
 	}
 	if (fixed_names.size() == 0)
 	{
-		return map<string, double>();
+		return Eigen::VectorXd();
 	}
-	map<string, double> rmap;
-	for (auto& fi : fixed_info)
+	int row = find_real_row(rname);
+	if ((row == -1) || (values.row(row).hasNaN()))
 	{
-		if (fi.second.find(rname) == fi.second.end())
-		{
-			throw runtime_error("FixedParInfo::get_real_fixed_values(): rname '" + rname + "' not in fixed_info");
-		}
-		rmap[fi.first] = fi.second.at(rname);
+		throw runtime_error("FixedParInfo::get_real_fixed_values(): rname '" + rname + "' not in fixed_info");
 	}
-	return rmap;
+	return values.row(row).transpose();
 }
 
 void FixedParInfo::add_realization(string rname, Eigen::VectorXd& rvals, vector<string>& pnames)
+{
+	if (rvals.size() != pnames.size())
+	{
+		throw runtime_error("FixedParInfo::add_realization(): rvals.size() != pnames.size()");
+	}
+	add_realizations(vector<string>{rname}, rvals.transpose(), pnames);
+}
+
+void FixedParInfo::add_realizations(const vector<string>& rnames, const Eigen::MatrixXd& rvals, const vector<string>& pnames)
 {
 	if (!initialized)
 	{
@@ -4147,19 +4801,24 @@ void FixedParInfo::add_realization(string rname, Eigen::VectorXd& rvals, vector<
 	{
 		return;
 	}
-	if (rvals.size() != pnames.size())
+	if ((rvals.rows() != rnames.size()) || (rvals.cols() != pnames.size()))
 	{
-		throw runtime_error("FixedParInfo::add_realization(): rvals.size() != pnames.size()");
+		throw runtime_error("FixedParInfo::add_realization(): rvals shape does not match rnames and pnames");
 	}
-	map<string, double> v;
-	for (int i = 0; i < rvals.size(); i++)
-		v[pnames[i]] = rvals[i];
+	//the column of rvals that holds each fixed par
+	pest_utils::NameIndex pindex(pnames);
+	vector<int> src_cols;
 	for (auto& name : fixed_names)
 	{
-		if (v.find(name) == v.end())
+		int j = pindex.find_index(name);
+		if (j == -1)
 			throw runtime_error("FixedParInfo::add_realization(): fixed name '" + name + "' not in pnames");
-		fixed_info.at(name)[rname] = v.at(name);
+		src_cols.push_back(j);
 	}
+	vector<int> rows = get_real_rows(rnames);
+	for (int j = 0; j < src_cols.size(); j++)
+		for (int i = 0; i < rows.size(); i++)
+			values(rows[i], j) = rvals(i, src_cols[j]);
 }
 
 void FixedParInfo::keep_realizations(const vector<string>& keep)
@@ -4175,26 +4834,26 @@ void FixedParInfo::keep_realizations(const vector<string>& keep)
 
 	set<string> skeep(keep.begin(), keep.end());
 	set<string>::iterator end = skeep.end();
-	set<string> sdrop;
-	map<string, double> rmap = fixed_info.at(fixed_names[0]);
-	for (auto& r : rmap)
-		if (skeep.find(r.first) == end)
-			sdrop.emplace(r.first);
-	end = sdrop.end();
-	for (auto& fi : fixed_info)
-	{
-		for (auto it = fi.second.begin(); it != fi.second.end();)
+	vector<int> keep_rows;
+	vector<string> keep_names;
+	for (int i = 0; i < real_names.size(); i++)
+	{
+		if (skeep.find(real_names[i]) != end)
 		{
-			if (sdrop.find(it->first) != end)
-			{
-				fi.second.erase(it++);
-			}
-			else
-			{
-				++it;
-			}
+			keep_rows.push_back(i);
+			keep_names.push_back(real_names[i]);
 		}
 	}
+	if (keep_rows.size() == real_names.size())
+		return;
+	Eigen::MatrixXd kept(keep_rows.size(), values.cols());
+	for (int i = 0; i < keep_rows.size(); i++)
+		kept.row(i) = values.row(keep_rows[i]);
+	values = kept;
+	real_names = keep_names;
+	real_index.clear();
+	for (int i = 0; i < real_names.size(); i++)
+		real_index[real_names[i]] = i;
 }
 
 void FixedParInfo::update_realizations(const vector<string>& other_var_names, const vector<string>& other_real_names, const Eigen::MatrixXd& other_mat)
@@ -4207,13 +4866,17 @@ void FixedParInfo::update_realizations(const vector<string>& other_var_names, co
 	{
 		return;
 	}
+	vector<int> rows;
 	for (int j = 0; j < other_var_names.size(); j++)
 	{
-		if (fixed_info.find(other_var_names[j]) == fixed_info.end())
+		int col = par_index.find_index(other_var_names[j]);
+		if (col == -1)
 			continue;
-		for (int i = 0; i < other_real_names.size(); i++)
+		if (rows.size() == 0)
+			rows = get_real_rows(other_real_names);
+		for (int i = 0; i < rows.size(); i++)
 		{
-			fixed_info.at(other_var_names[j])[other_real_names[i]] = other_mat(i, j);
+			values(rows[i], col) = other_mat(i, j);
 		}
 	}
 }
@@ -4222,14 +4885,13 @@ void FixedParInfo::update_par_values(const map<string, double>& pval_map)
 {
 	for (auto& p : pval_map)
 	{
-		if (fixed_info.find(p.first) != fixed_info.end())
-		{
-			for (auto& pm : fixed_info.at(p.first))
-			{
-				pm.second = p.second;
-			}
-
-		}
+		int col = par_index.find_index(p.first);
+		if (col == -1)
+			continue;
+		//only realizations that already have a value for this par
+		for (int i = 0; i < values.rows(); i++)
+			if (!isnan(values(i, col)))
+				values(i, col) = p.second;
 	}
 }
 
@@ -4243,28 +4905,30 @@ void FixedParInfo::fill_fixed(map<string, double>& fixed_map, vector<string>& rn
 	{
 		return;
 	}
-	for (auto& pname : fixed_names)
-	{
-		double fval = fixed_map.at(pname);
-		for (auto& rname : rnames)
-			fixed_info.at(pname)[rname] = fval;
-	}
+	Eigen::RowVectorXd fvals(fixed_names.size());
+	for (int j = 0; j < fixed_names.size(); j++)
+		fvals[j] = fixed_map.at(fixed_names[j]);
+	vector<int> rows = get_real_rows(rnames);
+	for (auto row : rows)
+		values.row(row) = fvals;
 
 }
 
-
+void FixedParInfo::clear()
+{
+	fixed_names.clear();
+	par_index = pest_utils::NameIndex();
+	real_names.clear();
+	real_index.clear();
+	values.resize(0, 0);
+}
 
 void FixedParInfo::initialize()
 {
-	fixed_info.clear();
-	/*if (fixed_names.size() == 0)
-	{
-		throw runtime_error("FixedParInfo::initialize: fixed_names is empty");
-	}*/
-	for (auto& name : fixed_names)
-	{
-		fixed_info[name] = map<string, double>();
-	}
+	par_index = pest_utils::NameIndex(fixed_names);
+	real_names.clear();
+	real_index.clear();
+	values.resize(0, fixed_names.size());
 	initialized = true;
 	
 }
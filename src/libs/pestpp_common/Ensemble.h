@@ -6,6 +6,12 @@
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include <mutex>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <list>
+#include <unordered_set>
+#include <condition_variable>
 #include "FileManager.h"
 #include "ObjectiveFunc.h"
 #include "OutputFileWriter.h"
@@ -19,6 +25,45 @@
 const string BASE_REAL_NAME = "BASE";
 const string MEDIAN_CENTER_ON_NAME = "_MEDIAN_";
 
+//eigen nullary functor that maps (row,col) through index arrays into a parent matrix
+class EnsembleIndexFunctor
+{
+public:
+	EnsembleIndexFunctor(const Eigen::MatrixXd* _parent, const vector<int>* _row_idxs, const vector<int>* _col_idxs) :
+		parent(_parent), row_idxs(_row_idxs), col_idxs(_col_idxs) { ; }
+	const double& operator()(Eigen::Index row, Eigen::Index col) const { return (*parent)((*row_idxs)[row], (*col_idxs)[col]); }
+private:
+	const Eigen::MatrixXd* parent;
+	const vector<int>* row_idxs;
+	const vector<int>* col_idxs;
+};
+
+//non-owning view of a row/column subset of an ensemble.  only the index arrays are
+//stored - expr() can be used directly in eigen expressions without copying the subset.
+//the view (and any expression made from it) is invalidated if the parent matrix is resized
+//or reassigned, and the view must outlive any expression made from it
+class EnsembleView
+{
+public:
+	typedef Eigen::CwiseNullaryOp<EnsembleIndexFunctor, Eigen::MatrixXd> Expr;
+	EnsembleView(const Eigen::MatrixXd* _parent, vector<int> _row_idxs, vector<int> _col_idxs);
+	Expr expr() const { return Eigen::MatrixXd::NullaryExpr(rows(), cols(), EnsembleIndexFunctor(parent, &row_idxs, &col_idxs)); }
+	Eigen::Index rows() const { return row_idxs.size(); }
+	Eigen::Index cols() const { return col_idxs.size(); }
+	double operator()(int i, int j) const { return (*parent)(row_idxs[i], col_idxs[j]); }
+	const vector<int>& get_row_idxs() const { return row_idxs; }
+	const vector<int>& get_col_idxs() const { return col_idxs; }
+	Eigen::MatrixXd eval() const;
+	Eigen::VectorXd get_col_vector(int j) const;
+	Eigen::RowVectorXd get_center(int center_row=-1, bool median=false) const;
+	Eigen::MatrixXd get_anomalies(const Eigen::RowVectorXd& center) const;
+private:
+	const Eigen::MatrixXd* parent;
+	vector<int> row_idxs;
+	vector<int> col_idxs;
+	bool all_rows;
+};
+
 class Ensemble
 {
 public:
@@ -36,12 +81,13 @@ public:
 	void to_csv_by_vars(ofstream& csv, bool write_header = true);
 	void to_binary_old(string file_name, bool transposed=false);
 	void to_binary(string file_name, bool transposed=false);
+	void to_binary_chunked(string file_name, bool single_precision=false);
 	void from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names);
 	pair<int, int> shape() { return pair<int, int>(reals.rows(), reals.cols()); }
 	void throw_ensemble_error(string message);
 	void throw_ensemble_error(string message,vector<string> vec);
-	const vector<string> get_var_names() const { return var_names; }
-	const vector<string> get_real_names() const { return real_names; }
+	const vector<string>& get_var_names() const { return var_names; }
+	const vector<string>& get_real_names() const { return real_names; }
 
 	const vector<string> get_real_names(vector<int> &indices);
 
@@ -62,7 +108,9 @@ public:
 	Eigen::VectorXd get_real_vector(const string &real_name);
 	Eigen::VectorXd get_var_vector(const string& var_name);
 	void update_real_ip(const string &rname, Eigen::VectorXd &real);
-	Eigen::MatrixXd get_eigen(vector<string> row_names, vector<string> col_names, bool update_vmap=true);
+	Eigen::MatrixXd get_eigen(const vector<string>& row_names, const vector<string>& col_names, bool update_vmap=true);
+	EnsembleView get_view(const vector<string>& row_names, const vector<string>& col_names, bool update_vmap=true);
+	EnsembleView get_view(const vector<int>& row_idxs, const vector<int>& col_idxs) const;
 	const Eigen::MatrixXd get_eigen() const { return reals; }
 	const Eigen::MatrixXd* get_eigen_ptr() const { return &reals; }
 	Eigen::MatrixXd* get_eigen_ptr_4_mod() { return &reals; }
@@ -72,6 +120,7 @@ public:
 
 	Eigen::MatrixXd get_eigen_anomalies(string on_real="");
 	Eigen::MatrixXd get_eigen_anomalies(const vector<string> &_real_names, const vector<string> &_var_names, string on_real="");
+	Eigen::RowVectorXd get_center(const EnsembleView& view, const vector<string>& _real_names, string on_real="");
 
 
 	vector<double> get_mean_stl_var_vector();
@@ -93,7 +142,7 @@ public:
 	void keep_rows(const vector<string> &keep_names);
 	
 
-	Pest* get_pest_scenario_ptr() { return pest_scenario_ptr; }
+	Pest* get_pest_scenario_ptr() const { return pest_scenario_ptr; }
 	Pest get_pest_scenario() { return *pest_scenario_ptr; }
 	void set_pest_scenario_ptr(Pest *_pest_scenario) { pest_scenario_ptr = _pest_scenario;}
 	void set_real_names(vector<string> &_real_names, bool update_org_names=false);
@@ -106,7 +155,7 @@ public:
 	//Ensemble& operator=(const Ensemble& other);
 	void set_rand_gen(std::mt19937* _rand_gen_ptr) { rand_gen_ptr = _rand_gen_ptr; }
 	std::mt19937* get_rand_gen_ptr() { return rand_gen_ptr; }
-	map<string, int> get_var_map() { return var_map; }
+	const pest_utils::NameIndex& get_var_map() { return var_map; }
 	map<string, int> get_real_map();
 
 	bool try_align_other_rows(PerformanceLog* performance_log, Ensemble& other);
@@ -122,11 +171,12 @@ protected:
 	vector<string> var_names;
 	vector<string> real_names;	
 	vector<string> org_real_names;
-	map<string, int> var_map;
+	pest_utils::NameIndex var_map;
 	void read_csv_by_reals(int num_reals,ifstream &csv, map<string,int> &header_info, map<string,int> &index_info);
 	void read_csv_by_vars(int num_reals, ifstream &csv, map<string, int> &header_info, map<string, int> &index_info);
+	bool read_csv_mapped(const string& file_name, int num_reals, map<string, int>& header_info, bool by_reals);
 	map<string,int> from_binary_old(string file_name, vector<string> &names,  bool transposed);
-	map<string, int> from_binary(string file_name, vector<string> &names, bool transposed);
+	map<string, int> from_binary(string file_name, vector<string> &names, bool transposed, const vector<string>& real_subset=vector<string>());
 	pair<map<string, int>, map<string, int>> prepare_csv(const vector<string> &names, ifstream &csv, bool forgive);
 	
 };
@@ -137,23 +187,31 @@ public:
 	FixedParInfo(vector<string> _fixed_names);
 	FixedParInfo() { initialized=false; }
 	void set_fixed_names(vector<string>& _fixed_names) { fixed_names = _fixed_names; initialize(); }
+	const vector<string>& get_fixed_names() const { return fixed_names; }
 	bool get_fixed_value(const string& pname, const string& rname, double& value);
 	map<string, double> get_par_fixed_values(const string& pname);
 	vector<double> get_real_fixed_values(const string& rname, vector<string>& pnames);
 	map<string, double> get_real_fixed_values(const string& rname);
+	Eigen::VectorXd get_real_fixed_vector(const string& rname);
 	void add_realization(string rname, Eigen::VectorXd& rvals, vector<string>& pnames);
+	void add_realizations(const vector<string>& rnames, const Eigen::MatrixXd& rvals, const vector<string>& pnames);
 	void keep_realizations(const vector<string>& keep);
 	void update_realizations(const vector<string>& other_var_names, const vector<string>& other_real_names, const Eigen::MatrixXd& other_mat);
 	void update_par_values(const map<string, double>& pval_map);
-	void clear() { fixed_info.clear(); fixed_names.clear(); }
+	void clear();
 	void fill_fixed(map<string, double>& fixed_map, vector<string>& rnames);
 private:
 	bool initialized;
 	vector<string> fixed_names;
-	//map<string, int> par2idx;
-	map<string, map<string, double>> fixed_info;
+	//dense realization x fixed par values - NaN marks a value that has not been set
+	pest_utils::NameIndex par_index;
+	vector<string> real_names;
+	unordered_map<string, int> real_index;
+	Eigen::MatrixXd values;
 
 	void initialize();
+	vector<int> get_real_rows(const vector<string>& rnames);
+	int find_real_row(const string& rname);
 
 };
 
@@ -177,7 +235,7 @@ public:
 	//ParameterEnsemble get_new(const vector<string> &_real_names, const vector<string> &_var_names);
 
 	void from_csv(string file_name, bool forgive = false);	
-	void from_binary(string file_name, bool forgive = false);
+	void from_binary(string file_name, bool forgive = false, const vector<string>& real_subset = vector<string>());
 
 	void from_eigen_mat(Eigen::MatrixXd mat, const vector<string> &_real_names, const vector<string> &_var_names,
 		transStatus _tstat = transStatus::NUM);
@@ -201,6 +259,7 @@ public:
 	void to_binary_ordered(string filename);
 	void to_binary_unordered(string filename);
 	void to_binary(string filename);
+	void to_binary_chunked(string filename, bool single_precision=false);
 	void to_dense(string filename);
 	void to_dense_unordered(string filename);
 	void to_dense_ordered(string filename);
@@ -221,6 +280,9 @@ private:
 	//vector<string> fixed_names;
 	//map<pair<string, string>, double> fixed_map;
 	void replace_fixed(string real_name,Parameters &pars);
+	bool batch_model_transform_supported() const;
+	void add_runs_batch(RunManagerAbstract* run_mgr_ptr, Parameters& pars, const vector<string>& run_real_names,
+		map<string, int>& rmap, const string& info_txt, map<int, int>& real_run_ids);
 	void prep_par_ensemble_after_read(map<string,int>& header_info);
 	FixedParInfo pfinfo;
 };
@@ -248,6 +310,64 @@ public:
 	void draw(int num_reals, Covariance &cov, PerformanceLog *plog, int level, ofstream& frec);
 	void initialize_without_noise(int num_reals);
 	//ObservationEnsemble get_mean_diff();
+private:
+	//run_mgr_pe is only filled if not null
+	vector<int> update_from_runs_bulk(map<int, int>& real_run_ids, RunManagerAbstract* run_mgr_ptr, ParameterEnsemble* run_mgr_pe);
+};
+
+//writes snapshots of ensembles to disk on a background thread so that file output can overlap
+//the next batch of model runs.  save() copies the ensemble and its scenario, dispatch() starts writing everything
+//saved since the last dispatch and flush() waits for the writes (rethrowing any write error)
+class AsyncEnsembleWriter
+{
+public:
+	AsyncEnsembleWriter() { ; }
+	~AsyncEnsembleWriter();
+	void save(const ParameterEnsemble& _pe, const vector<string>& file_names);
+	void save(const ObservationEnsemble& _oe, const vector<string>& file_names);
+	void dispatch();
+	void flush();
+	bool pending() { return write_thread.joinable(); }
+
+private:
+	vector<function<void()>> jobs;
+	thread write_thread;
+	exception_ptr write_exception;
+	static bool is_csv(const string& file_name);
+};
+
+//disk-backed column storage for ensemble-shaped values: the values live in a chunked binary (.ens)
+//file and column blocks are paged in on demand through an LRU cache bounded by cache_mb.
+//get_cols() is thread safe - block reads happen outside of the cache lock so that workers paging
+//different blocks dont serialize on disk i/o.  if remove_file is true, the file is deleted when the cache is destroyed
+class EnsembleBlockCache
+{
+public:
+	EnsembleBlockCache(const string& _filename, double cache_mb, bool _remove_file=false);
+	~EnsembleBlockCache();
+	const vector<string>& get_real_names() const { return header.row_names; }
+	const vector<string>& get_var_names() const { return header.col_names; }
+	int get_block_cols() const { return header.chunk_cols; }
+	//the number of columns that fit in the cache at once
+	int get_cache_cols() const { return max_blocks * header.chunk_cols; }
+	Eigen::MatrixXd get_cols(const vector<string>& names);
+	Eigen::MatrixXd get_cols(const vector<int>& idxs);
+	pair<int, int> get_hits_misses() const { return pair<int, int>(hits, misses); }
+
+private:
+	typedef shared_ptr<const Eigen::MatrixXd> BlockPtr;
+	string filename;
+	bool remove_file;
+	pest_utils::ChunkedBinaryHeader header;
+	pest_utils::NameIndex col_index;
+	int max_blocks, hits, misses;
+	list<int64_t> lru;
+	unordered_map<int64_t, pair<list<int64_t>::iterator, BlockPtr>> blocks;
+	//blocks being read by some thread - others wanting the same block wait on block_loaded
+	unordered_set<int64_t> loading;
+	mutex cache_lock;
+	condition_variable block_loaded;
+	BlockPtr get_block(int64_t block);
 };
 
 
@@ -255,24 +375,24 @@ public:
 class DrawThread
 {
 public:
-
+	//each group occupies the contiguous draw columns [group_starts[i], group_starts[i] + group_sizes[i])
+	//of both the draws matrix and the (aligned) covariance matrix
 	DrawThread(PerformanceLog *_performance_log, Covariance &_cov,Eigen::MatrixXd *_draws_ptr,
-		vector<string> &_group_keys, const map<string,vector<string>> &_grouper);
+		const vector<string> &_group_keys, const vector<int> &_group_starts, const vector<int> &_group_sizes);
 	
-	void work(int thread_id, int num_reals, int ies_verbose, map<string, int> idx_map, map<string, double> std_map);
+	//decompose one group's cov block and project its draws - safe to call concurrently
+	void draw_group(int thread_id, int igroup, int ies_verbose);
 
 
 private:
-    //int num_real, ies_verbose;
 	Eigen::MatrixXd *draws_ptr;
 	PerformanceLog* performance_log;
-	Covariance cov;
-	//Eigen::MatrixXd draws;
-	vector<string> group_keys;
-	//map<string, int> idx_map;
-	map<string, vector<string>> grouper;
-	//map<string, double> std_map;
-	mutex cov_lock, draw_lock, key_lock, pfm_lock;
+	Covariance& cov;
+	const vector<string>& group_keys;
+	const vector<int>& group_starts;
+	const vector<int>& group_sizes;
+	mutex pfm_lock;
+	void log_event(const string& message);
 };
 
 
@@ -3,6 +3,9 @@
 #include <iomanip>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <unordered_set>
+#include <numeric>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include "FileManager.h"
@@ -35,6 +38,9 @@ EnsembleSolver::EnsembleSolver(PerformanceLog* _performance_log, FileManager& _f
     use_localizer = _use_localizer;
     iter = _iter;
     verbose_level = pest_scenario.get_pestpp_options().get_ies_verbose_level();
+    single_precision = pest_scenario.get_pestpp_options().get_ies_single_precision();
+    use_out_of_core = (pest_scenario.get_pestpp_options().get_ies_out_of_core()) &&
+        (localizer.get_loctyp() == Localizer::LocTyp::LOCALANALYSIS);
     //prep the fast look par cov info
     message(1,"preparing fast-look containers for threaded localization solve");
     initialize();
@@ -43,6 +49,8 @@ EnsembleSolver::EnsembleSolver(PerformanceLog* _performance_log, FileManager& _f
 
 void EnsembleSolver::initialize(string center_on, vector<int> real_idxs)
 {
+    //the fast-look containers are being rebuilt, so any cached upgrade factors are stale
+    factor_cache.clear();
     vector<string> pe_real_names = pe.get_real_names();
     vector<string> oe_real_names = oe.get_real_names();
     vector<string> t;
@@ -146,34 +154,40 @@ void EnsembleSolver::initialize(string center_on, vector<int> real_idxs)
 	Eigen::MatrixXd mat = ph.get_obs_resid_subset(oe,true,oe_real_names);
 	for (int i = 0; i < obs_names.size(); i++)
 	{
-		obs_resid_map[obs_names[i]] = mat.col(i);
+		obs_resid_map[obs_names[i]] = StoredVector(mat.col(i), single_precision);
 	}
 	mat = oe.get_eigen_anomalies(oe_real_names, t, center_on);
 	for (int i = 0; i < obs_names.size(); i++)
 	{
-		obs_diff_map[obs_names[i]] = mat.col(i);
+		obs_diff_map[obs_names[i]] = StoredVector(mat.col(i), single_precision);
 	}
-	mat = base_oe.get_eigen(oe_real_names, obs_names);
+	EnsembleView base_view = base_oe.get_view(oe_real_names, obs_names);
 	Observations ctl_obs = pest_scenario.get_ctl_observations();
 	for (int i = 0; i < obs_names.size(); i++)
 	{
-		obs_err_map[obs_names[i]] = mat.col(i).array() - ctl_obs.get_rec(obs_names[i]);
+		obs_err_map[obs_names[i]] = StoredVector((base_view.get_col_vector(i).array() - ctl_obs.get_rec(obs_names[i])).matrix(), single_precision);
+	}
+	if (use_out_of_core)
+	{
+		//the par containers are filled from disk for each batch of cases during the solve
+		initialize_out_of_core(pe_real_names, center_on);
+		return;
 	}
 	mat = ph.get_par_resid_subset(pe,pe_real_names);
 	for (int i = 0; i < par_names.size(); i++)
 	{
-		par_resid_map[par_names[i]] = mat.col(i);
+		par_resid_map[par_names[i]] = StoredVector(mat.col(i), single_precision);
 	}
 	mat = pe.get_eigen_anomalies(pe_real_names,t,center_on);
 	for (int i = 0; i < par_names.size(); i++)
 	{
-		par_diff_map[par_names[i]] = mat.col(i);
+		par_diff_map[par_names[i]] = StoredVector(mat.col(i), single_precision);
 	}
 	if ((!pest_scenario.get_pestpp_options().get_ies_use_approx() && (Am.rows() > 0)))
 	{
 		for (int i = 0; i < par_names.size(); i++)
 		{
-			Am_map[par_names[i]] = Am.row(i);
+			Am_map[par_names[i]] = StoredVector(Am.row(i), single_precision);
 		}
 	}
 	mat.resize(0, 0);
@@ -204,58 +218,96 @@ void EnsembleSolver::message(int level, const string& _message, vector<T, A> _ex
 
 }
 
-void upgrade_thread_function(int id, int iter, double cur_lam, bool use_glm_form, vector<string> par_names,
-								vector<string> obs_names, UpgradeThread& worker, exception_ptr& eptr)
-{
-	try
-	{
-		worker.work(id, iter, cur_lam, use_glm_form, par_names, obs_names);
-	}
-	catch (...)
-	{
-		eptr = current_exception();
-	}
-
-	return;
-}
-
-
-void EnsembleSolver::solve_multimodal(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade, unordered_map<string, pair<vector<string>, vector<string>>>& loc_map,
+void EnsembleSolver::solve_multimodal(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade, LocCaseMap& loc_map,
                                       double mm_alpha) {
 
     stringstream ss;
-    //util functions
-    typedef std::function<bool(std::pair<std::string, double>, std::pair<std::string, double>)> Comparator;
-    // Defining a lambda function to compare two pairs. It will compare two pairs using second field
-    Comparator compFunctor = [](std::pair<std::string, double> elem1, std::pair<std::string, double> elem2)
-    {
-        return elem1.second < elem2.second;
-    };
-    typedef std::set<std::pair<std::string, double>, Comparator> sortedset;
-    typedef std::set<std::pair<std::string, double>, Comparator>::iterator sortedset_iter;
-
     int subset_size = (int)(((double)pe.shape().first) * mm_alpha);
+    if (use_out_of_core)
+    {
+        message(1, "out-of-core upgrade not supported with the multimodal solve, using in-memory containers");
+        use_out_of_core = false;
+        par_diff_cache.reset();
+        par_resid_cache.reset();
+    }
     ss.str("");
     ss << "multimodal upgrade using " << subset_size << " realizations";
     performance_log->log_event(ss.str());
 
-    //for each par realization in pe
-    //get the normed phi map
-
-
     vector<string> real_names = pe.get_real_names(),oreal_names = oe.get_real_names(),upgrade_real_names;
-    string real_name, oreal_name;
+    string real_name;
+    int nreal = pe.shape().first;
+    subset_size = min(subset_size, nreal - 1);
+    oe.update_var_map();
+    pest_utils::NameIndex ovar_map = oe.get_var_map();
+
+    //the weights for each realization - rows of this are the q_vec used for each realization's local solve
+    performance_log->log_event("forming multimodal phi matrix");
+    Eigen::MatrixXd q_mat(nreal, act_obs_names.size());
+    vector<int> q_idxs;
+    q_idxs.reserve(act_obs_names.size());
+    for (auto& aon : act_obs_names)
+        q_idxs.push_back(ovar_map.at(aon));
+    for (int i = 0; i < nreal; i++)
+        for (int j = 0; j < q_idxs.size(); j++)
+            q_mat(i, j) = weights.get_eigen_ptr()->coeff(i, q_idxs[j]);
+
+    //phi of every realization under every realization's weights in one product:
+    //column i holds the measurement phi of the ensemble using the weights of realization i
+    Eigen::MatrixXd phi_mat = Eigen::MatrixXd::Zero(nreal, nreal);
+    if (act_obs_names.size() > 0)
+    {
+        Eigen::MatrixXd resid = ph.get_obs_resid(oe);
+        resid = resid.cwiseProduct(resid);
+        phi_mat = resid * q_mat.cwiseProduct(q_mat).transpose();
+    }
+    for (int i = 0; i < nreal; i++)
+    {
+        double mx = phi_mat.col(i).maxCoeff();
+        if (mx > 0.0)
+            phi_mat.col(i) /= mx;
+    }
 
-    map<string,double> euclid_par_dist;
-    Eigen::VectorXd real,diff;
+    //parcov-weighted squared distances between all realizations from the gram matrix of the
+    //centered ensemble: d_ij = g_ii + g_jj - 2g_ij.  centering first keeps the cancellation small
+    performance_log->log_event("forming multimodal distance matrix");
     Eigen::SparseMatrix<double> parcov_inv = parcov.inv().get_matrix();
-    double edist;
-    map<string,int> real_map = pe.get_real_map();
-    oe.update_var_map();
-    map<string,int> ovar_map = oe.get_var_map();
+    Eigen::MatrixXd dist_mat = *pe.get_eigen_ptr();
+    dist_mat.rowwise() -= dist_mat.colwise().mean();
+    dist_mat = (dist_mat * parcov_inv) * dist_mat.transpose();
+    Eigen::VectorXd sq_norms = dist_mat.diagonal();
+    dist_mat = ((-2.0 * dist_mat).colwise() + sq_norms).rowwise() + sq_norms.transpose();
+    dist_mat = dist_mat.cwiseMax(0.0);
+    dist_mat.diagonal().setZero();
+    for (int i = 0; i < nreal; i++)
+    {
+        double mx = dist_mat.col(i).maxCoeff();
+        if (mx <= 0.0)
+        {
+            ss.str("");
+            ss << "multimodal solve error: maximum par diff for realization '" << real_names[i] <<"' not valid";
+            message(0,ss.str());
+        }
+        else
+            dist_mat.col(i) /= mx;
+    }
 
-    vector<int> real_idxs;
-    //Eigen::MatrixXd* real_ptr = pe_upgrade.get_eigen_ptr_4_mod();
+    //select the neighborhood of each realization - the subset_size best composite scores
+    performance_log->log_event("selecting multimodal neighborhoods");
+    vector<vector<int>> neighbors(nreal);
+    vector<int> order;
+    order.reserve(nreal);
+    for (int i = 0; i < nreal; i++)
+    {
+        order.clear();
+        for (int j = 0; j < nreal; j++)
+            if (j != i)
+                order.push_back(j);
+        Eigen::VectorXd score = dist_mat.col(i) + phi_mat.col(i);
+        partial_sort(order.begin(), order.begin() + subset_size, order.end(),
+            [&score](int a, int b) { return (score[a] < score[b]) || ((score[a] == score[b]) && (a < b)); });
+        neighbors[i].assign(order.begin(), order.begin() + subset_size);
+    }
 
     ofstream csv;
     if (pest_scenario.get_pestpp_options().get_ies_verbose_level()>1)
@@ -269,151 +321,86 @@ void EnsembleSolver::solve_multimodal(int num_threads, double cur_lam, bool use_
             csv << ",neighbor_" << j << ",phi,pdiff";
         }
         csv << endl;
+        for (int i = 0; i < nreal; i++)
+        {
+            csv << real_names[i];
+            for (auto j : neighbors[i])
+                csv << "," << real_names[j] << "," << phi_mat(j, i) << "," << dist_mat(j, i);
+            csv << endl;
+        }
+        csv.close();
+    }
 
+    //realizations whose neighborhoods cover the same set of realizations (and share weights) have the
+    //same local solve, so group them and solve once per group
+    map<vector<int>, vector<int>> hood_map;
+    for (int i = 0; i < nreal; i++)
+    {
+        vector<int> hood = neighbors[i];
+        hood.push_back(i);
+        sort(hood.begin(), hood.end());
+        hood_map[hood].push_back(i);
     }
 
-    for (int i=0;i<pe.shape().first;i++) {
+    vector<bool> solved(nreal, false);
+    vector<int> real_idxs;
+    Eigen::VectorXd real;
+    int num_reused = 0;
+    for (int i=0;i<nreal;i++) {
+        if (solved[i])
+            continue;
         real_name = real_names[i];
         performance_log->log_event("calculating multimodal upgrade for " + real_name);
-        euclid_par_dist.clear();
-        real = pe.get_real_vector(real_name);
-
-        //get the phi map for this realization using the weights vector for this realization
-        oreal_name = oreal_names[i];
-        Eigen::VectorXd q_vec(act_obs_names.size());
-        int ii =0;
-        for (auto& aon : act_obs_names) {
-            q_vec[ii] = weights.get_eigen_ptr()->coeff(i, ovar_map.at(aon));
-            ii++;
-        }
-        map<string,double> phi_map = ph.get_meas_phi(oe,q_vec);
-        double mx = -1.0e+300;
-        for (auto& p : phi_map)
-        {
-            if (p.second > mx)
-                mx = p.second;
-        }
-        for (auto& p : phi_map)
-        {
-            p.second /= mx;
-        }
-        //flip to map to par realization names
-        map<string,double> par_phi_map;
-        vector<string> oreal_names = oe.get_real_names(),preal_names=pe.get_real_names();
-        for (int i=0;i<oreal_names.size();i++)
-        {
-            par_phi_map[preal_names[i]] = phi_map.at(oreal_names[i]);
-        }
-        phi_map.clear();
-
-        //cout << real << endl;
-
-        for (auto &rname : real_names) {
-            if (rname == real_name)
-                continue;
-            diff = real - pe.get_real_vector(rname);
-            edist = diff.transpose() * parcov_inv * diff;
-            euclid_par_dist[rname] = edist;
-//            cout << real << endl;
-//            cout << pe.get_real_vector(rname) << endl;
-//            cout << diff << endl;
-//            cout << real_name << "," << rname << "," << edist << endl << endl;
-
-        }
-
-        mx = -1e300;
-        for (auto &e : euclid_par_dist) {
-            if (e.second > mx)
-                mx = e.second;
-        }
-        if (mx <= 0.0)
-        {
-            ss.str("");
-            ss << "multimodal solve error: maximum par diff for realization '" << real_name <<"' not valid";
-            message(0,ss.str());
-        }
-        else {
-            for (auto &e : euclid_par_dist) {
-                e.second /= mx;
-            }
-        }
-
-        map<string, double> composite_score;
-        for (auto &rname : real_names) {
-            if (rname == real_name)
-                continue;
-            composite_score[rname] = euclid_par_dist.at(rname) + par_phi_map.at(rname);
-        }
-        sortedset fitness_sorted(composite_score.begin(), composite_score.end(), compFunctor);
         real_idxs.clear();
         upgrade_real_names.clear();
-        real_idxs.push_back(real_map.at(real_name));
+        real_idxs.push_back(i);
         upgrade_real_names.push_back(real_name);
-        int iii = 0;
-        for (sortedset_iter ii=fitness_sorted.begin();ii!=fitness_sorted.end();++ii)
+        for (auto j : neighbors[i])
         {
-            int idx = real_map.at(ii->first);
-            real_idxs.push_back(idx);
-            upgrade_real_names.push_back(ii->first);
-            iii++;
-            if (iii >= subset_size)//plus one to count 'real_name'
-                break;
-            //cout << real_name << "," << ii->first << "," << ii->second << endl;
-
+            real_idxs.push_back(j);
+            upgrade_real_names.push_back(real_names[j]);
         }
-        if (pest_scenario.get_pestpp_options().get_ies_verbose_level()>1)
-        {
-            csv << real_name;
-            for (auto& rname : upgrade_real_names)
-            {
-                if (rname == real_name)
-                    continue;
-                csv << "," << rname << "," << par_phi_map.at(rname) << "," << euclid_par_dist.at(rname);
-            }
 
-            csv << endl;
-        }
         initialize(string(),real_idxs);
         //reset the weight map
         weight_map.clear();
-        weight_map.reserve(q_vec.size());
-        iii = 0;
+        weight_map.reserve(act_obs_names.size());
+        int iii = 0;
         for (auto& name : act_obs_names)
         {
-            weight_map[name] = q_vec[iii];
+            weight_map[name] = q_mat(i, iii);
             iii++;
         }
 
-
         ParameterEnsemble pe_real(&pest_scenario,pe.get_rand_gen_ptr());
         pe_real.reserve(upgrade_real_names,pe.get_var_names());
         solve(num_threads,cur_lam,use_glm_form,pe_real,loc_map);
         real = pe_real.get_real_vector(real_name);
-        //cout << real << endl;
         pe_upgrade.update_real_ip(real_name,real);
-//        iii = 0;
-//        for (auto ridx : real_idxs) {
-//            real_ptr->row(ridx) = pe_real.get_eigen_ptr()->row(iii);
-//            iii++;
-//        }
-
+        solved[i] = true;
 
+        //the other realizations sharing this neighborhood and weights take their rows from the same solve
+        vector<int> hood = real_idxs;
+        sort(hood.begin(), hood.end());
+        for (auto j : hood_map.at(hood))
+        {
+            if ((solved[j]) || (q_mat.row(j) != q_mat.row(i)))
+                continue;
+            real = pe_real.get_real_vector(real_names[j]);
+            pe_upgrade.update_real_ip(real_names[j], real);
+            solved[j] = true;
+            num_reused++;
+        }
+    }
+    if (num_reused > 0)
+    {
+        ss.str("");
+        ss << "multimodal upgrade reused " << num_reused << " local solves for realizations with coincident neighborhoods";
+        message(1, ss.str());
     }
-    csv.close();
-    //  get normalized par real scaled par diff l2 norm map
-    //  calculate composite normalized score and sort
-    //  select subset_size best reals
-    //  (re-)initialize this using current real as "center on" real
-    //  create a subset-sized pe instance and set zero
-    //  solve for subset_sized pe instance
-    //  randomly select a real subset-sized pe or use current real and set row in pe_upgrade
-
-
-
-
 }
 
-void EnsembleSolver::solve(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade, unordered_map<string, pair<vector<string>, vector<string>>>& loc_map)
+void EnsembleSolver::solve(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade, LocCaseMap& loc_map)
 {
 
 	//message(1, "starting solve for lambda", cur_lam);
@@ -430,6 +417,11 @@ void EnsembleSolver::solve(int num_threads, double cur_lam, bool use_glm_form, P
 		use_cov_loc = false;
 	//LocalAnalysisUpgradeThread worker(performance_log, par_resid_map, par_diff_map, obs_resid_map, obs_diff_map,obs_err_map,
 	//	localizer, parcov_inv_map, weight_map, pe_upgrade, loc_map, Am_map, _how);
+	if ((use_out_of_core) && (!use_cov_loc))
+	{
+		solve_out_of_core(num_threads, cur_lam, use_glm_form, pe_upgrade, loc_map);
+		return;
+	}
 	UpgradeThread* ut_ptr;
 	if (!use_cov_loc)
 		ut_ptr = new LocalAnalysisUpgradeThread(performance_log, par_resid_map, par_diff_map, obs_resid_map, obs_diff_map, obs_err_map,
@@ -437,96 +429,168 @@ void EnsembleSolver::solve(int num_threads, double cur_lam, bool use_glm_form, P
 	else
 		ut_ptr = new CovLocalizationUpgradeThread(performance_log, par_resid_map, par_diff_map, obs_resid_map, obs_diff_map, obs_err_map,
 			localizer, parcov_inv_map, weight_map, pe_upgrade, loc_map, Am_map, _how);
-	if ((num_threads < 1) || (loc_map.size() == 1))
-		//if (num_threads < 1)
-	{
-		//worker.work(0, iter, cur_lam, use_glm_form, act_par_names, act_obs_names);
-		ut_ptr->work(0, iter, cur_lam, use_glm_form, act_par_names, act_obs_names);
-	}
-	else
-	{
-		Eigen::setNbThreads(1);
-		vector<thread> threads;
-		vector<exception_ptr> exception_ptrs;
-		message(2, "launching threads");
-
-		for (int i = 0; i < num_threads; i++)
-		{
-			exception_ptrs.push_back(exception_ptr());
-		}
-
-		for (int i = 0; i < num_threads; i++)
-		{
-			//threads.push_back(thread(&LocalUpgradeThread::work, &worker, i, iter, cur_lam));
-
-			//threads.push_back(thread(localanalysis_upgrade_thread_function, i, iter, cur_lam, use_glm_form, act_par_names, act_obs_names, std::ref(worker), std::ref(exception_ptrs[i])));
-			threads.push_back(thread(upgrade_thread_function, i, iter, cur_lam, use_glm_form, act_par_names,
-				act_obs_names, std::ref(*ut_ptr), std::ref(exception_ptrs[i])));
+	if (factor_cache.get_use())
+		ut_ptr->set_factor_cache(&factor_cache);
+	run_upgrade_threads(num_threads, cur_lam, use_glm_form, *ut_ptr, loc_map.size(), act_par_names);
+	delete ut_ptr;
+}
 
 
+void EnsembleSolver::initialize_out_of_core(const vector<string>& pe_real_names, string center_on)
+{
+	//write the par anomalies and residuals to chunked files one column at a time so that
+	//they are never fully formed in memory - they are paged back in by block during the solve
+	par_diff_cache.reset();
+	par_resid_cache.reset();
+	vector<string> par_names = pe.get_var_names();
+	EnsembleView pe_view = pe.get_view(pe_real_names, vector<string>());
+	Eigen::RowVectorXd center = pe.get_center(pe_view, pe_real_names, center_on);
+	string diff_file = file_manager.get_base_filename() + ".par_diff.ooc.ens";
+	pest_utils::save_chunked_binary(diff_file, pe_real_names, par_names,
+		[&pe_view, &center](int j, Eigen::VectorXd& col) { col = pe_view.get_col_vector(j).array() - center[j]; }, single_precision);
+
+	EnsembleView base_view = ph.get_pe_base_ptr()->get_view(pe_real_names, par_names);
+	string resid_file = file_manager.get_base_filename() + ".par_resid.ooc.ens";
+	pest_utils::save_chunked_binary(resid_file, pe_real_names, par_names,
+		[&pe_view, &base_view](int j, Eigen::VectorXd& col) { col = pe_view.get_col_vector(j) - base_view.get_col_vector(j); }, single_precision);
+
+	double cache_mb = pest_scenario.get_pestpp_options().get_ies_out_of_core_cache_mb();
+	par_diff_cache = make_shared<EnsembleBlockCache>(diff_file, cache_mb, true);
+	par_resid_cache = make_shared<EnsembleBlockCache>(resid_file, cache_mb, true);
+	message(1, "out-of-core par containers prepared, max pars per batch:", par_diff_cache->get_cache_cols());
+}
 
-		}
-		message(2, "waiting to join threads");
-		//for (auto &t : threads)
-		//	t.join();
-		ss.str("");
-		int num_exp = 0;
+void EnsembleSolver::solve_out_of_core(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade,
+	LocCaseMap& loc_map)
+{
+	//group the local analysis cases into batches whose pars fit in the block cache.  cases are
+	//ordered by their first par column so that each block is read from disk about once per solve
+	Localizer::How _how = localizer.get_how();
+	pe.update_var_map();
+	const pest_utils::NameIndex& par_index = pe.get_var_map();
+	const vector<string>& case_par_names = loc_map.get_all_par_names();
+	vector<pair<int, int>> order;
+	order.reserve(loc_map.size());
+	for (int icase = 0; icase < loc_map.size(); icase++)
+	{
+		int first = pe.shape().second;
+		for (auto i : loc_map.get_par_idxs(icase))
+			first = min(first, par_index.at(case_par_names[i]));
+		order.push_back(make_pair(first, icase));
+	}
+	sort(order.begin(), order.end());
+
+	bool use_am = (!pest_scenario.get_pestpp_options().get_ies_use_approx()) && (Am.rows() > 0);
+	int max_pars = par_diff_cache->get_cache_cols();
+	LocCaseMap batch = loc_map.get_empty_copy();
+	vector<string> batch_pars;
+	unordered_set<string> batch_par_set;
+	int num_batches = 0, num_over = 0;
+	Eigen::MatrixXd mat;
+	auto solve_batch = [&](const string& factor_key_suffix)
+	{
+		par_diff_map.clear();
+		par_resid_map.clear();
+		Am_map.clear();
+		mat = par_diff_cache->get_cols(batch_pars);
+		for (int i = 0; i < batch_pars.size(); i++)
+			par_diff_map[batch_pars[i]] = StoredVector(mat.col(i), single_precision);
+		mat = par_resid_cache->get_cols(batch_pars);
+		for (int i = 0; i < batch_pars.size(); i++)
+			par_resid_map[batch_pars[i]] = StoredVector(mat.col(i), single_precision);
+		mat.resize(0, 0);
+		if (use_am)
+			for (auto& p : batch_pars)
+				Am_map[p] = StoredVector(Am.row(par_index.at(p)), single_precision);
+
+		LocalAnalysisUpgradeThread worker(performance_log, par_resid_map, par_diff_map, obs_resid_map, obs_diff_map, obs_err_map,
+			localizer, parcov_inv_map, weight_map, pe_upgrade, batch, Am_map, _how);
+		if (factor_cache.get_use())
+			worker.set_factor_cache(&factor_cache);
+		worker.set_factor_key_suffix(factor_key_suffix);
+		run_upgrade_threads(num_threads, cur_lam, use_glm_form, worker, batch.size(), batch_pars);
+		batch = loc_map.get_empty_copy();
+		batch_pars.clear();
+		batch_par_set.clear();
+		num_batches++;
+	};
 
-		for (int i = 0; i < num_threads; ++i)
-		{
-			bool found = false;
-			if (exception_ptrs[i])
-			{
-				found = true;
-				num_exp++;
-				try
-				{
-					rethrow_exception(exception_ptrs[i]);
-				}
-				catch (const std::exception& e)
-				{
-					//ss.str("");
-					ss << " thread " << i << "raised an exception: " << e.what();
-					//throw runtime_error(ss.str());
-				}
-				catch (...)
-				{
-					//ss.str("");
-					ss << " thread " << i << "raised an exception";
-					//throw runtime_error(ss.str());
-				}
-			}
-			threads[i].join();
-			if ((exception_ptrs[i]) && (!found))
+	for (auto& o : order)
+	{
+		int icase = o.second;
+		vector<int> case_par_idxs = loc_map.get_par_idxs(icase);
+		//only the columns not already loaded for this batch count against the cache - cases
+		//that share pars (e.g. localizing by obs) share their columns
+		int num_new = 0;
+		for (auto i : case_par_idxs)
+			if (batch_par_set.find(case_par_names[i]) == batch_par_set.end())
+				num_new++;
+		if ((batch.size() > 0) && (batch_pars.size() + num_new > max_pars))
+			solve_batch("");
+		if ((case_par_idxs.size() > max_pars) && (!use_am))
+		{
+			//this case alone overflows the cache.  the upgrade rows of a case are independent of
+			//each other (except through the Am term), so it is solved in cache-sized par chunks,
+			//each with its own factor cache key
+			for (int start = 0; start < case_par_idxs.size(); start += max_pars)
 			{
-				num_exp++;
-				try
-				{
-					rethrow_exception(exception_ptrs[i]);
-				}
-				catch (const std::exception& e)
-				{
-					//ss.str("");
-					ss << " thread " << i << "raised an exception: " << e.what();
-					//throw runtime_error(ss.str());
-				}
-				catch (...)
-				{
-					//ss.str("");
-					ss << " thread " << i << "raised an exception: ";
-					//throw runtime_error(ss.str());
-				}
+				vector<int> chunk(case_par_idxs.begin() + start,
+					case_par_idxs.begin() + min((int)case_par_idxs.size(), start + max_pars));
+				batch.add_case(loc_map.get_key(icase), loc_map.get_obs_idxs(icase), chunk);
+				for (auto i : chunk)
+					if (batch_par_set.insert(case_par_names[i]).second)
+						batch_pars.push_back(case_par_names[i]);
+				solve_batch("#" + to_string(start));
 			}
+			continue;
 		}
-		if (num_exp > 0)
-		{
-			throw runtime_error(ss.str());
-		}
-		delete ut_ptr;
-		message(1, "upgrade calculation done");
+		if (case_par_idxs.size() > max_pars)
+			num_over++;
+		batch.add_case(loc_map.get_key(icase), loc_map.get_obs_idxs(icase), case_par_idxs);
+		for (auto i : case_par_idxs)
+			if (batch_par_set.insert(case_par_names[i]).second)
+				batch_pars.push_back(case_par_names[i]);
 	}
+	if (batch.size() > 0)
+		solve_batch("");
+	par_diff_map.clear();
+	par_resid_map.clear();
+	Am_map.clear();
+
+	if (num_over > 0)
+	{
+		stringstream ss;
+		ss << "warning: " << num_over << " local analysis cases have more pars than fit in the out-of-core cache ("
+			<< max_pars << ") and can't be split because of the Am term, these were solved one case per batch, "
+			<< "increase ies_out_of_core_cache_mb to stay within the cache";
+		message(1, ss.str());
+	}
+	pair<int, int> hm = par_diff_cache->get_hits_misses();
+	stringstream ss;
+	ss << "out-of-core upgrade solved in " << num_batches << " batches, par block cache hits/misses: " << hm.first << "/" << hm.second;
+	message(1, ss.str());
 }
 
+void EnsembleSolver::run_upgrade_threads(int num_threads, double cur_lam, bool use_glm_form, UpgradeThread& worker, int num_cases,
+	vector<string>& par_names)
+{
+	int num_workers = num_threads;
+	if ((num_threads < 1) || (num_cases == 1))
+		num_workers = 1;
+	worker.prepare(num_workers, iter, cur_lam, use_glm_form, par_names, act_obs_names);
+	if (num_workers > 1)
+	{
+		Eigen::setNbThreads(1);
+		message(2, "dispatching upgrade cases to thread pool");
+	}
+	//the cases are pulled (and stolen) by the persistent pool workers - any exceptions
+	//are rethrown here as a single runtime_error
+	pest_utils::TaskPool::get_instance().parallel_for(num_cases, num_workers, [&](int thread_id, int case_idx)
+		{
+			worker.solve_case(thread_id, case_idx, iter, cur_lam, use_glm_form);
+		});
+	message(1, "upgrade calculation done");
+}
 
 void EnsembleSolver::message(int level, const string& _message)
 {
@@ -543,258 +607,234 @@ void EnsembleSolver::message(int level, const string& _message, T extra)
 }
 
 
-UpgradeThread::UpgradeThread(PerformanceLog* _performance_log, unordered_map<string, 
-	Eigen::VectorXd>& _par_resid_map, unordered_map<string, Eigen::VectorXd>& _par_diff_map, 
-	unordered_map<string, Eigen::VectorXd>& _obs_resid_map, unordered_map<string, 
-	Eigen::VectorXd>& _obs_diff_map, unordered_map<string, Eigen::VectorXd>& _obs_err_map, 
-	Localizer& _localizer, unordered_map<string, double>& _parcov_inv_map, 
-	unordered_map<string, double>& _weight_map, ParameterEnsemble& _pe_upgrade, 
-	unordered_map<string, pair<vector<string>, vector<string>>>& _cases, 
-	unordered_map<string, Eigen::VectorXd>& _Am_map, Localizer::How& _how):
-	par_resid_map(_par_resid_map),par_diff_map(_par_diff_map), obs_resid_map(_obs_resid_map), 
-	obs_diff_map(_obs_diff_map), obs_err_map(_obs_err_map), localizer(_localizer),
-    pe_upgrade(_pe_upgrade), cases(_cases), parcov_inv_map(_parcov_inv_map), 
-	weight_map(_weight_map), Am_map(_Am_map)
-	{
-		performance_log = _performance_log;
-		how = _how;
-		count = 0;
+size_t UpgradeFactors::get_bytes() const
+{
+	return sizeof(double) * (s2.size() + par_proj.size() + obs_proj.size() + am_par_proj.size() + am_proj.size());
+}
 
-		for (auto& c : cases)
-		{
-			keys.push_back(c.first);
-		}
-		//sort(keys.begin(), keys.end());
-		total = keys.size();
-		//random_shuffle(keys.begin(), keys.end());
+Eigen::MatrixXd UpgradeFactors::get_upgrade(double cur_lam) const
+{
+	Eigen::VectorXd ivec;
+	if (use_glm_form)
+		ivec = (s2.array() + (cur_lam + 1.0)).inverse().matrix();
+	else
+		//the mda obs noise was factored without the sqrt(inflation factor) scaling
+		ivec = ((s2.array() * cur_lam) + 1.0).inverse().matrix();
+	Eigen::MatrixXd upgrade = -1.0 * (par_proj * ivec.asDiagonal() * obs_proj);
+	if (am_proj.rows() > 0)
+		upgrade -= am_par_proj * ivec.asDiagonal() * am_proj;
+	upgrade.transposeInPlace();
+	return upgrade;
+}
 
-	
+void UpgradeFactorCache::set_max_mb(double max_mb)
+{
+	lock_guard<mutex> guard(cache_lock);
+	max_bytes = (max_mb > 0.0) ? (size_t)(max_mb * 1024.0 * 1024.0) : 0;
 }
 
+shared_ptr<const UpgradeFactors> UpgradeFactorCache::get(const string& key)
+{
+	lock_guard<mutex> guard(cache_lock);
+	unordered_map<string, shared_ptr<const UpgradeFactors>>::const_iterator it = factors.find(key);
+	if (it == factors.end())
+		return shared_ptr<const UpgradeFactors>();
+	return it->second;
+}
 
+void UpgradeFactorCache::put(const string& key, shared_ptr<const UpgradeFactors> _factors)
+{
+	//first come, first kept - every lambda needs the same cases so there is nothing to gain by evicting
+	lock_guard<mutex> guard(cache_lock);
+	size_t bytes = _factors->get_bytes();
+	if ((used_bytes + bytes > max_bytes) || (factors.find(key) != factors.end()))
+		return;
+	factors[key] = _factors;
+	used_bytes += bytes;
+}
 
-void CovLocalizationUpgradeThread::work(int thread_id, int iter, double cur_lam, bool use_glm_form, vector<string> par_names,
-									vector<string> obs_names)
+void UpgradeFactorCache::clear()
 {
+	lock_guard<mutex> guard(cache_lock);
+	factors.clear();
+	used_bytes = 0;
+}
 
-	//declare these helpers in here so they are thread safe...
-		class local_utils
+//helpers shared by the upgrade solves - these only touch their arguments so they are thread safe
+class local_utils
+{
+public:
+	static Eigen::DiagonalMatrix<double, Eigen::Dynamic> get_matrix_from_map(vector<string>& names, unordered_map<string, double>& dmap)
 	{
-	public:
-		static Eigen::DiagonalMatrix<double, Eigen::Dynamic> get_matrix_from_map(vector<string>& names, unordered_map<string, double>& dmap)
+		Eigen::VectorXd vec(names.size());
+		int i = 0;
+		for (auto name : names)
 		{
-			Eigen::VectorXd vec(names.size());
-			int i = 0;
-			for (auto name : names)
-			{
-				vec[i] = dmap.at(name);
-				++i;
-			}
-			Eigen::DiagonalMatrix<double, Eigen::Dynamic> m = vec.asDiagonal();
-			return m;
+			vec[i] = dmap.at(name);
+			++i;
 		}
-		static Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string>& names, unordered_map<string, Eigen::VectorXd>& emap)
+		Eigen::DiagonalMatrix<double, Eigen::Dynamic> m = vec.asDiagonal();
+		return m;
+	}
+	static Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string>& names, unordered_map<string, StoredVector>& emap)
+	{
+		Eigen::MatrixXd mat(num_reals, names.size());
+		mat.setZero();
+
+		for (int j = 0; j < names.size(); j++)
 		{
-			Eigen::MatrixXd mat(num_reals, names.size());
-			mat.setZero();
+			emap.at(names[j]).copy_to(mat.col(j));
+		}
 
-			for (int j = 0; j < names.size(); j++)
-			{
-				mat.col(j) = emap[names[j]];
-			}
+		return mat;
+	}
+	static void save_mat(int verbose_level, int tid, int iter, int t_count, string prefix, const Eigen::MatrixXd& mat)
+	{
+		if (verbose_level < 2)
+			return;
 
-			return mat;
-		}
-		static void save_mat(int verbose_level, int tid, int iter, int t_count, string prefix, Eigen::MatrixXd& mat)
-		{
-			if (verbose_level < 2)
-				return;
+		if (verbose_level < 3)
+			return;
+		//cout << "thread: " << tid << ", " << t_count << ", " << prefix << " rows:cols" << mat.rows() << ":" << mat.cols() << endl;
+		stringstream ss;
 
-			if (verbose_level < 3)
-				return;
-			//cout << "thread: " << tid << ", " << t_count << ", " << prefix << " rows:cols" << mat.rows() << ":" << mat.cols() << endl;
-			stringstream ss;
+		ss << "thread_" << tid << ".count_ " << t_count << ".iter_" << iter << "." << prefix << ".dat";
+		string fname = ss.str();
+		ofstream f(fname);
+		if (!f.good())
+			cout << "error getting ofstream " << fname << endl;
+		else
+		{
 
-			ss << "thread_" << tid << ".count_ " << t_count << ".iter_" << iter << "." << prefix << ".dat";
-			string fname = ss.str();
-			ofstream f(fname);
-			if (!f.good())
-				cout << "error getting ofstream " << fname << endl;
-			else
+			try
 			{
-
-				try
-				{
-					f << mat << endl;
-					f.close();
-				}
-				catch (...)
-				{
-					cout << "error saving matrix " << fname << endl;
-				}
+				f << mat << endl;
+				f.close();
+			}
+			catch (...)
+			{
+				cout << "error saving matrix " << fname << endl;
 			}
 		}
-	};
+	}
+};
 
-	stringstream ss;
+UpgradeThread::UpgradeThread(PerformanceLog* _performance_log, unordered_map<string, 
+	StoredVector>& _par_resid_map, unordered_map<string, StoredVector>& _par_diff_map, 
+	unordered_map<string, StoredVector>& _obs_resid_map, unordered_map<string, 
+	StoredVector>& _obs_diff_map, unordered_map<string, StoredVector>& _obs_err_map, 
+	Localizer& _localizer, unordered_map<string, double>& _parcov_inv_map, 
+	unordered_map<string, double>& _weight_map, ParameterEnsemble& _pe_upgrade, 
+	LocCaseMap& _cases, 
+	unordered_map<string, StoredVector>& _Am_map, Localizer::How& _how):
+	par_resid_map(_par_resid_map),par_diff_map(_par_diff_map), obs_resid_map(_obs_resid_map), 
+	obs_diff_map(_obs_diff_map), obs_err_map(_obs_err_map), localizer(_localizer),
+    pe_upgrade(_pe_upgrade), cases(_cases), parcov_inv_map(_parcov_inv_map), 
+	weight_map(_weight_map), Am_map(_Am_map)
+	{
+		performance_log = _performance_log;
+		factor_cache = nullptr;
+		how = _how;
+		count = 0;
+		total = cases.size();
 
-	unique_lock<mutex> ctrl_guard(ctrl_lock, defer_lock);
-	int maxsing, num_reals, verbose_level, pcount = 0, t_count=0;
-	double eigthresh;
-	bool use_approx;
-	bool use_prior_scaling;
-	bool use_localizer = false;
-	bool loc_by_obs = true;
+	
+}
 
-	while (true)
+void UpgradeThread::prepare(int num_workers, int iter, double cur_lam, bool use_glm_form, vector<string>& par_names,
+	vector<string>& obs_names)
+{
+	Pest* pest_scenario_ptr = pe_upgrade.get_pest_scenario_ptr();
+	maxsing = pest_scenario_ptr->get_svd_info().maxsing;
+	eigthresh = pest_scenario_ptr->get_svd_info().eigthresh;
+	use_approx = pest_scenario_ptr->get_pestpp_options().get_ies_use_approx();
+	use_prior_scaling = pest_scenario_ptr->get_pestpp_options().get_ies_use_prior_scaling();
+	num_reals = pe_upgrade.shape().first;
+	verbose_level = pest_scenario_ptr->get_pestpp_options().get_ies_verbose_level();
+	loc_by_obs = (how != Localizer::How::PARAMETERS);
+	count = 0;
+	part_map_files.clear();
+	part_map_files.resize(num_workers);
+}
+
+int UpgradeThread::next_count()
+{
+	int t_count = count++;
+	if (t_count % 1000 == 0)
 	{
-		if (ctrl_guard.try_lock())
-		{
-			
-			maxsing = pe_upgrade.get_pest_scenario_ptr()->get_svd_info().maxsing;
-			eigthresh = pe_upgrade.get_pest_scenario_ptr()->get_svd_info().eigthresh;
-			use_approx = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_approx();
-			use_prior_scaling = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_prior_scaling();
-			num_reals = pe_upgrade.shape().first;
-			verbose_level = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_verbose_level();
-			ctrl_guard.unlock();
-			//if (pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_localize_how()[0] == 'P')
-			if (how == Localizer::How::PARAMETERS)
-				loc_by_obs = false;
-			else
-			{
-				throw runtime_error("Covariance localization only supporte for localization by parameters...");
-			}
-			break;
-		}
+		stringstream ss;
+		ss << "upgrade thread progress: " << t_count << " of " << total << " parts done";
+		if (verbose_level > 3)
+			cout << ss.str() << endl;
+		lock_guard<mutex> pfm_guard(pfm_lock);
+		performance_log->log_event(ss.str());
 	}
-	ofstream f_thread;
-	if (verbose_level > 2)
+	return t_count + 1;
+}
+
+void UpgradeThread::write_part_map(int thread_id, int t_count, int iter, int case_idx)
+{
+	if (verbose_level <= 2)
+		return;
+	//each worker only ever writes to its own file
+	ofstream& f_thread = part_map_files.at(thread_id);
+	if (!f_thread.is_open())
 	{
-		ss.str("");
+		stringstream ss;
 		ss << "thread_" << thread_id << "part_map.csv";
 		f_thread.open(ss.str());
-		ss.str("");
 	}
-	Eigen::MatrixXd par_resid, par_diff, Am;
-	Eigen::MatrixXd obs_resid, obs_diff, obs_err, loc;
-	Eigen::DiagonalMatrix<double, Eigen::Dynamic> weights, parcov_inv;
-	vector<string> case_par_names, case_obs_names;
-	string key;
-
-
-	//these locks are used to control (thread-safe) access to the fast look up containers
-	unique_lock<mutex> next_guard(next_lock, defer_lock);
-	unique_lock<mutex> obs_diff_guard(obs_diff_lock, defer_lock);
-	unique_lock<mutex> obs_resid_guard(obs_resid_lock, defer_lock);
-	unique_lock<mutex> obs_err_guard(obs_err_lock, defer_lock);
-	unique_lock<mutex> par_diff_guard(par_diff_lock, defer_lock);
-	unique_lock<mutex> par_resid_guard(par_resid_lock, defer_lock);
-	unique_lock<mutex> loc_guard(loc_lock, defer_lock);
-	unique_lock<mutex> weight_guard(weight_lock, defer_lock);
-	unique_lock<mutex> parcov_guard(parcov_lock, defer_lock);
-	unique_lock<mutex> am_guard(am_lock, defer_lock);
-
-	//reset all the solution parts
-	par_resid.resize(0, 0);
-	par_diff.resize(0, 0);
-	obs_resid.resize(0, 0);
-	obs_diff.resize(0, 0);
-	obs_err.resize(0, 0);
-	loc.resize(0, 0);
-	Am.resize(0, 0);
-	weights.resize(0);
-	parcov_inv.resize(0);
-	Am.resize(0, 0);
-
-
-	//loop until this thread gets access to all the containers it needs to solve with 
-	//which in this solution, is all active pars and obs...
-	
-	while (true)
-	{
-		//if all the solution pieces are filled, break out and solve!
-		if (((use_approx) || (par_resid.rows() > 0)) &&
-			(weights.size() > 0) &&
-			(parcov_inv.size() > 0) &&
-			(par_diff.rows() > 0) &&
-			(obs_resid.rows() > 0) &&
-			(obs_err.rows() > 0) &&
-			(obs_diff.rows() > 0) &&
-			((!use_localizer) || (loc.rows() > 0)) &&
-			((use_approx) || (Am.rows() > 0)))
-			break;
-
-
-		//get access to the obs_diff container
-		if ((obs_diff.rows() == 0) && (obs_diff_guard.try_lock()))
-		{
-			//piggy back here for thread safety
-			//if (pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_svd_pack() == PestppOptions::SVD_PACK::PROPACK)
-			//	use_propack = true;
-			obs_diff = local_utils::get_matrix_from_map(num_reals, obs_names, obs_diff_map);
-			obs_diff_guard.unlock();
-		}
-
-		//get access to the residual container
-		if ((obs_resid.rows() == 0) && (obs_resid_guard.try_lock()))
-		{
-			obs_resid = local_utils::get_matrix_from_map(num_reals, obs_names, obs_resid_map);
-			obs_resid_guard.unlock();
-		}
-
-		//get access to the obs noise container
-		if ((obs_err.rows() == 0) && (obs_err_guard.try_lock()))
-		{
-			obs_err = local_utils::get_matrix_from_map(num_reals, obs_names, obs_err_map);
-			obs_err_guard.unlock();
-		}
+	f_thread << t_count << "," << iter;
+	for (auto name : cases.get_par_names(case_idx))
+		f_thread << "," << name;
+	for (auto name : cases.get_obs_names(case_idx))
+		f_thread << "," << name;
+	f_thread << endl;
+}
 
-		//get access to the par diff container
-		if ((par_diff.rows() == 0) && (par_diff_guard.try_lock()))
-		{
-			par_diff = local_utils::get_matrix_from_map(num_reals, par_names, par_diff_map);
-			par_diff_guard.unlock();
-		}
+void UpgradeThread::add_to_upgrade(const vector<string>& par_names, const Eigen::MatrixXd& upgrade)
+{
+	lock_guard<mutex> put_guard(put_lock);
+	pe_upgrade.add_2_cols_ip(par_names, upgrade);
+}
 
-		//get access to the par residual container
-		if ((par_resid.rows() == 0) && (par_resid_guard.try_lock()))
-		{
-			par_resid = local_utils::get_matrix_from_map(num_reals, par_names, par_resid_map);
-			par_resid_guard.unlock();
-		}
 
-		//get access to the obs weights container
-		if ((weights.rows() == 0) && (weight_guard.try_lock()))
-		{
-			weights = local_utils::get_matrix_from_map(obs_names, weight_map);
-			weight_guard.unlock();
-		}
+void CovLocalizationUpgradeThread::prepare(int num_workers, int iter, double cur_lam, bool use_glm_form, vector<string>& par_names,
+	vector<string>& obs_names)
+{
+	UpgradeThread::prepare(num_workers, iter, cur_lam, use_glm_form, par_names, obs_names);
+	if (loc_by_obs)
+	{
+		throw runtime_error("Covariance localization only supporte for localization by parameters...");
+	}
+	int thread_id = 0, t_count = 0;
+	solve_obs_names = obs_names;
 
-		//get access to the inverse prior parcov
-		if ((parcov_inv.rows() == 0) && (parcov_guard.try_lock()))
-		{
-			parcov_inv = local_utils::get_matrix_from_map(par_names, parcov_inv_map);
-			parcov_guard.unlock();
-		}
+	//the full solution components are the same for every case, so they are formed once here
+	//from all active pars and obs, then shared (read-only) by the case solves
+	Eigen::MatrixXd par_resid, Am;
+	Eigen::MatrixXd obs_diff, obs_err;
+	Eigen::DiagonalMatrix<double, Eigen::Dynamic> weights, parcov_inv;
+	obs_diff = local_utils::get_matrix_from_map(num_reals, obs_names, obs_diff_map);
+	obs_resid = local_utils::get_matrix_from_map(num_reals, obs_names, obs_resid_map);
+	obs_err = local_utils::get_matrix_from_map(num_reals, obs_names, obs_err_map);
+	par_diff = local_utils::get_matrix_from_map(num_reals, par_names, par_diff_map);
+	par_resid = local_utils::get_matrix_from_map(num_reals, par_names, par_resid_map);
+	weights = local_utils::get_matrix_from_map(obs_names, weight_map);
+	parcov_inv = local_utils::get_matrix_from_map(par_names, parcov_inv_map);
+	//the Am container is only needed in the full glm solution (and is empty for mda and multimodal solves)
+	if ((!use_approx) && (!Am_map.empty()))
+	{
+		int am_cols = Am_map.at(par_names[0]).size();
+		Am.resize(par_names.size(), am_cols);
+		Am.setZero();
 
-		//if needed, get access to the Am container - needed in the full glm solution
-		if ((!use_approx) && (Am.rows() == 0) && (am_guard.try_lock()))
+		for (int j = 0; j < par_names.size(); j++)
 		{
-			//Am = local_utils::get_matrix_from_map(num_reals, par_names, Am_map).transpose();
-			int am_cols = Am_map[par_names[0]].size();
-			Am.resize(par_names.size(), am_cols);
-			Am.setZero();
-
-			for (int j = 0; j < par_names.size(); j++)
-			{
-				Am.row(j) = Am_map[par_names[j]];
-			}
-			am_guard.unlock();
+			Am_map.at(par_names[j]).copy_to(Am.row(j));
 		}
 	}
 
-
 	par_diff.transposeInPlace();
 	obs_diff.transposeInPlace();
 	obs_resid.transposeInPlace();
@@ -803,7 +843,7 @@ void CovLocalizationUpgradeThread::work(int thread_id, int iter, double cur_lam,
 
 
 	//container to quickly look indices
-	map<string, int> par2col_map;
+	par2col_map.clear();
 	for (int i = 0; i < par_names.size(); i++)
 		par2col_map[par_names[i]] = i;
 
@@ -819,17 +859,14 @@ void CovLocalizationUpgradeThread::work(int thread_id, int iter, double cur_lam,
 	//form the (optionally) scaled par resid matrix
 	local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_resid", par_resid);
 	
-	ss.str("");
 	double scale = (1.0 / (sqrt(double(num_reals - 1))));
 
 	local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_diff", obs_diff);
 
 	//calculate some full solution components first...
 
-	Eigen::MatrixXd ivec, upgrade_1, s, s2, V, Ut, t;
-	Eigen::MatrixXd upgrade_2;
-	Eigen::VectorXd loc_vec;
-	
+	Eigen::MatrixXd ivec, s, s2, V, Ut;
+
 	upgrade_2.resize(num_reals, pe_upgrade.shape().second);
 	upgrade_2.setZero();
 
@@ -931,7 +968,7 @@ void CovLocalizationUpgradeThread::work(int thread_id, int iter, double cur_lam,
 		t = V * s.asDiagonal() * ivec * Ut;
 		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "t", t);
 
-		if ((!use_approx) && (iter > 1))
+		if ((!use_approx) && (iter > 1) && (Am.rows() > 0))
 		{
 			if (use_prior_scaling)
 			{
@@ -971,683 +1008,240 @@ void CovLocalizationUpgradeThread::work(int thread_id, int iter, double cur_lam,
 			//upgrade_2.resize(0, 0);
 		}
 	}
-
-	//This is the main thread loop - it continues until all upgrade pieces have been completed
-	map<string, Eigen::VectorXd> loc_map;
-	//solve for each case par_name
-	Eigen::VectorXd pt = parcov_inv.diagonal();
-	string name;
-	while (true)
-	{	
-		//clear the pieces used last time...
-		key = "";
-		loc_map.clear();
-
-		//get new pieces...
-		while (true)
-		{
-			if ((key != "") && (loc_map.size() > 0))
-				break;
-			if (next_guard.try_lock())
-			{
-				//if all the pieces have been completed, return
-				if (count == keys.size())
-				{
-					if (verbose_level > 3)
-					{
-						cout << "upgrade thread: " << thread_id << " processed " << pcount << " upgrade parts" << endl;
-					}
-					if (f_thread.good())
-						f_thread.close();
-					return;
-				}
-				key = keys[count];
-				pair<vector<string>, vector<string>> p = cases.at(key);
-				//we can potentially optimize the speed of this loc type by changing how many pars are
-				//passed in each "case" so herein, we support a generic number of pars per case...
-				case_par_names = p.second;
-				//In this solution, we ignore case obs names since we are using the full set of obs for the solution...
-				case_obs_names = p.first;
-				
-				if (count % 1000 == 0)
-				{
-					ss.str("");
-					ss << "upgrade thread progress: " << count << " of " << total << " parts done";
-					if (verbose_level > 3)
-						cout << ss.str() << endl;
-					performance_log->log_event(ss.str());
-				}
-				count++;
-				t_count = count;
-				pcount++;
-				next_guard.unlock();
-				
-			}
-			//get access to the localizer
-			if ((key != "") && (loc_map.size() == 0) && (loc_guard.try_lock()))
-			{
-				//get the nobs-length localizing vector for each case par name
-				for (auto& par_name : case_par_names)
-				{
-					loc_map[par_name] = localizer.get_obs_hadamard_vector(par_name, obs_names);
-				}
-				loc_guard.unlock();
-			}
-		}
-
-		if (verbose_level > 2)
-		{
-			f_thread << t_count << "," << iter;
-			for (auto name : case_par_names)
-				f_thread << "," << name;
-			for (auto name : case_obs_names)
-				f_thread << "," << name;
-			f_thread << endl;
-		}
-		upgrade_1.resize(num_reals,case_par_names.size());
-		upgrade_1.setZero();
-
-		for (int i = 0; i < case_par_names.size(); i++)
-		{
-			name = case_par_names[i];
-			loc_vec = loc_map[name];
-			Eigen::VectorXd par_vec = par_diff.row(par2col_map[name]) * t;
-			//apply the localizer
-			par_vec = par_vec.cwiseProduct(loc_vec);
-			if (!use_glm_form)
-				par_vec = -1.0 * par_vec.transpose() * obs_resid;
-			else
-			{
-				par_vec = -1.0 * par_vec.transpose() * obs_resid;
-				//if (use_prior_scaling)
-				//	par_vec *= pt[i];
-			}
-			upgrade_1.col(i) += par_vec.transpose();
-			//add the par change part for the full glm solution
-			if ((use_glm_form) && (!use_approx) && (iter > 1))
-			{
-				//update_2 is transposed relative to upgrade_1
-				upgrade_1.col(i) += upgrade_2.row(par2col_map[name]);
-			}
-
-		}
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1", upgrade_1);
-
-		//put this piece of the upgrade vector in
-		unique_lock<mutex> put_guard(put_lock, defer_lock);
-		while (true)
-		{
-			if (put_guard.try_lock())
-			{
-				pe_upgrade.add_2_cols_ip(case_par_names, upgrade_1);
-				put_guard.unlock();
-				break;
-			}
-		}
-	}
 }
 
-
-void LocalAnalysisUpgradeThread::work(int thread_id, int iter, double cur_lam, bool use_glm_form,
-									vector<string> par_names, vector<string> obs_names)
+void CovLocalizationUpgradeThread::solve_case(int thread_id, int case_idx, int iter, double cur_lam, bool use_glm_form)
 {
-
-	//declare these helpers in here so they are thread safe...
-	class local_utils
+	//we can potentially optimize the speed of this loc type by changing how many pars are
+	//passed in each "case" so herein, we support a generic number of pars per case...
+	//In this solution, we ignore case obs names since we are using the full set of obs for the solution...
+	vector<string> case_par_names = cases.get_par_names(case_idx);
+	int t_count = next_count();
+	write_part_map(thread_id, t_count, iter, case_idx);
+
+	Eigen::MatrixXd upgrade_1(num_reals, case_par_names.size());
+	upgrade_1.setZero();
+	Eigen::VectorXd loc_vec;
+	string name;
+	for (int i = 0; i < case_par_names.size(); i++)
 	{
-	public:
-		static Eigen::DiagonalMatrix<double, Eigen::Dynamic> get_matrix_from_map(vector<string>& names, unordered_map<string, double>& dmap)
+		name = case_par_names[i];
+		//get the nobs-length localizing vector for each case par name
+		loc_vec = localizer.get_obs_hadamard_vector(name, solve_obs_names);
+		int pidx = par2col_map.at(name);
+		Eigen::VectorXd par_vec = par_diff.row(pidx) * t;
+		//apply the localizer
+		par_vec = par_vec.cwiseProduct(loc_vec);
+		par_vec = -1.0 * par_vec.transpose() * obs_resid;
+		upgrade_1.col(i) += par_vec.transpose();
+		//add the par change part for the full glm solution
+		if ((use_glm_form) && (!use_approx) && (iter > 1))
 		{
-			Eigen::VectorXd vec(names.size());
-			int i = 0;
-			for (auto name : names)
-			{
-				vec[i] = dmap.at(name);
-				++i;
-			}
-			Eigen::DiagonalMatrix<double, Eigen::Dynamic> m = vec.asDiagonal();
-			return m;
-		}
-		static Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string>& names, unordered_map<string, Eigen::VectorXd>& emap)
-		{
-			Eigen::MatrixXd mat(num_reals, names.size());
-			mat.setZero();
-
-			for (int j = 0; j < names.size(); j++)
-			{
-				mat.col(j) = emap.at(names[j]);
-			}
-
-			return mat;
+			//update_2 is transposed relative to upgrade_1
+			upgrade_1.col(i) += upgrade_2.row(pidx);
 		}
-		static void save_mat(int verbose_level, int tid, int iter, int t_count, string prefix, Eigen::MatrixXd& mat)
-		{
-			if (verbose_level < 2)
-				return;
-
-			if (verbose_level < 3)
-				return;
-			//cout << "thread: " << tid << ", " << t_count << ", " << prefix << " rows:cols" << mat.rows() << ":" << mat.cols() << endl;
-			stringstream ss;
 
-			ss << "thread_" << tid << ".count_ " << t_count << ".iter_" << iter << "." << prefix << ".dat";
-			string fname = ss.str();
-			ofstream f(fname);
-			if (!f.good())
-				cout << "error getting ofstream " << fname << endl;
-			else
-			{
+	}
+	local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1", upgrade_1);
 
-				try
-				{
-					f << mat << endl;
-					f.close();
-				}
-				catch (...)
-				{
-					cout << "error saving matrix " << fname << endl;
-				}
-			}
-		}
-	};
+	//put this piece of the upgrade vector in
+	add_to_upgrade(case_par_names, upgrade_1);
+}
 
-	stringstream ss;
 
-	unique_lock<mutex> ctrl_guard(ctrl_lock, defer_lock);
-	int maxsing, num_reals, verbose_level, pcount = 0, t_count;
-	double eigthresh;
-	bool use_approx;
-	bool use_prior_scaling;
-	bool use_localizer = false;
-	bool loc_by_obs = true;
+void LocalAnalysisUpgradeThread::solve_case(int thread_id, int case_idx, int iter, double cur_lam, bool use_glm_form)
+{
+	const string& key = cases.get_key(case_idx);
+	vector<string> par_names = cases.get_par_names(case_idx);
+	vector<string> obs_names = cases.get_obs_names(case_idx);
+	int t_count = next_count();
+	write_part_map(thread_id, t_count, iter, case_idx);
+
+	//if the lambda-independent factors for this case are already formed, only the
+	//cheap per-lambda rescaling is needed
+	//(the par chunks of an out-of-core case share the case key, so they are told apart by the suffix)
+	shared_ptr<const UpgradeFactors> factors;
+	string factor_key = key + factor_key_suffix;
+	if (factor_cache != nullptr)
+		factors = factor_cache->get(factor_key);
+	if (!factors)
+	{
+		factors = get_factors(thread_id, t_count, iter, use_glm_form, key, par_names, obs_names);
+		if (factor_cache != nullptr)
+			factor_cache->put(factor_key, factors);
+	}
+	Eigen::MatrixXd upgrade_1 = factors->get_upgrade(cur_lam);
+	local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1", upgrade_1);
+
+	add_to_upgrade(par_names, upgrade_1);
+}
 
-	while (true)
-	{
-		if (ctrl_guard.try_lock())
-		{
-			maxsing = pe_upgrade.get_pest_scenario_ptr()->get_svd_info().maxsing;
-			eigthresh = pe_upgrade.get_pest_scenario_ptr()->get_svd_info().eigthresh;
-			use_approx = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_approx();
-			use_prior_scaling = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_use_prior_scaling();
-			num_reals = pe_upgrade.shape().first;
-			verbose_level = pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_verbose_level();
-			ctrl_guard.unlock();
-			//if (pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_ies_localize_how()[0] == 'P')
-			if (how == Localizer::How::PARAMETERS)
-				loc_by_obs = false;
-			break;
-		}
-	}
-	ofstream f_thread;
-	if (verbose_level > 2)
-	{
-		ss.str("");
-		ss << "thread_" << thread_id << "part_map.csv";
-		f_thread.open(ss.str());
-		ss.str("");
-	}
+shared_ptr<UpgradeFactors> LocalAnalysisUpgradeThread::get_factors(int thread_id, int t_count, int iter, bool use_glm_form,
+	const string& key, vector<string>& par_names, vector<string>& obs_names)
+{
+	//form the lambda-independent upgrade factors for one case.  the fast-look containers
+	//are read-only during the solve so they are read here without locking
+	bool use_localizer = localizer.get_use();
 	Eigen::MatrixXd par_resid, par_diff, Am;
-	Eigen::MatrixXd obs_resid, obs_diff, obs_err, loc;
+	Eigen::MatrixXd obs_resid, obs_diff, obs_err;
+	Eigen::VectorXd loc;
 	Eigen::DiagonalMatrix<double, Eigen::Dynamic> weights, parcov_inv;
-	string key;
-
 
-	//these locks are used to control (thread-safe) access to the fast look up containers
-	unique_lock<mutex> next_guard(next_lock, defer_lock);
-	unique_lock<mutex> obs_diff_guard(obs_diff_lock, defer_lock);
-	unique_lock<mutex> obs_resid_guard(obs_resid_lock, defer_lock);
-	unique_lock<mutex> obs_err_guard(obs_err_lock, defer_lock);
-	unique_lock<mutex> par_diff_guard(par_diff_lock, defer_lock);
-	unique_lock<mutex> par_resid_guard(par_resid_lock, defer_lock);
-	unique_lock<mutex> loc_guard(loc_lock, defer_lock);
-	unique_lock<mutex> weight_guard(weight_lock, defer_lock);
-	unique_lock<mutex> parcov_guard(parcov_lock, defer_lock);
-	unique_lock<mutex> am_guard(am_lock, defer_lock);
-	unique_lock<mutex> put_guard(put_lock, defer_lock);
-
-	set<string> sorg_par_names(par_names.begin(),par_names.end());
-	set<string> sorg_obs_names(obs_names.begin(),obs_names.end());
-
-
-	//This is the main thread loop - it continues until all upgrade pieces have been completed
-	while (true)
+	//get the localizer values for either the pars or the obs of this case - these scale
+	//the rows of the (transposed) par diff or obs diff
+	if (use_localizer)
 	{
-		//First get a new case of par and obs names to solve with
-		par_names.clear();
-		obs_names.clear();
-		use_localizer = false;
-		
-		while (true)
-		{
-			if (next_guard.try_lock())
-			{
-				//if all the pieces have been completed, return
-				if (count == keys.size())
-				{
-					if (verbose_level > 3)
-					{
-						cout << "upgrade thread: " << thread_id << " processed " << pcount << " upgrade parts" << endl;
-					}
-					if (f_thread.good())
-						f_thread.close();
-					return;
-				}
-				key = keys[count];
-				pair<vector<string>, vector<string>> p = cases.at(key);
-				par_names = p.second;
-				obs_names = p.first;
-				if (localizer.get_use())
-				{
-					/*if ((loc_by_obs) && (par_names.size() == 1) && (k == par_names[0]))
-						use_localizer = true;
-					else if ((!loc_by_obs) && (obs_names.size() == 1) && (k == obs_names[0]))
-						use_localizer = true;*/
-					//if ((loc_by_obs) && (obs_names.size() == 1) && (k == obs_names[0]))	
-					//else if ((!loc_by_obs) && (par_names.size() == 1) && (k == par_names[0]))
-					//	use_localizer = true;
-					use_localizer = true;
-				}
-				if (count % 1000 == 0)
-				{
-					ss.str("");
-					ss << "upgrade thread progress: " << count << " of " << total << " parts done";
-					if (verbose_level > 3)
-						cout << ss.str() << endl;
-					performance_log->log_event(ss.str());
-				}
-				count++;
-				t_count = count;
-				pcount++;
-				next_guard.unlock();
-				break;
-			}
-		}
-
-		//check here that the names in the case match the names passed - this is needed for seq da
-		/*vector<string> t;
-		set<string>::iterator end = sorg_par_names.end();
-		for (auto& par_name : par_names)
-			if (sorg_par_names.find(par_name) != end)
-				t.push_back(par_name);
-		if (t.size() == 0)
-		{
-			ss.str("");
-			ss << "thread " << thread_id << " processing case " << key << " - no par_names in case found in act_par_names";
-			throw runtime_error(ss.str());
-		}
-		if (t.size() != par_names.size())
-		{
-			f_thread << "par_names for case " << key << "reduced from " << par_names.size() << " to " << t.size() << endl;
-		}
-		par_names = t;
-
-		t.clear();
-		end = sorg_obs_names.end();
-		for (auto& obs_name : obs_names)
-			if (sorg_obs_names.find(obs_name) != end)
-				t.push_back(obs_name);
-		if (t.size() == 0)
-		{
-			ss.str("");
-			ss << "thread " << thread_id << " processing case " << key << " - no obs_names in case found in act_obs_names";
-			throw runtime_error(ss.str());
-		}
-		if (t.size() != obs_names.size())
-		{
-			f_thread << "obs_names for case " << key << "reduced from " << obs_names.size() << " to " << t.size() << endl;
-		}
-		obs_names = t;
-		t.clear();*/
-
-
-
+		if (loc_by_obs)
+			loc = localizer.get_par_taper_vector(key, par_names);
+		else
+			loc = localizer.get_obs_taper_vector(key, obs_names);
+	}
+	obs_diff = local_utils::get_matrix_from_map(num_reals, obs_names, obs_diff_map);
+	obs_resid = local_utils::get_matrix_from_map(num_reals, obs_names, obs_resid_map);
+	obs_err = local_utils::get_matrix_from_map(num_reals, obs_names, obs_err_map);
+	par_diff = local_utils::get_matrix_from_map(num_reals, par_names, par_diff_map);
+	par_resid = local_utils::get_matrix_from_map(num_reals, par_names, par_resid_map);
+	weights = local_utils::get_matrix_from_map(obs_names, weight_map);
+	parcov_inv = local_utils::get_matrix_from_map(par_names, parcov_inv_map);
+	//the Am container is only needed in the full glm solution (and is empty for mda and multimodal solves)
+	if ((!use_approx) && (!Am_map.empty()))
+	{
+		int am_cols = Am_map.at(par_names[0]).size();
+		Am.resize(par_names.size(), am_cols);
+		Am.setZero();
 
-		if (verbose_level > 2)
+		for (int j = 0; j < par_names.size(); j++)
 		{
-			f_thread << t_count << "," << iter;
-			for (auto name : par_names)
-				f_thread << "," << name;
-			for (auto name : obs_names)
-				f_thread << "," << name;
-			f_thread << endl;
+			Am_map.at(par_names[j]).copy_to(Am.row(j));
 		}
+	}
 
-		//reset all the solution parts
-		par_resid.resize(0, 0);
-		par_diff.resize(0, 0);
-		obs_resid.resize(0, 0);
-		obs_diff.resize(0, 0);
-		obs_err.resize(0, 0);
-		loc.resize(0, 0);
-		Am.resize(0, 0);
-		weights.resize(0);
-		parcov_inv.resize(0);
-		Am.resize(0, 0);
-
-		
-		//now loop until this thread gets access to all the containers it needs to solve with
-		while (true)
-		{
-			//if all the solution pieces are filled, break out and solve!
-			if (((use_approx) || (par_resid.rows() > 0)) &&
-				(weights.size() > 0) &&
-				(parcov_inv.size() > 0) &&
-				(par_diff.rows() > 0) &&
-				(obs_resid.rows() > 0) &&
-				(obs_err.rows() > 0) &&
-				(obs_diff.rows() > 0) &&
-				((!use_localizer) || (loc.rows() > 0)) &&
-				((use_approx) || (Am.rows() > 0)))
-				break;
-			
-			//get access to the localizer
-			if ((use_localizer) && (loc.rows() == 0) && (loc_guard.try_lock()))
-			{
-				//get a matrix that is either the shape of par diff or obs diff
-				if (loc_by_obs)
-				{
-					//loc = localizer.get_localizing_par_hadamard_matrix(num_reals, obs_names[0], par_names);
-					loc = localizer.get_pardiff_hadamard_matrix(num_reals, key, par_names);
-				}
-
-				else
-				{
-					//loc = localizer.get_localizing_obs_hadamard_matrix(num_reals, par_names[0], obs_names);
-					loc = localizer.get_obsdiff_hadamard_matrix(num_reals, key, obs_names);
-				}
-				loc_guard.unlock();
-			}
-
-			//get access to the obs_diff container
-			if ((obs_diff.rows() == 0) && (obs_diff_guard.try_lock()))
-			{
-				//piggy back here for thread safety
-				//if (pe_upgrade.get_pest_scenario_ptr()->get_pestpp_options().get_svd_pack() == PestppOptions::SVD_PACK::PROPACK)
-				//	use_propack = true;
-				obs_diff = local_utils::get_matrix_from_map(num_reals, obs_names, obs_diff_map);
-				obs_diff_guard.unlock();
-			}
-
-			//get access to the residual container
-			if ((obs_resid.rows() == 0) && (obs_resid_guard.try_lock()))
-			{
-				obs_resid = local_utils::get_matrix_from_map(num_reals, obs_names, obs_resid_map);
-				obs_resid_guard.unlock();
-			}
-
-			//get access to the obs noise container
-			if ((obs_err.rows() == 0) && (obs_err_guard.try_lock()))
-			{
-				obs_err = local_utils::get_matrix_from_map(num_reals, obs_names, obs_err_map);
-				obs_err_guard.unlock();
-			}
-
-			//get access to the par diff container
-			if ((par_diff.rows() == 0) && (par_diff_guard.try_lock()))
-			{
-				par_diff = local_utils::get_matrix_from_map(num_reals, par_names, par_diff_map);
-				par_diff_guard.unlock();
-			}
+	par_diff.transposeInPlace();
+	obs_diff.transposeInPlace();
+	obs_resid.transposeInPlace();
+	par_resid.transposeInPlace();
+	obs_err.transposeInPlace();
 
-			//get access to the par residual container
-			if ((par_resid.rows() == 0) && (par_resid_guard.try_lock()))
-			{
-				par_resid = local_utils::get_matrix_from_map(num_reals, par_names, par_resid_map);
-				par_resid_guard.unlock();
-			}
+	//form the scaled obs resid matrix
+	local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_resid", obs_resid);
+	//Eigen::MatrixXd scaled_residual = weights * obs_resid;
 
-			//get access to the obs weights container
-			if ((weights.rows() == 0) && (weight_guard.try_lock()))
-			{
-				weights = local_utils::get_matrix_from_map(obs_names, weight_map);
-				weight_guard.unlock();
-			}
+	//form the (optionally) scaled par resid matrix
+	local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_resid", par_resid);
+	local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_diff", par_diff);
 
-			//get access to the inverse prior parcov
-			if ((parcov_inv.rows() == 0) && (parcov_guard.try_lock()))
-			{
-				parcov_inv = local_utils::get_matrix_from_map(par_names, parcov_inv_map);
-				parcov_guard.unlock();
-			}
+	double scale = (1.0 / (sqrt(double(num_reals - 1))));
 
-			//if needed, get access to the Am container - needed in the full glm solution
-			if ((!use_approx) && (Am.rows() == 0) && (am_guard.try_lock()))
-			{
-				//Am = local_utils::get_matrix_from_map(num_reals, par_names, Am_map).transpose();
-				int am_cols = Am_map[par_names[0]].size();
-				Am.resize(par_names.size(), am_cols);
-				Am.setZero();
+	local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_diff", obs_diff);
 
-				for (int j = 0; j < par_names.size(); j++)
-				{
-					Am.row(j) = Am_map[par_names[j]];
-				}
-				am_guard.unlock();
-			}
-		}
-		
+	//apply the localizer here...
+	if (use_localizer)
+		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "loc", loc);
+	if (use_localizer)
+	{
+		if (loc_by_obs)
+			par_diff = loc.asDiagonal() * par_diff;
+		else
+			obs_diff = loc.asDiagonal() * obs_diff;
+	}
 
-		par_diff.transposeInPlace();
-		obs_diff.transposeInPlace();
-		obs_resid.transposeInPlace();
-		par_resid.transposeInPlace();
-		obs_err.transposeInPlace();
+	shared_ptr<UpgradeFactors> f = make_shared<UpgradeFactors>();
+	f->use_glm_form = use_glm_form;
+	Eigen::MatrixXd s, V, Ut;
 
-		//form the scaled obs resid matrix
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_resid", obs_resid);
-		//Eigen::MatrixXd scaled_residual = weights * obs_resid;
+	//----------------------------------
+	//es-mda solution
+	//----------------------------------
+	if (!use_glm_form)
+	{
+		// Low rank Cee. Section 14.3.2 Evenson Book
+		obs_err = obs_err.colwise() - obs_err.rowwise().mean();
+		Eigen::MatrixXd s0, V0, U0, s0_i;
+		SVD_REDSVD rsvd;
+		rsvd.solve_ip(obs_diff, s0, U0, V0, eigthresh, maxsing);
+		s0_i = s0.asDiagonal().inverse();
+		Eigen::MatrixXd X0 = U0.transpose() * obs_err;
+		X0 = s0_i * X0;
+		Eigen::MatrixXd s1, V1, U1;
+		//scaling the noise by sqrt(cur_lam) only scales s1, so that is left to the per-factor rescaling
+		rsvd.solve_ip(X0, s1, U1, V1, 0, maxsing);
+		f->s2 = s1.cwiseProduct(s1);
+		Eigen::MatrixXd X1 = s0_i * U1;
+		X1 = U0 * X1;
+		f->obs_proj = X1.transpose() * obs_resid;
+		f->par_proj = par_diff * (obs_diff.transpose() * X1);
+		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X1", X1);
+	}
 
-		//form the (optionally) scaled par resid matrix
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_resid", par_resid);
+	//----------------------------------
+	//glm solution
+	//----------------------------------
+	else
+	{
+		obs_resid = weights * obs_resid;
+		obs_diff = scale * (weights * obs_diff);
 		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_diff", par_diff);
-		
-		stringstream ss;
-
-		double scale = (1.0 / (sqrt(double(num_reals - 1))));
-
-		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_diff", obs_diff);
-
-		//apply the localizer here...
-		if (use_localizer)
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "loc", loc);
-		if (use_localizer)
-		{
-			if (loc_by_obs)
-				par_diff = par_diff.cwiseProduct(loc);
-			else
-				obs_diff = obs_diff.cwiseProduct(loc);
-		}
-
-		Eigen::MatrixXd ivec, upgrade_1, s, s2, V, Ut, d_dash;
-
-		//----------------------------------
-		//es-mda solution
-		//----------------------------------
-		
-		if (!use_glm_form)
-		{
-			if (true)
-			{
-                // Low rank Cee. Section 14.3.2 Evenson Book
-				obs_err = obs_err.colwise() - obs_err.rowwise().mean();
-				obs_err = sqrt(cur_lam) * obs_err;
-				Eigen::MatrixXd s0, V0, U0, s0_i;
-				SVD_REDSVD rsvd;
-				rsvd.solve_ip(obs_diff, s0, U0, V0, eigthresh, maxsing);
-				s0_i = s0.asDiagonal().inverse();
-				Eigen::MatrixXd X0 = U0.transpose() * obs_err;
-				X0 = s0_i * X0;
-				Eigen::MatrixXd s1, V1, U1, s1_2, s1_2i;
-				rsvd.solve_ip(X0, s1, U1, V1, 0, maxsing);
-
-				s1_2 = s1.cwiseProduct(s1);
-				s1_2i = (Eigen::VectorXd::Ones(s1_2.size()) + s1_2).asDiagonal().inverse();
-				Eigen::MatrixXd X1 = s0_i * U1;
-				X1 = U0 * X1;
-
-				Eigen::MatrixXd X4 = s1_2i * X1.transpose();
-				Eigen::MatrixXd X2 = X4 * obs_resid;
-				Eigen::MatrixXd X3 = X1 * X2;
-
-				X3 = obs_diff.transpose() * X3;
-				upgrade_1 = -1 * par_diff * X3;
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1", upgrade_1);
-				upgrade_1.transposeInPlace();
-
-			}
-			else
-			{
-				// Use when ensemble size is larger than number of observation. 
-				// This is a good option when number of observation is small
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_err", obs_err);
-				obs_err = obs_err.colwise() - obs_err.rowwise().mean();
-
-				Eigen::MatrixXd s2_, s, V, U, cum_sum;
-				SVD_REDSVD rsvd;
-				Eigen::MatrixXd C;
-				C = obs_diff + (sqrt(cur_lam) * obs_err); // curr_lam is the inflation factor 	
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "C", C);
-				Eigen::VectorXd s2;
-
-
-				rsvd.solve_ip(C, s, U, V, eigthresh, maxsing);
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "s", s);
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "U", U);
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "V", V);
-				s2 = s.cwiseProduct(s);
-				s2_ = s2.asDiagonal().inverse();
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "inv_s2_", s2_);
-
-
-				Eigen::MatrixXd X1 = s2_ * U.transpose();
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X1", X1);
-
-				X1 = X1 * obs_resid;
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X1_obs_resid", X1);
-
-				X1 = U * X1;
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "U_X1", X1);
-
-				X1 = obs_diff.transpose() * X1;
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "obs_diff_X1", X1);
-
-				upgrade_1 = -1 * par_diff * X1;
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1", upgrade_1);
-				upgrade_1.transposeInPlace();
-			}		
-			
-			
-		}
-
-
-		//----------------------------------
-		//glm solution
-		//----------------------------------
+		if (use_prior_scaling)
+			par_diff = scale * parcov_inv * par_diff;
 		else
-		{
-			obs_resid = weights * obs_resid;
-			obs_diff = scale * (weights * obs_diff);
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "par_diff", par_diff);
-			if (use_prior_scaling)
-				par_diff = scale * parcov_inv * par_diff;
-			else
-				par_diff = scale * par_diff;
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "scaled_par_diff", par_diff);
-			SVD_REDSVD rsvd;
-			rsvd.solve_ip(obs_diff, s, Ut, V, eigthresh, maxsing);
-
-			Ut.transposeInPlace();
-			obs_diff.resize(0, 0);
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Ut", Ut);
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "s", s);
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "V", V);
-
-			Eigen::MatrixXd s2 = s.cwiseProduct(s);
-
-			ivec = ((Eigen::VectorXd::Ones(s2.size()) * (cur_lam + 1.0)) + s2).asDiagonal().inverse();
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "ivec", ivec);
+			par_diff = scale * par_diff;
+		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "scaled_par_diff", par_diff);
+		SVD_REDSVD rsvd;
+		rsvd.solve_ip(obs_diff, s, Ut, V, eigthresh, maxsing);
 
-			Eigen::MatrixXd X1 = Ut * obs_resid;
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X1", X1);
-			
-			Eigen::MatrixXd X2 = ivec * X1;
-			X1.resize(0, 0);
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X2", X2);
-			
-			Eigen::MatrixXd X3 = V * s.asDiagonal() * X2;
-			X2.resize(0, 0);
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X3", X3);
-			upgrade_1 = -1.0 * par_diff * X3;
-			
+		Ut.transposeInPlace();
+		obs_diff.resize(0, 0);
+		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Ut", Ut);
+		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "s", s);
+		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "V", V);
+
+		f->s2 = s.cwiseProduct(s);
+		f->obs_proj = Ut * obs_resid;
+		Ut.resize(0, 0);
+		local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X1", f->obs_proj);
+		f->par_proj = par_diff * V * s.asDiagonal();
+
+		if ((!use_approx) && (iter > 1) && (Am.rows() > 0))
+		{
 			if (use_prior_scaling)
 			{
-				//upgrade_1 = parcov_inv * upgrade_1;
+				par_resid = parcov_inv * par_resid;
 			}
-			
-			upgrade_1.transposeInPlace();
-			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_1", upgrade_1);
-			X3.resize(0, 0);
-
-			Eigen::MatrixXd upgrade_2;
-			if ((!use_approx) && (iter > 1))
-			{
-				if (use_prior_scaling)
-				{
-					par_resid = parcov_inv * par_resid;
-				}
-			
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Am", Am);
-				Eigen::MatrixXd x4 = Am.transpose() * par_resid;
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X4", x4);
 
-				par_resid.resize(0, 0);
-
-				Eigen::MatrixXd x5 = Am * x4;
-				x4.resize(0, 0);
-				Am.resize(0, 0);
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "Am", Am);
+			Eigen::MatrixXd x4 = Am.transpose() * par_resid;
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X4", x4);
 
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X5", x5);
-				Eigen::MatrixXd x6 = par_diff.transpose() * x5;
-				x5.resize(0, 0);
+			par_resid.resize(0, 0);
 
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X6", x6);
-				Eigen::MatrixXd x7 = V * ivec * V.transpose() * x6;
-				x6.resize(0, 0);
+			Eigen::MatrixXd x5 = Am * x4;
+			x4.resize(0, 0);
+			Am.resize(0, 0);
 
-				if (use_prior_scaling)
-				{
-					upgrade_2 = -1.0 * parcov_inv * par_diff * x7;
-				}
-				else
-				{
-					upgrade_2 = -1.0 * (par_diff * x7);
-				}
-				x7.resize(0, 0);
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X5", x5);
+			Eigen::MatrixXd x6 = par_diff.transpose() * x5;
+			x5.resize(0, 0);
 
-				upgrade_1 = upgrade_1 + upgrade_2.transpose();
-				local_utils::save_mat(verbose_level, thread_id, iter, t_count, "upgrade_2", upgrade_2);
-				upgrade_2.resize(0, 0);
+			local_utils::save_mat(verbose_level, thread_id, iter, t_count, "X6", x6);
+			f->am_proj = V.transpose() * x6;
+			x6.resize(0, 0);
 
+			if (use_prior_scaling)
+			{
+				f->am_par_proj = parcov_inv * par_diff * V;
 			}
-		}
-		
-		while (true)
-		{
-			if (put_guard.try_lock())
+			else
 			{
-				pe_upgrade.add_2_cols_ip(par_names, upgrade_1);				
-				put_guard.unlock();
-				break;
+				f->am_par_proj = par_diff * V;
 			}
 		}
 	}
-
+	return f;
 }
 
 
 
 
-
 L2PhiHandler::L2PhiHandler(Pest *_pest_scenario, FileManager *_file_manager,
 	ObservationEnsemble *_oe_base, ParameterEnsemble *_pe_base,
 	Covariance *_parcov, bool should_prep_csv, string _tag)
@@ -1709,8 +1303,9 @@ L2PhiHandler::L2PhiHandler(Pest *_pest_scenario, FileManager *_file_manager,
 Eigen::MatrixXd L2PhiHandler::get_obs_resid(ObservationEnsemble &oe, bool apply_ineq)
 {
 	vector<string> names = oe_base->get_var_names();
-	Eigen::MatrixXd resid = oe.get_eigen(vector<string>(),names) -
-		oe_base->get_eigen(oe.get_real_names(), vector<string>());
+	//views so that only the residual matrix is allocated
+	Eigen::MatrixXd resid = oe.get_view(vector<string>(), names).expr() -
+		oe_base->get_view(oe.get_real_names(), vector<string>()).expr();
 	
 	if (apply_ineq)
 		apply_ineq_constraints(resid,names);
@@ -1725,7 +1320,7 @@ Eigen::MatrixXd L2PhiHandler::get_obs_resid_subset(ObservationEnsemble &oe, bool
         real_names = oe.get_real_names();
     }
 	vector<string> names = oe.get_var_names();
-	Eigen::MatrixXd resid = oe.get_eigen(real_names,vector<string>()) - oe_base->get_eigen(real_names, names);
+	Eigen::MatrixXd resid = oe.get_view(real_names,vector<string>()).expr() - oe_base->get_view(real_names, names).expr();
 	if (apply_ineq)
 		apply_ineq_constraints(resid, names);
 	return resid;
@@ -1733,8 +1328,8 @@ Eigen::MatrixXd L2PhiHandler::get_obs_resid_subset(ObservationEnsemble &oe, bool
 
 Eigen::MatrixXd L2PhiHandler::get_par_resid(ParameterEnsemble &pe)
 {
-	Eigen::MatrixXd resid = pe.get_eigen(vector<string>(), pe_base->get_var_names()) -
-		pe_base->get_eigen(pe.get_real_names(), vector<string>());
+	Eigen::MatrixXd resid = pe.get_view(vector<string>(), pe_base->get_var_names()).expr() -
+		pe_base->get_view(pe.get_real_names(), vector<string>()).expr();
 	return resid;
 }
 
@@ -1744,7 +1339,7 @@ Eigen::MatrixXd L2PhiHandler::get_par_resid_subset(ParameterEnsemble &pe, vector
     {
         real_names = pe.get_real_names();
     }
-	Eigen::MatrixXd resid = pe.get_eigen(real_names,vector<string>()) - pe_base->get_eigen(real_names,pe.get_var_names());
+	Eigen::MatrixXd resid = pe.get_view(real_names,vector<string>()).expr() - pe_base->get_view(real_names,pe.get_var_names()).expr();
 	return resid;
 }
 
@@ -1755,11 +1350,10 @@ Eigen::MatrixXd L2PhiHandler::get_actual_obs_resid(ObservationEnsemble &oe)
 	Eigen::MatrixXd resid(oe.shape().first, act_obs_names.size());
 	resid.setZero();
 	Observations obs = pest_scenario->get_ctl_observations();
-	Eigen::MatrixXd oe_vals = oe.get_eigen(vector<string>(), act_obs_names);
+	EnsembleView oe_vals = oe.get_view(vector<string>(), act_obs_names);
 	Eigen::MatrixXd ovals = obs.get_data_eigen_vec(act_obs_names);
 	ovals.transposeInPlace();
-	for (int i = 0; i < resid.rows(); i++)
-		resid.row(i) = oe_vals.row(i) - ovals;
+	resid = oe_vals.expr() - ovals.replicate(resid.rows(), 1);
 	apply_ineq_constraints(resid, act_obs_names);
 	return resid;
 }
@@ -1782,128 +1376,166 @@ Eigen::VectorXd L2PhiHandler::get_q_vector()
 	return q;
 }
 
-map<string, double> L2PhiHandler::get_obs_group_contrib(Eigen::VectorXd &phi_vec)
+void L2PhiHandler::prep_phi_info()
 {
-	map<string, double> group_phi_map;
-	double sum;
-	for (auto &og : obs_group_idx_map)
+	//the per-obs and per-par arrays only need to be rebuilt if the base ensemble variables change
+	vector<string> names = oe_base->get_var_names();
+	vector<Eigen::Triplet<double>> triplets;
+	int g;
+	if (names != group_obs_names)
+	{
+		const ObservationInfo* oinfo = pest_scenario->get_ctl_observation_info_ptr();
+		obs_group_names = pest_scenario->get_ctl_ordered_obs_group_names();
+		pest_utils::NameIndex group_index(obs_group_names);
+		for (int i = 0; i < names.size(); i++)
+		{
+			g = group_index.find_index(oinfo->get_group(names[i]));
+			if (g >= 0)
+				triplets.push_back(Eigen::Triplet<double>(i, g, 1.0));
+		}
+		obs_group_mat.resize(names.size(), obs_group_names.size());
+		obs_group_mat.setFromTriplets(triplets.begin(), triplets.end());
+		get_ineq_idxs(names, lt_idxs, gt_idxs);
+		obs_q_vec = get_q_vector();
+		group_obs_names = names;
+	}
+	if (org_reg_factor == 0.0)
+		return;
+	names = pe_base->get_var_names();
+	if (names != group_par_names)
 	{
-		sum = 0.0;
-		for (auto i : og.second)
-			sum += phi_vec[i];
-		group_phi_map[og.first] = sum;
+		const ParameterInfo& pi = pest_scenario->get_ctl_parameter_info();
+		par_group_names = pest_scenario->get_ctl_ordered_par_group_names();
+		pest_utils::NameIndex group_index(par_group_names);
+		triplets.clear();
+		for (int i = 0; i < names.size(); i++)
+		{
+			g = group_index.find_index(pi.get_parameter_rec_ptr(names[i])->group);
+			if (g >= 0)
+				triplets.push_back(Eigen::Triplet<double>(i, g, 1.0));
+		}
+		par_group_mat.resize(names.size(), par_group_names.size());
+		par_group_mat.setFromTriplets(triplets.begin(), triplets.end());
+		group_par_names = names;
 	}
+}
 
-	return group_phi_map;
+void L2PhiHandler::update(ObservationEnsemble & oe, ParameterEnsemble & pe)
+{
+	meas.clear();
+	actual.clear();
+	obs_group_phi_map.clear();
+	regul.clear();
+	par_group_phi_map.clear();
+	update_reals(oe, pe, oe.get_real_names(), pe.get_real_names());
 }
 
-map<string, double> L2PhiHandler::get_par_group_contrib(Eigen::VectorXd &phi_vec)
+void L2PhiHandler::update_reals(ObservationEnsemble& oe, ParameterEnsemble& pe, const vector<string>& oe_real_names,
+	const vector<string>& pe_real_names)
 {
-	map<string, double> group_phi_map;
-	double sum;
-	for (auto &pg : par_group_idx_map)
+	prep_phi_info();
+
+	//drop the phi entries of any realizations that are no longer in the ensembles
+	vector<string> names = oe.get_real_names();
+	set<string> keep(names.begin(), names.end());
+	for (auto it = meas.begin(); it != meas.end();)
+		it = (keep.find(it->first) == keep.end()) ? meas.erase(it) : next(it);
+	for (auto it = actual.begin(); it != actual.end();)
+		it = (keep.find(it->first) == keep.end()) ? actual.erase(it) : next(it);
+	for (auto it = obs_group_phi_map.begin(); it != obs_group_phi_map.end();)
+		it = (keep.find(it->first) == keep.end()) ? obs_group_phi_map.erase(it) : next(it);
+
+	//only the listed realizations (that are still in the ensembles) are recalculated
+	names.clear();
+	for (auto& rname : oe_real_names)
+		if (keep.find(rname) != keep.end())
+			names.push_back(rname);
+	calc_obs_phi(oe, names);
+	if (org_reg_factor != 0.0)
+	{
+		names = pe.get_real_names();
+		keep.clear();
+		keep.insert(names.begin(), names.end());
+		for (auto it = regul.begin(); it != regul.end();)
+			it = (keep.find(it->first) == keep.end()) ? regul.erase(it) : next(it);
+		for (auto it = par_group_phi_map.begin(); it != par_group_phi_map.end();)
+			it = (keep.find(it->first) == keep.end()) ? par_group_phi_map.erase(it) : next(it);
+		names.clear();
+		for (auto& rname : pe_real_names)
+			if (keep.find(rname) != keep.end())
+				names.push_back(rname);
+		calc_par_phi(pe, names);
+		composite = calc_composite(meas, regul);
+	}
+	else
 	{
-		sum = 0.0;
-		for (auto i : pg.second)
-			sum += phi_vec[i];
-		group_phi_map[pg.first] = sum;
+		composite = meas;
 	}
-	return group_phi_map;
 }
 
-void L2PhiHandler::update(ObservationEnsemble & oe, ParameterEnsemble & pe)
+void L2PhiHandler::calc_obs_phi(ObservationEnsemble& oe, const vector<string>& real_names)
 {
-	//build up obs group and par group idx maps for group reporting
-	obs_group_idx_map.clear();
-	vector<string> nnz_obs = oe_base->get_var_names();
-	ObservationInfo oinfo = pest_scenario->get_ctl_observation_info();
-	vector<int> idx;
+	//only realizations that are also in the base ensemble get a phi value
+	vector<string> base_real_names = oe_base->get_real_names();
+	set<string> base_set(base_real_names.begin(), base_real_names.end());
+	vector<string> names;
+	for (auto& rname : real_names)
+		if (base_set.find(rname) != base_set.end())
+			names.push_back(rname);
+	if (names.size() == 0)
+		return;
 
-	/*for (auto& og : pest_scenario->get_ctl_ordered_obs_group_names())
+	vector<string> obs_names = oe_base->get_var_names();
+	if (obs_names.size() == 0)
 	{
-		idx.clear();
-		for (int i = 0; i < nnz_obs.size(); i++)
+		for (auto& rname : names)
 		{
-			if (oinfo.get_group(nnz_obs[i]) == og)
-			{
-				idx.push_back(i);
-			}
+			meas[rname] = 0.0;
+			actual[rname] = 0.0;
+			obs_group_phi_map[rname] = vector<double>(obs_group_names.size(), 0.0);
 		}
-		if (idx.size() > 0)
-			obs_group_idx_map[og] = idx;
-	}*/
-	for (auto& og : pest_scenario->get_ctl_ordered_obs_group_names())
-		obs_group_idx_map[og] = vector<int>();
-
-	for (int i = 0; i < nnz_obs.size(); i++)
-	{
-		obs_group_idx_map[oinfo.get_group(nnz_obs[i])].push_back(i);
+		return;
 	}
+	EnsembleView oe_vals = oe.get_view(names, obs_names);
 
-
-	//update the various phi component vectors
-	meas.clear();
-	obs_group_phi_map.clear();
-	Eigen::VectorXd q = get_q_vector();
-	map<string, Eigen::VectorXd> meas_map = calc_meas(oe, q);
-	for (auto &pv : meas_map)
-	{
-		meas[pv.first] = pv.second.sum();
-
-	}
-	if (org_reg_factor != 0.0)
+	//measurement phi is against the noisy obs values in the base ensemble
+	Eigen::MatrixXd resid = oe_vals.expr() - oe_base->get_view(names, vector<string>()).expr();
+	apply_ineq_constraints(resid, lt_idxs, gt_idxs);
+	resid = (resid.array().rowwise() * obs_q_vec.transpose().array()).square().matrix();
+	Eigen::VectorXd phi = resid.rowwise().sum();
+	for (int i = 0; i < names.size(); i++)
+		meas[names[i]] = phi[i];
+
+	//actual phi is against the control file obs values
+	Eigen::RowVectorXd ovals = pest_scenario->get_ctl_observations().get_data_eigen_vec(obs_names).transpose();
+	resid = oe_vals.expr().rowwise() - ovals;
+	apply_ineq_constraints(resid, lt_idxs, gt_idxs);
+	resid = (resid.array().rowwise() * obs_q_vec.transpose().array()).square().matrix();
+	phi = resid.rowwise().sum();
+	Eigen::MatrixXd group_phi = resid * obs_group_mat;
+	for (int i = 0; i < names.size(); i++)
 	{
-		par_group_idx_map.clear();
-		vector<string> pars = pe_base->get_var_names();
-		ParameterInfo pi = pest_scenario->get_ctl_parameter_info();
-		for (auto& pg : pest_scenario->get_ctl_ordered_par_group_names())
-		{
-			idx.clear();
-			for (int i = 0; i < pars.size(); i++)
-			{
-				if (pi.get_parameter_rec_ptr(pars[i])->group == pg)
-					idx.push_back(i);
-			}
-			if (idx.size() > 0)
-				par_group_idx_map[pg] = idx;
-		}
-		regul.clear();
-		map<string, Eigen::VectorXd> reg_map = calc_regul(pe);//, *reg_factor);
-		//for (auto &pv : calc_regul(pe))
-		//string name;
-		//big assumption - if oe is a diff shape, then this
-		//must be a subset, so just use the first X rows of pe
-		/*for (int i = 0; i < oe.shape().first; i++)
-		{
-			//name = preal_names[i];
-			name = pe.get_real_names()[i];
-			//cout << name << endl;
-			regul[name] = reg_map[name].sum();
-			par_group_phi_map[name] = get_par_group_contrib(reg_map[name]);
-		}*/
-        for (auto& r : reg_map)
-        {
-            //name = preal_names[i];
-            //name = pe.get_real_names()[i];
-            //cout << name << endl;
-            regul[r.first] = r.second.sum();
-            par_group_phi_map[r.first] = get_par_group_contrib(r.second);
-        }
-        composite.clear();
-        composite = calc_composite(meas, regul);
+		actual[names[i]] = phi[i];
+		obs_group_phi_map[names[i]] = eigenvec_2_stlvec(group_phi.row(i).transpose());
 	}
-	else
-    {
-	    composite = meas;
-    }
-	
-	actual.clear();
-	for (auto &pv : calc_actual(oe, q))
+}
+
+void L2PhiHandler::calc_par_phi(ParameterEnsemble& pe, const vector<string>& real_names)
+{
+	if (real_names.size() == 0)
+		return;
+	pe_base->transform_ip(ParameterEnsemble::transStatus::NUM);
+	pe.transform_ip(ParameterEnsemble::transStatus::NUM);
+	Eigen::MatrixXd diff_mat = pe.get_view(real_names, pe_base->get_var_names()).expr() -
+		pe_base->get_view(real_names, vector<string>()).expr();
+	diff_mat = (diff_mat.array().square().rowwise() * parcov_inv_diag.transpose().array()).matrix();
+	Eigen::VectorXd phi = diff_mat.rowwise().sum();
+	Eigen::MatrixXd group_phi = diff_mat * par_group_mat;
+	for (int i = 0; i < real_names.size(); i++)
 	{
-		actual[pv.first] = pv.second.sum();
-		obs_group_phi_map[pv.first] = get_obs_group_contrib(pv.second);
+		regul[real_names[i]] = phi[i];
+		par_group_phi_map[real_names[i]] = eigenvec_2_stlvec(group_phi.row(i).transpose());
 	}
-
 }
 
 void L2PhiHandler::save_residual_cov(ObservationEnsemble& oe, int iter)
@@ -2296,18 +1928,16 @@ void L2PhiHandler::write_group_csv(int iter_num, int total_runs, ofstream &csv,
 		for (auto &e : extra)
 			csv << ',' << e;
 
-		for (auto &name : pest_scenario->get_ctl_ordered_obs_group_names())
-			if (obs_group_phi_map[oreal].find(name) == obs_group_phi_map[oreal].end())
-				csv << ',' << 0.0;
-			else
-				csv  << ',' << obs_group_phi_map[oreal][name];
+		for (auto &v : obs_group_phi_map[oreal])
+			csv  << ',' << v;
 		if (org_reg_factor != 0.0)
 		{
-			for (auto& name : pest_scenario->get_ctl_ordered_par_group_names())
-				if (par_group_phi_map[preal].find(name) == par_group_phi_map[preal].end())
+			if (par_group_phi_map.find(preal) == par_group_phi_map.end())
+				for (int i = 0; i < pest_scenario->get_ctl_ordered_par_group_names().size(); i++)
 					csv << ',' << 0.0;
-				else
-					csv << ',' << par_group_phi_map[preal][name];
+			else
+				for (auto& v : par_group_phi_map[preal])
+					csv << ',' << v;
 		}
 		csv << endl;;
 		csv.flush();
@@ -2410,106 +2040,51 @@ map<string, Eigen::VectorXd> L2PhiHandler::calc_meas(ObservationEnsemble & oe, E
 	return phi_map;
 }
 
-map<string, Eigen::VectorXd> L2PhiHandler::calc_regul(ParameterEnsemble & pe)
+void L2PhiHandler::get_ineq_idxs(const vector<string>& names, vector<int>& _lt_idxs, vector<int>& _gt_idxs)
 {
-	map<string, Eigen::VectorXd> phi_map;
-	vector<string> real_names = pe.get_real_names();
-	pe_base->transform_ip(ParameterEnsemble::transStatus::NUM);
-	pe.transform_ip(ParameterEnsemble::transStatus::NUM);
-	Eigen::MatrixXd diff_mat = get_par_resid(pe);
-
-
-	Eigen::VectorXd diff;
-	for (int i = 0; i < real_names.size(); i++)
+	_lt_idxs.clear();
+	_gt_idxs.clear();
+	if ((lt_obs_names.size() == 0) && (gt_obs_names.size() == 0))
+		return;
+	pest_utils::NameIndex index(names);
+	int idx;
+	for (auto& n : lt_obs_names)
 	{
-		diff = diff_mat.row(i);
-		diff = diff.cwiseProduct(diff);
-		//cout << diff << endl;
-		diff = diff.cwiseProduct(parcov_inv_diag);
-		//cout << diff << endl;
-		//cout << parcov_inv_diag << endl;
-		//phi_map[real_names[i]] = _reg_fac * diff;
-		phi_map[real_names[i]] = diff;
-		
+		idx = index.find_index(n);
+		if (idx >= 0)
+			_lt_idxs.push_back(idx);
+	}
+	for (auto& n : gt_obs_names)
+	{
+		idx = index.find_index(n);
+		if (idx >= 0)
+			_gt_idxs.push_back(idx);
 	}
-	return phi_map;
 }
 
-
 void L2PhiHandler::apply_ineq_constraints(Eigen::MatrixXd &resid, vector<string> &names)
 {
-	
-	//vector<string> names = oe_base->get_var_names();
-	//vector<string> lt_names = get_lt_obs_names(), gt_names = get_gt_obs_names();
-	//vector<string> act_obs_names = pest_scenario->get_ctl_ordered_nz_obs_names();
-	
 	assert(names.size() == resid.cols());
-
-	map<string, double> lt_vals,gt_vals;
-	Observations obs = pest_scenario->get_ctl_observations();
-	for (auto &n : lt_obs_names)
-		lt_vals[n] = obs.get_rec(n);
-	for (auto &n : gt_obs_names)
-		gt_vals[n] = obs.get_rec(n);
-	if ((lt_vals.size() == 0) && (gt_vals.size() == 0))
+	if ((lt_obs_names.size() == 0) && (gt_obs_names.size() == 0))
 		return;
-	map<string, int> idxs;
-	//for (int i = 0; i < act_obs_names.size(); i++)
-	//	idxs[act_obs_names[i]] = i;
-	for (int i = 0; i < names.size(); i++)
-		idxs[names[i]] = i;
-	int idx;
-	double val;
-	Eigen::VectorXd col;
-
-	for (auto iv : lt_vals)
-	{
-		idx = idxs[iv.first];
-		col = resid.col(idx);
-		val = iv.second;
-		//cout << resid.col(idx) << endl;
-		for (int i = 0; i < resid.rows(); i++)
-			col(i) = (col(i) < 0.0) ? 0.0 : col(i);
-		//cout << resid.col(idx) << endl;
-		resid.col(idx) = col;
-		//cout << resid.col(idx) << endl;
-	}
-
-	for (auto iv : gt_vals)
+	//use the stored column indices if these are the base obs names
+	if (names == group_obs_names)
 	{
-		idx = idxs[iv.first];
-		col = resid.col(idx);
-		val = iv.second;
-		for (int i = 0; i < resid.rows(); i++)
-			col(i) = (col(i) > 0.0) ? 0.0 : col(i);
-		resid.col(idx) = col;
+		apply_ineq_constraints(resid, lt_idxs, gt_idxs);
+		return;
 	}
+	vector<int> _lt_idxs, _gt_idxs;
+	get_ineq_idxs(names, _lt_idxs, _gt_idxs);
+	apply_ineq_constraints(resid, _lt_idxs, _gt_idxs);
 }
 
-
-map<string, Eigen::VectorXd> L2PhiHandler::calc_actual(ObservationEnsemble & oe, Eigen::VectorXd &q_vec)
+void L2PhiHandler::apply_ineq_constraints(Eigen::MatrixXd& resid, const vector<int>& _lt_idxs, const vector<int>& _gt_idxs)
 {
-	map<string, Eigen::VectorXd> phi_map;
-	Eigen::MatrixXd resid = get_actual_obs_resid(oe);
-	vector<string> base_real_names = oe_base->get_real_names(), oe_real_names = oe.get_real_names();
-	vector<string>::iterator start = base_real_names.begin(), end = base_real_names.end();
-	double phi;
-	string rname;
-
-	Eigen::MatrixXd oe_reals = oe.get_eigen(vector<string>(), oe_base->get_var_names());
-	Eigen::VectorXd diff;
-	for (int i = 0; i<oe.shape().first; i++)
-	{
-		rname = oe_real_names[i];
-		if (find(start, end, rname) == end)
-			continue;
-		//diff = (oe_vec - obs_val_vec).cwiseProduct(q);
-		diff = resid.row(i);
-		diff = diff.cwiseProduct(q_vec);
-		//phi = (diff.cwiseProduct(diff)).sum();
-		phi_map[rname] = diff.cwiseProduct(diff);
-	}
-	return phi_map;
+	//less-than obs only contribute when the residual is positive, greater-than only when negative
+	for (auto idx : _lt_idxs)
+		resid.col(idx) = resid.col(idx).cwiseMax(0.0);
+	for (auto idx : _gt_idxs)
+		resid.col(idx) = resid.col(idx).cwiseMin(0.0);
 }
 
 
@@ -2881,7 +2456,11 @@ vector<int> run_ensemble_util(PerformanceLog* performance_log, ofstream& frec,Pa
 	ParameterEnsemble run_mgr_pe = _pe.zeros_like(0);
 	try
 	{
-		failed_real_indices = _oe.update_from_runs(real_run_ids, run_mgr_ptr, run_mgr_pe);
+		//the run mgr par values are only harvested when they are going to be checked
+		if (check_pe_consistency)
+			failed_real_indices = _oe.update_from_runs(real_run_ids, run_mgr_ptr, run_mgr_pe);
+		else
+			failed_real_indices = _oe.update_from_runs(real_run_ids, run_mgr_ptr);
 	} 
 	catch (const exception& e)
 	{
@@ -3244,13 +2823,23 @@ bool EnsembleMethod::should_terminate()
 vector<ObservationEnsemble> EnsembleMethod::run_lambda_ensembles(vector<ParameterEnsemble>& pe_lams, vector<double>& lam_vals, 
 	vector<double>& scale_vals, int cycle, vector<int>& pe_subset_idxs, vector<int>& oe_subset_idxs)
 {
-	ofstream& frec = file_manager.rec_ofstream();
 	stringstream ss;
 	ss << "queuing " << pe_lams.size() << " ensembles";
 	performance_log->log_event(ss.str());
+	prep_lambda_runs(pe_lams[0], pe_subset_idxs, oe_subset_idxs);
+	vector<map<int, int>> real_run_ids_vec;
+	for (auto& pe_lam : pe_lams)
+		real_run_ids_vec.push_back(queue_lambda_runs(pe_lam, pe_subset_idxs, cycle));
+	performance_log->log_event("making runs");
+	make_lambda_runs();
+	return process_lambda_runs(pe_lams, lam_vals, scale_vals, real_run_ids_vec, pe_subset_idxs, oe_subset_idxs);
+}
+
+void EnsembleMethod::prep_lambda_runs(ParameterEnsemble& pe_lam, vector<int>& pe_subset_idxs, vector<int>& oe_subset_idxs)
+{
+	stringstream ss;
 	run_mgr_ptr->reinitialize();
-	vector<string> names = pe_lams[0].get_real_names();
-	ss.str("");
+	vector<string> names = pe_lam.get_real_names();
 	for (auto i : pe_subset_idxs)
 		ss << i << ":" << names[i] << ", ";
 	message(1, "subset idx:pe real name: ", ss.str());
@@ -3259,32 +2848,31 @@ vector<ObservationEnsemble> EnsembleMethod::run_lambda_ensembles(vector<Paramete
 	for (auto i : oe_subset_idxs)
 		ss << i << ":" << names[i] << ", ";
 	message(1, "subset idx:oe real name: ", ss.str());
+}
 
-	//set_subset_idx(pe_lams[0].shape().first);
-	vector<map<int, int>> real_run_ids_vec;
-	//ParameterEnsemble pe_lam;
-	//for (int i=0;i<pe_lams.size();i++)
-	for (auto& pe_lam : pe_lams)
+map<int, int> EnsembleMethod::queue_lambda_runs(ParameterEnsemble& pe_lam, vector<int>& pe_subset_idxs, int cycle)
+{
+	try
 	{
-		try
-		{
-			real_run_ids_vec.push_back(pe_lam.add_runs(run_mgr_ptr, pe_subset_idxs,cycle));
-		}
-		catch (const exception& e)
-		{
-			stringstream ss;
-			ss << "run_ensemble() error queueing runs: " << e.what();
-			throw_em_error(ss.str());
-		}
-		catch (...)
-		{
-			throw_em_error(string("run_ensembles() error queueing runs"));
-		}
+		return pe_lam.add_runs(run_mgr_ptr, pe_subset_idxs, cycle);
 	}
-	performance_log->log_event("making runs");
-	try
+	catch (const exception& e)
+	{
+		stringstream ss;
+		ss << "run_ensemble() error queueing runs: " << e.what();
+		throw_em_error(ss.str());
+	}
+	catch (...)
 	{
+		throw_em_error(string("run_ensembles() error queueing runs"));
+	}
+	return map<int, int>();
+}
 
+void EnsembleMethod::make_lambda_runs()
+{
+	try
+	{
 		run_mgr_ptr->run();
 	}
 	catch (const exception& e)
@@ -3297,7 +2885,11 @@ vector<ObservationEnsemble> EnsembleMethod::run_lambda_ensembles(vector<Paramete
 	{
 		throw_em_error(string("error running ensembles"));
 	}
+}
 
+vector<ObservationEnsemble> EnsembleMethod::process_lambda_runs(vector<ParameterEnsemble>& pe_lams, vector<double>& lam_vals,
+	vector<double>& scale_vals, vector<map<int, int>>& real_run_ids_vec, vector<int>& pe_subset_idxs, vector<int>& oe_subset_idxs)
+{
 	performance_log->log_event("processing runs");
 	vector<int> failed_real_indices;
 	vector<ObservationEnsemble> obs_lams;
@@ -3404,7 +2996,7 @@ vector<ObservationEnsemble> EnsembleMethod::run_lambda_ensembles(vector<Paramete
 	return obs_lams;
 }
 
-pair<string,string> EnsembleMethod::save_ensembles(string tag, int cycle, ParameterEnsemble& _pe, ObservationEnsemble& _oe)
+pair<string,string> EnsembleMethod::save_ensembles(string tag, int cycle, ParameterEnsemble& _pe, ObservationEnsemble& _oe, bool async)
 {
 	stringstream ss;
 	ss << file_manager.get_base_filename();
@@ -3419,15 +3011,9 @@ pair<string,string> EnsembleMethod::save_ensembles(string tag, int cycle, Parame
 	else
 		ss << "." << iter << ".obs";
 	if (pest_scenario.get_pestpp_options().get_save_binary())
-	{
-		ss << ".jcb";
-		_oe.to_binary(ss.str());
-	}
+		ss << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 	else
-	{
 		ss << ".csv";
-		_oe.to_csv(ss.str());
-	}
 	string oname = ss.str();
 	ss.str("");
 	ss << file_manager.get_base_filename();
@@ -3442,16 +3028,31 @@ pair<string,string> EnsembleMethod::save_ensembles(string tag, int cycle, Parame
 	else
 		ss << "." << iter << ".par";
 	if (pest_scenario.get_pestpp_options().get_save_binary())
+		ss << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
+	else
+		ss << ".csv";
+	string pname = ss.str();
+
+	if (async)
 	{
-		ss << ".jcb";
-		_pe.to_binary(ss.str());
+		ens_writer.save(_oe, vector<string>{ oname });
+		ens_writer.save(_pe, vector<string>{ pname });
+		ens_writer.dispatch();
 	}
 	else
 	{
-		ss << ".csv";
-		_pe.to_csv(ss.str());
+		ens_writer.flush();
+		if (pest_scenario.get_pestpp_options().get_save_binary())
+		{
+			_oe.to_binary(oname);
+			_pe.to_binary(pname);
+		}
+		else
+		{
+			_oe.to_csv(oname);
+			_pe.to_csv(pname);
+		}
 	}
-	string pname = ss.str();
 	return pair<string, string>(pname, oname);
 }
 
@@ -3466,11 +3067,14 @@ void EnsembleMethod::report_and_save(int cycle)
 	cout << "   number of active realizations:   " << pe.shape().first << endl;
 	cout << "   number of model runs:            " << run_mgr_ptr->get_total_runs() << endl;
 
-	pair<string, string> names = save_ensembles(string(), cycle, pe, oe);
-	frec << "      current obs ensemble saved to " << names.second << endl;
-	cout << "      current obs ensemble saved to " << names.second << endl;
-	frec << "      current par ensemble saved to " << names.first << endl;
-	cout << "      current par ensemble saved to " << names.first << endl;
+	//the last iteration is written synchronously, earlier ones overlap the next iteration's runs
+	bool async = iter < pest_scenario.get_control_info().noptmax;
+	pair<string, string> names = save_ensembles(string(), cycle, pe, oe, async);
+	string saved = (async) ? " queued for writing to " : " saved to ";
+	frec << "      current obs ensemble" << saved << names.second << endl;
+	cout << "      current obs ensemble" << saved << names.second << endl;
+	frec << "      current par ensemble" << saved << names.first << endl;
+	cout << "      current par ensemble" << saved << names.first << endl;
 	save_real_par_rei(pest_scenario, pe, oe, output_file_writer, file_manager, iter, BASE_REAL_NAME, cycle);
 	save_real_par_rei(pest_scenario, pe, oe, output_file_writer, file_manager, -1, BASE_REAL_NAME, cycle);
 }
@@ -3691,6 +3295,11 @@ void EnsembleMethod::initialize(int cycle, bool run, bool use_existing)
 			message(1, "using localization matrix " + localizer.get_filename());
 			localizer.report(file_manager.rec_ofstream());
 		}
+		if (localizer.get_use_distance())
+		{
+			message(1, "using distance-based localization from coordinate files " + ppo->get_ies_loc_par_coords() + " and " + ppo->get_ies_loc_obs_coords());
+			message(2, "with ies_loc_distance ", ppo->get_ies_loc_distance());
+		}
 	}
 	if ((use_localizer) && (!localizer.get_autoadaloc()))
 	{
@@ -3948,8 +3557,7 @@ void EnsembleMethod::initialize(int cycle, bool run, bool use_existing)
 		ss << file_manager.get_base_filename();
 		if (cycle != NetPackage::NULL_DA_CYCLE)
 			ss << "." << cycle;
-		ss << ".0.par.jcb";
-		pe.to_binary(ss.str());
+		ss << ".0.par" << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 	}
 	else
 	{
@@ -3957,9 +3565,10 @@ void EnsembleMethod::initialize(int cycle, bool run, bool use_existing)
 		if (cycle != NetPackage::NULL_DA_CYCLE)
 			ss << "." << cycle;
 		ss << ".0.par.csv";
-		pe.to_csv(ss.str());
 	}
-	message(1, "saved initial parameter ensemble to ", ss.str());
+	//the initial par and obs+noise ensembles are written while the prior runs are going
+	ens_writer.save(pe, vector<string>{ ss.str() });
+	message(1, "saving initial parameter ensemble to ", ss.str());
 	message(2, "checking for denormal values in obs + noise ensemble");
 	oe_base.check_for_normal("obs+noise observation ensemble");
 	ss.str("");
@@ -3968,8 +3577,7 @@ void EnsembleMethod::initialize(int cycle, bool run, bool use_existing)
 		ss << file_manager.get_base_filename();
 		if (cycle != NetPackage::NULL_DA_CYCLE)
 			ss << "." << cycle;
-		ss << ".obs+noise.jcb";
-		oe_base.to_binary(ss.str());
+		ss << ".obs+noise" << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 	}
 	else
 	{
@@ -3977,9 +3585,10 @@ void EnsembleMethod::initialize(int cycle, bool run, bool use_existing)
 		if (cycle != NetPackage::NULL_DA_CYCLE)
 			ss << "." << cycle;
 		ss << ".obs+noise.csv";
-		oe_base.to_csv(ss.str());
 	}
-	message(1, "saved obs+noise observation ensemble (obsval + noise realizations) to ", ss.str());
+	ens_writer.save(oe_base, vector<string>{ ss.str() });
+	ens_writer.dispatch();
+	message(1, "saving obs+noise observation ensemble (obsval + noise realizations) to ", ss.str());
 
     initialize_weights();
 
@@ -4146,8 +3755,7 @@ void EnsembleMethod::initialize(int cycle, bool run, bool use_existing)
 		ss << file_manager.get_base_filename();
 		if (cycle != NetPackage::NULL_DA_CYCLE)
 			ss << "." << cycle;
-		ss << ".0.obs.jcb";
-		oe.to_binary(ss.str());
+		ss << ".0.obs" << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 	}
 	else
 	{
@@ -4155,9 +3763,16 @@ void EnsembleMethod::initialize(int cycle, bool run, bool use_existing)
 		if (cycle != NetPackage::NULL_DA_CYCLE)
 			ss << "." << cycle;
 		ss << ".0.obs.csv";
-		oe.to_csv(ss.str());
 	}
-	message(1, "saved initial obs ensemble to", ss.str());
+	ens_writer.save(oe, vector<string>{ ss.str() });
+	ens_writer.dispatch();
+	if (pest_scenario.get_control_info().noptmax < 1)
+	{
+		ens_writer.flush();
+		message(1, "saved initial obs ensemble to", ss.str());
+	}
+	else
+		message(1, "queued initial obs ensemble for writing to", ss.str());
 	
 	//save the 0th iter par and rei and well as the untagged par and rei
 	save_real_par_rei(pest_scenario, pe, oe, output_file_writer, file_manager, iter, BASE_REAL_NAME, cycle);
@@ -4848,15 +4463,22 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 	obscov.update_sets();
 
 	//buid up this container here and then reuse it for each lambda later...
-	unordered_map<string, pair<vector<string>, vector<string>>> loc_map;
+	LocCaseMap loc_map;
 	if (use_localizer)
 	{
 		loc_map = localizer.get_localanalysis_case_map(iter, act_obs_names, act_par_names, oe, pe, performance_log);
+		//without the Am term, each par's upgrade only depends on its own obs set, so pars with identical
+		//localized obs sets can share one factorization
+		if ((use_mda) || (pest_scenario.get_pestpp_options().get_ies_use_approx()) || (iter <= 1))
+			loc_map = localizer.batch_cases_by_obs(loc_map, performance_log);
 	}
 	else
 	{
-		pair<vector<string>, vector<string>> p(act_obs_names, act_par_names);
-		loc_map["all"] = p;
+		loc_map = LocCaseMap(act_obs_names, act_par_names);
+		vector<int> obs_idxs(act_obs_names.size()), par_idxs(act_par_names.size());
+		iota(obs_idxs.begin(), obs_idxs.end(), 0);
+		iota(par_idxs.begin(), par_idxs.end(), 0);
+		loc_map.add_case("all", obs_idxs, par_idxs);
 	}
 	if (loc_map.size() == 0)
 	{
@@ -4873,19 +4495,46 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 	vector<string> pe_filenames;
 
 	performance_log->log_event("preparing EnsembleSolver");
-	ParameterEnsemble pe_upgrade(pe.get_pest_scenario_ptr(), &rand_gen, pe.get_eigen(vector<string>(), act_par_names, false), pe.get_real_names(), act_par_names);
-	pe_upgrade.set_zeros();
+	ParameterEnsemble pe_upgrade(pe.get_pest_scenario_ptr(), &rand_gen, Eigen::MatrixXd::Zero(pe.shape().first, act_par_names.size()), pe.get_real_names(), act_par_names);
 	pe_upgrade.set_trans_status(pe.get_trans_status());
 	ObservationEnsemble oe_upgrade(oe.get_pest_scenario_ptr(), &rand_gen, oe.get_eigen(vector<string>(), act_obs_names, false), oe.get_real_names(), act_obs_names);
     //oe_upgrade.get_eigen_ptr_4_mod()->setZero();
 	//pass pe so that we can use the current par values but pass oe_upgrade since it only includes nz weight obs
     EnsembleSolver es(performance_log, file_manager, pest_scenario, pe, oe_upgrade, oe_base, weights, localizer, parcov, Am, ph,
 		use_localizer, iter, act_par_names, act_obs_names);
+	//the svd of each case does not depend on lambda, so keep it between lambdas
+	if (inflation_factors.size() > 1)
+		es.set_factor_cache_mb(pest_scenario.get_pestpp_options().get_ies_upgrade_factor_cache_mb());
+
+	//if saving upgrades to disk, only the subset rows are kept in memory
+	bool save_upgrades = (!pest_scenario.get_pestpp_options().get_ies_upgrades_in_memory()) && (subset_idxs.size() < pe.shape().first) && ((inflation_factors.size() > 1) || (backtrack_factors.size() > 1));
+	vector<int> run_subset_idxs = subset_idxs;
+	if (save_upgrades)
+	{
+		run_subset_idxs.resize(subset_idxs.size());
+		iota(run_subset_idxs.begin(), run_subset_idxs.end(), 0);
+	}
 
+	//when testing more than one lambda, the runs for the upgrade ensembles that are ready are made on a
+	//background thread while the remaining lambdas are solved.  the run manager is only ever used by one
+	//thread at a time: runs are queued here while the run thread is idle
+	bool overlap_runs = (inflation_factors.size() > 1) && (pest_scenario.get_pestpp_options().get_ies_overlap_lambda_runs()) &&
+		(!pest_scenario.get_pestpp_options().get_ies_debug_upgrade_only()) && (run_mgr_ptr->get_mgr_type() != RunManagerAbstract::RUN_MGR_TYPE::NOTDEFINED);
+	vector<map<int, int>> real_run_ids_lams;
+	thread run_thread;
+	atomic<bool> runs_done(true);
+	exception_ptr run_exception = nullptr;
+	//make sure the run thread is joined on any exit from here
+	struct RunThreadGuard
+	{
+		thread& t;
+		~RunThreadGuard() { if (t.joinable()) t.join(); }
+	} run_thread_guard{ run_thread };
 
     //solve for each factor
-    for (auto& cur_lam : inflation_factors)
+    for (int ilam = 0; ilam < inflation_factors.size(); ilam++)
 	{
+		double cur_lam = inflation_factors[ilam];
 		ss.str("");
 		if (!use_mda)
 			message(1, "starting calcs for glm factor", cur_lam);
@@ -4893,8 +4542,7 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 			message(1, "starting calcs for mda factor", cur_lam);
 		message(2, "see .log file for more details");
 
-		pe_upgrade = ParameterEnsemble(pe.get_pest_scenario_ptr(), &rand_gen, pe.get_eigen(vector<string>(), act_par_names, false), pe.get_real_names(), act_par_names);
-        pe_upgrade.set_zeros();
+		pe_upgrade = ParameterEnsemble(pe.get_pest_scenario_ptr(), &rand_gen, Eigen::MatrixXd::Zero(pe.shape().first, act_par_names.size()), pe.get_real_names(), act_par_names);
 		pe_upgrade.set_trans_status(pe.get_trans_status());
         double mm_alpha = pest_scenario.get_pestpp_options().get_ies_multimodal_alpha();
 		if (mm_alpha != 1.0)
@@ -4925,12 +4573,15 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 			ss.str("");
 			ss << file_manager.get_base_filename() << "." << iter << "." << cur_lam << ".lambda." << sf << ".scale.par";
 
-			if ((!pest_scenario.get_pestpp_options().get_ies_upgrades_in_memory()) && (subset_idxs.size() < pe.shape().first) && ((inflation_factors.size() > 1) || (backtrack_factors.size() > 1)))
+			if (save_upgrades)
 			{
-				pe_lam_scale.to_dense(ss.str() + ".bin");
-				pe_filenames.push_back(ss.str() + ".bin");
+				//chunked format so only the surviving realizations are read back later - the
+				//".spill" tag keeps this apart from a lambda ensemble saved in the ens format below
+				string spill_filename = ss.str() + ".spill.ens";
+				pe_lam_scale.to_binary_chunked(spill_filename, pest_scenario.get_pestpp_options().get_ies_single_precision());
+				pe_filenames.push_back(spill_filename);
 				pe_lam_scale.keep_rows(subset_idxs,true);
-				message(1,"upgrade ensemble saved to " + ss.str() + ".bin");
+				message(1,"upgrade ensemble saved to " + spill_filename);
 
 			}
 			else if (!pest_scenario.get_pestpp_options().get_ies_upgrades_in_memory())
@@ -4946,7 +4597,7 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 
 			if (pest_scenario.get_pestpp_options().get_save_binary())
 			{
-				pe_lam_scale.to_binary(ss.str()+".jcb");
+				pe_lam_scale.to_binary(ss.str() + pest_scenario.get_pestpp_options().get_ensemble_binary_ext());
 			}
 			else
 			{
@@ -4959,6 +4610,60 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 		ss.str("");
 		message(1, "finished calcs for:", cur_lam);
 
+		//if the run thread is idle, start the runs for the upgrade ensembles that are ready
+		//(the last lambda's runs are made below)
+		if ((overlap_runs) && (runs_done) && (ilam < inflation_factors.size() - 1))
+		{
+			if (run_thread.joinable())
+				run_thread.join();
+			if (run_exception)
+				break;
+			if (real_run_ids_lams.size() == 0)
+				prep_lambda_runs(pe_lams[0], run_subset_idxs, subset_idxs);
+			ss.str("");
+			ss << "queuing runs for " << pe_lams.size() - real_run_ids_lams.size() << " upgrade ensembles while the remaining lambdas are solved";
+			performance_log->log_event(ss.str());
+			message(1, ss.str());
+			for (int i = real_run_ids_lams.size(); i < pe_lams.size(); i++)
+				real_run_ids_lams.push_back(queue_lambda_runs(pe_lams[i], run_subset_idxs, cycle));
+			runs_done = false;
+			run_thread = thread([this, &runs_done, &run_exception]()
+			{
+				try
+				{
+					run_mgr_ptr->run();
+				}
+				catch (...)
+				{
+					run_exception = current_exception();
+				}
+				runs_done = true;
+			});
+		}
+	}
+	//all of the upgrades are formed, so the out-of-core scratch files arent needed during the runs
+	es.release_out_of_core();
+	if (run_thread.joinable())
+	{
+		performance_log->log_event("waiting for background upgrade ensemble runs");
+		run_thread.join();
+	}
+	if (run_exception)
+	{
+		try
+		{
+			rethrow_exception(run_exception);
+		}
+		catch (const exception& e)
+		{
+			ss.str("");
+			ss << "error running ensembles: " << e.what();
+			throw_em_error(ss.str());
+		}
+		catch (...)
+		{
+			throw_em_error(string("error running ensembles"));
+		}
 	}
 
 	if (pest_scenario.get_pestpp_options().get_ies_debug_upgrade_only())
@@ -4991,7 +4696,6 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 		return true;
 	}
 
-	vector<map<int, int>> real_run_ids_lams;
 	int best_idx = -1;
 	double best_mean = 1.0e+30, best_std = 1.0e+30; // todo (Ayman): read those from input
 	double mean, std;
@@ -4999,16 +4703,23 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 	message(0, "running upgrade ensembles");
 	vector<ObservationEnsemble> oe_lams;
 	
-	//if we are saving upgrades to disk
-	if (pe_filenames.size() > 0)
+	if (real_run_ids_lams.size() > 0)
 	{
-		vector<int> temp;
-		for (int i = 0; i < subset_idxs.size(); i++)
-			temp.push_back(i);
-		oe_lams = run_lambda_ensembles(pe_lams, lam_vals, scale_vals, cycle, temp, subset_idxs);
+		//some of the runs were made while solving, so just make the rest
+		if (real_run_ids_lams.size() < pe_lams.size())
+		{
+			ss.str("");
+			ss << "queuing " << pe_lams.size() - real_run_ids_lams.size() << " ensembles";
+			performance_log->log_event(ss.str());
+			for (int i = real_run_ids_lams.size(); i < pe_lams.size(); i++)
+				real_run_ids_lams.push_back(queue_lambda_runs(pe_lams[i], run_subset_idxs, cycle));
+			performance_log->log_event("making runs");
+			make_lambda_runs();
+		}
+		oe_lams = process_lambda_runs(pe_lams, lam_vals, scale_vals, real_run_ids_lams, run_subset_idxs, subset_idxs);
 	}
 	else
- 		oe_lams = run_lambda_ensembles(pe_lams, lam_vals, scale_vals, cycle, subset_idxs,subset_idxs);
+ 		oe_lams = run_lambda_ensembles(pe_lams, lam_vals, scale_vals, cycle, run_subset_idxs, subset_idxs);
 
 	message(0, "evaluting upgrade ensembles");
 	message(1, "last mean: ", last_best_mean);
@@ -5045,7 +4756,7 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 
 			if (pest_scenario.get_pestpp_options().get_save_binary())
 			{
-				ss << ".jcb";
+				ss << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 				oe_lams[i].to_binary(ss.str());
 			}
 			else
@@ -5117,7 +4828,8 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 				message(1, "updating realizations with reduced phi");
 				update_reals_by_phi(pe_lams[best_idx], oe_lams[best_idx],subset_idxs);
 			}
-			ph.update(oe, pe);
+			else
+				ph.update(oe, pe);
 			//re-check phi
 			double new_best_mean = ph.get_mean(L2PhiHandler::phiType::COMPOSITE);
 			if (new_best_mean < best_mean)
@@ -5188,9 +4900,17 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 					pe_lams[best_idx].drop_rows(missing);
 			}
 			
-			remaining_pe_lam.from_binary(pe_filenames[best_idx]);
+			//skip any failed runs from subset testing while loading
+			vector<string> keep_real_names;
+			if (missing.size() > 0)
+			{
+				set<string> smissing(missing.begin(), missing.end());
+				for (auto& rname : pe.get_real_names())
+					if (smissing.find(rname) == smissing.end())
+						keep_real_names.push_back(rname);
+			}
+			remaining_pe_lam.from_binary(pe_filenames[best_idx], false, keep_real_names);
 			remaining_pe_lam.transform_ip(ParameterEnsemble::transStatus::NUM);
-			//remove any failed runs from subset testing
 			if (missing.size() > 0)
 				remaining_pe_lam.drop_rows(missing);
 			for (auto& pe_filename : pe_filenames)
@@ -5295,7 +5015,8 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 			throw_em_error(string("all realization dropped after finishing subset runs...something might be wrong..."));
 		}
 		performance_log->log_event("updating phi");
-		ph.update(oe_lam_best, pe_lams[best_idx]);
+		//the subset reals were evaluated above, so only the remaining reals need phi
+		ph.update_reals(oe_lam_best, pe_lams[best_idx], remaining_oe_lam.get_real_names(), remaining_pe_lam.get_real_names());
 		best_mean = ph.get_mean(L2PhiHandler::phiType::COMPOSITE);
 		best_std = ph.get_std(L2PhiHandler::phiType::COMPOSITE);
 		message(1, "phi summary for entire ensemble using lambda,scale_fac ", vector<double>({ lam_vals[best_idx],scale_vals[best_idx] }));
@@ -5309,9 +5030,6 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 
 	}
 
-	ph.update(oe_lam_best, pe_lams[best_idx]);
-	best_mean = ph.get_mean(L2PhiHandler::phiType::COMPOSITE);
-	best_std = ph.get_std(L2PhiHandler::phiType::COMPOSITE);
 	message(1, "last best mean phi * acceptable phi factor: ", last_best_mean * acc_fac);
 	message(1, "current best mean phi: ", best_mean);
 
@@ -5356,7 +5074,8 @@ bool EnsembleMethod::solve(bool use_mda, vector<double> inflation_factors, vecto
 			update_reals_by_phi(pe_lams[best_idx], oe_lam_best);
 			
 		}
-		ph.update(oe, pe);
+		else
+			ph.update(oe, pe);
 		//re-check phi
 		double new_best_mean = ph.get_mean(L2PhiHandler::phiType::COMPOSITE);
 		if (new_best_mean < best_mean)
@@ -5628,7 +5347,7 @@ bool EnsembleMethod::initialize_pe(Covariance& cov)
 				throw_em_error(string("error processing par csv"));
 			}
 		}
-		else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0))
+		else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0) || (par_ext.compare("ens") == 0))
 		{
 			message(1, "loading par ensemble from binary file", par_csv);
 			try
@@ -5647,7 +5366,7 @@ bool EnsembleMethod::initialize_pe(Covariance& cov)
 		}
 		else
 		{
-			ss << "unrecognized par csv extension " << par_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized par csv extension " << par_ext << ", looking for csv, jcb, jco, or ens";
 			throw_em_error(ss.str());
 		}
 
@@ -5855,7 +5574,7 @@ bool EnsembleMethod::initialize_weights()
 				throw_em_error(string("error processing weights csv"));
 			}
 		}
-		else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0))
+		else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0) || (obs_ext.compare("ens") == 0))
 		{
 			message(1, "loading weights ensemble from binary file", weight_csv);
 			try
@@ -5875,7 +5594,7 @@ bool EnsembleMethod::initialize_weights()
 		}
 		else
 		{
-			ss << "unrecognized weights ensemble extension " << obs_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized weights ensemble extension " << obs_ext << ", looking for csv, jcb, jco, or ens";
 			throw_em_error(ss.str());
 		}
 		//make sure all oe realizations are in weights
@@ -5962,7 +5681,7 @@ bool EnsembleMethod::initialize_oe(Covariance& cov)
                 throw_em_error(string("error processing obs csv"));
             }
         }
-        else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0))
+        else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0) || (obs_ext.compare("ens") == 0))
         {
             message(1, "loading obs ensemble from binary file", obs_csv);
             try
@@ -5982,7 +5701,7 @@ bool EnsembleMethod::initialize_oe(Covariance& cov)
         }
         else
         {
-            ss << "unrecognized obs ensemble extension " << obs_ext << ", looking for csv, jcb, or jco";
+            ss << "unrecognized obs ensemble extension " << obs_ext << ", looking for csv, jcb, jco, or ens";
             throw_em_error(ss.str());
         }
         if (pp_args.find("IES_NUM_REALS") != pp_args.end())
@@ -6036,7 +5755,7 @@ void EnsembleMethod::initialize_restart()
 			throw_em_error(string("error processing restart obs csv"));
 		}
 	}
-	else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0))
+	else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0) || (obs_ext.compare("ens") == 0))
 	{
 		message(1, "loading restart obs ensemble from binary file", obs_restart_csv);
 		try
@@ -6055,7 +5774,7 @@ void EnsembleMethod::initialize_restart()
 	}
 	else
 	{
-		ss << "unrecognized restart obs ensemble extension " << obs_ext << ", looking for csv, jcb, or jco";
+		ss << "unrecognized restart obs ensemble extension " << obs_ext << ", looking for csv, jcb, jco, or ens";
 		throw_em_error(ss.str());
 	}
 	if (par_restart_csv.size() > 0)
@@ -6078,7 +5797,7 @@ void EnsembleMethod::initialize_restart()
 				throw_em_error(string("error processing restart par csv"));
 			}
 		}
-		else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0))
+		else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0) || (par_ext.compare("ens") == 0))
 		{
 			message(1, "loading restart par ensemble from binary file", par_restart_csv);
 			try
@@ -6097,7 +5816,7 @@ void EnsembleMethod::initialize_restart()
 		}
 		else
 		{
-			ss << "unrecognized restart par ensemble extension " << par_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized restart par ensemble extension " << par_ext << ", looking for csv, jcb, jco, or ens";
 			throw_em_error(ss.str());
 		}
 		if (pe.shape().first != oe.shape().first)
@@ -6188,7 +5907,7 @@ void EnsembleMethod::initialize_restart()
 				ss.str("");
 				if (pest_scenario.get_pestpp_options().get_save_binary())
 				{
-					ss << file_manager.get_base_filename() << ".obs+noise.jcb";
+					ss << file_manager.get_base_filename() << ".obs+noise" << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 					oe_base.to_binary(ss.str());
 				}
 				else
@@ -6659,17 +6378,16 @@ void EnsembleMethod::update_reals_by_phi(ParameterEnsemble& _pe, ObservationEnse
 		for (int i = 0; i < pe_names.size(); i++)
 			pe_idx_to_name[i] = pe_names[i];
 	}
-	//store map of current phi values
-	ph.update(oe, pe);
+	//store map of the new phi values
+	ph.update(_oe, _pe);
 	L2PhiHandler::phiType pt = L2PhiHandler::phiType::COMPOSITE;
-	map<string, double>* phi_map = ph.get_phi_map_ptr(pt);
-	map<string, double> cur_phi_map;
-	for (auto p : *phi_map)
-		cur_phi_map[p.first] = p.second;
+	map<string, double> new_phi_map = ph.get_phi_map(pt);
 
-	//now get a phi map of the new phi values
-	ph.update(_oe, _pe);
-	phi_map = ph.get_phi_map_ptr(pt);
+	//now get the current phi values - these are then updated in place for just the reals that change
+	ph.update(oe, pe);
+	map<string, double>* phi_map = ph.get_phi_map_ptr(pt);
+	map<string, double> cur_phi_map = *phi_map;
+	vector<string> updated_oe_names, updated_pe_names;
 
 	double acc_fac = pest_scenario.get_pestpp_options().get_ies_accept_phi_fac();
 	double cur_phi, new_phi;
@@ -6679,7 +6397,7 @@ void EnsembleMethod::update_reals_by_phi(ParameterEnsemble& _pe, ObservationEnse
 	for (int i = 0; i < _oe.shape().first; i++)
 	{
 		oname = oe_names[i];
-		new_phi = phi_map->at(oname);
+		new_phi = new_phi_map.at(oname);
 		cur_phi = cur_phi_map.at(oname);
 		if (new_phi < cur_phi * acc_fac)
 		{
@@ -6696,9 +6414,11 @@ void EnsembleMethod::update_reals_by_phi(ParameterEnsemble& _pe, ObservationEnse
 			pe.update_real_ip(pname, real);
 			real = _oe.get_real_vector(oname);
 			oe.update_real_ip(oname, real);
+			updated_oe_names.push_back(oname);
+			updated_pe_names.push_back(pname);
 		}
 	}
-	ph.update(oe, pe);
+	ph.update_reals(oe, pe, updated_oe_names, updated_pe_names);
 
 }
 
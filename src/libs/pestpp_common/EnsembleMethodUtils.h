@@ -33,6 +33,10 @@ public:
 		       ObservationEnsemble *_oe_base, ParameterEnsemble *_pe_base,
 		       Covariance *_parcov, bool should_prep_csv = true, string _tag=string());
 	void update(ObservationEnsemble &oe, ParameterEnsemble &pe);
+	//recalculate phi for only the listed realizations (the rows that changed since the last update with these
+	//ensembles), keeping the current phi values of the others and dropping realizations no longer in oe/pe
+	void update_reals(ObservationEnsemble &oe, ParameterEnsemble &pe, const vector<string>& oe_real_names,
+		const vector<string>& pe_real_names);
 	double get_mean(phiType pt);
 	double get_std(phiType pt);
 	double get_max(phiType pt);
@@ -57,8 +61,10 @@ public:
 	Eigen::VectorXd get_q_vector();
 	vector<string> get_lt_obs_names() { return lt_obs_names; }
 	vector<string> get_gt_obs_names() { return gt_obs_names; }
+	ParameterEnsemble* get_pe_base_ptr() { return pe_base; }
 
 	void apply_ineq_constraints(Eigen::MatrixXd &resid, vector<string> &names);
+	void apply_ineq_constraints(Eigen::MatrixXd &resid, const vector<int>& _lt_idxs, const vector<int>& _gt_idxs);
 
 	void save_residual_cov(ObservationEnsemble& oe, int iter);
 
@@ -73,8 +79,8 @@ private:
 	void prepare_group_csv(ofstream &csv, vector<string> extra = vector<string>());
 
 	map<string, Eigen::VectorXd> calc_meas(ObservationEnsemble &oe, Eigen::VectorXd& q_vec);
-	map<string, Eigen::VectorXd> calc_regul(ParameterEnsemble &pe);// , double _reg_fac);
-	map<string, Eigen::VectorXd> calc_actual(ObservationEnsemble &oe, Eigen::VectorXd& q_vec);
+	void calc_obs_phi(ObservationEnsemble& oe, const vector<string>& real_names);
+	void calc_par_phi(ParameterEnsemble& pe, const vector<string>& real_names);
 	map<string, double> calc_composite(map<string,double> &_meas, map<string,double> &_regul);
 	//map<string, double>* get_phi_map(PhiHandler::phiType &pt);
 	void write_csv(int iter_num, int total_runs,ofstream &csv, phiType pt,
@@ -99,12 +105,18 @@ private:
 	vector<string> lt_obs_names;
 	vector<string> gt_obs_names;
 
-	map<string, vector<int>> obs_group_idx_map;
-	map<string, vector<int>> par_group_idx_map;
-	map<string, map<string, double>> obs_group_phi_map, par_group_phi_map;
+	//per-variable info for the oe_base/pe_base variable names, rebuilt when those names change
+	vector<string> group_obs_names, group_par_names;
+	vector<string> obs_group_names, par_group_names;
+	Eigen::VectorXd obs_q_vec;
+	vector<int> lt_idxs, gt_idxs;
+	//variable-by-group indicator matrices to sum phi contributions by ctl-ordered group
+	Eigen::SparseMatrix<double> obs_group_mat, par_group_mat;
+	//group phi contributions by realization, in ctl group order
+	map<string, vector<double>> obs_group_phi_map, par_group_phi_map;
 
-	map<string, double> get_obs_group_contrib(Eigen::VectorXd &phi_vec);
-	map<string, double> get_par_group_contrib(Eigen::VectorXd &phi_vec);
+	void prep_phi_info();
+	void get_ineq_idxs(const vector<string>& names, vector<int>& _lt_idxs, vector<int>& _gt_idxs);
 
 };
 
@@ -143,6 +155,74 @@ vector<int> run_ensemble_util(PerformanceLog* performance_log, ofstream& frec, P
 	ObservationEnsemble& _oe, RunManagerAbstract* run_mgr_ptr,
 	bool check_pe_consistency = false, const vector<int>& real_idxs = vector<int>(),int da_cycle=NetPackage::NULL_DA_CYCLE);
 
+//a vector in the solver's fast-lookup containers - held in single precision when
+//ies_ensemble_precision is 'float' and promoted back to double for the upgrade solve
+class StoredVector
+{
+public:
+	StoredVector() : single(false) { ; }
+	template<typename Derived>
+	StoredVector(const Eigen::MatrixBase<Derived>& vec, bool _single) : single(_single)
+	{
+		if (single)
+			fvec = vec.template cast<float>();
+		else
+			dvec = vec;
+	}
+	int size() const { return single ? fvec.size() : dvec.size(); }
+	template<typename Dest>
+	void copy_to(Dest&& dest) const
+	{
+		if (single)
+			dest = fvec.cast<double>();
+		else
+			dest = dvec;
+	}
+private:
+	bool single;
+	Eigen::VectorXd dvec;
+	Eigen::VectorXf fvec;
+};
+
+//the lambda-independent pieces of one local upgrade solve: the truncated svd of the
+//(scaled) obs anomalies projected onto the par anomalies and the residuals.  only the
+//rescaling of the singular values changes with lambda, so each lambda is just two
+//small products once these are formed
+class UpgradeFactors
+{
+public:
+	UpgradeFactors() : use_glm_form(true) { ; }
+	bool use_glm_form;
+	Eigen::VectorXd s2;
+	//upgrade = -(par_proj * f(s2,lam) * obs_proj) - (am_par_proj * f(s2,lam) * am_proj)
+	Eigen::MatrixXd par_proj, obs_proj;
+	Eigen::MatrixXd am_par_proj, am_proj;
+	size_t get_bytes() const;
+	//the (num_reals x num_pars) upgrade for lambda (glm) or the inflation factor (mda)
+	Eigen::MatrixXd get_upgrade(double cur_lam) const;
+};
+
+//upgrade factors keyed by local analysis case, shared by the upgrade threads and kept
+//across lambdas up to a memory budget - cases that do not fit are refactored each lambda
+class UpgradeFactorCache
+{
+public:
+	UpgradeFactorCache() : max_bytes(0), used_bytes(0) { ; }
+	void set_max_mb(double max_mb);
+	bool get_use() const { return max_bytes > 0; }
+	shared_ptr<const UpgradeFactors> get(const string& key);
+	void put(const string& key, shared_ptr<const UpgradeFactors> factors);
+	void clear();
+	int size() const { return factors.size(); }
+
+private:
+	size_t max_bytes, used_bytes;
+	unordered_map<string, shared_ptr<const UpgradeFactors>> factors;
+	mutex cache_lock;
+};
+
+class UpgradeThread;
+
 class EnsembleSolver
 {
 public:
@@ -151,10 +231,15 @@ public:
 		Covariance& _parcov,Eigen::MatrixXd& _Am, L2PhiHandler& _ph,
 		bool _use_localizer, int _iter, vector<string>& _act_par_names, vector<string> &_act_obs_names);
 
-	void solve(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade, unordered_map<string, pair<vector<string>, vector<string>>>& loc_map);
-    void solve_multimodal(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade, unordered_map<string,
-                        pair<vector<string>, vector<string>>>& loc_map, double mm_alpha);
+	void solve(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade, LocCaseMap& loc_map);
+    void solve_multimodal(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade, LocCaseMap& loc_map,
+                        double mm_alpha);
 
+	//keep the lambda-independent upgrade factors between solves (0 to disable)
+	void set_factor_cache_mb(double cache_mb) { factor_cache.clear(); factor_cache.set_max_mb(cache_mb); }
+	//drop the out-of-core par containers, which removes their scratch files from disk
+	void release_out_of_core() { par_diff_cache.reset(); par_resid_cache.reset(); }
+	~EnsembleSolver() { release_out_of_core(); }
 
 private:
 	PerformanceLog* performance_log;
@@ -168,12 +253,17 @@ private:
 	Covariance& parcov;
 	Eigen::MatrixXd& Am;
 	L2PhiHandler& ph;
-	unordered_map<string, Eigen::VectorXd> par_resid_map, obs_resid_map, Am_map;
-	unordered_map<string, Eigen::VectorXd> par_diff_map, obs_diff_map, obs_err_map;
+	unordered_map<string, StoredVector> par_resid_map, obs_resid_map, Am_map;
+	unordered_map<string, StoredVector> par_diff_map, obs_diff_map, obs_err_map;
 	unordered_map<string, double> weight_map;
 	unordered_map<string, double> parcov_inv_map;
 	//unordered_map<string, pair<vector<string>, vector<string>>> loc_map;
 	vector<string>& act_par_names, act_obs_names;
+	bool single_precision;
+	//disk-backed par anomalies and residuals used in place of the par maps when out-of-core
+	bool use_out_of_core;
+	shared_ptr<EnsembleBlockCache> par_diff_cache, par_resid_cache;
+	UpgradeFactorCache factor_cache;
 	template<typename T, typename A>
 	void message(int level, const string& _message, vector<T, A> _extras, bool echo = true);
 	void message(int level, const string& _message);
@@ -182,6 +272,11 @@ private:
 	void message(int level, const string& _message, T extra);
 
 	void initialize(string center_on = string(), vector<int> real_idxs=vector<int>());
+	void initialize_out_of_core(const vector<string>& pe_real_names, string center_on);
+	void solve_out_of_core(int num_threads, double cur_lam, bool use_glm_form, ParameterEnsemble& pe_upgrade,
+		LocCaseMap& loc_map);
+	void run_upgrade_threads(int num_threads, double cur_lam, bool use_glm_form, UpgradeThread& worker, int num_cases,
+		vector<string>& par_names);
 
 
 };
@@ -190,35 +285,48 @@ private:
 class UpgradeThread
 {
 public: 
-	UpgradeThread(PerformanceLog* _performance_log, unordered_map<string, Eigen::VectorXd>& _par_resid_map, unordered_map<string, Eigen::VectorXd>& _par_diff_map,
-		unordered_map<string, Eigen::VectorXd>& _obs_resid_map, unordered_map<string, Eigen::VectorXd>& _obs_diff_map, unordered_map<string, Eigen::VectorXd>& _obs_err_map,
+	UpgradeThread(PerformanceLog* _performance_log, unordered_map<string, StoredVector>& _par_resid_map, unordered_map<string, StoredVector>& _par_diff_map,
+		unordered_map<string, StoredVector>& _obs_resid_map, unordered_map<string, StoredVector>& _obs_diff_map, unordered_map<string, StoredVector>& _obs_err_map,
 		Localizer& _localizer, unordered_map<string, double>& _parcov_inv_map,
 		unordered_map<string, double>& _weight_map, ParameterEnsemble& _pe_upgrade,
-		unordered_map<string, pair<vector<string>, vector<string>>>& _cases,
-		unordered_map<string, Eigen::VectorXd>& _Am_map, Localizer::How& _how);
+		LocCaseMap& _cases,
+		unordered_map<string, StoredVector>& _Am_map, Localizer::How& _how);
+	virtual ~UpgradeThread() {}
 
-	virtual void work(int thread_id, int iter, double cur_lam, bool use_glm_form, vector<string> par_names, vector<string> obs_names) { ; }
+	//read the solve settings (and for some types, form shared components) before the cases are solved
+	virtual void prepare(int num_workers, int iter, double cur_lam, bool use_glm_form, vector<string>& par_names,
+		vector<string>& obs_names);
+	//solve one case - called concurrently from the task pool workers
+	virtual void solve_case(int thread_id, int case_idx, int iter, double cur_lam, bool use_glm_form) { ; }
+	void set_factor_cache(UpgradeFactorCache* _factor_cache) { factor_cache = _factor_cache; }
 
 protected:
 	PerformanceLog* performance_log;
+	UpgradeFactorCache* factor_cache;
 	Localizer::How how;
-	vector<string> keys;
-	int count, total;
+	atomic<int> count;
+	int total;
+	int maxsing, num_reals, verbose_level;
+	double eigthresh;
+	bool use_approx, use_prior_scaling, loc_by_obs;
+	vector<ofstream> part_map_files;
 
-	unordered_map<string, pair<vector<string>, vector<string>>>& cases;
+	LocCaseMap& cases;
 
 	ParameterEnsemble& pe_upgrade;
 	Localizer& localizer;
 	unordered_map<string, double>& parcov_inv_map;
 	unordered_map<string, double>& weight_map;
 
-	unordered_map<string, Eigen::VectorXd>& par_resid_map, & par_diff_map, & Am_map;
-	unordered_map<string, Eigen::VectorXd>& obs_resid_map, & obs_diff_map, obs_err_map;
+	unordered_map<string, StoredVector>& par_resid_map, & par_diff_map, & Am_map;
+	unordered_map<string, StoredVector>& obs_resid_map, & obs_diff_map, obs_err_map;
+
+	//only the shared outputs need guarding - the containers above are read-only during the solve
+	mutex put_lock, pfm_lock;
 
-	mutex ctrl_lock, weight_lock, loc_lock, parcov_lock;
-	mutex obs_resid_lock, obs_diff_lock, par_resid_lock;
-	mutex par_diff_lock, am_lock, put_lock, obs_err_lock;
-	mutex next_lock;
+	int next_count();
+	void write_part_map(int thread_id, int t_count, int iter, int case_idx);
+	void add_to_upgrade(const vector<string>& par_names, const Eigen::MatrixXd& upgrade);
 
 };
 
@@ -227,7 +335,14 @@ class CovLocalizationUpgradeThread : public UpgradeThread
 public:
 	using UpgradeThread::UpgradeThread;
 
-	void work(int thread_id, int iter, double cur_lam, bool use_glm_form, vector<string> par_names, vector<string> obs_names);
+	void prepare(int num_workers, int iter, double cur_lam, bool use_glm_form, vector<string>& par_names,
+		vector<string>& obs_names);
+	void solve_case(int thread_id, int case_idx, int iter, double cur_lam, bool use_glm_form);
+
+private:
+	vector<string> solve_obs_names;
+	map<string, int> par2col_map;
+	Eigen::MatrixXd par_diff, obs_resid, t, upgrade_2;
 };
 
 class LocalAnalysisUpgradeThread: public UpgradeThread
@@ -235,29 +350,13 @@ class LocalAnalysisUpgradeThread: public UpgradeThread
 public:
 	using UpgradeThread::UpgradeThread;
 
-	void work(int thread_id, int iter, double cur_lam,bool use_glm_form, vector<string> par_names, vector<string> obs_names);
-
-
-//private:
-//	PerformanceLog* performance_log;
-//	Localizer::How how;
-//	vector<string> keys;
-//	int count, total;
-//
-//	unordered_map<string, pair<vector<string>, vector<string>>>& cases;
-//
-//	ParameterEnsemble& pe_upgrade;
-//	Localizer& localizer;
-//	unordered_map<string, double>& parcov_inv_map;
-//	unordered_map<string, double>& weight_map;
-//
-//	unordered_map<string, Eigen::VectorXd>& par_resid_map, & par_diff_map, & Am_map;
-//	unordered_map<string, Eigen::VectorXd>& obs_resid_map, & obs_diff_map, obs_err_map;
-//
-//	mutex ctrl_lock, weight_lock, loc_lock, parcov_lock;
-//	mutex obs_resid_lock, obs_diff_lock, par_resid_lock;
-//	mutex par_diff_lock, am_lock, put_lock, obs_err_lock;
-//	mutex next_lock;
+	void solve_case(int thread_id, int case_idx, int iter, double cur_lam, bool use_glm_form);
+	void set_factor_key_suffix(const string& _factor_key_suffix) { factor_key_suffix = _factor_key_suffix; }
+
+private:
+	string factor_key_suffix;
+	shared_ptr<UpgradeFactors> get_factors(int thread_id, int t_count, int iter, bool use_glm_form,
+		const string& key, vector<string>& par_names, vector<string>& obs_names);
 
 };
 
@@ -322,7 +421,10 @@ public:
 	//void transfer_dynamic_state_from_pe_to_oe(ParameterEnsemble& _pe, ObservationEnsemble& _oe);
     void transfer_par_dynamic_state_final_to_initial_ip(ParameterEnsemble& _pe);
 
-	pair<string, string> save_ensembles(string tag, int cycle, ParameterEnsemble& _pe, ObservationEnsemble& _oe);
+	//if async, the ensembles are snapshotted and written in the background - see AsyncEnsembleWriter
+	pair<string, string> save_ensembles(string tag, int cycle, ParameterEnsemble& _pe, ObservationEnsemble& _oe, bool async=false);
+	//wait for any background ensemble writes to finish
+	void flush_saves() { ens_writer.flush(); }
 	vector<string>& get_par_dyn_state_names() { return par_dyn_state_names; }
 
 
@@ -373,6 +475,8 @@ protected:
 
 	bool oe_drawn, pe_drawn;
 
+	AsyncEnsembleWriter ens_writer;
+
 	bool solve_glm(int cycle = NetPackage::NULL_DA_CYCLE);
 	bool solve_mda(bool last_iter, int cycle = NetPackage::NULL_DA_CYCLE);
 
@@ -386,6 +490,12 @@ protected:
 	//vector<ObservationEnsemble> run_lambda_ensembles(vector<ParameterEnsemble>& pe_lams, vector<double>& lam_vals, vector<double>& scale_vals, int cycle= NetPackage::NULL_DA_CYCLE);
 
 	vector<ObservationEnsemble> run_lambda_ensembles(vector<ParameterEnsemble>& pe_lams, vector<double>& lam_vals, vector<double>& scale_vals, int cycle, vector<int>& pe_subset_idxs, vector<int>& oe_subset_idxs);
+	//the pieces of run_lambda_ensembles(), so the runs of each upgrade ensemble can be queued as soon as it is ready
+	void prep_lambda_runs(ParameterEnsemble& pe_lam, vector<int>& pe_subset_idxs, vector<int>& oe_subset_idxs);
+	map<int, int> queue_lambda_runs(ParameterEnsemble& pe_lam, vector<int>& pe_subset_idxs, int cycle);
+	void make_lambda_runs();
+	vector<ObservationEnsemble> process_lambda_runs(vector<ParameterEnsemble>& pe_lams, vector<double>& lam_vals, vector<double>& scale_vals,
+		vector<map<int, int>>& real_run_ids_vec, vector<int>& pe_subset_idxs, vector<int>& oe_subset_idxs);
 
 	void report_and_save(int cycle);
 	void save_mat(string prefix, Eigen::MatrixXd& mat);
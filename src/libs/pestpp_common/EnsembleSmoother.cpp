@@ -76,5 +76,5 @@ void IterEnsembleSmoother::iterate_2_solution()
 
 void IterEnsembleSmoother::finalize()
 {
-
+	flush_saves();
 }
@@ -2,6 +2,7 @@
 #include <iomanip>
 #include <unordered_set>
 #include <iterator>
+#include <array>
 #include "Ensemble.h"
 #include "RestartController.h"
 #include "utilities.h"
@@ -22,8 +23,8 @@ bool Localizer::initialize(PerformanceLog *performance_log, bool forgive_missing
 		
 	par2col_map.clear();
 	obs2row_map.clear();
-	colname2col_map.clear();
-	rowname2row_map.clear();
+	colname2col_map = pest_utils::NameIndex();
+	rowname2row_map = pest_utils::NameIndex();
 
 	how_str = pest_scenario_ptr->get_pestpp_options().get_ies_localize_how();
 	loc_typ = pest_scenario_ptr->get_pestpp_options().get_ies_loc_type();
@@ -59,8 +60,12 @@ bool Localizer::initialize(PerformanceLog *performance_log, bool forgive_missing
 	string filename = pest_scenario_ptr->get_pestpp_options().get_ies_localizer();
 	autoadaloc = pest_scenario_ptr->get_pestpp_options().get_ies_autoadaloc();
 	sigma_dist = pest_scenario_ptr->get_pestpp_options().get_ies_autoadaloc_sigma_dist();
+	par_coords_filename = pest_scenario_ptr->get_pestpp_options().get_ies_loc_par_coords();
+	obs_coords_filename = pest_scenario_ptr->get_pestpp_options().get_ies_loc_obs_coords();
+	loc_distance = pest_scenario_ptr->get_pestpp_options().get_ies_loc_distance();
+	use_distance = (par_coords_filename.size() > 0) || (obs_coords_filename.size() > 0);
 	use = true;
-	if ((filename.size() == 0) && (!autoadaloc))
+	if ((filename.size() == 0) && (!autoadaloc) && (!use_distance))
 	{
 		initialized = true;
 		use = false;
@@ -68,16 +73,30 @@ bool Localizer::initialize(PerformanceLog *performance_log, bool forgive_missing
 	}
 	//use = true;
 
-	if (filename.size() == 0)
+	if ((filename.size() == 0) && (!use_distance))
 	{
 		initialized = true;
 		return use;
 	}
-	performance_log->log_event("loading localizer matrix from file " + filename);
-	org_mat.from_file(filename);
+	if (use_distance)
+	{
+		if (filename.size() > 0)
+			throw runtime_error("Localizer error: 'ies_localizer' can not be used with 'ies_loc_par_coords' and 'ies_loc_obs_coords'");
+		if ((par_coords_filename.size() == 0) || (obs_coords_filename.size() == 0))
+			throw runtime_error("Localizer error: distance-based localization requires both 'ies_loc_par_coords' and 'ies_loc_obs_coords'");
+		if (loc_distance <= 0.0)
+			throw runtime_error("Localizer error: distance-based localization requires 'ies_loc_distance' > 0.0");
+		performance_log->log_event("forming distance-based localizer from coordinate files " + par_coords_filename + " and " + obs_coords_filename);
+		org_mat = get_distance_mat(performance_log);
+	}
+	else
+	{
+		performance_log->log_event("loading localizer matrix from file " + filename);
+		org_mat.from_file(filename);
+	}
 	
 	performance_log->log_event("processing localizer matrix");
-	_localizer_map = process_mat(performance_log,org_mat,forgive_missing);
+	loc_cases = process_mat(performance_log,org_mat,forgive_missing);
 	
 	if (autoadaloc)
 	{
@@ -86,19 +105,227 @@ bool Localizer::initialize(PerformanceLog *performance_log, bool forgive_missing
 			throw runtime_error("using a localizer matrix and autoadaloc requires ies_ or da_ localize_how == 'PARAMETERS'");		
 	}
 	else
-		cur_mat = org_mat;
+	{
+		//org_mat is only needed to restart autoadaloc, so hand the storage over rather than copying it
+		cur_mat = std::move(org_mat);
+		org_mat = Mat();
+	}
 	initialized = true;
 	return use;
 }
 
+void Localizer::read_coords(const string& coord_filename, const set<string>& keep_names, vector<string>& names,
+	vector<string>& dims, Eigen::MatrixXd& coords)
+{
+	ifstream in(coord_filename);
+	if (!in.good())
+		throw runtime_error("Localizer::read_coords() error opening coordinate file " + coord_filename);
+	string line;
+	vector<string> tokens;
+	if (!getline(in, line))
+		throw runtime_error("Localizer::read_coords() error reading header line from " + coord_filename);
+	pest_utils::upper_ip(line);
+	pest_utils::tokenize(pest_utils::strip_cp(line), tokens, ",", false);
+	if (tokens.size() < 2)
+		throw runtime_error("Localizer::read_coords() error: coordinate file " + coord_filename + " needs a name column and at least one coordinate column");
+	//the first column is the name, the rest have to be coordinate dimensions
+	dims.clear();
+	set<string> allowed{ "X","Y","Z","T" };
+	for (int i = 1; i < tokens.size(); i++)
+	{
+		string d = pest_utils::strip_cp(tokens[i]);
+		if (allowed.find(d) == allowed.end())
+			throw runtime_error("Localizer::read_coords() error: coordinate column '" + d + "' in " + coord_filename + " must be one of 'X','Y','Z' or 'T'");
+		if (find(dims.begin(), dims.end(), d) != dims.end())
+			throw runtime_error("Localizer::read_coords() error: coordinate column '" + d + "' listed more than once in " + coord_filename);
+		dims.push_back(d);
+	}
+	names.clear();
+	vector<vector<double>> vals;
+	set<string> dup_check;
+	vector<string> dups;
+	int lcount = 1, num_skipped = 0;
+	double val;
+	while (getline(in, line))
+	{
+		lcount++;
+		pest_utils::strip_ip(line);
+		if (line.size() == 0)
+			continue;
+		pest_utils::upper_ip(line);
+		tokens.clear();
+		pest_utils::tokenize(line, tokens, ",", false);
+		if (tokens.size() != dims.size() + 1)
+		{
+			stringstream ss;
+			ss << "Localizer::read_coords() error: line " << lcount << " of " << coord_filename << " has " << tokens.size() << " entries, expected " << dims.size() + 1;
+			throw runtime_error(ss.str());
+		}
+		string name = pest_utils::strip_cp(tokens[0]);
+		if (keep_names.find(name) == keep_names.end())
+		{
+			num_skipped++;
+			continue;
+		}
+		if (dup_check.find(name) != dup_check.end())
+		{
+			dups.push_back(name);
+			continue;
+		}
+		dup_check.emplace(name);
+		vector<double> v;
+		for (int i = 1; i < tokens.size(); i++)
+		{
+			try
+			{
+				pest_utils::convert_ip(pest_utils::strip_cp(tokens[i]), val);
+			}
+			catch (...)
+			{
+				stringstream ss;
+				ss << "Localizer::read_coords() error converting '" << tokens[i] << "' to double on line " << lcount << " of " << coord_filename;
+				throw runtime_error(ss.str());
+			}
+			v.push_back(val);
+		}
+		names.push_back(name);
+		vals.push_back(v);
+	}
+	in.close();
+	if (dups.size() > 0)
+	{
+		stringstream ss;
+		ss << "Localizer::read_coords() error: the following names were listed more than once in " << coord_filename << ": ";
+		for (auto& d : dups)
+			ss << d << ",";
+		throw runtime_error(ss.str());
+	}
+	coords.resize(names.size(), dims.size());
+	for (int i = 0; i < names.size(); i++)
+		for (int j = 0; j < dims.size(); j++)
+			coords(i, j) = vals[i][j];
+	if (num_skipped > 0)
+	{
+		stringstream ss;
+		ss << "Note: " << num_skipped << " entries in " << coord_filename << " were skipped because they are not adjustable parameters or non-zero weighted observations";
+		cout << ss.str() << endl;
+	}
+}
+
+Mat Localizer::get_distance_mat(PerformanceLog* performance_log)
+{
+	vector<string> ctl_par_names = pest_scenario_ptr->get_ctl_ordered_adj_par_names();
+	vector<string> ctl_obs_names = pest_scenario_ptr->get_ctl_ordered_nz_obs_names();
+	set<string> keep_pars(ctl_par_names.begin(), ctl_par_names.end());
+	set<string> keep_obs(ctl_obs_names.begin(), ctl_obs_names.end());
+
+	vector<string> par_names, obs_names, par_dims, obs_dims;
+	Eigen::MatrixXd par_coords, obs_coords;
+	performance_log->log_event("reading parameter coordinates from " + par_coords_filename);
+	read_coords(par_coords_filename, keep_pars, par_names, par_dims, par_coords);
+	performance_log->log_event("reading observation coordinates from " + obs_coords_filename);
+	read_coords(obs_coords_filename, keep_obs, obs_names, obs_dims, obs_coords);
+	if (par_names.size() == 0)
+		throw runtime_error("Localizer::get_distance_mat() error: no adjustable parameters found in " + par_coords_filename);
+	if (obs_names.size() == 0)
+		throw runtime_error("Localizer::get_distance_mat() error: no non-zero weighted observations found in " + obs_coords_filename);
+
+	//line the obs coordinate columns up with the par coordinate columns
+	if (par_dims.size() != obs_dims.size())
+		throw runtime_error("Localizer::get_distance_mat() error: parameter and observation coordinate files must have the same coordinate columns");
+	vector<int> obs_dim_idx;
+	for (auto& d : par_dims)
+	{
+		auto it = find(obs_dims.begin(), obs_dims.end(), d);
+		if (it == obs_dims.end())
+			throw runtime_error("Localizer::get_distance_mat() error: parameter coordinate column '" + d + "' not found in " + obs_coords_filename);
+		obs_dim_idx.push_back(it - obs_dims.begin());
+	}
+	if (par_names.size() < ctl_par_names.size())
+		cout << "Note: " << ctl_par_names.size() - par_names.size() << " adjustable parameters are not in " << par_coords_filename << " and will not be updated" << endl;
+	if (obs_names.size() < ctl_obs_names.size())
+		cout << "Note: " << ctl_obs_names.size() - obs_names.size() << " non-zero weighted observations are not in " << obs_coords_filename << " and will not be used in the upgrade" << endl;
+	int ndim = par_dims.size();
+	if (ndim > 4)
+		throw runtime_error("Localizer::get_distance_mat() error: at most 4 coordinate columns are supported");
+
+	stringstream ss;
+	ss << "forming distance-based localizer for " << par_names.size() << " parameters and " << obs_names.size() << " observations with cutoff distance " << loc_distance;
+	performance_log->log_event(ss.str());
+
+	//bin the obs into a uniform grid with the cell size equal to the cutoff distance
+	//so all neighbours of a par are in the 3^ndim cells around the par's cell
+	map<array<long long, 4>, vector<int>> grid;
+	array<long long, 4> cell;
+	for (int i = 0; i < obs_names.size(); i++)
+	{
+		cell.fill(0);
+		for (int j = 0; j < ndim; j++)
+			cell[j] = (long long)floor(obs_coords(i, obs_dim_idx[j]) / loc_distance);
+		grid[cell].push_back(i);
+	}
+
+	//Gaspari-Cohn taper with half-width c so the taper goes to zero at the cutoff distance
+	double c = loc_distance / 2.0;
+	int num_offsets = 1;
+	for (int j = 0; j < ndim; j++)
+		num_offsets *= 3;
+	vector<Eigen::Triplet<double>> triplets;
+	array<long long, 4> pcell, ncell;
+	double d, r, val;
+	for (int ipar = 0; ipar < par_names.size(); ipar++)
+	{
+		pcell.fill(0);
+		for (int j = 0; j < ndim; j++)
+			pcell[j] = (long long)floor(par_coords(ipar, j) / loc_distance);
+		for (int ioff = 0; ioff < num_offsets; ioff++)
+		{
+			ncell = pcell;
+			int rem = ioff;
+			for (int j = 0; j < ndim; j++)
+			{
+				ncell[j] += (rem % 3) - 1;
+				rem /= 3;
+			}
+			auto git = grid.find(ncell);
+			if (git == grid.end())
+				continue;
+			for (auto iobs : git->second)
+			{
+				d = 0.0;
+				for (int j = 0; j < ndim; j++)
+					d += pow(par_coords(ipar, j) - obs_coords(iobs, obs_dim_idx[j]), 2);
+				d = sqrt(d);
+				if (d >= loc_distance)
+					continue;
+				r = d / c;
+				if (r <= 1.0)
+					val = (((-0.25 * r + 0.5) * r + 0.625) * r - (5.0 / 3.0)) * r * r + 1.0;
+				else
+					val = ((((r / 12.0 - 0.5) * r + 0.625) * r + (5.0 / 3.0)) * r - 5.0) * r + 4.0 - 2.0 / (3.0 * r);
+				if (val > 0.0)
+					triplets.push_back(Eigen::Triplet<double>(iobs, ipar, val));
+			}
+		}
+	}
+	ss.str("");
+	ss << triplets.size() << " non-zero localizer entries (" << setprecision(4) << 100.0 * (double)triplets.size() / ((double)obs_names.size() * (double)par_names.size()) << "% of dense) within cutoff distance";
+	performance_log->log_event(ss.str());
+	if (triplets.size() == 0)
+		throw runtime_error("Localizer::get_distance_mat() error: no parameter-observation pairs are within 'ies_loc_distance' of each other");
+	Mat mat;
+	mat.from_triplets(obs_names, par_names, triplets);
+	return mat;
+}
+
 void Localizer::update_obs_info_from_mat(Mat& mat, vector<vector<string>>& obs_map, vector<string>& missing, vector<string>& dups, set<string>& obs_names, 
 	map<string, vector<string>>& obgnme_map, vector<string>& not_allowed)
 {
-	vector<string> row_names = mat.get_row_names();
+	const vector<string>& row_names = *mat.rn_ptr();
 	set<string> dup_check;
 	string o;
 	
-	rowname2row_map.clear();
+	rowname2row_map = mat.get_row_index();
 	obs2row_map.clear();
 	missing.clear();
 	dups.clear();
@@ -108,7 +335,6 @@ void Localizer::update_obs_info_from_mat(Mat& mat, vector<vector<string>>& obs_m
 	for (int i = 0; i < mat.nrow(); i++)
 	{
 		o = row_names[i];
-		rowname2row_map[o] = i;
 		if (obs_names.find(o) != obs_names.end())
 		{
 			obs2row_map[o] = i;
@@ -146,19 +372,19 @@ void Localizer::update_par_info_from_mat(Mat& mat, vector<vector<string>>& par_m
 	set<string> dup_check;
 	string o;
 
-	colname2col_map.clear();
+	colname2col_map = pest_utils::NameIndex();
 	par2col_map.clear();
 	missing.clear();
 	dups.clear();
 	not_allowed.clear();
 	par_map.clear();
 
-	vector<string> col_names = mat.get_col_names();
+	const vector<string>& col_names = *mat.cn_ptr();
+	colname2col_map = mat.get_col_index();
 	string p;
 	for (int i = 0; i < mat.ncol(); ++i)
 	{
 		p = col_names[i];
-		colname2col_map[p] = i;
 		if (par_names.find(p) != par_names.end())
 		{
 			par2col_map[p] = i;
@@ -188,20 +414,21 @@ void Localizer::update_par_info_from_mat(Mat& mat, vector<vector<string>>& par_m
 	}
 }
 
-unordered_map<string, pair<vector<string>, vector<string>>> Localizer::process_mat(PerformanceLog* performance_log, Mat& mat, bool forgive_missing)
+LocCaseMap Localizer::process_mat(PerformanceLog* performance_log, Mat& mat, bool forgive_missing)
 {
 	stringstream ss;
 
 	//error checking and building up container of names
-	vector<string> names = pest_scenario_ptr->get_ctl_ordered_adj_par_names();
-	set<string> par_names(names.begin(), names.end());
-	names = pest_scenario_ptr->get_ctl_ordered_nz_obs_names();
-	set<string> obs_names(names.begin(), names.end());
+	vector<string> ctl_par_names = pest_scenario_ptr->get_ctl_ordered_adj_par_names();
+	set<string> par_names(ctl_par_names.begin(), ctl_par_names.end());
+	vector<string> ctl_obs_names = pest_scenario_ptr->get_ctl_ordered_nz_obs_names();
+	set<string> obs_names(ctl_obs_names.begin(), ctl_obs_names.end());
+	vector<string> names;
 
 	par2col_map.clear();
 	obs2row_map.clear();
-	colname2col_map.clear();
-	rowname2row_map.clear();
+	colname2col_map = pest_utils::NameIndex();
+	rowname2row_map = pest_utils::NameIndex();
 	
 	map<string, vector<string>> pargp_map;
 	ParameterGroupInfo *pi = pest_scenario_ptr->get_base_group_info_ptr();
@@ -312,12 +539,29 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::process_m
 	}
 
 
+	//the row and col names of the matrix as positions in the ctl-ordered obs and par names
+	vector<vector<int>> obs_idx_map, par_idx_map;
+	pest_utils::NameIndex obs_index(ctl_obs_names), par_index(ctl_par_names);
+	for (auto& onames : obs_map)
+	{
+		obs_idx_map.push_back(vector<int>());
+		for (auto& o : onames)
+			obs_idx_map.back().push_back(obs_index.at(o));
+	}
+	for (auto& pnames : par_map)
+	{
+		par_idx_map.push_back(vector<int>());
+		for (auto& p : pnames)
+			par_idx_map.back().push_back(par_index.at(p));
+	}
+	obs_map.clear();
+	par_map.clear();
+
 	//map all the nz locations in the matrix
 	map<int, vector<int>> idx_map;
-	vector<string> vobs, vpar;
+	vector<int> vobs, vpar;
 
-	//int i, j;
-	unordered_map<string, pair<vector<string>, vector<string>>> localizer_map;
+	LocCaseMap localizer_map(ctl_obs_names, ctl_par_names);
 
 	if (how == How::PARAMETERS)
 	{
@@ -335,15 +579,12 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::process_m
 		//populate the localizer map
 		for (auto &idx : idx_map)
 		{
-			vpar = par_map[idx.first];
 			vobs.clear();
 			for (auto &i : idx.second)
 			{
-				vobs.insert(vobs.end(), obs_map[i].begin(), obs_map[i].end());
+				vobs.insert(vobs.end(), obs_idx_map[i].begin(), obs_idx_map[i].end());
 			}
-			pair<vector<string>, vector<string>> p(vobs, vpar);
-			//localizer_map.push_back(p);
-			localizer_map[col_names[idx.first]] = p;
+			localizer_map.add_case(col_names[idx.first], vobs, par_idx_map[idx.first]);
 		}
 
 	}
@@ -363,20 +604,121 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::process_m
 		//populate the localizer map
 		for (auto &idx : idx_map)
 		{
-			vobs = obs_map[idx.first];
 			vpar.clear();
 			for (auto &i : idx.second)
 			{
-				vpar.insert(vpar.end(), par_map[i].begin(), par_map[i].end());
+				vpar.insert(vpar.end(), par_idx_map[i].begin(), par_idx_map[i].end());
 			}
-			pair<vector<string>, vector<string>> p(vobs, vpar);
-			//localizer_map.push_back(p);
-			localizer_map[row_names[idx.first]] = p;
+			localizer_map.add_case(row_names[idx.first], obs_idx_map[idx.first], vpar);
 		}
 	}	
 	return localizer_map;
 }
 
+LocCaseMap Localizer::get_active_cases(const LocCaseMap& cases, vector<string>& act_obs_names, vector<string>& act_par_names)
+{
+	//re-point the cases at the active obs and par names, dropping cases left without obs or pars
+	pest_utils::NameIndex act_obs_index(act_obs_names), act_par_index(act_par_names);
+	vector<int> obs_pos, par_pos;
+	for (auto& o : cases.get_all_obs_names())
+		obs_pos.push_back(act_obs_index.find_index(o));
+	for (auto& p : cases.get_all_par_names())
+		par_pos.push_back(act_par_index.find_index(p));
+
+	LocCaseMap act_cases(act_obs_names, act_par_names);
+	vector<int> otemp, ptemp;
+	for (int icase = 0; icase < cases.size(); icase++)
+	{
+		otemp.clear();
+		ptemp.clear();
+		for (auto i : cases.get_obs_idxs(icase))
+			if (obs_pos[i] >= 0)
+				otemp.push_back(obs_pos[i]);
+		for (auto i : cases.get_par_idxs(icase))
+			if (par_pos[i] >= 0)
+				ptemp.push_back(par_pos[i]);
+		if ((otemp.size() > 0) && (ptemp.size() > 0))
+			act_cases.add_case(cases.get_key(icase), otemp, ptemp);
+	}
+	return act_cases;
+}
+
+LocCaseMap Localizer::batch_cases_by_obs(const LocCaseMap& case_map, PerformanceLog* performance_log)
+{
+	//only the by-parameter local analysis solves each case against its own obs set
+	if ((how != How::PARAMETERS) || (loctyp != LocTyp::LOCALANALYSIS) || (case_map.size() < 2))
+		return case_map;
+
+	//visit the cases in name order so the batch keys (and par order) are repeatable
+	vector<pair<string, int>> order;
+	order.reserve(case_map.size());
+	for (int icase = 0; icase < case_map.size(); icase++)
+		order.push_back(make_pair(case_map.get_key(icase), icase));
+	sort(order.begin(), order.end());
+
+	//the case key is used to look up the localizer column during the solve, so the
+	//batched cases must agree on the localizer values as well as the obs
+	const vector<string>& all_obs_names = case_map.get_all_obs_names();
+	map<pair<vector<int>, vector<double>>, int> sig_map;
+	vector<int> batch_of(case_map.size(), -1);
+	vector<int> batch_first;
+	vector<double> loc_vals;
+	map<string, int>::iterator oend = obs2row_map.end(), oit;
+	for (auto& o : order)
+	{
+		int icase = o.second;
+		int idx = colname2col_map.find_index(o.first);
+		if (idx < 0)
+		{
+			//not a localizer column - leave it as its own case
+			batch_of[icase] = batch_first.size();
+			batch_first.push_back(icase);
+			continue;
+		}
+		vector<int> case_obs_idxs = case_map.get_obs_idxs(icase);
+		loc_vals.clear();
+		loc_vals.reserve(case_obs_idxs.size());
+		for (auto i : case_obs_idxs)
+		{
+			oit = obs2row_map.find(all_obs_names[i]);
+			if (oit == oend)
+				loc_vals.push_back(0.0);
+			else
+				loc_vals.push_back(cur_mat.e_ptr()->coeff(oit->second, idx));
+		}
+		pair<vector<int>, vector<double>> sig(case_obs_idxs, loc_vals);
+		map<pair<vector<int>, vector<double>>, int>::iterator sit = sig_map.find(sig);
+		if (sit == sig_map.end())
+		{
+			sig_map[sig] = batch_first.size();
+			batch_of[icase] = batch_first.size();
+			batch_first.push_back(icase);
+		}
+		else
+			batch_of[icase] = sit->second;
+	}
+	sig_map.clear();
+
+	vector<vector<int>> batch_pars(batch_first.size());
+	for (auto& o : order)
+	{
+		vector<int> case_par_idxs = case_map.get_par_idxs(o.second);
+		vector<int>& bpars = batch_pars[batch_of[o.second]];
+		bpars.insert(bpars.end(), case_par_idxs.begin(), case_par_idxs.end());
+	}
+	LocCaseMap batch_map = case_map.get_empty_copy();
+	for (int ibatch = 0; ibatch < batch_first.size(); ibatch++)
+	{
+		int icase = batch_first[ibatch];
+		batch_map.add_case(case_map.get_key(icase), case_map.get_obs_idxs(icase), batch_pars[ibatch]);
+	}
+	stringstream ss;
+	ss << "local analysis cases batched by identical obs sets: " << case_map.size() << " cases solved as " << batch_map.size() << " batches";
+	performance_log->log_event(ss.str());
+	if (pest_scenario_ptr->get_pestpp_options().get_ies_verbose_level() > 1)
+		cout << "..." << ss.str() << endl;
+	return batch_map;
+}
 
 void Localizer::report(ofstream &f_rec)
 {
@@ -445,39 +787,21 @@ void Localizer::report(ofstream &f_rec)
 
 }
 
-unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_localanalysis_case_map(int iter, vector<string>& act_obs_names, vector<string>& act_par_names, 
+LocCaseMap Localizer::get_localanalysis_case_map(int iter, vector<string>& act_obs_names, vector<string>& act_par_names, 
 	ObservationEnsemble &oe, ParameterEnsemble &pe, PerformanceLog *performance_log)
 {
 
-	set<string> sact_par_names(act_par_names.begin(), act_par_names.end());
-	set<string> sact_obs_names(act_obs_names.begin(), act_obs_names.end());
-	set<string>::iterator pend = sact_par_names.end();
-	set<string>::iterator oend = sact_obs_names.end();
-	vector<string> ptemp, otemp;
-	unordered_map<string, pair<vector<string>, vector<string>>> lmap;
-	for (auto& i : _localizer_map)
-	{
-		ptemp.clear();
-		otemp.clear();
-		for (auto& o : i.second.first)
-			if (sact_obs_names.find(o) != oend)
-				otemp.push_back(o);
-		for (auto& p : i.second.second)
-			if (sact_par_names.find(p) != pend)
-				ptemp.push_back(p);
-		if ((otemp.size() > 0) && (ptemp.size() > 0))
-			lmap[i.first] = pair<vector<string>, vector<string>>(otemp, ptemp);
-
-	}
+	LocCaseMap lmap = get_active_cases(loc_cases, act_obs_names, act_par_names);
 	if (!autoadaloc)
 	{
 		return lmap;
 	}
 	map<string, set<string>> listed_obs;
-	for (auto i : lmap)
+	for (int icase = 0; icase < lmap.size(); icase++)
 	{
-		set<string> oset(i.second.first.begin(), i.second.first.end());
-		for (auto pname : i.second.second)
+		vector<string> onames = lmap.get_obs_names(icase);
+		set<string> oset(onames.begin(), onames.end());
+		for (auto pname : lmap.get_par_names(icase))
 		{
 			listed_obs[pname] = oset;
 		}
@@ -524,58 +848,23 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 	}
 
 	//here we go...
-	vector<int> par_indices;
-	for (int jpar = 0; jpar < npar; jpar++)
-		par_indices.push_back(jpar);
 	vector<Eigen::Triplet<double>> triplets;
-	AutoAdaLocThread worker(performance_log, &f_out, iter, ies_verbose, npar, nobs, par_indices, pe_diff, oe_diff, par_std, obs_std, act_par_names, act_obs_names, triplets,sigma_dist,listed_obs);
+	AutoAdaLocThread worker(performance_log, &f_out, iter, ies_verbose, npar, nobs, pe_diff, oe_diff, par_std, obs_std, act_par_names, act_obs_names, triplets,sigma_dist,listed_obs);
 
 	int num_threads = pe.get_pest_scenario_ptr()->get_pestpp_options().get_ies_num_threads();
 
-	if (num_threads < 1)
-		worker.work(0);
-	else
+	int num_workers = max(num_threads, 1);
+	if (num_workers > 1)
 	{
 		Eigen::setNbThreads(1);
-		vector<thread> threads;
-		vector<exception_ptr> exception_ptrs;
-		performance_log->log_event("launching autoadaloc threads");
-
-		for (int i = 0; i < num_threads; i++)
-		{
-			exception_ptrs.push_back(exception_ptr());
-		}
-
-		for (int i = 0; i < num_threads; i++)
-		{
-			//threads.push_back(thread(&LocalUpgradeThread::work, &worker, i, iter, cur_lam));
-
-			threads.push_back(thread(aal_upgrade_thread_function, i, std::ref(worker), std::ref(exception_ptrs[i])));
-
-		}
-		performance_log->log_event("waiting to join threads");
-		//for (auto &t : threads)
-		//	t.join();
-		for (int i = 0; i < num_threads; ++i)
-		{
-			if (exception_ptrs[i])
-			{
-				try
-				{
-					rethrow_exception(exception_ptrs[i]);
-				}
-				catch (const std::exception& e)
-				{
-					ss.str("");
-					ss << "thread " << i << "raised an exception: " << e.what();
-					throw runtime_error(ss.str());
-				}
-			}
-			threads[i].join();
-		}
-		performance_log->log_event("threaded localized upgrade calculation done");
-
+		performance_log->log_event("dispatching autoadaloc parameter blocks to thread pool");
 	}
+	//note: the worker standardizes (and compacts) oe_diff in place
+	pest_utils::TaskPool::get_instance().parallel_for(worker.get_num_blocks(), num_workers, [&](int thread_id, int iblock)
+		{
+			worker.process_block(thread_id, iblock);
+		});
+	performance_log->log_event("autoadaloc correlation calculations done");
 
 	if (triplets.size() == 0)
 	{
@@ -645,31 +934,15 @@ unordered_map<string, pair<vector<string>, vector<string>>> Localizer::get_local
 	ss.str("");
 	ss << "autoadaloc matrix constructed with " << cur_mat.e_ptr()->nonZeros() << " non-zero elements";
 	performance_log->log_event(ss.str());
-	lmap = process_mat(performance_log, cur_mat);
+	lmap = get_active_cases(process_mat(performance_log, cur_mat), act_obs_names, act_par_names);
 	cout << "automatic adaptive localization calculations done" << endl;
 	return lmap;
 }
 
 
-void aal_upgrade_thread_function(int id, AutoAdaLocThread &worker, exception_ptr &eptr)
-{
-	try
-	{
-		worker.work(id);
-	}
-	catch (...)
-	{
-		eptr = current_exception();
-	}
-
-	return;
-}
-
-
-
-AutoAdaLocThread::AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs, vector<int> &_par_indices,
+AutoAdaLocThread::AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs,
 	Eigen::MatrixXd &_pe_diff, Eigen::MatrixXd &_oe_diff, Eigen::ArrayXd &_par_std, Eigen::ArrayXd &_obs_std, vector<string> &_par_names, vector<string> &_obs_names,
-	vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist,map<string,set<string>> &_list_obs): pe_diff(_pe_diff), oe_diff(_oe_diff), par_indices(_par_indices), par_std(_par_std), obs_std(_obs_std),par_names(_par_names),
+	vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist,map<string,set<string>> &_list_obs): pe_diff(_pe_diff), oe_diff(_oe_diff), par_std(_par_std), obs_std(_obs_std),par_names(_par_names),
 	obs_names(_obs_names),triplets(_triplets), list_obs(_list_obs)
 {
 	iter = _iter;
@@ -679,219 +952,136 @@ AutoAdaLocThread::AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_
 	performance_log = _performance_log;
 	f_out = _f_out;
 	sigma_dist = _sigma_dist;
-	
-	for (int i = 0; i < obs_names.size(); i++)
-		idx2obs[i] = obs_names[i];
+	count = 0;
+
+	for (int jpar = 0; jpar < npar; jpar++)
+		if (par_std[jpar] != 0.0)
+			par_cols.push_back(jpar);
+	//standardize the obs anomalies in place, dropping the zero-std obs so that
+	//each obs tile is a contiguous block of columns
+	for (int iobs = 0; iobs < nobs; iobs++)
+	{
+		if (obs_std[iobs] == 0.0)
+			continue;
+		oe_diff.col(obs_cols.size()) = oe_diff.col(iobs) * (1.0 / obs_std[iobs]);
+		obs_cols.push_back(iobs);
+	}
+	oe_diff.conservativeResize(Eigen::NoChange, obs_cols.size());
 
+	//size the blocks so the shifted par block and the product tile are each about 2MB
+	int nreals = pe_diff.rows();
+	const int tile_doubles = 1 << 18;
+	block_size = max(1, min(64, tile_doubles / max(1, nreals * nreals)));
+	obs_tile_size = max(16, tile_doubles / max(1, nreals * block_size));
 }
 
-void AutoAdaLocThread::work(int thread_id)
+void AutoAdaLocThread::process_block(int thread_id, int iblock)
 {
-
+	//the circular-shift background correlations of a par with an obs are the
+	//correlations of the (reverse) shifted par with the unshifted obs, so stacking
+	//all nreals shifts of each par in the block lets one GEMM per obs tile give both
+	//the correlation (shift 0) and the full background distribution (shifts 1 to nreals-1)
 	stringstream ss;
-	int jpar, pcount = 0, nreals = pe_diff.rows();
-	double cc, bg_cc, bg_mean, bg_std, thres, t;
-	double sign;
+	int nreals = pe_diff.rows();
 	double scale = 1.0 / double(nreals - 1);
-	double pstd, ostd;
-	//vector<Eigen::Triplet<double>> triplets, ones;
-	Eigen::VectorXd par_ss, obs_ss, obs_ss_shift;
-
-	par_ss.resize(nreals);
-	obs_ss.resize(nreals);
-	obs_ss_shift.resize(nreals);
-	Eigen::ArrayXd bg_cc_vec(nreals - 1);
-	set<string> sobs;
-	unique_lock<mutex> par_indices_guard(par_indices_lock, defer_lock);
-	unique_lock<mutex> oe_diff_gaurd(oe_diff_lock, defer_lock);
-	unique_lock<mutex> f_out_guard(f_out_lock, defer_lock);
-	unique_lock<mutex> triplets_guard(triplets_lock, defer_lock);
-	unique_lock<mutex>pfm_guard(pfm_lock, defer_lock);
-	unique_lock<mutex>par_names_guard(par_names_lock, defer_lock);
-	bool use_list_obs = true;
-	while (true)
-	{
-
-		while (true)
-		{
-			if (par_indices_guard.try_lock())
-			{
-				if (par_indices.size() == 0)
-				{
-					ss.str("");
-					ss << "autoadaloc thread: " << thread_id << " processed " << pcount << " parameters ";
-					if (ies_verbose > 1)
-					{
-						cout << ss.str() << endl;
-					}
-					while (true)
-					{
-						if (pfm_guard.try_lock())
-						{
-							performance_log->log_event(ss.str());
-							pfm_guard.unlock();
-							break;
-						}
-					}
-					par_indices_guard.unlock();
-					return;
-				}
-				if (par_indices.size() % 10000 == 0)
-				{
-					ss.str("");
-					ss << "autoadaloc iter " << iter << " progress: " << par_indices.size() << " of " << npar << " parameters done";
-					while (true)
-					{
-						if (pfm_guard.try_lock())
-						{
-							performance_log->log_event(ss.str());
-							pfm_guard.unlock();
-							break;
-						}
-					}
-					if (ies_verbose > 1)
-						cout << ss.str() << endl;
-				}
-				
-				jpar = par_indices[par_indices.size() - 1];
-				par_indices.pop_back();
-				if (par_std[jpar] == 0.0)
-				{
-					par_indices_guard.unlock();
-					continue;
-				}
-				par_ss = pe_diff.col(jpar) * (1.0 / par_std[jpar]);
-				
-				if (list_obs.size() > 0)
-				{
-					sobs = list_obs[par_names[jpar]];
-					use_list_obs = true;
-				}
-				else
-				{
-					use_list_obs = false;
-				}
-				pcount++;
-				par_indices_guard.unlock();
-				break;
-			}
+	int start = iblock * block_size;
+	int nblock = min(block_size, (int)par_cols.size() - start);
+	int nact_obs = obs_cols.size();
+
+	Eigen::MatrixXd shifted(nreals, nblock * nreals);
+	vector<vector<char>> allowed(nblock);
+	vector<bool> use_list_obs(nblock, false), no_obs(nblock, true);
+	for (int j = 0; j < nblock; j++)
+	{
+		int jpar = par_cols[start + j];
+		Eigen::VectorXd par_ss = pe_diff.col(jpar) * (1.0 / par_std[jpar]);
+		for (int ishift = 0; ishift < nreals; ishift++)
+		{
+			for (int i = 0; i < nreals; i++)
+				shifted(i, (j * nreals) + ishift) = par_ss[(i + ishift) % nreals];
 		}
-
-		
-		string oname;
-		bool no_obs = true;
-		for (int iobs = 0; iobs < nobs; iobs++)
+		if (list_obs.size() > 0)
 		{
-			while (true)
-			{
-				if (oe_diff_gaurd.try_lock())
-				{
-					
-					obs_ss = oe_diff.col(iobs);
-					oname = obs_names[iobs];
-					oe_diff_gaurd.unlock();
-					break;
-				}
-
-			}
-			if (obs_std[iobs] == 0.0) 
-			{
-				continue;
-			}
-			
-			if ((use_list_obs) && (sobs.size() == 0))
-				continue;
-
-			if ((sobs.size() > 0) && (sobs.find(oname) == sobs.end()))
-			{
-				continue;
-			}
-			obs_ss = obs_ss * (1.0 / obs_std[iobs]);
-			cc = (par_ss.transpose() * obs_ss)[0] * scale;
-			obs_ss_shift = 1.0 * obs_ss; //force a copy
-			for (int ireal = 0; ireal < nreals - 1; ireal++)
+			use_list_obs[j] = true;
+			allowed[j].resize(nact_obs, 0);
+			map<string, set<string>>::const_iterator it = list_obs.find(par_names[jpar]);
+			if (it != list_obs.end())
 			{
-
-				//obs_ss_shift.transpose() = obs_ss_shift.transpose() * perm;
-				//circular shift
-				t = obs_ss_shift[nreals - 1];
-				for (int i = nreals - 1; i > 0; i--)
-					obs_ss_shift[i] = obs_ss_shift[i - 1];
-				obs_ss_shift[0] = t;
-
-				//bg_cc = (par_ss.transpose() * obs_ss_shift)[0] * scale;
-				bg_cc_vec[ireal] = (par_ss.transpose() * obs_ss_shift)[0] * scale;
-				//cout << ireal << " " << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_cc << endl;
+				for (int iobs = 0; iobs < nact_obs; iobs++)
+					if (it->second.find(obs_names[obs_cols[iobs]]) != it->second.end())
+						allowed[j][iobs] = 1;
 			}
+		}
+	}
+	shifted *= scale;
 
-			//cout << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_cc << endl; 
-			(cc < 0.0) ? sign = -1. : sign = 1.;
-
-			bg_mean = bg_cc_vec.mean();
-			bg_std = sqrt((bg_cc_vec - bg_mean).pow(2).sum() / (nreals - 1));
+	vector<Eigen::Triplet<double>> block_triplets;
+	Eigen::MatrixXd cc_tile;
+	Eigen::ArrayXd cc, bg_mean, bg_std, sign, thres;
+	Eigen::Array<bool, Eigen::Dynamic, 1> kept;
+	for (int ostart = 0; ostart < nact_obs; ostart += obs_tile_size)
+	{
+		int ntile = min(obs_tile_size, nact_obs - ostart);
+		cc_tile.noalias() = shifted.transpose() * oe_diff.middleCols(ostart, ntile);
+		for (int j = 0; j < nblock; j++)
+		{
+			int jpar = par_cols[start + j];
+			//rows are the shifts for this par, cols are the obs in this tile
+			Eigen::Block<Eigen::MatrixXd> par_tile = cc_tile.middleRows(j * nreals, nreals);
+			cc = par_tile.row(0).transpose().array();
+			bg_mean = par_tile.bottomRows(nreals - 1).colwise().mean().transpose().array();
+			bg_std = ((par_tile.bottomRows(nreals - 1).array().rowwise() - bg_mean.transpose()).square().colwise().sum().transpose() / (nreals - 1)).sqrt();
+			sign = (cc < 0.0).select(Eigen::ArrayXd::Constant(ntile, -1.0), Eigen::ArrayXd::Constant(ntile, 1.0));
 			thres = bg_mean + (sign * sigma_dist * bg_std);
-			if (ies_verbose > 1)
+			kept = ((sign * cc) - (sign * thres)) > 0.0;
+			for (int k = 0; k < ntile; k++)
 			{
-				
-				while (true)
+				if ((use_list_obs[j]) && (allowed[j][ostart + k] == 0))
+					continue;
+				int iobs = obs_cols[ostart + k];
+				if (kept[k])
 				{
-					if (f_out_guard.try_lock())
-					{
-						*f_out << obs_names[iobs] << "," << par_names[jpar] << "," << cc << "," << bg_mean << "," << bg_std << "," << thres << "," << (((sign * cc) - (sign * thres)) > 0.0);
-						for (int i = 0; i < nreals - 1; i++)
-							*f_out << "," << bg_cc_vec[i];
-						*f_out << endl;
-						f_out_guard.unlock();
-						break;
-
-					}
+					block_triplets.push_back(Eigen::Triplet<double>(iobs, jpar, cc[k]));
+					no_obs[j] = false;
 				}
-				
-			}
-			if (((sign * cc) - (sign * thres)) > 0.0)
-			{
-				//cout << par_names[jpar] << " " << obs_names[iobs] << " " << cc << " " << bg_mean << " " << bg_std << " " << thres << " kept " << endl;
-				while (true)
+				if (ies_verbose > 1)
 				{
-					if (triplets_guard.try_lock())
-					{
-						triplets.push_back(Eigen::Triplet<double>(iobs, jpar, cc));
-						triplets_guard.unlock();
-						break;
-					}
+					ss.str("");
+					ss << obs_names[iobs] << "," << par_names[jpar] << "," << cc[k] << "," << bg_mean[k] << "," << bg_std[k] << "," << thres[k] << "," << kept[k];
+					for (int i = 1; i < nreals; i++)
+						ss << "," << par_tile(i, k);
+					lock_guard<mutex> f_out_guard(f_out_lock);
+					*f_out << ss.str() << endl;
 				}
-				no_obs = false;
-				
 			}
-			
-
 		}
-		if (no_obs)
+	}
+	{
+		lock_guard<mutex> triplets_guard(triplets_lock);
+		triplets.insert(triplets.end(), block_triplets.begin(), block_triplets.end());
+	}
+	for (int j = 0; j < nblock; j++)
+	{
+		if (no_obs[j])
 		{
-			string pname;
-			while (true)
-			{
-				if (par_names_guard.try_lock())
-				{
-					pname = par_names[jpar];
-					par_names_guard.unlock();
-					break;
-				}
-			}
 			ss.str("");
-
-			ss << "autoadaloc warning: parameter " << pname << " is completely localized -it maps to no observations";
-			while (true)
-			{
-				if (pfm_guard.try_lock())
-				{
-					performance_log->log_event(ss.str());
-					pfm_guard.unlock();
-					break;
-				}
-			}
+			ss << "autoadaloc warning: parameter " << par_names[par_cols[start + j]] << " is completely localized -it maps to no observations";
+			lock_guard<mutex> pfm_guard(pfm_lock);
+			performance_log->log_event(ss.str());
 		}
 	}
+	int prev_count = count.fetch_add(nblock);
+	if (((prev_count + nblock) / 10000) > (prev_count / 10000))
+	{
+		ss.str("");
+		ss << "autoadaloc iter " << iter << " progress: " << prev_count + nblock << " of " << npar << " parameters done";
+		{
+			lock_guard<mutex> pfm_guard(pfm_lock);
+			performance_log->log_event(ss.str());
+		}
+		if (ies_verbose > 1)
+			cout << ss.str() << endl;
+	}
 }
 
 
@@ -902,49 +1092,104 @@ Eigen::VectorXd Localizer::get_obs_hadamard_vector(string par_name, vector<strin
 	{
 		if (par2col_map.find(par_name) == par2col_map.end())
 			throw runtime_error("Localizer::get_obs_hadamard_vector(): error: par name '" + par_name + "' not found");
-		idx = par2col_map[par_name];
+		idx = par2col_map.at(par_name);
 	}
 	else
 	{
-		idx = colname2col_map[par_name];
+		idx = colname2col_map.at(par_name);
 	}
 	Eigen::VectorXd loc(obs_names.size());
 	loc.setZero();
-	Eigen::VectorXd col = cur_mat.e_ptr()->col(idx);
-	map<string, int>::iterator end = obs2row_map.end();
+	const Eigen::SparseMatrix<double>& mat = *cur_mat.e_ptr();
+	map<string, int>::iterator end = obs2row_map.end(), it;
 	for (int i = 0; i < obs_names.size(); i++)
 	{
-		if (obs2row_map.find(obs_names[i]) != end)
-			loc[i] = col[obs2row_map.at(obs_names[i])];
+		it = obs2row_map.find(obs_names[i]);
+		if (it != end)
+			loc[i] = mat.coeff(it->second, idx);
 	}
 	return loc;
 }
 
-Eigen::MatrixXd Localizer::get_obsdiff_hadamard_matrix(int num_reals, string col_name, vector<string> &obs_names)
+Eigen::VectorXd Localizer::get_obs_taper_vector(const string& col_name, const vector<string> &obs_names)
 {
-	if (colname2col_map.find(col_name) == colname2col_map.end())
-		throw runtime_error("Localizer::get_obsdiff_hadamard_matrix error: col_name not found in localizer matrix: " + col_name);
-	int idx = colname2col_map.at(col_name);
-	Eigen::VectorXd mat_vec = cur_mat.e_ptr()->col(idx);
-	Eigen::MatrixXd loc(obs_names.size(), num_reals);
-	for (int i=0;i<obs_names.size();i++)
+	int idx = colname2col_map.find_index(col_name);
+	if (idx < 0)
+		throw runtime_error("Localizer::get_obs_taper_vector error: col_name not found in localizer matrix: " + col_name);
+	//sparse lookups into the column - the column is never densified
+	const Eigen::SparseMatrix<double>& mat = *cur_mat.e_ptr();
+	Eigen::VectorXd loc(obs_names.size());
+	for (int i = 0; i < obs_names.size(); i++)
 	{
-		loc.row(i).setConstant(mat_vec[obs2row_map.at(obs_names[i])]);
+		loc[i] = mat.coeff(obs2row_map.at(obs_names[i]), idx);
 	}
 	return loc;
 }
 
 
-Eigen::MatrixXd Localizer::get_pardiff_hadamard_matrix(int num_reals, string row_name, vector<string> &par_names)
+Eigen::VectorXd Localizer::get_par_taper_vector(const string& row_name, const vector<string> &par_names)
 {
-	if (rowname2row_map.find(row_name) == rowname2row_map.end())
-		throw runtime_error("Localizer::get_pardiff_hadamard_matrix error: row_name not found in localizer matrix: " + row_name);
-	int idx = rowname2row_map.at(row_name);
-	Eigen::VectorXd mat_vec = cur_mat.e_ptr()->row(idx);
-	Eigen::MatrixXd loc(par_names.size(), num_reals);
-	for (int i = 0; i<par_names.size(); i++)
+	int idx = rowname2row_map.find_index(row_name);
+	if (idx < 0)
+		throw runtime_error("Localizer::get_par_taper_vector error: row_name not found in localizer matrix: " + row_name);
+	const Eigen::SparseMatrix<double>& mat = *cur_mat.e_ptr();
+	Eigen::VectorXd loc(par_names.size());
+	for (int i = 0; i < par_names.size(); i++)
 	{
-		loc.row(i).setConstant(mat_vec[par2col_map.at(par_names[i])]);
+		loc[i] = mat.coeff(idx, par2col_map.at(par_names[i]));
 	}
 	return loc;
 }
+
+LocCaseMap::LocCaseMap(const vector<string>& _obs_names, const vector<string>& _par_names)
+{
+	obs_names = make_shared<const vector<string>>(_obs_names);
+	par_names = make_shared<const vector<string>>(_par_names);
+	obs_ptr.push_back(0);
+	par_ptr.push_back(0);
+}
+
+LocCaseMap LocCaseMap::get_empty_copy() const
+{
+	LocCaseMap other;
+	other.obs_names = obs_names;
+	other.par_names = par_names;
+	return other;
+}
+
+void LocCaseMap::add_case(const string& key, const vector<int>& case_obs_idxs, const vector<int>& case_par_idxs)
+{
+	keys.push_back(key);
+	obs_idxs.insert(obs_idxs.end(), case_obs_idxs.begin(), case_obs_idxs.end());
+	obs_ptr.push_back(obs_idxs.size());
+	par_idxs.insert(par_idxs.end(), case_par_idxs.begin(), case_par_idxs.end());
+	par_ptr.push_back(par_idxs.size());
+}
+
+vector<int> LocCaseMap::get_obs_idxs(int icase) const
+{
+	return vector<int>(obs_idxs.begin() + obs_ptr[icase], obs_idxs.begin() + obs_ptr[icase + 1]);
+}
+
+vector<int> LocCaseMap::get_par_idxs(int icase) const
+{
+	return vector<int>(par_idxs.begin() + par_ptr[icase], par_idxs.begin() + par_ptr[icase + 1]);
+}
+
+vector<string> LocCaseMap::get_obs_names(int icase) const
+{
+	vector<string> names;
+	names.reserve(get_num_obs(icase));
+	for (int i = obs_ptr[icase]; i < obs_ptr[icase + 1]; i++)
+		names.push_back((*obs_names)[obs_idxs[i]]);
+	return names;
+}
+
+vector<string> LocCaseMap::get_par_names(int icase) const
+{
+	vector<string> names;
+	names.reserve(get_num_pars(icase));
+	for (int i = par_ptr[icase]; i < par_ptr[icase + 1]; i++)
+		names.push_back((*par_names)[par_idxs[i]]);
+	return names;
+}
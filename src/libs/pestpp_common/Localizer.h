@@ -3,6 +3,7 @@
 
 #include <map>
 #include <random>
+#include <atomic>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include "FileManager.h"
@@ -15,11 +16,38 @@
 #include "PerformanceLog.h"
 #include "Ensemble.h"
 
+//the localization cases in compressed (CSR-like) form: each case holds the integer positions of its
+//obs and pars in one shared pair of name lists, so case names are only formed one case at a time
+class LocCaseMap
+{
+public:
+	LocCaseMap() : LocCaseMap(vector<string>(), vector<string>()) {}
+	LocCaseMap(const vector<string>& _obs_names, const vector<string>& _par_names);
+	//a map with no cases that shares this map's name lists
+	LocCaseMap get_empty_copy() const;
+	void add_case(const string& key, const vector<int>& case_obs_idxs, const vector<int>& case_par_idxs);
+	int size() const { return keys.size(); }
+	const string& get_key(int icase) const { return keys[icase]; }
+	int get_num_obs(int icase) const { return obs_ptr[icase + 1] - obs_ptr[icase]; }
+	int get_num_pars(int icase) const { return par_ptr[icase + 1] - par_ptr[icase]; }
+	vector<int> get_obs_idxs(int icase) const;
+	vector<int> get_par_idxs(int icase) const;
+	vector<string> get_obs_names(int icase) const;
+	vector<string> get_par_names(int icase) const;
+	const vector<string>& get_all_obs_names() const { return *obs_names; }
+	const vector<string>& get_all_par_names() const { return *par_names; }
+
+private:
+	shared_ptr<const vector<string>> obs_names, par_names;
+	vector<string> keys;
+	vector<int> obs_ptr, obs_idxs, par_ptr, par_idxs;
+};
+
 class AutoAdaLocThread
 {
 public:
 
-	AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs, vector<int> &_par_indices,
+	AutoAdaLocThread(PerformanceLog *_performance_log, ofstream *_f_out, int _iter, int _ies_verbose, int _npar, int _nobs,
 		Eigen::MatrixXd &_pe_diff, Eigen::MatrixXd &_oe_diff, Eigen::ArrayXd &_par_std, Eigen::ArrayXd &_obs_std, vector<string> &_par_names, vector<string> &_obs_names,
 		vector<Eigen::Triplet<double>> &_triplets, double _sigma_dist, map<string,set<string>> &_list_obs);
 
@@ -27,25 +55,27 @@ public:
 	//Eigen::MatrixXd get_matrix_from_map(int num_reals, vector<string> &names, map<string, Eigen::VectorXd> &emap);
 
 
-	void work(int thread_id);
+	//the parameters are tested in blocks - the number of blocks to pass to process_block()
+	int get_num_blocks() { return (par_cols.size() + block_size - 1) / block_size; }
+	//test the correlations between one block of parameters and all obs - safe to call concurrently
+	void process_block(int thread_id, int iblock);
 
 
 private:
 	int npar, nobs, ies_verbose, iter;
-	int nzero_par, nzero_obs;
+	int block_size, obs_tile_size;
 	double sigma_dist;
 	Eigen::MatrixXd &pe_diff, &oe_diff;
-	vector<int> &par_indices;
 	Eigen::ArrayXd &par_std, &obs_std;
 	vector<string> &par_names, &obs_names;
 	vector<Eigen::Triplet<double>> &triplets;
 	PerformanceLog *performance_log;
 	ofstream *f_out;
 	map<string, set<string>> list_obs;
-	map<int, string> idx2obs;
-	mutex pe_diff_lock, oe_diff_lock, par_indices_lock, pfm_lock;
-	mutex f_out_lock, par_names_lock, obs_names_lock;
-	mutex triplets_lock;
+	//indices of the pars and obs with nonzero std (the oe_diff columns are compacted to obs_cols)
+	vector<int> par_cols, obs_cols;
+	atomic<int> count;
+	mutex pfm_lock, f_out_lock, triplets_lock;
 };
 
 
@@ -55,15 +85,19 @@ class Localizer
 public:
 	enum How { PARAMETERS, OBSERVATIONS};
 	enum LocTyp {COVARIANCE, LOCALANALYSIS };
-	Localizer() { initialized=false; }
-	Localizer(Pest* _pest_scenario_ptr) { pest_scenario_ptr = _pest_scenario_ptr; initialized = false; }
+	Localizer() { initialized=false; use_distance = false; }
+	Localizer(Pest* _pest_scenario_ptr) { pest_scenario_ptr = _pest_scenario_ptr; initialized = false; use_distance = false; }
 	bool initialize(PerformanceLog *performance_log, bool forgive_missing=false);
-	unordered_map<string, pair<vector<string>, vector<string>>> get_localanalysis_case_map(int iter, vector<string>& act_obs_names, vector<string>& act_par_names, 
+	LocCaseMap get_localanalysis_case_map(int iter, vector<string>& act_obs_names, vector<string>& act_par_names, 
 		ObservationEnsemble &oe, ParameterEnsemble &pe, PerformanceLog *performance_log);// { return localizer_map; }
+	//merge local analysis cases (localizing by parameters) that have identical obs sets and localizer values
+	//so they share one factorization
+	LocCaseMap batch_cases_by_obs(const LocCaseMap& case_map, PerformanceLog *performance_log);
 	
 	void set_pest_scenario(Pest *_pest_scenario_ptr) { pest_scenario_ptr = _pest_scenario_ptr; }
-	Eigen::MatrixXd get_obsdiff_hadamard_matrix(int num_reals,string col_name,vector<string> &obs_names);
-	Eigen::MatrixXd get_pardiff_hadamard_matrix(int num_reals, string row_name, vector<string> &par_names);
+	//the localizer values for one case, to scale the rows of the (transposed) obs or par anomalies
+	Eigen::VectorXd get_obs_taper_vector(const string& col_name, const vector<string> &obs_names);
+	Eigen::VectorXd get_par_taper_vector(const string& row_name, const vector<string> &par_names);
 	//Eigen::MatrixXd get_kalmangain_hadamard_matrix(vector<string>& obs_names, vector<string>& par_names);
 	Eigen::VectorXd get_obs_hadamard_vector(string par_name, vector<string>& obs_names);
 
@@ -71,7 +105,8 @@ public:
 	bool get_use() { return use; }
 	bool get_autoadaloc() { return autoadaloc; }
 	string get_filename() { return filename;  }
-	int get_num_upgrade_steps() { return _localizer_map.size(); }
+	bool get_use_distance() { return use_distance; }
+	int get_num_upgrade_steps() { return loc_cases.size(); }
 	LocTyp get_loctyp() { return loctyp; }
 	void report(ofstream &f_rec);
 	bool is_initialized() { return initialized; }
@@ -79,17 +114,27 @@ private:
 	bool use;
 	bool autoadaloc;
 	double sigma_dist;
+	bool use_distance;
+	string par_coords_filename, obs_coords_filename;
+	double loc_distance;
 	bool initialized;
 	How how;
 	LocTyp loctyp;
 	Pest * pest_scenario_ptr;
 	Mat org_mat, cur_mat;
 	string filename;
-	unordered_map<string,pair<vector<string>, vector<string>>> _localizer_map;
+	LocCaseMap loc_cases;
 	//map<string, set<string>> listed_obs;
-	map<string, int> obs2row_map, par2col_map,colname2col_map, rowname2row_map;
-
-	unordered_map<string, pair<vector<string>, vector<string>>> process_mat(PerformanceLog *performance_log, Mat& mat, bool forgive_missing=false);
+	map<string, int> obs2row_map, par2col_map;
+	//shared with the row and col indices of the localizer matrix
+	pest_utils::NameIndex colname2col_map, rowname2row_map;
+
+	LocCaseMap process_mat(PerformanceLog *performance_log, Mat& mat, bool forgive_missing=false);
+	//form the sparse localizer matrix from the par and obs coordinate files using a Gaspari-Cohn taper
+	Mat get_distance_mat(PerformanceLog *performance_log);
+	void read_coords(const string& coord_filename, const set<string>& keep_names, vector<string>& names,
+		vector<string>& dims, Eigen::MatrixXd& coords);
+	LocCaseMap get_active_cases(const LocCaseMap& cases, vector<string>& act_obs_names, vector<string>& act_par_names);
 	void update_obs_info_from_mat(Mat& mat, vector<vector<string>>& obs_map, vector<string>& missing, vector<string>& dups, 
 		set<string>& obs_names, map<string, vector<string>>& obgnme_map, vector<string>& not_allowed);
 	void update_par_info_from_mat(Mat& mat, vector<vector<string>>& par_map, vector<string>& missing, vector<string>& dups,
@@ -97,6 +142,5 @@ private:
 
 };
 
-void aal_upgrade_thread_function(int id, AutoAdaLocThread &worker, exception_ptr &eptr);
 
 #endif
@@ -1192,7 +1192,7 @@ map<string, map<string, double>> MOEA::get_obj_func_summary_stats(ParameterEnsem
 	map<string, double> mean_map, std_map;
 	_op.fill_moment_maps(mean_map, std_map);
 	_op.update_var_map();
-	map<string, int> var_map = _op.get_var_map();
+	pest_utils::NameIndex var_map = _op.get_var_map();
 	map<string, double> sum;
 	map<string, map<string, double>> summary_stats;
 	for (auto obs_obj : obs_obj_names)
@@ -1559,7 +1559,7 @@ ObservationEnsemble MOEA::get_chance_shifted_op(ParameterEnsemble& _dp, Observat
 
 void MOEA::finalize()
 {
-
+	pop_writer.flush();
 }
 
 void MOEA::initialize()
@@ -2229,7 +2229,7 @@ void MOEA::initialize()
 		ss << file_manager.get_base_filename() << ".0." << dv_pop_file_tag;
 		if (pest_scenario.get_pestpp_options().get_save_binary())
 		{
-			ss << ".jcb";
+			ss << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 			dp.to_binary(ss.str());
 		}
 		else
@@ -2252,7 +2252,7 @@ void MOEA::initialize()
 	ss << file_manager.get_base_filename() << ".0." << obs_pop_file_tag;
 	if (pest_scenario.get_pestpp_options().get_save_binary())
 	{
-		ss << ".jcb";
+		ss << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 		op.to_binary(ss.str());
 	}
 	else
@@ -2282,7 +2282,7 @@ void MOEA::initialize()
 		ss << file_manager.get_base_filename() << ".0." << obs_pop_file_tag << ".chance";
 		if (pest_scenario.get_pestpp_options().get_save_binary())
 		{
-			ss << ".jcb";
+			ss << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 			shifted_op.to_binary(ss.str());
 		}
 		else
@@ -2302,7 +2302,7 @@ void MOEA::initialize()
 	ss << file_manager.get_base_filename() << ".0." << dv_pop_file_tag;
 	if (pest_scenario.get_pestpp_options().get_save_binary())
 	{
-		ss << ".jcb";
+		ss << pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
 		dp.to_binary(ss.str());
 	}
 	else
@@ -2848,7 +2848,7 @@ bool MOEA::initialize_dv_population()
 				throw_moea_error(string("error processing dv population file"));
 			}
 		}
-		else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0))
+		else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0) || (par_ext.compare("ens") == 0))
 		{
 			message(1, "loading dv population from binary file", dv_filename);
 			try
@@ -2867,7 +2867,7 @@ bool MOEA::initialize_dv_population()
 		}
 		else
 		{
-			ss << "unrecognized dv population file extension " << par_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized dv population file extension " << par_ext << ", looking for csv, jcb, jco, or ens";
 			throw_moea_error(ss.str());
 		}
 
@@ -2965,7 +2965,7 @@ void MOEA::initialize_obs_restart_population()
 			throw_moea_error(string("error processing obs population file"));
 		}
 	}
-	else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0))
+	else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0) || (par_ext.compare("ens") == 0))
 	{
 	message(1, "loading obs population from binary file", obs_filename);
 	try
@@ -2984,7 +2984,7 @@ void MOEA::initialize_obs_restart_population()
 	}
 	else
 	{
-	ss << "unrecognized obs population restart file extension " << par_ext << ", looking for csv, jcb, or jco";
+	ss << "unrecognized obs population restart file extension " << par_ext << ", looking for csv, jcb, jco, or ens";
 	throw_moea_error(ss.str());
 	}
 
@@ -3357,7 +3357,7 @@ ParameterEnsemble MOEA::generate_simplex_population(int num_members, ParameterEn
     vector<string> real_names = _dp.get_real_names();
     string new_name,current_name;
     _dp.update_var_map();
-    map<string, int> var_map = _dp.get_var_map();
+    pest_utils::NameIndex var_map = _dp.get_var_map();
     string dv_name;
     int ii;
     int i_last;
@@ -3443,7 +3443,7 @@ ParameterEnsemble MOEA::generate_diffevol_population(int num_members, ParameterE
 	vector<string> real_names = _dp.get_real_names();
 	string new_name;
 	_dp.update_var_map();
-	map<string, int> var_map = _dp.get_var_map();
+	pest_utils::NameIndex var_map = _dp.get_var_map();
 	string dv_name;
 	int ii;
 	int i_last;
@@ -3565,7 +3565,7 @@ ParameterEnsemble MOEA::generate_pm_population(int num_members, ParameterEnsembl
 	string new_name;
 
 	_dp.update_var_map();
-	map<string, int> var_map = _dp.get_var_map();
+	pest_utils::NameIndex var_map = _dp.get_var_map();
 	bool adaptive_mr = false;
 	if (var_map.find(MR_NAME) != var_map.end())
 		adaptive_mr = true;
@@ -3688,7 +3688,7 @@ ParameterEnsemble MOEA::generate_sbx_population(int num_members, ParameterEnsemb
 	Eigen::VectorXd parent1, parent2;
 	int tries = 0;
 	_dp.update_var_map();
-	map<string, int> var_map = _dp.get_var_map();
+	pest_utils::NameIndex var_map = _dp.get_var_map();
 	bool adaptive_cr = false;
 	if (var_map.find(CR_NAME) != var_map.end())
 		adaptive_cr = true;
@@ -3750,52 +3750,37 @@ ParameterEnsemble MOEA::generate_sbx_population(int num_members, ParameterEnsemb
 
 void MOEA::save_populations(ParameterEnsemble& dp, ObservationEnsemble& op, string tag)
 {
-	
+	//the populations are snapshotted here and written in the background while the next
+	//generation is formed and run - the final generation is flushed before returning
 	stringstream ss;
-	string fname;
+	string ext = ".csv";
+	if (pest_scenario.get_pestpp_options().get_save_binary())
+		ext = pest_scenario.get_pestpp_options().get_ensemble_binary_ext();
+	bool save_gen = (save_every > 0) && (iter % save_every == 0);
+	vector<string> dp_names, op_names;
 
 	ss << file_manager.get_base_filename();
 	if (tag.size() > 0)
 	{
 		ss << "." << tag;
 	}
-	ss << "." << dv_pop_file_tag;
-	if (pest_scenario.get_pestpp_options().get_save_binary())
-	{
-		ss << ".jcb";
-		dp.to_binary(ss.str());
-	}
-	else
-	{
-		ss << ".csv";
-		dp.to_csv(ss.str());
-	}
-	string name = ss.str();
+	ss << "." << dv_pop_file_tag << ext;
+	dp_names.push_back(ss.str());
 	ss.str("");
-	ss << " saved decision variable population of size " << dp.shape().first << " X " << dp.shape().second << " to '" << name << "'";
+	ss << " saving decision variable population of size " << dp.shape().first << " X " << dp.shape().second << " to '" << dp_names.back() << "'";
 	message(1, ss.str());
 	ss.str("");
-	if ((save_every > 0) && (iter % save_every == 0))
+	if (save_gen)
 	{
 		ss << file_manager.get_base_filename() << "." << iter;
 		if (tag.size() > 0)
 		{
 			ss << "." << tag;
 		}
-		ss << "." << dv_pop_file_tag;
-		if (pest_scenario.get_pestpp_options().get_save_binary())
-		{
-			ss << ".jcb";
-			dp.to_binary(ss.str());
-		}
-		else
-		{
-			ss << ".csv";
-			dp.to_csv(ss.str());
-		}
-		string name = ss.str();
+		ss << "." << dv_pop_file_tag << ext;
+		dp_names.push_back(ss.str());
 		ss.str("");
-		ss << " saved generation-specific decision variable population of size " << dp.shape().first << " X " << dp.shape().second << " to '" << name << "'";
+		ss << " saving generation-specific decision variable population of size " << dp.shape().first << " X " << dp.shape().second << " to '" << dp_names.back() << "'";
 		message(1, ss.str());
 	}
 	
@@ -3806,23 +3791,13 @@ void MOEA::save_populations(ParameterEnsemble& dp, ObservationEnsemble& op, stri
 	{
 		ss << "." << tag;
 	}
-	ss << "." << obs_pop_file_tag;
-	if (pest_scenario.get_pestpp_options().get_save_binary())
-	{
-		ss << ".jcb";
-		op.to_binary(ss.str());
-	}
-	else
-	{
-		ss << ".csv";
-		op.to_csv(ss.str());
-	}
-	name = ss.str();
+	ss << "." << obs_pop_file_tag << ext;
+	op_names.push_back(ss.str());
 	ss.str("");
-	ss << " saved observation population of size " << op.shape().first << " X " << op.shape().second << " to '" << name << "'";
+	ss << " saving observation population of size " << op.shape().first << " X " << op.shape().second << " to '" << op_names.back() << "'";
 	message(1, ss.str());
 
-	if ((save_every > 0) && (iter % save_every == 0))
+	if (save_gen)
 	{
 		ss.str("");
 		ss << file_manager.get_base_filename() << "." << iter;
@@ -3830,23 +3805,18 @@ void MOEA::save_populations(ParameterEnsemble& dp, ObservationEnsemble& op, stri
 		{
 			ss << "." << tag;
 		}
-		ss << "." << obs_pop_file_tag;
-		if (pest_scenario.get_pestpp_options().get_save_binary())
-		{
-			ss << ".jcb";
-			op.to_binary(ss.str());
-		}
-		else
-		{
-			ss << ".csv";
-			op.to_csv(ss.str());
-		}
-		name = ss.str();
+		ss << "." << obs_pop_file_tag << ext;
+		op_names.push_back(ss.str());
 		ss.str("");
-		ss << " saved generation-specific observation population of size " << op.shape().first << " X " << op.shape().second << " to '" << name << "'";
+		ss << " saving generation-specific observation population of size " << op.shape().first << " X " << op.shape().second << " to '" << op_names.back() << "'";
 		message(1, ss.str());
 	}
 
+	pop_writer.save(dp, dp_names);
+	pop_writer.save(op, op_names);
+	pop_writer.dispatch();
+	if (iter >= pest_scenario.get_control_info().noptmax)
+		pop_writer.flush();
 }
 
 string MOEA::get_new_member_name(string tag)
@@ -4291,7 +4261,7 @@ void MOEA::gauss_mutation_ip(ParameterEnsemble& _dp)
 
 	_dp.transform_ip(ParameterEnsemble::transStatus::NUM);
 	_dp.update_var_map();
-	map<string, int> var_map = _dp.get_var_map();
+	pest_utils::NameIndex var_map = _dp.get_var_map();
 	bool adaptive_mr = false;
 	if (var_map.find(MR_NAME) != var_map.end())
 		adaptive_mr = true;
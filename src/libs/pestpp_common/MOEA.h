@@ -157,6 +157,7 @@ private:
 	bool risk_obj;
 	int restart_iter_offset;
 	int save_every;
+	AsyncEnsembleWriter pop_writer;
 	map<int,int> population_schedule;
 
 	//these two instances are passed as pointers to the constraints
@@ -185,7 +185,7 @@ bool SeqQuadProgram::initialize_dv(Covariance &cov)
 				throw_sqp_error(string("error processing dv csv file"));
 			}
 		}
-		else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0))
+		else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0) || (par_ext.compare("ens") == 0))
 		{
 			message(1, "loading dv ensemble from binary file", dv_file);
 			try
@@ -204,7 +204,7 @@ bool SeqQuadProgram::initialize_dv(Covariance &cov)
 		}
 		else
 		{
-			ss << "unrecognized dv ensemble file extension " << par_ext << ", looking for csv, jcb, or jco";
+			ss << "unrecognized dv ensemble file extension " << par_ext << ", looking for csv, jcb, jco, or ens";
 			throw_sqp_error(ss.str());
 		}
 
@@ -575,7 +575,7 @@ bool SeqQuadProgram::initialize_restart()
 			throw_sqp_error(string("error processing restart obs csv"));
 		}
 	}
-	else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0))
+	else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0) || (obs_ext.compare("ens") == 0))
 	{
 		message(1, "loading restart obs ensemble from binary file", obs_restart_csv);
 		try
@@ -594,7 +594,7 @@ bool SeqQuadProgram::initialize_restart()
 	}
 	else
 	{
-		ss << "unrecognized restart obs ensemble extension " << obs_ext << ", looking for csv, jcb, or jco";
+		ss << "unrecognized restart obs ensemble extension " << obs_ext << ", looking for csv, jcb, jco, or ens";
 		throw_sqp_error(ss.str());
 	}
 	
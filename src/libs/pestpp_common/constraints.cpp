@@ -594,7 +594,7 @@ void Constraints::initialize(vector<string>& ctl_ord_dec_var_names, double _dbl_
 						throw_constraints_error(string("error processing par stack"));
 					}
 				}
-				else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0))
+				else if ((par_ext.compare("jcb") == 0) || (par_ext.compare("jco") == 0) || (par_ext.compare("ens") == 0))
 				{
 					pfm.log_event("loading par stack from binary file " + par_csv);
 					try
@@ -738,7 +738,7 @@ void Constraints::initialize(vector<string>& ctl_ord_dec_var_names, double _dbl_
 						throw_constraints_error(string("error processing obs stack"));
 					}
 				}
-				else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0))
+				else if ((obs_ext.compare("jcb") == 0) || (obs_ext.compare("jco") == 0) || (obs_ext.compare("ens") == 0))
 				{
 					pfm.log_event("loading obs stack from binary file+ " + obs_csv);
 					try
@@ -1098,7 +1098,7 @@ ObservationEnsemble Constraints::get_chance_shifted_constraints(ParameterEnsembl
 		risk_map[rname] = risk;
 	}
 	pe.update_var_map();
-	map<string, int> vm = pe.get_var_map();
+	pest_utils::NameIndex vm = pe.get_var_map();
 	if (risk_obj.size() > 0)
 	{
 		if (vm.find(risk_obj) == vm.end())
@@ -1436,7 +1436,7 @@ Observations Constraints::get_chance_shifted_constraints(Observations& current_o
 	Eigen::MatrixXd anom = _stack_oe.get_eigen_anomalies();
 	//get the map of realization name to index location in the stack
 	_stack_oe.update_var_map();
-	map<string, int> var_map = _stack_oe.get_var_map();
+	pest_utils::NameIndex var_map = _stack_oe.get_var_map();
 	//get the mean and stdev summary containters, summarized by observation (e.g. constraint) name
 	//pair<map<string, double>, map<string, double>> mm = _stack_oe.get_moment_maps();
 	map<string, double> mean_map, std_map;
@@ -2960,7 +2960,7 @@ Mat Constraints::get_working_set_constraint_matrix(Parameters& par_and_dec_vars,
         full_s_inv.resize(0, 0);
         Eigen::MatrixXd working_mat(working_set.size(), dv.shape().second);
         oe.update_var_map();
-        map<string, int> vmap = oe.get_var_map();
+        pest_utils::NameIndex vmap = oe.get_var_map();
         int i = 0;
         for (auto &n : working_set) {
             working_mat.row(i) = approx_jco.row(vmap[n]);
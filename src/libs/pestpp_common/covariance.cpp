@@ -73,12 +73,10 @@ Mat::Mat(vector<string> _row_names, vector<string> _col_names,
 
 void Mat::update_sets()
 {
-	row_set.clear();
-	//row_set.emplace(row_names.begin(), row_names.end());
-	row_set = set<string>(row_names.begin(), row_names.end());
-	col_set.clear();
-	//col_set.emplace(col_names.begin(), col_names.end());
-	col_set = set<string>(col_names.begin(), col_names.end());
+	if (!row_index.same_names(row_names))
+		row_index = pest_utils::NameIndex(row_names);
+	if (!col_index.same_names(col_names))
+		col_index = pest_utils::NameIndex(col_names);
 }
 
 
@@ -780,19 +778,12 @@ Mat Mat::get(const vector<string> &new_row_names, const vector<string> &new_col_
 	if (new_col_names.size() == 0) throw runtime_error("Mat::get() error: new_col_names is empty");
 	vector<string> row_not_found;
 	
-	if (update)
+	if ((update) || (row_index.size() != row_names.size()) || (col_index.size() != col_names.size()))
 		update_sets();
-	set<string>::iterator end = row_set.end();
-	for (auto &n : new_row_names)
-		if (row_set.find(n) == end)
-			row_not_found.push_back(n);
+	vector<int> new_row_idxs = row_index.get_indices(new_row_names, row_not_found);
 
 	vector<string> col_not_found;
-	//set<string> col_set(col_names.begin(), col_names.end());
-	end = col_set.end();
-	for (auto &n : new_col_names)
-		if (col_set.find(n) == end)
-			col_not_found.push_back(n);
+	vector<int> new_col_idxs = col_index.get_indices(new_col_names, col_not_found);
 	if (row_not_found.size() != 0)
 	{
 		cout << "Mat::get() error: the following row names were not found:" << endl;
@@ -817,45 +808,25 @@ Mat Mat::get(const vector<string> &new_row_names, const vector<string> &new_col_
 
 	int nrow = new_row_names.size();
 	int ncol = new_col_names.size();
-	int irow_new;
-	int icol_new;
 
-	unordered_map<string, int> row_name2new_index_map;
-	unordered_map<string, int> col_name2new_index_map;
+	// map each existing row and col position to its position in the new matrix (-1 if not wanted)
+	vector<int> row_old2new(row_names.size(), -1), col_old2new(col_names.size(), -1);
+	for (int i = 0; i < nrow; i++)
+		row_old2new[new_row_idxs[i]] = i;
+	for (int i = 0; i < ncol; i++)
+		col_old2new[new_col_idxs[i]] = i;
 
-	// Build mapping of parameter names to column number in new matrix to be returned
-	icol_new = 0;
-	for (vector<string>::const_iterator b = new_col_names.begin(), e = new_col_names.end();
-		b != e; ++b, ++icol_new) {
-		col_name2new_index_map[(*b)] = icol_new;
-	}
-
-	// Build mapping of observation names to row  number in new matrix to be returned
-	irow_new = 0;
-	for (vector<string>::const_iterator b = new_row_names.begin(), e = new_row_names.end();
-		b != e; ++b, ++irow_new) {
-		row_name2new_index_map[(*b)] = irow_new;
-	}
-
-	unordered_map<string, int>::const_iterator found_col;
-	unordered_map<string, int>::const_iterator found_row;
-	unordered_map<string, int>::const_iterator not_found_col_map = col_name2new_index_map.end();
-	unordered_map<string, int>::const_iterator not_found_row_map = row_name2new_index_map.end();
-
-	const string *row_name;
-	const string *col_name;
+	int inew, jnew;
 	std::vector<Eigen::Triplet<double> > triplet_list;
 	for (int icol = 0; icol<matrix.outerSize(); ++icol)
 	{
 		for (Eigen::SparseMatrix<double>::InnerIterator it(matrix, icol); it; ++it)
 		{
-			col_name = &col_names[it.col()];
-			row_name = &row_names[it.row()];
-			found_col = col_name2new_index_map.find(*col_name);
-			found_row = row_name2new_index_map.find(*row_name);
-			if (found_col != not_found_col_map && found_row != not_found_row_map)
+			jnew = col_old2new[it.col()];
+			inew = row_old2new[it.row()];
+			if ((jnew >= 0) && (inew >= 0))
 			{
-				triplet_list.push_back(Eigen::Triplet<double>(found_row->second, found_col->second, it.value()));
+				triplet_list.push_back(Eigen::Triplet<double>(inew, jnew, it.value()));
 			}
 		}
 	}
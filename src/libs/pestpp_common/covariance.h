@@ -85,7 +85,10 @@ public:
 
 	bool isdiagonal();
 
+	//rebuild the row and col name indices if the names have changed
 	void update_sets();
+	const pest_utils::NameIndex& get_row_index() { update_sets(); return row_index; }
+	const pest_utils::NameIndex& get_col_index() { update_sets(); return col_index; }
 
 	//void set_row_names(vector<string> _row_names) { row_names = _row_names; }
 	//void set_col_names(vector<string> _col_names) { col_names = _col_names; }
@@ -99,8 +102,8 @@ protected:
 	Eigen::VectorXd s;
 	vector<string> row_names;
 	vector<string> col_names;
-	set<string> row_set;
-	set<string> col_set;
+	pest_utils::NameIndex row_index;
+	pest_utils::NameIndex col_index;
 	int icode = 2;
 	MatType mattype;
 
@@ -1118,6 +1118,56 @@ bool PestppOptions::assign_ies_value_by_key(const string& key, const string& val
         convert_ip(value,ies_multimodal_alpha);
         return true;
     }
+	else if (key == "IES_OUT_OF_CORE")
+	{
+	ies_out_of_core = pest_utils::parse_string_arg_to_bool(value);
+	return true;
+	}
+	else if (key == "IES_OUT_OF_CORE_CACHE_MB")
+	{
+	convert_ip(value, ies_out_of_core_cache_mb);
+	if (ies_out_of_core_cache_mb <= 0.0)
+		throw runtime_error("ies_out_of_core_cache_mb must be greater than zero");
+	return true;
+	}
+	else if ((key == "IES_ENSEMBLE_PRECISION") || (key == "ENSEMBLE_PRECISION"))
+	{
+	passed_args.insert("IES_ENSEMBLE_PRECISION");
+	passed_args.insert("ENSEMBLE_PRECISION");
+	ies_ensemble_precision = lower_cp(strip_cp(value));
+	if ((ies_ensemble_precision != "double") && (ies_ensemble_precision != "float"))
+		throw runtime_error("ies_ensemble_precision must be 'double' or 'float', not " + ies_ensemble_precision);
+	return true;
+	}
+	else if (key == "IES_UPGRADE_FACTOR_CACHE_MB")
+	{
+	convert_ip(value, ies_upgrade_factor_cache_mb);
+	if (ies_upgrade_factor_cache_mb < 0.0)
+		throw runtime_error("ies_upgrade_factor_cache_mb must not be negative");
+	return true;
+	}
+	else if (key == "IES_LOC_PAR_COORDS")
+	{
+	ies_loc_par_coords = org_value;
+	return true;
+	}
+	else if (key == "IES_LOC_OBS_COORDS")
+	{
+	ies_loc_obs_coords = org_value;
+	return true;
+	}
+	else if (key == "IES_LOC_DISTANCE")
+	{
+	convert_ip(value, ies_loc_distance);
+	if (ies_loc_distance <= 0.0)
+		throw runtime_error("ies_loc_distance must be greater than zero");
+	return true;
+	}
+	else if (key == "IES_OVERLAP_LAMBDA_RUNS")
+	{
+	ies_overlap_lambda_runs = pest_utils::parse_string_arg_to_bool(value);
+	return true;
+	}
 
 
 
@@ -1298,6 +1348,34 @@ bool PestppOptions::assign_value_by_key_continued(const string& key, const strin
         }
         return true;
     }
+    else if (key == "RAM_RUN_DIR")
+    {
+        ram_run_dir = strip_cp(org_value);
+        string lvalue = lower_cp(ram_run_dir);
+        if (lvalue == "true")
+            ram_run_dir = "/dev/shm";
+        else if (lvalue == "false")
+            ram_run_dir = "";
+        return true;
+    }
+    else if (key == "RAM_RUN_FILES")
+    {
+        ram_run_files.clear();
+        vector<string> tokes;
+        tokenize(org_value, tokes, ",");
+        for (const auto& toke: tokes)
+        {
+            ram_run_files.push_back(strip_cp(toke));
+        }
+        return true;
+    }
+    else if (key == "ENSEMBLE_BINARY_FORMAT")
+    {
+        ensemble_binary_format = lower_cp(strip_cp(value));
+        if ((ensemble_binary_format != "jcb") && (ensemble_binary_format != "ens") && (ensemble_binary_format != "ens32"))
+            throw runtime_error("ensemble_binary_format must be 'jcb', 'ens' or 'ens32', not " + ensemble_binary_format);
+        return true;
+    }
 
 	
 	return false;
@@ -1530,6 +1608,11 @@ void PestppOptions::summary(ostream& os) const
     os << "panther_transfer_on_fail: " << endl;
     for (auto& file : panther_transfer_on_fail)
         os << file << endl;
+    os << "ram_run_dir: " << ram_run_dir << endl;
+    os << "ram_run_files: " << endl;
+    for (auto& file : ram_run_files)
+        os << file << endl;
+    os << "ensemble_binary_format: " << ensemble_binary_format << endl;
 
     os << endl;
 
@@ -1720,6 +1803,14 @@ void PestppOptions::summary(ostream& os) const
 	os << "ies_upgrades_in_memory: " << ies_upgrades_in_memory << endl;
 	os << "ies_ordered_binary: " << ies_ordered_binary << endl;
 	os << "ies_multimodal_alpha: " << ies_multimodal_alpha << endl;
+	os << "ies_out_of_core: " << ies_out_of_core << endl;
+	os << "ies_out_of_core_cache_mb: " << ies_out_of_core_cache_mb << endl;
+	os << "ies_ensemble_precision: " << ies_ensemble_precision << endl;
+	os << "ies_upgrade_factor_cache_mb: " << ies_upgrade_factor_cache_mb << endl;
+	os << "ies_loc_par_coords: " << ies_loc_par_coords << endl;
+	os << "ies_loc_obs_coords: " << ies_loc_obs_coords << endl;
+	os << "ies_loc_distance: " << ies_loc_distance << endl;
+	os << "ies_overlap_lambda_runs: " << ies_overlap_lambda_runs << endl;
 
 
 	os << endl << "pestpp-sen options: " << endl;
@@ -1896,6 +1987,14 @@ void PestppOptions::set_defaults()
 	set_ies_upgrades_in_memory(true);
 	set_ies_ordered_binary(true);
     set_ies_multimodal_alpha(1.0);
+	set_ies_out_of_core(false);
+	set_ies_out_of_core_cache_mb(1000.0);
+	set_ies_ensemble_precision("double");
+	set_ies_upgrade_factor_cache_mb(1000.0);
+	set_ies_loc_par_coords("");
+	set_ies_loc_obs_coords("");
+	set_ies_loc_distance(0.0);
+	set_ies_overlap_lambda_runs(true);
     set_ensemble_output_precision(6);
 
 	// DA parameters
@@ -1941,6 +2040,9 @@ void PestppOptions::set_defaults()
 	set_panther_echo(true);
     set_panther_transfer_on_finish(vector<string>{});
     set_panther_transfer_on_fail(vector<string>{});
+    set_ram_run_dir("");
+    set_ram_run_files(vector<string>{});
+    set_ensemble_binary_format("jcb");
 
 }
 
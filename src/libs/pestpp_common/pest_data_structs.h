@@ -523,6 +523,23 @@ public:
 	void set_ies_ordered_binary(bool _flag) { ies_ordered_binary = _flag; }
     double get_ies_multimodal_alpha() const { return ies_multimodal_alpha; }
     void set_ies_multimodal_alpha(double _flag) { ies_multimodal_alpha = _flag; }
+	bool get_ies_out_of_core() const { return ies_out_of_core; }
+	void set_ies_out_of_core(bool _flag) { ies_out_of_core = _flag; }
+	double get_ies_out_of_core_cache_mb() const { return ies_out_of_core_cache_mb; }
+	void set_ies_out_of_core_cache_mb(double _mb) { ies_out_of_core_cache_mb = _mb; }
+	string get_ies_ensemble_precision() const { return ies_ensemble_precision; }
+	void set_ies_ensemble_precision(string _precision) { ies_ensemble_precision = _precision; }
+	bool get_ies_single_precision() const { return ies_ensemble_precision == "float"; }
+	double get_ies_upgrade_factor_cache_mb() const { return ies_upgrade_factor_cache_mb; }
+	void set_ies_upgrade_factor_cache_mb(double _mb) { ies_upgrade_factor_cache_mb = _mb; }
+	string get_ies_loc_par_coords() const { return ies_loc_par_coords; }
+	void set_ies_loc_par_coords(string _filename) { ies_loc_par_coords = _filename; }
+	string get_ies_loc_obs_coords() const { return ies_loc_obs_coords; }
+	void set_ies_loc_obs_coords(string _filename) { ies_loc_obs_coords = _filename; }
+	double get_ies_loc_distance() const { return ies_loc_distance; }
+	void set_ies_loc_distance(double _dist) { ies_loc_distance = _dist; }
+	bool get_ies_overlap_lambda_runs() const { return ies_overlap_lambda_runs; }
+	void set_ies_overlap_lambda_runs(bool _flag) { ies_overlap_lambda_runs = _flag; }
     void set_ensemble_output_precision(int prec) { ensemble_output_precision = prec;}
     int get_ensemble_output_precision() const {return ensemble_output_precision;}
 
@@ -609,6 +626,15 @@ public:
     const vector<string>& get_panther_transfer_on_fail() const {return panther_transfer_on_fail;}
     void set_panther_transfer_on_finish(vector<string> _files) {panther_transfer_on_finish = _files;}
     void set_panther_transfer_on_fail(vector<string> _files) {panther_transfer_on_fail = _files;}
+    string get_ram_run_dir() const { return ram_run_dir; }
+    void set_ram_run_dir(string _dir) { ram_run_dir = _dir; }
+    const vector<string>& get_ram_run_files() const { return ram_run_files; }
+    void set_ram_run_files(vector<string> _files) { ram_run_files = _files; }
+    string get_ensemble_binary_format() const { return ensemble_binary_format; }
+    void set_ensemble_binary_format(string _format) { ensemble_binary_format = _format; }
+    //file extension for binary ensemble files written when save_binary is true
+    string get_ensemble_binary_ext() const { return (ensemble_binary_format == "jcb") ? ".jcb" : ".ens"; }
+    bool get_ensemble_binary_single() const { return ensemble_binary_format == "ens32"; }
 
 
 
@@ -788,6 +814,14 @@ private:
 	bool ies_upgrades_in_memory;
 	bool ies_ordered_binary;
 	double ies_multimodal_alpha;
+	bool ies_out_of_core;
+	double ies_out_of_core_cache_mb;
+	string ies_ensemble_precision;
+	double ies_upgrade_factor_cache_mb;
+	string ies_loc_par_coords;
+	string ies_loc_obs_coords;
+	double ies_loc_distance;
+	bool ies_overlap_lambda_runs;
 
 
 	// Data Assimilation parameters
@@ -826,6 +860,9 @@ private:
 	bool panther_debug_fail_freeze;
 	bool panther_echo;
 	vector<string> panther_transfer_on_finish, panther_transfer_on_fail;
+	string ram_run_dir;
+	vector<string> ram_run_files;
+	string ensemble_binary_format;
 
 };
 //ostream& operator<< (ostream &os, const PestppOptions& val);
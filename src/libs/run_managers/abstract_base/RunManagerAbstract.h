@@ -55,6 +55,8 @@ public:
 	virtual RunManagerAbstract::RUN_UNTIL_COND run_until(RUN_UNTIL_COND condition, int n_nops = 0, double sec = 0.0);
 	virtual const std::vector<std::string> &get_par_name_vec() const;
 	virtual const std::vector<std::string> &get_obs_name_vec() const;
+	const pest_utils::NameIndex& get_par_name_index() const { return file_stor.get_par_name_index(); }
+	const pest_utils::NameIndex& get_obs_name_index() const { return file_stor.get_obs_name_index(); }
 	virtual void get_info(int run_id, int &run_status, std::string &info_txt, double &info_value);
 	virtual bool run_finished(int run_id);
 	virtual bool get_run(int run_id, Parameters &pars, Observations &obs, bool clear_old=true);
@@ -225,6 +225,20 @@ const std::vector<string>& RunStorage::get_obs_name_vec()const
 	return obs_names;
 }
 
+const pest_utils::NameIndex& RunStorage::get_par_name_index() const
+{
+	if (!par_index.same_names(par_names))
+		par_index = pest_utils::NameIndex(par_names);
+	return par_index;
+}
+
+const pest_utils::NameIndex& RunStorage::get_obs_name_index() const
+{
+	if (!obs_index.same_names(obs_names))
+		obs_index = pest_utils::NameIndex(obs_names);
+	return obs_index;
+}
+
 streamoff RunStorage::get_stream_pos(int run_id)
 {
 	streamoff pos = beg_run0 + run_byte_size*run_id;
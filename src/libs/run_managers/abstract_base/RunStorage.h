@@ -27,6 +27,7 @@
 #include <cstdint>
 #include <Eigen/Dense>
 #include "network_package.h"
+#include "utilities.h"
 
 class Parameters;
 class Observations;
@@ -70,6 +71,9 @@ public:
 	int increment_nruns();
 	const std::vector<std::string>& get_par_name_vec()const;
 	const std::vector<std::string>& get_obs_name_vec()const;
+	//hash indices into the par and obs name vectors, shared with callers rather than rebuilt
+	const pest_utils::NameIndex& get_par_name_index() const;
+	const pest_utils::NameIndex& get_obs_name_index() const;
 	int get_run_status(int run_id);
 	void get_info(int run_id, int &run_status, std::string &info_txt, double &info_value);
 	int get_run(int run_id, Parameters &pars, Observations &obs, bool clear_old=true);
@@ -98,6 +102,8 @@ private:
 	std::streamoff run_data_byte_size;
 	std::vector<std::string> par_names;
 	std::vector<std::string> obs_names;
+	mutable pest_utils::NameIndex par_index;
+	mutable pest_utils::NameIndex obs_index;
 	void check_rec_size(const std::vector<char> &serial_data) const;
 	void check_rec_id(int run_id);
 	std::int8_t get_run_status_native(int run_id);
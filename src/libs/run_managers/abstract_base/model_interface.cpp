@@ -7,11 +7,19 @@
 #include <fstream>
 #include <vector>
 #include <cstring>
+#include <cstdio>
 #include <sstream>
 #include <thread>
 #include <unordered_set>
 #include "model_interface.h"
 #include <limits>
+#include <cerrno>
+#include <algorithm>
+#ifdef OS_LINUX
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -84,6 +92,238 @@ void ModelInterface::scrub_filename_ip(string& fname)
 }
 
 
+string ModelInterface::run_dir_path(const string& fname) const
+{
+	if ((run_dir.empty()) || (fname.empty()) || (fname[0] == '/') || (fname[0] == '\\') || (fname.find(':') != string::npos))
+		return fname;
+	return run_dir + OperSys::DIR_SEP + fname;
+}
+
+vector<string> ModelInterface::run_dir_paths(const vector<string>& fnames) const
+{
+	vector<string> paths;
+	paths.reserve(fnames.size());
+	for (auto& fname : fnames)
+		paths.push_back(run_dir_path(fname));
+	return paths;
+}
+
+#ifdef OS_LINUX
+void copy_file_preserve_mode(const string& src, const string& dest)
+{
+	struct stat st;
+	if (stat(src.c_str(), &st) != 0)
+		throw runtime_error("model input/output error: couldn't stat file '" + src + "'");
+	ifstream in(src, ios::binary);
+	ofstream out(dest, ios::binary | ios::trunc);
+	if ((!in.good()) || (!out.good()))
+		throw runtime_error("model input/output error: couldn't copy file '" + src + "' to '" + dest + "'");
+	out << in.rdbuf();
+	out.close();
+	in.close();
+	//keep executable bits so that models/scripts in the run dir can still be called
+	chmod(dest.c_str(), st.st_mode & 07777);
+}
+
+void copy_dir_tree(const string& src, const string& dest, const string& exclude)
+{
+	DIR* dir = opendir(src.c_str());
+	if (dir == NULL)
+		throw runtime_error("model input/output error: couldn't open directory '" + src + "' for staging");
+	struct dirent* entry;
+	struct stat st;
+	string name, src_path, dest_path;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		name = entry->d_name;
+		if ((name == ".") || (name == ".."))
+			continue;
+		src_path = src + "/" + name;
+		dest_path = dest + "/" + name;
+		//dont recurse into the staged dir itself if it lives below the source dir
+		if ((src_path == exclude) || (stat(src_path.c_str(), &st) != 0))
+			continue;
+		if (S_ISDIR(st.st_mode))
+		{
+			if ((mkdir(dest_path.c_str(), st.st_mode & 07777) != 0) && (errno != EEXIST))
+			{
+				closedir(dir);
+				throw runtime_error("model input/output error: couldn't create staged directory '" + dest_path + "'");
+			}
+			copy_dir_tree(src_path, dest_path, exclude);
+		}
+		else if (S_ISREG(st.st_mode))
+			copy_file_preserve_mode(src_path, dest_path);
+	}
+	closedir(dir);
+}
+
+void remove_dir_tree(const string& path)
+{
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL)
+		return;
+	struct dirent* entry;
+	struct stat st;
+	string name, entry_path;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		name = entry->d_name;
+		if ((name == ".") || (name == ".."))
+			continue;
+		entry_path = path + "/" + name;
+		if ((lstat(entry_path.c_str(), &st) == 0) && (S_ISDIR(st.st_mode)))
+			remove_dir_tree(entry_path);
+		else
+			unlink(entry_path.c_str());
+	}
+	closedir(dir);
+	rmdir(path.c_str());
+}
+#endif
+
+bool ModelInterface::is_stageable_path(const string& fname)
+{
+	//only names below the working dir can be mirrored into the staged dir - absolute names and
+	//names that climb out with '..' would resolve outside of it
+	if ((fname.empty()) || (fname[0] == '/') || (fname[0] == '\\') || (fname.find(':') != string::npos))
+		return false;
+	vector<string> tokens;
+	pest_utils::tokenize(fname, tokens, "/\\");
+	for (auto& token : tokens)
+		if (token == "..")
+			return false;
+	return true;
+}
+
+void ModelInterface::stage_run_dir(const string& ram_base, const vector<string>& extra_files)
+{
+#ifdef OS_LINUX
+	struct stat st;
+	if ((stat(ram_base.c_str(), &st) != 0) || (!S_ISDIR(st.st_mode)))
+		throw_mio_error("run dir staging location '" + ram_base + "' does not exist or is not a directory");
+
+	//the model interface files are always staged, along with any existing files named on the
+	//model command line and the files/dirs listed by the user (ram_run_files)
+	vector<string> interface_files;
+	interface_files.insert(interface_files.end(), tplfile_vec.begin(), tplfile_vec.end());
+	interface_files.insert(interface_files.end(), inpfile_vec.begin(), inpfile_vec.end());
+	interface_files.insert(interface_files.end(), insfile_vec.begin(), insfile_vec.end());
+	interface_files.insert(interface_files.end(), outfile_vec.begin(), outfile_vec.end());
+	for (auto& fname : interface_files)
+		if (!is_stageable_path(fname))
+			throw_mio_error("model interface file '" + fname + "' is not below the working dir and can't be staged with ram_run_dir");
+	vector<string> stage_files;
+	for (auto& fname : extra_files)
+	{
+		string sname = fname;
+		scrub_filename_ip(sname);
+		if (!is_stageable_path(sname))
+			throw_mio_error("ram_run_files entry '" + fname + "' is not below the working dir and can't be staged");
+		if (stat(sname.c_str(), &st) != 0)
+			throw_mio_error("ram_run_files entry '" + fname + "' not found");
+		stage_files.push_back(sname);
+	}
+	vector<string> tokens;
+	for (auto& comline : comline_vec)
+	{
+		tokens.clear();
+		pest_utils::tokenize(comline, tokens, " \t");
+		for (auto& token : tokens)
+			if ((is_stageable_path(token)) && (stat(token.c_str(), &st) == 0) && (S_ISREG(st.st_mode)))
+				stage_files.push_back(token);
+	}
+	stage_files.insert(stage_files.end(), interface_files.begin(), interface_files.end());
+
+	remove_run_dir();
+	string org_dir = OperSys::getcwd();
+	string base = ram_base;
+	if (base[0] != '/')
+		base = org_dir + "/" + base;
+	int i = 0;
+	string stage_dir;
+	while (true)
+	{
+		stringstream ss;
+		ss << base << "/pestpp_run_" << getpid() << "_" << i;
+		stage_dir = ss.str();
+		if (mkdir(stage_dir.c_str(), 0755) == 0)
+			break;
+		if (errno != EEXIST)
+			throw_mio_error("couldn't create staged run dir '" + stage_dir + "'");
+		i++;
+	}
+	std::chrono::system_clock::time_point start_time = chrono::system_clock::now();
+	cout << pest_utils::get_time_string() << " staging " << stage_files.size() << " model files/dirs from '" << org_dir << "' into '" << stage_dir << "'" << endl;
+	try
+	{
+		unordered_set<string> staged;
+		for (auto& fname : stage_files)
+		{
+			if (staged.find(fname) != staged.end())
+				continue;
+			staged.insert(fname);
+			//mirror the parent dirs so that files can be written below the staged dir
+			tokens.clear();
+			pest_utils::tokenize(fname, tokens, "/\\");
+			string dest_path = stage_dir;
+			for (int j = 0; j < (int)tokens.size() - 1; j++)
+			{
+				dest_path = dest_path + "/" + tokens[j];
+				if ((mkdir(dest_path.c_str(), 0755) != 0) && (errno != EEXIST))
+					throw runtime_error("model input/output error: couldn't create staged directory '" + dest_path + "'");
+			}
+			//model input and output files may not exist yet, only their dirs are needed
+			if (stat(fname.c_str(), &st) != 0)
+				continue;
+			dest_path = stage_dir + "/" + fname;
+			if (S_ISDIR(st.st_mode))
+			{
+				if ((mkdir(dest_path.c_str(), st.st_mode & 07777) != 0) && (errno != EEXIST))
+					throw runtime_error("model input/output error: couldn't create staged directory '" + dest_path + "'");
+				copy_dir_tree(org_dir + "/" + fname, dest_path, stage_dir);
+			}
+			else if (S_ISREG(st.st_mode))
+				copy_file_preserve_mode(fname, dest_path);
+		}
+	}
+	catch (...)
+	{
+		remove_dir_tree(stage_dir);
+		throw;
+	}
+	cout << pest_utils::get_time_string() << " done, took " << pest_utils::get_duration_sec(start_time) << " seconds" << endl;
+	run_dir = stage_dir;
+#else
+	throw_mio_error("staging the run dir in RAM-backed storage is only supported on linux");
+#endif
+}
+
+void ModelInterface::copy_back_from_run_dir(const vector<string>& files)
+{
+#ifdef OS_LINUX
+	if (run_dir.empty())
+		return;
+	for (auto& file : files)
+	{
+		string staged = run_dir_path(file);
+		if ((staged == file) || (!pest_utils::check_exist_in(staged)))
+			continue;
+		copy_file_preserve_mode(staged, file);
+	}
+#endif
+}
+
+void ModelInterface::remove_run_dir()
+{
+#ifdef OS_LINUX
+	if (run_dir.empty())
+		return;
+	remove_dir_tree(run_dir);
+	run_dir = "";
+#endif
+}
+
 void ModelInterface::throw_mio_error(string base_message)
 {
 	throw runtime_error("model input/output error:" + base_message);
@@ -136,8 +376,16 @@ void ModelInterface::check_tplins(const vector<string> &par_names, const vector<
 	unordered_set<string> ins_obs_names, file_obs_names;
 	for (auto ins_file : insfile_vec)
 	{
-		InstructionFile isf(ins_file);
-		file_obs_names = isf.parse_and_check();
+		if (BinaryInstructionFile::is_binary_ins_file(ins_file))
+		{
+			BinaryInstructionFile bisf(ins_file);
+			file_obs_names = bisf.parse_and_check();
+		}
+		else
+		{
+			InstructionFile isf(ins_file);
+			file_obs_names = isf.parse_and_check();
+		}
 		ins_obs_names.insert(file_obs_names.begin(), file_obs_names.end());
 		//isf.read_output_file(model_exec_info.outfile_vec[0]);
 	}
@@ -244,9 +492,18 @@ void ThreadedInstructionProcess::work(int tid, vector<int>& ins_idx, Observation
 				break;
 			}
 		}
-		InstructionFile ins(insfile_vec[i]);
-		ins.set_additional_delimiters(additional_ins_delims);
-		Observations oobs = ins.read_output_file(outfile_vec[i]);
+		Observations oobs;
+		if (BinaryInstructionFile::is_binary_ins_file(insfile_vec[i]))
+		{
+			BinaryInstructionFile bins(insfile_vec[i]);
+			oobs = bins.read_output_file(outfile_vec[i]);
+		}
+		else
+		{
+			InstructionFile ins(insfile_vec[i]);
+			ins.set_additional_delimiters(additional_ins_delims);
+			oobs = ins.read_output_file(outfile_vec[i]);
+		}
 		while (true)
 		{
 			if (obs_guard.try_lock())
@@ -350,7 +607,7 @@ void ModelInterface::write_input_files(Parameters *pars_ptr)
 	vector<thread> threads;
 	vector<exception_ptr> exception_ptrs;
 	Parameters pro_pars = *pars_ptr; //copy
-	ThreadedTemplateProcess ttp(tplfile_vec, inpfile_vec, fill_tpl_zeros);
+	ThreadedTemplateProcess ttp(run_dir_paths(tplfile_vec), run_dir_paths(inpfile_vec), fill_tpl_zeros);
 
 	for (int i = 0; i < nnum_threads; i++)
 	{
@@ -468,7 +725,7 @@ void ModelInterface::read_output_files(Observations *obs)
 	vector<exception_ptr> exception_ptrs;
 	Observations temp_obs;
 
-	ThreadedInstructionProcess tip(insfile_vec, outfile_vec);
+	ThreadedInstructionProcess tip(run_dir_paths(insfile_vec), run_dir_paths(outfile_vec));
 
 	for (int i = 0; i < nnum_threads; i++)
 	{
@@ -616,7 +873,7 @@ void ModelInterface::remove_existing()
 	{
 		vector<string> failed_file_vec;
 		failed_file_op = false;
-		for (auto& out_file : outfile_vec)
+		for (auto& out_file : run_dir_paths(outfile_vec))
 		{
 			if ((pest_utils::check_exist_out(out_file)) && (remove(out_file.c_str()) != 0))
 			{
@@ -624,7 +881,7 @@ void ModelInterface::remove_existing()
 				failed_file_op = true;
 			}
 		}
-		for (auto& in_file : inpfile_vec)
+		for (auto& in_file : run_dir_paths(inpfile_vec))
 		{
 			if ((pest_utils::check_exist_out(in_file)) && (remove(in_file.c_str()) != 0))
 			{
@@ -651,139 +908,156 @@ void ModelInterface::remove_existing()
 }
 
 
-void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished, exception_ptr& eptr,
-						Parameters* pars_ptr, Observations* obs_ptr)
+void ModelInterface::prepare_run(Parameters* pars_ptr)
 {
-			
-	try
-	{
-		remove_existing();
-		write_input_files(pars_ptr);
-		
-		std::chrono::system_clock::time_point start_time = chrono::system_clock::now();
-		cout << pest_utils::get_time_string() << " calling forward run command(s)" << endl;
+	remove_existing();
+	write_input_files(pars_ptr);
+}
+
+
+void ModelInterface::harvest_run(Observations* obs_ptr)
+{
+	read_output_files(obs_ptr);
+}
+
+
+bool ModelInterface::execute_run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished)
+{
+	std::chrono::system_clock::time_point start_time = chrono::system_clock::now();
+	cout << pest_utils::get_time_string() << " calling forward run command(s)" << endl;
 
 #ifdef OS_WIN
-		//a flag to track if the run was terminated
-		bool term_break = false;
-		//create a job object to track child and grandchild process
-		HANDLE job = CreateJobObject(NULL, NULL);
-		if (job == NULL) throw PestError("could not create job object handle");
-		JOBOBJECT_EXTENDED_LIMIT_INFORMATION jeli = { 0 };
-		jeli.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
-		if (0 == SetInformationJobObject(job, JobObjectExtendedLimitInformation, &jeli, sizeof(jeli)))
+	//a flag to track if the run was terminated
+	bool term_break = false;
+	//create a job object to track child and grandchild process
+	HANDLE job = CreateJobObject(NULL, NULL);
+	if (job == NULL) throw PestError("could not create job object handle");
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION jeli = { 0 };
+	jeli.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+	if (0 == SetInformationJobObject(job, JobObjectExtendedLimitInformation, &jeli, sizeof(jeli)))
+	{
+		throw PestError("could not assign job limit flag to job object");
+	}
+	for (auto &cmd_string : comline_vec)
+	{
+	    cout << pest_utils::get_time_string() << " calling forward run command: '" << cmd_string << "' " << endl;
+		//start the command
+		PROCESS_INFORMATION pi;
+		try
 		{
-			throw PestError("could not assign job limit flag to job object");
+			pi = start(cmd_string, run_dir);
 		}
-		for (auto &cmd_string : comline_vec)
+		catch (...)
 		{
-		    cout << pest_utils::get_time_string() << " calling forward run command: '" << cmd_string << "' " << endl;
-			//start the command
-			PROCESS_INFORMATION pi;
-			try
-			{
-				pi = start(cmd_string);
-			}
-			catch (...)
-			{
-				finished->set(true);
-				throw std::runtime_error("start_command() failed for command: " + cmd_string);
-			}
-			if (0 == AssignProcessToJobObject(job, pi.hProcess))
+			finished->set(true);
+			throw std::runtime_error("start_command() failed for command: " + cmd_string);
+		}
+		if (0 == AssignProcessToJobObject(job, pi.hProcess))
+		{
+			throw PestError("could not add process to job object: " + cmd_string);
+		}
+		DWORD exitcode;
+		while (true)
+		{
+			//sleep
+			std::this_thread::sleep_for(std::chrono::milliseconds(OperSys::thread_sleep_milli_secs));
+			//check if process is still active
+			GetExitCodeProcess(pi.hProcess, &exitcode);
+			//if the process ended, break
+			if (exitcode != STILL_ACTIVE)
 			{
-				throw PestError("could not add process to job object: " + cmd_string);
+				break;
 			}
-			DWORD exitcode;
-			while (true)
+			//else cout << exitcode << "...still waiting for command " << cmd_string << endl;
+			//check for termination flag
+			if (terminate->get())
 			{
-				//sleep
-				std::this_thread::sleep_for(std::chrono::milliseconds(OperSys::thread_sleep_milli_secs));
-				//check if process is still active
-				GetExitCodeProcess(pi.hProcess, &exitcode);
-				//if the process ended, break
-				if (exitcode != STILL_ACTIVE)
+				std::cout << "received terminate signal" << std::endl;
+				//try to kill the process
+				bool success = (CloseHandle(job) != 0);
+
+				//bool success = TerminateProcess(pi.hProcess, 0);
+				if (!success)
 				{
-					break;
+					finished->set(true);
+					throw std::runtime_error("unable to terminate process for command: " + cmd_string);
 				}
-				//else cout << exitcode << "...still waiting for command " << cmd_string << endl;
-				//check for termination flag
-				if (terminate->get())
-				{
-					std::cout << "received terminate signal" << std::endl;
-					//try to kill the process
-					bool success = (CloseHandle(job) != 0);
-
-					//bool success = TerminateProcess(pi.hProcess, 0);
-					if (!success)
-					{
-						finished->set(true);
-						throw std::runtime_error("unable to terminate process for command: " + cmd_string);
-					}
-					term_break = true;
+				term_break = true;
 
-					break;
-				}
+				break;
 			}
-			//jump out of the for loop if terminated
-			if (term_break) break;
 		}
+		//jump out of the for loop if terminated
+		if (term_break) break;
+	}
 
 
 #endif
 
 #ifdef OS_LINUX
-		//a flag to track if the run was terminated
-		bool term_break = false;
-		for (auto &cmd_string : comline_vec)
-		{
+	//a flag to track if the run was terminated
+	bool term_break = false;
+	for (auto &cmd_string : comline_vec)
+	{
             cout << pest_utils::get_time_string() << " calling forward run command: '" << cmd_string << "' " << endl;
-			//start the command
-			int command_pid = start(cmd_string);
-			while (true)
+		//start the command
+		int command_pid = start(cmd_string, run_dir);
+		while (true)
+		{
+			//sleep
+			std::this_thread::sleep_for(std::chrono::milliseconds(OperSys::thread_sleep_milli_secs));
+			//check if process is still active
+			int status = 0;
+			pid_t exit_code = waitpid(command_pid, &status, WNOHANG);
+			//if the process ended, break
+			if ((exit_code == -1) || (status != 0))
 			{
-				//sleep
-				std::this_thread::sleep_for(std::chrono::milliseconds(OperSys::thread_sleep_milli_secs));
-				//check if process is still active
-				int status = 0;
-				pid_t exit_code = waitpid(command_pid, &status, WNOHANG);
-				//if the process ended, break
-				if ((exit_code == -1) || (status != 0))
+				finished->set(true);
+				cout << "exit_code: " << exit_code << endl;
+				cout << "status: " << status << endl;
+				throw std::runtime_error("waitpid() returned error status for command: " + cmd_string);
+			}
+			else if (exit_code != 0)
+			{
+				break;
+			}
+			//check for termination flag
+			if (terminate->get())
+			{
+				std::cout << "received terminate signal" << std::endl;
+				//try to kill the process
+				errno = 0;
+				int success = kill(-command_pid, SIGKILL);
+				if (success == -1)
 				{
 					finished->set(true);
-					cout << "exit_code: " << exit_code << endl;
-					cout << "status: " << status << endl;
-					throw std::runtime_error("waitpid() returned error status for command: " + cmd_string);
-				}
-				else if (exit_code != 0)
-				{
-					break;
-				}
-				//check for termination flag
-				if (terminate->get())
-				{
-					std::cout << "received terminate signal" << std::endl;
-					//try to kill the process
-					errno = 0;
-					int success = kill(-command_pid, SIGKILL);
-					if (success == -1)
-					{
-						finished->set(true);
-						throw std::runtime_error("unable to terminate process for command: " + cmd_string);
-					}
-					term_break = true;
-					break;
+					throw std::runtime_error("unable to terminate process for command: " + cmd_string);
 				}
+				term_break = true;
+				break;
 			}
-			//jump out of the for loop if terminated
-			if (term_break) break;
 		}
+		//jump out of the for loop if terminated
+		if (term_break) break;
+	}
 #endif
 
-		cout << pest_utils::get_time_string() << " foward run command(s) finished, took " << pest_utils::get_duration_sec(start_time) << " seconds" << endl;
+	cout << pest_utils::get_time_string() << " foward run command(s) finished, took " << pest_utils::get_duration_sec(start_time) << " seconds" << endl;
+	return !term_break;
+}
 
-		if (term_break) return;
 
-		read_output_files(obs_ptr);
+void ModelInterface::run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished, exception_ptr& eptr,
+						Parameters* pars_ptr, Observations* obs_ptr)
+{
+			
+	try
+	{
+		prepare_run(pars_ptr);
+
+		if (!execute_run(terminate, finished)) return;
+
+		harvest_run(obs_ptr);
 
 		//set the finished flag for the listener thread
 		finished->set(true);
@@ -818,7 +1092,7 @@ Parameters TemplateFile::write_input_file(const string& input_filename, Paramete
 	ofstream f_in(input_filename);
 	if (f_in.bad())
 		throw_tpl_error("couldn't open model input file '" + input_filename + "' for writing");
-	string line, val_str, name;
+	string line, name;
 	double val;
 	vector<pair<string, pair<int, int>>> tpl_line_map;
 	Parameters pro_pars;
@@ -890,10 +1164,10 @@ Parameters TemplateFile::write_input_file(const string& input_filename, Paramete
 			{
 				throw_tpl_error("parameter '" + name + "' not in parameters instance");
 			}
-			val_str = cast_to_fixed_len_string(t.second.second, val, name);
-			line.replace(t.second.first, t.second.second, val_str);
+			write_fixed_len(t.second.second, val, name);
+			line.replace(t.second.first, t.second.second, fmt_buf.data(), t.second.second);
 			//pest_utils::convert_ip(val_str, val);
-			val = stod(val_str);
+			val = strtod(fmt_buf.data(), nullptr);
 			pro_pars.insert(name, val);
 		}
 		f_in << line << endl;
@@ -1006,119 +1280,132 @@ vector<pair<string,pair<int, int>>> TemplateFile::parse_tpl_line(const string& l
 
 string TemplateFile::cast_to_fixed_len_string(int size, double value, string& name)
 {
-	string val_str, fill_val=" ";
-	stringstream ss;
+	int len = write_fixed_len(size, value, name);
+	return string(fmt_buf.data(), len);
+}
+
+int TemplateFile::format_into_buf(bool sci, int precision, double value)
+{
+	//same conversions as stringstream with scientific/fixed and precision(),
+	//but into a reusable buffer so that no allocation happens per parameter
+	const char* fmt = sci ? "%.*e" : "%.*f";
+	int len = snprintf(fmt_buf.data(), fmt_buf.size(), fmt, precision, value);
+	if (len >= fmt_buf.size())
+	{
+		fmt_buf.resize(len + 1);
+		len = snprintf(fmt_buf.data(), fmt_buf.size(), fmt, precision, value);
+	}
+	return len;
+}
+
+int TemplateFile::write_fixed_len(int size, double value, string& name)
+{
+	if (fmt_buf.size() < size + 32)
+		fmt_buf.resize(size + 32);
+	char* buf = fmt_buf.data();
 	int precision = size;
 	bool sci = false;
 	if (value < 0)
 		precision--; // for the minus sign
 	if ((abs(value) >= 100) || (abs(value) < 0.01))
 	{
-		ss << scientific;
 		precision = precision - 2; //for the "e" and (at least) 1 exponent digit
 		sci = true;
 	}
-	else
-	{
-		ss << fixed;
-	}
-	ss.width(size);
-	
-	int size_last = -1;
-	if (fill_zeros)
+
+	int len, size_last = -1;
+	len = format_into_buf(sci, precision, value);
+	if (len > size)
 	{
-		ss.fill('0');
-		ss << internal;
-		fill_val = "0";
+		//each precision decrement shortens the string by one char unless rounding carries into
+		//a new digit, so jump straight to the precision that should fit. If the length comes out
+		//as predicted, no carry happened in between and the one-at-a-time search below would
+		//have stopped at the same precision
+		int jump_precision = precision - (len - size);
+		if (jump_precision >= 1)
+		{
+			int jump_len = format_into_buf(sci, jump_precision, value);
+			if (jump_len == size)
+				return jump_len;
+			len = format_into_buf(sci, precision, value);
+		}
 	}
 	while (true)
 	{
-		
-		ss.str("");
-		ss.precision(precision);
-
-		ss << value;
-		val_str = ss.str();
-		if (val_str.size() <= size)
+		if (size_last != -1)
+			len = format_into_buf(sci, precision, value);
+		buf = fmt_buf.data();
+		if (len <= size)
 			break;
-		if (val_str.size() > size)
-			precision--;
+		precision--;
 		if (precision <= 0)
 		{
 			//time for desparate measures:
 			//if the exponent has a leading zero, drop it
-			if (val_str.substr(val_str.size() - 2, 1) == "0")
+			if (buf[len - 2] == '0')
 			{
-				string t = val_str.substr(0, val_str.size() - 2);
-				val_str = t + val_str.substr(val_str.size() - 1, 1);
-				if (val_str.size() <= size)
+				buf[len - 2] = buf[len - 1];
+				len--;
+				buf[len] = '\0';
+				if (len <= size)
 					break;
 			}
 			//if there is an unnesscary zero(s) between the radix and the exponent
-			int r_idx = val_str.find_first_of(".")+1; // to skip past the radix
-			int e_idx = val_str.find_first_of("Ee");
-			if (r_idx != e_idx)
+			char* radix = strchr(buf, '.');
+			char* expo = strpbrk(buf, "Ee");
+			if ((radix != nullptr) && (expo != nullptr) && (expo > radix + 1))
 			{
-				string t = val_str.substr(r_idx, e_idx - r_idx);
-				if (stod(t) == 0.0)
+				bool all_zero = true;
+				for (char* c = radix + 1; c < expo; c++)
+					if (*c != '0')
+					{
+						all_zero = false;
+						break;
+					}
+				if (all_zero)
 				{
-					t = val_str.substr(0, r_idx-1); // to skip the radix in the new number
-					val_str = t + val_str.substr(e_idx);
-					if (val_str.size() <= size)
+					memmove(radix, expo, (buf + len) - expo + 1);
+					len = len - (expo - radix);
+					if (len <= size)
 						break;
 				}
 			}
-			ss.str("");
-		 	ss << "TemplateFile casting error: cant represent value " << value;
+			stringstream ss;
+			ss << "TemplateFile casting error: cant represent value " << value;
 			ss << " for " << name << " in space that is only " << size << " chars wide";
 			throw_tpl_error(ss.str());
 		}
-		if (val_str.size() == size_last)
+		if (len == size_last)
 		{
 			if (sci)
-				throw_tpl_error("internal error: val_str size not decreasing over successive attempts:" + val_str);
+				throw_tpl_error("internal error: val_str size not decreasing over successive attempts:" + string(buf, len));
 			else
 			{
-				val_str = val_str.substr(0, size);
+				len = size;
+				buf[len] = '\0';
 				break;
 			}
-			
-
-			
 		}
-		size_last = val_str.size();
+		size_last = len;
 	}
 	//occasionally, when reducing precision, rounding will cause an 
 	// extra char to be dropped, so this left pads it back
 	//this also pads for really large par spaces
-	if (val_str.size() < size)
+	if (len < size)
 	{
-		ss.str("");
 		//if the fill value isnt a space and its a negative value
-		// we need to push the dash into the stringstream, then 
-		//remove the dash from the val string
-		int s = size;
-		if ((fill_val != " ") && (val_str.at(0) == '-'))
-		{
-			ss << "-";
-			val_str = val_str.substr(1, val_str.size() - 1);
-			s--;
-		}
-		for (int i = val_str.size(); i < s; i++)
-			ss << fill_val;
-		ss << val_str;
-		val_str = ss.str();
-	}
-	
-	/*int width = size;
-	if (value < 0.0)
-		width--;
-		
-	ss << value;
-	val_str = ss.str();*/
-	if (val_str.size() != size)
-		throw_tpl_error("val_str != size: " + val_str);
-	return val_str;
+		//the dash stays in front of the fill
+		char fill_val = fill_zeros ? '0' : ' ';
+		int s = 0;
+		if ((fill_zeros) && (buf[0] == '-'))
+			s = 1;
+		memmove(buf + s + (size - len), buf + s, len - s + 1);
+		memset(buf + s, fill_val, size - len);
+		len = size;
+	}
+	if (len != size)
+		throw_tpl_error("val_str != size: " + string(buf, len));
+	return len;
 }
 
 string TemplateFile::read_line( ifstream& f_tpl)
@@ -1742,3 +2029,257 @@ void InstructionFile::execute_line_advance(const string& token, string& line, if
 		line = read_out_line(f_out);
 	}
 }
+
+
+BinaryInstructionFile::BinaryInstructionFile(string _ins_filename) : ins_filename(_ins_filename), ins_line_num(0),
+real_size(4)
+{
+}
+
+bool BinaryInstructionFile::is_binary_ins_file(const string& ins_filename)
+{
+	ifstream f_ins(ins_filename);
+	if (!f_ins.good())
+		return false;
+	string line;
+	vector<string> tokens;
+	getline(f_ins, line);
+	f_ins.close();
+	pest_utils::tokenize(pest_utils::upper_cp(line), tokens);
+	return ((tokens.size() > 0) && (tokens[0] == "BIF"));
+}
+
+void BinaryInstructionFile::throw_ins_error(const string& message, int ins_lnum)
+{
+	stringstream ss;
+	ss << "BinaryInstructionFile error in file '" << ins_filename << "'";
+	if (ins_lnum != 0)
+		ss << " on instruction file line: " << ins_lnum;
+	ss << " : " << message;
+	throw runtime_error(ss.str());
+}
+
+int BinaryInstructionFile::dtype_size(const string& dtype)
+{
+	if ((dtype == "FLOAT32") || (dtype == "INT32"))
+		return 4;
+	if ((dtype == "FLOAT64") || (dtype == "INT64"))
+		return 8;
+	throw_ins_error("unrecognized dtype '" + dtype + "', should be 'float32', 'float64', 'int32' or 'int64'", ins_line_num);
+	return 0;
+}
+
+void BinaryInstructionFile::parse()
+{
+	ifstream f_ins(ins_filename);
+	if (!f_ins.good())
+		throw_ins_error("couldn't open binary ins file for reading");
+	instructions.clear();
+	real_size = 4;
+	ins_line_num = 0;
+	string line;
+	vector<string> tokens;
+	getline(f_ins, line);
+	ins_line_num++;
+	pest_utils::tokenize(pest_utils::upper_cp(line), tokens);
+	if ((tokens.size() != 1) || (tokens[0] != "BIF"))
+		throw_ins_error("first line should be 'bif'", ins_line_num);
+	while (getline(f_ins, line))
+	{
+		ins_line_num++;
+		pest_utils::strip_ip(line);
+		if ((line.size() == 0) || (line[0] == '#'))
+			continue;
+		tokens.clear();
+		pest_utils::tokenize(pest_utils::upper_cp(line), tokens);
+		if (tokens[0] == "PRECISION")
+		{
+			if (tokens.size() != 2)
+				throw_ins_error("'precision' line should be 'precision single|double'", ins_line_num);
+			if (tokens[1] == "SINGLE")
+				real_size = 4;
+			else if (tokens[1] == "DOUBLE")
+				real_size = 8;
+			else
+				throw_ins_error("unrecognized precision '" + tokens[1] + "', should be 'single' or 'double'", ins_line_num);
+			continue;
+		}
+		if (tokens.size() < 2)
+			throw_ins_error("expecting '<obsnme> offset <byte_offset> <dtype>' or '<obsnme> array <record> <layer> <row> <col>'", ins_line_num);
+		BinaryObsInstruction bi;
+		bi.name = tokens[0];
+		bi.ins_lnum = ins_line_num;
+		bi.offset = 0;
+		bi.record = bi.layer = bi.row = bi.col = 0;
+		if (tokens[1] == "OFFSET")
+		{
+			if (tokens.size() != 4)
+				throw_ins_error("'offset' instruction should be '<obsnme> offset <byte_offset> <dtype>'", ins_line_num);
+			bi.is_array = false;
+			try
+			{
+				pest_utils::convert_ip(tokens[2], bi.offset);
+			}
+			catch (...)
+			{
+				throw_ins_error("error casting byte offset '" + tokens[2] + "' for observation '" + bi.name + "'", ins_line_num);
+			}
+			if (bi.offset < 0)
+				throw_ins_error("byte offset for observation '" + bi.name + "' must be non-negative", ins_line_num);
+			bi.dtype = tokens[3];
+			dtype_size(bi.dtype);
+		}
+		else if (tokens[1] == "ARRAY")
+		{
+			if (tokens.size() != 6)
+				throw_ins_error("'array' instruction should be '<obsnme> array <record> <layer> <row> <col>'", ins_line_num);
+			bi.is_array = true;
+			vector<int*> idx{ &bi.record, &bi.layer, &bi.row, &bi.col };
+			for (int i = 0; i < 4; i++)
+			{
+				try
+				{
+					pest_utils::convert_ip(tokens[i + 2], *idx[i]);
+				}
+				catch (...)
+				{
+					throw_ins_error("error casting index '" + tokens[i + 2] + "' for observation '" + bi.name + "'", ins_line_num);
+				}
+				if (*idx[i] < 1)
+					throw_ins_error("record, layer, row and col for observation '" + bi.name + "' must be greater or equal to 1", ins_line_num);
+			}
+		}
+		else
+			throw_ins_error("unrecognized binary instruction '" + tokens[1] + "', should be 'offset' or 'array'", ins_line_num);
+		instructions.push_back(bi);
+	}
+	f_ins.close();
+}
+
+unordered_set<string> BinaryInstructionFile::parse_and_check()
+{
+	parse();
+	unordered_set<string> names;
+	for (auto& bi : instructions)
+	{
+		if (names.find(bi.name) != names.end())
+			throw_ins_error("observation '" + bi.name + "' listed multiple times in binary ins file", bi.ins_lnum);
+		names.emplace(bi.name);
+	}
+	return names;
+}
+
+double BinaryInstructionFile::read_value(ifstream& f_out, long long offset, const string& dtype)
+{
+	char buf[8];
+	int size = dtype_size(dtype);
+	f_out.seekg(offset, ios::beg);
+	f_out.read(buf, size);
+	if (!f_out.good())
+		throw_ins_error("error reading " + dtype + " at byte offset " + to_string(offset));
+	if (dtype == "FLOAT32")
+	{
+		float v;
+		memcpy(&v, buf, size);
+		return (double)v;
+	}
+	else if (dtype == "FLOAT64")
+	{
+		double v;
+		memcpy(&v, buf, size);
+		return v;
+	}
+	else if (dtype == "INT32")
+	{
+		int32_t v;
+		memcpy(&v, buf, size);
+		return (double)v;
+	}
+	int64_t v;
+	memcpy(&v, buf, size);
+	return (double)v;
+}
+
+Observations BinaryInstructionFile::read_output_file(const string& output_filename)
+{
+	if (instructions.size() == 0)
+		parse();
+	if (!pest_utils::check_exist_in(output_filename))
+		throw_ins_error("output file '" + output_filename + "' not found");
+	ifstream f_out(output_filename, ios::binary);
+	if (!f_out.good())
+		throw_ins_error("can't open output file '" + output_filename + "' for reading");
+	f_out.seekg(0, ios::end);
+	long long file_size = f_out.tellg();
+
+	//MODFLOW-style array record header: kstp,kper,pertim,totim,text(16),ncol,nrow,ilay
+	string real_dtype = (real_size == 4) ? "FLOAT32" : "FLOAT64";
+	long long hdr_size = 36 + (2 * real_size);
+	long long rec_size = 0;
+	int ncol = 0, nrow = 0, nlay = 0;
+	vector<pair<long long, int>> offsets;
+	for (int i = 0; i < instructions.size(); i++)
+	{
+		BinaryObsInstruction& bi = instructions[i];
+		if (!bi.is_array)
+		{
+			if (bi.offset + dtype_size(bi.dtype) > file_size)
+				throw_ins_error("byte offset for observation '" + bi.name + "' is beyond the end of output file '" + output_filename + "'", bi.ins_lnum);
+			offsets.push_back(pair<long long, int>(bi.offset, i));
+			continue;
+		}
+		if (nlay == 0)
+		{
+			//the array layout is read from the record headers, once per output file
+			if (file_size < hdr_size)
+				throw_ins_error("output file '" + output_filename + "' too small to contain an array record header");
+			ncol = (int)read_value(f_out, hdr_size - 12, "INT32");
+			nrow = (int)read_value(f_out, hdr_size - 8, "INT32");
+			if ((ncol < 1) || (nrow < 1))
+				throw_ins_error("invalid array dimensions in first record header of output file '" + output_filename + "', check 'precision'");
+			rec_size = hdr_size + ((long long)ncol * nrow * real_size);
+			int kstp = (int)read_value(f_out, 0, "INT32");
+			int kper = (int)read_value(f_out, 4, "INT32");
+			long long rec_offset = 0;
+			while (rec_offset + rec_size <= file_size)
+			{
+				if (((int)read_value(f_out, rec_offset, "INT32") != kstp) || ((int)read_value(f_out, rec_offset + 4, "INT32") != kper))
+					break;
+				nlay++;
+				rec_offset += rec_size;
+			}
+			if (nlay == 0)
+				throw_ins_error("output file '" + output_filename + "' does not contain a complete array record, check 'precision'");
+		}
+		if ((bi.layer > nlay) || (bi.row > nrow) || (bi.col > ncol))
+		{
+			stringstream ss;
+			ss << "layer/row/col for observation '" << bi.name << "' outside of array dimensions (" << nlay << "," << nrow << "," << ncol << ") in output file '" << output_filename << "'";
+			throw_ins_error(ss.str(), bi.ins_lnum);
+		}
+		long long rec_offset = ((((long long)bi.record - 1) * nlay) + (bi.layer - 1)) * rec_size;
+		if (rec_offset + rec_size > file_size)
+			throw_ins_error("record " + to_string(bi.record) + " for observation '" + bi.name + "' is beyond the end of output file '" + output_filename + "'", bi.ins_lnum);
+		int ilay = (int)read_value(f_out, rec_offset + hdr_size - 4, "INT32");
+		if (ilay != bi.layer)
+			throw_ins_error("record header layer " + to_string(ilay) + " does not match layer " + to_string(bi.layer) + " for observation '" + bi.name + "'", bi.ins_lnum);
+		bi.offset = rec_offset + hdr_size + (((((long long)bi.row - 1) * ncol) + (bi.col - 1)) * real_size);
+		bi.dtype = real_dtype;
+		offsets.push_back(pair<long long, int>(bi.offset, i));
+	}
+
+	//read in file order so the seeks only ever move forward
+	sort(offsets.begin(), offsets.end());
+	Observations obs;
+	double value;
+	for (auto& o : offsets)
+	{
+		BinaryObsInstruction& bi = instructions[o.second];
+		value = read_value(f_out, o.first, bi.dtype);
+		if ((value != 0.0) && (!isnormal(value)))
+			throw_ins_error("reading observation '" + bi.name + "' yielded denormal value from output file '" + output_filename + "'", bi.ins_lnum);
+		obs.insert(bi.name, value);
+	}
+	f_out.close();
+	return obs;
+}
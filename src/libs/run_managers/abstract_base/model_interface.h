@@ -21,12 +21,15 @@ public:
 	void throw_tpl_error(const string& message, int lnum=0, bool warn=false);
 	void set_fill_zeros(bool _flag) { fill_zeros = _flag; }
 	string get_tpl_filename() { return tpl_filename; }
+	string cast_to_fixed_len_string(int size, double value, string& name);
 private:
 	int line_num;
 	string marker;
 	string tpl_filename;
+	vector<char> fmt_buf;
 	vector<pair<string, pair<int, int>>> parse_tpl_line(const string& line);
-	string cast_to_fixed_len_string(int size, double value, string& name);
+	int write_fixed_len(int size, double value, string& name);
+	int format_into_buf(bool sci, int precision, double value);
 	string read_line(ifstream& f_tpl);
 	void prep_tpl_file_for_reading(ifstream& f_tpl);
 	unordered_set<string> get_names(ifstream& f);
@@ -87,8 +90,37 @@ private:
 	string additional_delimiters;
 	
 	void tokenize(const std::string& str, vector<string>& tokens, const std::string& delimiters, const bool trimEmpty=true, int mx_tokens=-1);
-	
 
+
+};
+
+//declarative reader for binary model output files.  A binary instruction file starts with 'bif'
+//and maps each observation to either a raw byte offset + dtype or to a (record,layer,row,col)
+//location in a MODFLOW-style layered array file (heads, drawdown, concentration)
+class BinaryInstructionFile {
+public:
+	BinaryInstructionFile(string _ins_filename);
+	static bool is_binary_ins_file(const string& ins_filename);
+	unordered_set<string> parse_and_check();
+	Observations read_output_file(const string& output_filename);
+private:
+	struct BinaryObsInstruction
+	{
+		string name;
+		bool is_array;
+		long long offset;
+		string dtype;
+		int record, layer, row, col;
+		int ins_lnum;
+	};
+	string ins_filename;
+	int ins_line_num;
+	int real_size;
+	vector<BinaryObsInstruction> instructions;
+	void parse();
+	int dtype_size(const string& dtype);
+	double read_value(ifstream& f_out, long long offset, const string& dtype);
+	void throw_ins_error(const string& message, int ins_lnum = 0);
 };
 
 
@@ -103,14 +135,28 @@ public:
 	void run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished,
 		exception_ptr& eptr,
 		Parameters* par, Observations* obs);
+	//the three stages of a model run, in order.  run() calls all three back to back - nothing
+	//overlaps them yet since the panther protocol only gives an agent one run at a time
+	void prepare_run(Parameters* pars_ptr);
+	bool execute_run(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished);
+	void harvest_run(Observations* obs_ptr);
 	void check_io_access();
 	void check_tplins(const vector<string> &par_names, const vector<string> &obs_names);
 	void set_additional_ins_delimiters(string delims) { additional_ins_delimiters = delims; }
 	void set_fill_tpl_zeros(bool _flag) { fill_tpl_zeros = _flag; }
 	void set_num_threads(int _num_threads) { num_threads = _num_threads; }
+	//stage a copy of the model files (interface files, files named on the command line and
+	//extra_files) under ram_base (e.g. /dev/shm) and do all model input/output and command execution there
+	void stage_run_dir(const string& ram_base, const vector<string>& extra_files);
+	void copy_back_from_run_dir(const vector<string>& files);
+	void remove_run_dir();
+	string get_run_dir() const { return run_dir; }
+	void set_run_dir(const string& _run_dir) { run_dir = _run_dir; }
+	string run_dir_path(const string& fname) const;
 
 private:
 	int num_threads;
+	string run_dir;
 	//Pest* pest_scenario_ptr;
 	vector<TemplateFile> templatefiles;
 	vector<InstructionFile> instructionfiles;
@@ -122,10 +168,12 @@ private:
 	bool fill_tpl_zeros;
 	string additional_ins_delimiters;
 
+	static bool is_stageable_path(const string& fname);
 	void write_input_files(Parameters *pars_ptr);
 	void read_output_files(Observations *obs_ptr);
 	void remove_existing();
 	void scrub_filename_ip(string& fname);
+	vector<string> run_dir_paths(const vector<string>& fnames) const;
 
 };
 
@@ -39,10 +39,12 @@ RunManagerSerial::RunManagerSerial(const vector<string> _comline_vec,
 	const vector<string> _tplfile_vec, const vector<string> _inpfile_vec,
 	const vector<string> _insfile_vec, const vector<string> _outfile_vec,
 	const string &stor_filename, const string &_run_dir, int _max_run_fail,
-	bool fill_tpl_zeros, string additional_ins_delimiters, int _num_threads)
+	bool fill_tpl_zeros, string additional_ins_delimiters, int _num_threads,
+	string _ram_run_dir, vector<string> _ram_run_files, vector<string> _transfer_on_finish)
 	: RunManagerAbstract(_comline_vec, _tplfile_vec, _inpfile_vec,
 	_insfile_vec, _outfile_vec, stor_filename, _max_run_fail),
-	run_dir(_run_dir), mi(_tplfile_vec,_inpfile_vec,_insfile_vec,_outfile_vec, _comline_vec)
+	run_dir(_run_dir), mi(_tplfile_vec,_inpfile_vec,_insfile_vec,_outfile_vec, _comline_vec),
+	ram_run_dir(_ram_run_dir), ram_run_files(_ram_run_files), transfer_on_finish(_transfer_on_finish)
 {
 	mi.set_additional_ins_delimiters(additional_ins_delimiters);
 	mi.set_fill_tpl_zeros(fill_tpl_zeros);
@@ -121,6 +123,13 @@ void RunManagerSerial::run()
 
 	std::vector<double> obs_vec;
 	vector<int> run_id_vec;
+
+	//stage the run dir once, the staged copy is reused by later calls to run()
+	if ((!ram_run_dir.empty()) && (mi.get_run_dir().empty()))
+	{
+		mi.stage_run_dir(ram_run_dir, ram_run_files);
+		cout << "    model runs will be done in staged dir '" << mi.get_run_dir() << "'" << endl << endl;
+	}
 	
 	std::chrono::system_clock::time_point start_time_all = std::chrono::system_clock::now();
 	while (!(run_id_vec = get_outstanding_run_ids()).empty())
@@ -156,6 +165,7 @@ void RunManagerSerial::run()
 				//message << "(" << success_runs << "/" << nruns << " runs complete)";
 				//std::cout << message.str();
 				file_stor.update_run(i_run, pars, obs);
+				mi.copy_back_from_run_dir(transfer_on_finish);
 
 			}
 			catch (const std::exception& ex)
@@ -220,4 +230,5 @@ void RunManagerSerial::run()
 
 RunManagerSerial::~RunManagerSerial(void)
 {
+	mi.remove_run_dir();
 }
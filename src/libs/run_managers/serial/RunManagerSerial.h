@@ -30,12 +30,17 @@ public:
 		const std::vector<std::string> _tplfile_vec, const std::vector<std::string> _inpfile_vec,
 		const std::vector<std::string> _insfile_vec, const std::vector<std::string> _outfile_vec,
 		const std::string &stor_filename, const std::string &run_dir, int _max_run_fail=1,
-		bool fill_tpl_zeros=false, string additional_ins_delimiters="", int _num_threads=1);
+		bool fill_tpl_zeros=false, string additional_ins_delimiters="", int _num_threads=1,
+		string _ram_run_dir="", std::vector<std::string> _ram_run_files=std::vector<std::string>(),
+		std::vector<std::string> _transfer_on_finish=std::vector<std::string>());
 	virtual void run();
 	~RunManagerSerial(void);
 private:
 	ModelInterface mi;
 	std::string run_dir;
+	std::string ram_run_dir;
+	std::vector<std::string> ram_run_files;
+	std::vector<std::string> transfer_on_finish;
 
     void run_async(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished,
                    exception_ptr& run_exception,
@@ -23,7 +23,8 @@ PANTHERAgent::PANTHERAgent(ofstream &_frec)
 	: frec(_frec),
 	  max_time_without_master_ping_seconds(300),
 	  restart_on_error(false),
-	  current_da_cycle(NetPackage::NULL_DA_CYCLE)
+	  current_da_cycle(NetPackage::NULL_DA_CYCLE),
+	  has_finished_run(false)
 {
 }
 
@@ -89,6 +90,7 @@ PANTHERAgent::~PANTHERAgent()
 {
 	w_close(sockfd);
 	w_cleanup();
+	mi.remove_run_dir();
 }
 
 
@@ -149,6 +151,13 @@ void PANTHERAgent::process_ctl_file(const string &ctl_filename)
 	mi.set_additional_ins_delimiters(pest_scenario.get_pestpp_options().get_additional_ins_delimiters());
 	mi.set_fill_tpl_zeros(pest_scenario.get_pestpp_options().get_fill_tpl_zeros());
 	mi.set_num_threads(pest_scenario.get_pestpp_options().get_num_tpl_ins_threads());
+	string ram_run_dir = pest_scenario.get_pestpp_options().get_ram_run_dir();
+	if (!ram_run_dir.empty())
+	{
+		report("staging run dir in '" + ram_run_dir + "'", true);
+		mi.stage_run_dir(ram_run_dir, pest_scenario.get_pestpp_options().get_ram_run_files());
+		report("model runs will be done in staged dir '" + mi.get_run_dir() + "'", true);
+	}
 
 	restart_on_error = pest_scenario.get_pestpp_options().get_panther_agent_restart_on_error();
 	max_time_without_master_ping_seconds = pest_scenario.get_pestpp_options().get_panther_agent_no_ping_timeout_secs();
@@ -265,7 +274,8 @@ void PANTHERAgent::transfer_files(const vector<string>& tfiles, int group, int r
     stringstream ss;
     NetPackage pack;
     for (auto& filename :tfiles) {
-        if (!check_exist_in(filename))
+        string path = mi.run_dir_path(filename);
+        if (!check_exist_in(path))
         {
             ss.str("");
             ss << "file " << filename << " does not exists";
@@ -274,7 +284,7 @@ void PANTHERAgent::transfer_files(const vector<string>& tfiles, int group, int r
         }
 
         ifstream in;
-        in.open(filename.c_str(), ifstream::binary);
+        in.open(path.c_str(), ifstream::binary);
         if (in.bad()) {
             ss.str("");
             ss << "error opening file " << filename << " for reading";
@@ -375,6 +385,8 @@ std::pair<NetPackage::PackType,std::string> PANTHERAgent::run_model(Parameters &
     }
 
     vector<double> obs_vec;
+    //give the os a chance to release the previous run's file handles before the files are removed
+    wait_for_file_release();
     thread run_thread(&PANTHERAgent::run_async, this, &f_terminate, &f_finished, std::ref(run_exception),
                       &pars, &obs);
 
@@ -527,8 +539,8 @@ std::pair<NetPackage::PackType,std::string> PANTHERAgent::run_model(Parameters &
         }
     }
 
-	//sleep here just to give the os a chance to cleanup any remaining file handles
-	w_sleep(poll_interval_seconds * 1000);
+	has_finished_run = true;
+	last_run_finish = chrono::system_clock::now();
 	return pair<NetPackage::PackType,std::string> (final_run_status,smessage.str());
 }
 
@@ -540,6 +552,17 @@ void PANTHERAgent::run_async(pest_utils::thread_flag* terminate, pest_utils::thr
 }
 
 
+void PANTHERAgent::wait_for_file_release()
+{
+	if (!has_finished_run)
+		return;
+	long long elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now() - last_run_finish).count();
+	long long remaining = (long long)poll_interval_seconds * 1000 - elapsed;
+	if (remaining > 0)
+		w_sleep((int)remaining);
+}
+
+
 void PANTHERAgent::start(const string &host, const string &port)
 {
 	stringstream ss;
@@ -707,6 +730,7 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 				err = send_message(net_pack);
 				w_close(sockfd);
 				w_cleanup();
+				mi.remove_run_dir();
 				exit(-1);
 			}	
 			snames.clear();
@@ -730,6 +754,7 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 				err = send_message(net_pack);
 				w_close(sockfd);
 				w_cleanup();
+				mi.remove_run_dir();
 				exit(-1);
 			}
 
@@ -777,6 +802,7 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 				err = send_message(net_pack);
 				w_close(sockfd);
 				w_cleanup();
+				mi.remove_run_dir();
 				exit(-1);
 			}
 			snames.clear();
@@ -800,6 +826,7 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 				err = send_message(net_pack);
 				w_close(sockfd);
 				w_cleanup();
+				mi.remove_run_dir();
 				exit(-1);
 			}
 		}
@@ -878,8 +905,16 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 							sort(obs_names.begin(), obs_names.end());
 							par_name_vec = par_names;
 							obs_name_vec = obs_names;
+							//the cycle can have its own interface files, so stage a fresh run dir for them
+							mi.remove_run_dir();
 							mi = ModelInterface(childPest.get_tplfile_vec(), childPest.get_inpfile_vec(),
 								childPest.get_insfile_vec(), childPest.get_outfile_vec(), childPest.get_comline_vec());
+							string ram_run_dir = pest_scenario.get_pestpp_options().get_ram_run_dir();
+							if (!ram_run_dir.empty())
+							{
+								report("staging run dir for DA_CYCLE " + to_string(da_cycle) + " in '" + ram_run_dir + "'", true);
+								mi.stage_run_dir(ram_run_dir, pest_scenario.get_pestpp_options().get_ram_run_files());
+							}
 							obs = childPest.get_ctl_observations();
 							stringstream ss;
 							ss << "Updated interface components for DA_CYCLE " << da_cycle << " as follows: " << endl;
@@ -1088,6 +1123,7 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 				report(ss.str(), true);
                 transfer_files(pest_scenario.get_pestpp_options().get_panther_transfer_on_finish(), group_id,
                                run_id,info_txt, "run_status=completed");
+                mi.copy_back_from_run_dir(pest_scenario.get_pestpp_options().get_panther_transfer_on_finish());
 
             }
 			else if (final_run_status.first == NetPackage::PackType::RUN_FAILED)
@@ -1245,12 +1281,14 @@ void PANTHERAgent::start_impl(const string &host, const string &port)
 }
 
 
-void PANTHERAgent::terminate_or_restart(int error_code) const
+void PANTHERAgent::terminate_or_restart(int error_code)
 {
 	
 	w_sleep(poll_interval_seconds * 10000);
 	if(!restart_on_error)
 	{
+		//exit() skips the destructor, so clean up the staged run dir here
+		mi.remove_run_dir();
 		exit(error_code);
 	}
 	
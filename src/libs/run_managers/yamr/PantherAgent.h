@@ -26,6 +26,7 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <chrono>
 #include "utilities.h"
 #include "pest_error.h"
 #include "network_package.h"
@@ -78,8 +79,13 @@ private:
 	void run_async(pest_utils::thread_flag* terminate, pest_utils::thread_flag* finished,
 		exception_ptr& run_exception,
 		Parameters* pars, Observations* obs);
+	//the os file handle release wait is done ahead of the next run (and only for whatever part of
+	//poll_interval_seconds hasn't already passed) so results go back to the master right away
+	bool has_finished_run;
+	std::chrono::system_clock::time_point last_run_finish;
+	void wait_for_file_release();
 
-	void terminate_or_restart(int error_code) const;
+	void terminate_or_restart(int error_code);
 
 	//Observations ctl_obs;
 	//Parameters ctl_pars;
@@ -303,7 +303,10 @@ int main(int argc, char* argv[])
 				pest_scenario.get_pestpp_options().get_max_run_fail(),
 				pest_scenario.get_pestpp_options().get_fill_tpl_zeros(),
 				pest_scenario.get_pestpp_options().get_additional_ins_delimiters(),
-				pest_scenario.get_pestpp_options().get_num_tpl_ins_threads());
+				pest_scenario.get_pestpp_options().get_num_tpl_ins_threads(),
+				pest_scenario.get_pestpp_options().get_ram_run_dir(),
+				pest_scenario.get_pestpp_options().get_ram_run_files(),
+				pest_scenario.get_pestpp_options().get_panther_transfer_on_finish());
 		}
 
 		const ParamTransformSeq &base_trans_seq = pest_scenario.get_base_par_tran_seq();
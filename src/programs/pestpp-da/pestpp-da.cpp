@@ -502,7 +502,10 @@ int main(int argc, char* argv[])
 				pest_scenario.get_pestpp_options().get_max_run_fail(),
 				pest_scenario.get_pestpp_options().get_fill_tpl_zeros(),
 				pest_scenario.get_pestpp_options().get_additional_ins_delimiters(),
-				pest_scenario.get_pestpp_options().get_num_tpl_ins_threads());
+				pest_scenario.get_pestpp_options().get_num_tpl_ins_threads(),
+				pest_scenario.get_pestpp_options().get_ram_run_dir(),
+				pest_scenario.get_pestpp_options().get_ram_run_files(),
+				pest_scenario.get_pestpp_options().get_panther_transfer_on_finish());
 		}
 		
 		//generate a parent ensemble which includes all parameters across all cycles
@@ -592,7 +595,11 @@ int main(int argc, char* argv[])
 					file_manager.build_filename("rns"), pathname,
 					childPest.get_pestpp_options().get_max_run_fail(),
 					childPest.get_pestpp_options().get_fill_tpl_zeros(),
-					childPest.get_pestpp_options().get_additional_ins_delimiters());
+					childPest.get_pestpp_options().get_additional_ins_delimiters(),
+					childPest.get_pestpp_options().get_num_tpl_ins_threads(),
+					childPest.get_pestpp_options().get_ram_run_dir(),
+					childPest.get_pestpp_options().get_ram_run_files(),
+					childPest.get_pestpp_options().get_panther_transfer_on_finish());
 			}
 
 			ParamTransformSeq& base_trans_seq = childPest.get_base_par_tran_seq_4_mod();
@@ -765,12 +772,14 @@ int main(int argc, char* argv[])
                     fout_rec << "...'da_obs_cycle_table' passed, translating noise realizations" << endl;
 				    cycle_curr_noise.update_var_map();
 				    Observations org_obs = pest_scenario.get_ctl_observations();
-				    map<string,int> vmap = cycle_curr_noise.get_var_map();
+				    const pest_utils::NameIndex& vmap = cycle_curr_noise.get_var_map();
+                    int idx;
                     for (auto o : childPest.get_ctl_observations())
                     {
-                        if (oi.get_observation_rec_ptr(o.first)->weight != 0.0)
+                        idx = vmap.find_index(o.first);
+                        if ((idx >= 0) && (oi.get_observation_rec_ptr(o.first)->weight != 0.0))
                         {
-                            cycle_curr_noise.get_eigen_ptr_4_mod()->col(vmap[o.first]).array() +=o.second -  org_obs[o.first];
+                            cycle_curr_noise.get_eigen_ptr_4_mod()->col(idx).array() +=o.second -  org_obs[o.first];
                         }
                     }
                 }
@@ -0,0 +1,205 @@
+// micro-benchmark comparing the buffer-based TemplateFile::cast_to_fixed_len_string
+// with the original stringstream implementation.  Every value is also checked
+// for identical output strings (or an error in both) and identical processed
+// (re-parsed) values.
+//
+// usage: fixed_len_bench [num_values] [seed]
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include "model_interface.h"
+
+using namespace std;
+
+//the stringstream-based implementation that TemplateFile used previously
+string cast_to_fixed_len_string_stream(int size, double value, bool fill_zeros)
+{
+	string val_str, fill_val = " ";
+	stringstream ss;
+	int precision = size;
+	bool sci = false;
+	if (value < 0)
+		precision--;
+	if ((abs(value) >= 100) || (abs(value) < 0.01))
+	{
+		ss << scientific;
+		precision = precision - 2;
+		sci = true;
+	}
+	else
+	{
+		ss << fixed;
+	}
+	ss.width(size);
+
+	int size_last = -1;
+	if (fill_zeros)
+	{
+		ss.fill('0');
+		ss << internal;
+		fill_val = "0";
+	}
+	while (true)
+	{
+		ss.str("");
+		ss.precision(precision);
+		ss << value;
+		val_str = ss.str();
+		if (val_str.size() <= size)
+			break;
+		if (val_str.size() > size)
+			precision--;
+		if (precision <= 0)
+		{
+			if (val_str.substr(val_str.size() - 2, 1) == "0")
+			{
+				string t = val_str.substr(0, val_str.size() - 2);
+				val_str = t + val_str.substr(val_str.size() - 1, 1);
+				if (val_str.size() <= size)
+					break;
+			}
+			int r_idx = val_str.find_first_of(".") + 1;
+			int e_idx = val_str.find_first_of("Ee");
+			if (r_idx != e_idx)
+			{
+				string t = val_str.substr(r_idx, e_idx - r_idx);
+				if (stod(t) == 0.0)
+				{
+					t = val_str.substr(0, r_idx - 1);
+					val_str = t + val_str.substr(e_idx);
+					if (val_str.size() <= size)
+						break;
+				}
+			}
+			throw runtime_error("cant represent value");
+		}
+		if (val_str.size() == size_last)
+		{
+			if (sci)
+				throw runtime_error("val_str size not decreasing");
+			else
+			{
+				val_str = val_str.substr(0, size);
+				break;
+			}
+		}
+		size_last = val_str.size();
+	}
+	if (val_str.size() < size)
+	{
+		ss.str("");
+		int s = size;
+		if ((fill_val != " ") && (val_str.at(0) == '-'))
+		{
+			ss << "-";
+			val_str = val_str.substr(1, val_str.size() - 1);
+			s--;
+		}
+		for (int i = val_str.size(); i < s; i++)
+			ss << fill_val;
+		ss << val_str;
+		val_str = ss.str();
+	}
+	if (val_str.size() != size)
+		throw runtime_error("val_str != size");
+	return val_str;
+}
+
+int main(int argc, char* argv[])
+{
+	int num_values = 1000000;
+	unsigned int seed = 123456789;
+	if (argc > 1)
+		num_values = atoi(argv[1]);
+	if (argc > 2)
+		seed = atoi(argv[2]);
+
+	mt19937 gen(seed);
+	uniform_real_distribution<double> mant(-1.0, 1.0);
+	uniform_int_distribution<int> expo(-30, 30);
+	uniform_int_distribution<int> width(4, 25);
+	vector<double> values(num_values);
+	vector<int> widths(num_values);
+	for (int i = 0; i < num_values; i++)
+	{
+		values[i] = mant(gen) * pow(10.0, expo(gen));
+		widths[i] = width(gen);
+	}
+
+	//values where rounding carries into a new digit, plus range boundaries, at every width
+	vector<double> edges{ 0.0, 1.0, -1.0, 0.01, 100.0, 9.999999999999, -99.99999999, 0.009999999999,
+		9.9999999e99, -9.99999999e-100, 9.999999e-10, 1.0e100, 123456789.123456789 };
+	for (auto e : edges)
+	{
+		for (int w = 1; w <= 25; w++)
+		{
+			values.push_back(e);
+			widths.push_back(w);
+		}
+	}
+	num_values = values.size();
+
+	string name = "bench";
+	for (int ifill = 0; ifill < 2; ifill++)
+	{
+		bool fill_zeros = (ifill == 1);
+		TemplateFile tpl("bench.tpl", fill_zeros);
+		vector<string> stream_strs(num_values), buf_strs(num_values);
+
+		chrono::system_clock::time_point start_time = chrono::system_clock::now();
+		double stream_sum = 0.0;
+		for (int i = 0; i < num_values; i++)
+		{
+			try
+			{
+				stream_strs[i] = cast_to_fixed_len_string_stream(widths[i], values[i], fill_zeros);
+				stream_sum += stod(stream_strs[i]);
+			}
+			catch (...)
+			{
+				stream_strs[i] = "<error>";
+			}
+		}
+		double stream_sec = chrono::duration<double>(chrono::system_clock::now() - start_time).count();
+
+		start_time = chrono::system_clock::now();
+		double buf_sum = 0.0;
+		for (int i = 0; i < num_values; i++)
+		{
+			try
+			{
+				buf_strs[i] = tpl.cast_to_fixed_len_string(widths[i], values[i], name);
+				buf_sum += strtod(buf_strs[i].c_str(), nullptr);
+			}
+			catch (...)
+			{
+				buf_strs[i] = "<error>";
+			}
+		}
+		double buf_sec = chrono::duration<double>(chrono::system_clock::now() - start_time).count();
+
+		int num_diff = 0;
+		for (int i = 0; i < num_values; i++)
+		{
+			if (stream_strs[i] != buf_strs[i])
+			{
+				if (num_diff < 10)
+					cout << "  mismatch for value " << values[i] << ", width " << widths[i] << ": '" << stream_strs[i] << "' vs '" << buf_strs[i] << "'" << endl;
+				num_diff++;
+			}
+		}
+		cout << "fill_zeros: " << fill_zeros << ", values: " << num_values << endl;
+		cout << "  stringstream: " << stream_sec << " sec" << endl;
+		cout << "  buffer:       " << buf_sec << " sec (" << stream_sec / buf_sec << "x)" << endl;
+		cout << "  mismatches:   " << num_diff << ", processed sum difference: " << stream_sum - buf_sum << endl;
+		if (num_diff > 0)
+			return 1;
+	}
+	return 0;
+}